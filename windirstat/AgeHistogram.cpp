@@ -0,0 +1,144 @@
+// AgeHistogram.cpp - Implementation of CAgeHistogram
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "AgeHistogram.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const ULONGLONG TICKS_PER_DAY = 24 * 60 * 60 * ULONGLONG(10000000);
+
+    // Upper age limits of the buckets (in days) except AGE_OLDER
+    const ULONGLONG bucketLimitDays[AGE_BUCKETCOUNT - 1] = { 1, 7, 31, 92, 365, 2 * 365, 5 * 365 + 1 };
+
+    ULONGLONG FileTimeToTicks(const FILETIME& t)
+    {
+        ULARGE_INTEGER u;
+        u.LowPart = t.dwLowDateTime;
+        u.HighPart = t.dwHighDateTime;
+        return u.QuadPart;
+    }
+}
+
+// The reference time is taken once. If it moved, files would be
+// subtracted from other buckets than they had been added to.
+ULONGLONG CAgeHistogram::GetReferenceTime()
+{
+    static ULONGLONG _referenceTime = 0;
+    if(_referenceTime == 0)
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        _referenceTime = FileTimeToTicks(now);
+    }
+    return _referenceTime;
+}
+
+AGEBUCKET CAgeHistogram::GetBucket(const FILETIME& lastWriteTime)
+{
+    const ULONGLONG reference = GetReferenceTime();
+    const ULONGLONG t = FileTimeToTicks(lastWriteTime);
+    if(t >= reference)
+    {
+        return AGE_LASTDAY; // Clock skew or written since the program start
+    }
+
+    const ULONGLONG age = reference - t;
+    for(int i = 0; i < _countof(bucketLimitDays); i++)
+    {
+        if(age < bucketLimitDays[i] * TICKS_PER_DAY)
+        {
+            return AGEBUCKET(i);
+        }
+    }
+    return AGE_OLDER;
+}
+
+CAgeHistogram::CAgeHistogram()
+{
+    ZeroMemory(m_counts, sizeof(m_counts));
+}
+
+void CAgeHistogram::AddFile(const FILETIME& lastWriteTime, ULONGLONG bytes)
+{
+    const AGEBUCKET bucket = GetBucket(lastWriteTime);
+    m_counts[bucket] += bytes;
+    m_counts[AGE_BUCKETCOUNT + bucket]++;
+}
+
+void CAgeHistogram::Add(const CAgeHistogram& other)
+{
+    for(int i = 0; i < _countof(m_counts); i++)
+    {
+        m_counts[i] += other.m_counts[i];
+    }
+}
+
+void CAgeHistogram::Subtract(const CAgeHistogram& other)
+{
+    for(int i = 0; i < _countof(m_counts); i++)
+    {
+        ASSERT(m_counts[i] >= other.m_counts[i]);
+        m_counts[i] -= other.m_counts[i];
+    }
+}
+
+bool CAgeHistogram::IsEmpty() const
+{
+    return GetFilesFrom(AGE_LASTDAY) == 0;
+}
+
+ULONGLONG CAgeHistogram::GetBytes(AGEBUCKET bucket) const
+{
+    ASSERT(bucket < AGE_BUCKETCOUNT);
+    return m_counts[bucket];
+}
+
+ULONGLONG CAgeHistogram::GetFiles(AGEBUCKET bucket) const
+{
+    ASSERT(bucket < AGE_BUCKETCOUNT);
+    return m_counts[AGE_BUCKETCOUNT + bucket];
+}
+
+// Sum over the buckets from first to AGE_OLDER
+ULONGLONG CAgeHistogram::GetBytesFrom(AGEBUCKET first) const
+{
+    ULONGLONG sum = 0;
+    for(int i = first; i < AGE_BUCKETCOUNT; i++)
+    {
+        sum += m_counts[i];
+    }
+    return sum;
+}
+
+ULONGLONG CAgeHistogram::GetFilesFrom(AGEBUCKET first) const
+{
+    ULONGLONG sum = 0;
+    for(int i = first; i < AGE_BUCKETCOUNT; i++)
+    {
+        sum += m_counts[AGE_BUCKETCOUNT + i];
+    }
+    return sum;
+}
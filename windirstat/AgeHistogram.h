@@ -0,0 +1,78 @@
+// AgeHistogram.h - Declaration of CAgeHistogram
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_AGEHISTOGRAM_H__
+#define __WDS_AGEHISTOGRAM_H__
+#pragma once
+
+//
+// Age classes of the last write time, relative to the program start.
+//
+enum AGEBUCKET
+{
+    AGE_LASTDAY,
+    AGE_LASTWEEK,
+    AGE_LASTMONTH,
+    AGE_LASTQUARTER,
+    AGE_LASTYEAR,
+    AGE_TWOYEARS,       // Older than a year, but not older than two
+    AGE_FIVEYEARS,
+    AGE_OLDER,
+    AGE_BUCKETCOUNT
+};
+
+// Files from this bucket on count as cold data
+const AGEBUCKET AGE_FIRSTCOLD = AGE_TWOYEARS;
+
+//
+// CAgeHistogram. Bytes and files of a subtree per AGEBUCKET.
+// Every folder item carries one, which is kept up to date together
+// with its size (see CItem::UpwardAddAges()). So the hot/cold totals
+// of any subtree are at hand without a traversal.
+//
+class CAgeHistogram
+{
+public:
+    static AGEBUCKET GetBucket(const FILETIME& lastWriteTime);
+
+    CAgeHistogram();
+
+    void AddFile(const FILETIME& lastWriteTime, ULONGLONG bytes);
+    void Add(const CAgeHistogram& other);
+    void Subtract(const CAgeHistogram& other);
+
+    bool IsEmpty() const;
+    ULONGLONG GetBytes(AGEBUCKET bucket) const;
+    ULONGLONG GetFiles(AGEBUCKET bucket) const;
+    ULONGLONG GetBytesFrom(AGEBUCKET first) const;
+    ULONGLONG GetFilesFrom(AGEBUCKET first) const;
+
+protected:
+    static ULONGLONG GetReferenceTime();
+
+    // m_counts[bucket] are the bytes, m_counts[AGE_BUCKETCOUNT + bucket] the files.
+    // One flat array, so that Add() and Subtract() are a single loop,
+    // which the compiler turns into vector instructions.
+    ULONGLONG m_counts[2 * AGE_BUCKETCOUNT];
+};
+
+#endif // __WDS_AGEHISTOGRAM_H__
@@ -0,0 +1,1326 @@
+// Benchmark.cpp - Implementation of CBenchmark
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "windirstat.h"
+#include "dirstatdoc.h"
+#include "item.h"
+#include "treemap.h"
+#include "TreemapEngine.h"
+#include "selectobject.h"
+#include "WorkLimiter.h"
+#include "VirtualFileSystem.h"
+#include "FileIndex.h"
+#include "QueryEngine.h"
+#include "ExtensionCollector.h"
+#include "VisibleRowModel.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const int TREEMAP_WIDTH = 1920;
+    const int TREEMAP_HEIGHT = 1080;
+    const int TREEMAP_UHD_WIDTH = 3840;     // Where the cushions dominate
+    const int TREEMAP_UHD_HEIGHT = 2160;
+
+    double GetMilliseconds()
+    {
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+        ::QueryPerformanceFrequency(&frequency);
+        ::QueryPerformanceCounter(&counter);
+        return counter.QuadPart * 1000.0 / frequency.QuadPart;
+    }
+
+    LONGLONG GetPrivateBytes()
+    {
+        PROCESS_MEMORY_COUNTERS_EX pmc;
+        ZeroMemory(&pmc, sizeof(pmc));
+        pmc.cb = sizeof(pmc);
+
+        if(!::GetProcessMemoryInfo(::GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc)))
+        {
+            return 0;
+        }
+        return (LONGLONG)pmc.PrivateUsage;
+    }
+
+#ifdef _DEBUG
+    // The debug CRT lets us count the allocations.
+    volatile LONG _allocations;
+    _CRT_ALLOC_HOOK _previousAllocHook;
+
+    int __cdecl CountingAllocHook(int allocType, void *userData, size_t size, int blockType, long requestNumber, const unsigned char *filename, int lineNumber)
+    {
+        if(allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+        {
+            ::InterlockedIncrement(&_allocations);
+        }
+        if(_previousAllocHook != NULL)
+        {
+            return _previousAllocHook(allocType, userData, size, blockType, requestNumber, filename, lineNumber);
+        }
+        return TRUE;
+    }
+#endif // _DEBUG
+
+    void CollectPreOrder(CItem *item, CArray<CTreeListItem *, CTreeListItem *>& items)
+    {
+        items.Add(item);
+        for(int i = 0; i < item->GetChildrenCount(); i++)
+        {
+            CollectPreOrder(item->GetChild(i), items);
+        }
+    }
+
+    // Sorts the children of every directory, as the tree list does.
+    int _sortSubitem;
+
+    int __cdecl CompareSiblings(const void *p1, const void *p2)
+    {
+        const CItem *item1 = *(const CItem **)p1;
+        const CItem *item2 = *(const CItem **)p2;
+        return item1->CompareSibling(item2, _sortSubitem);
+    }
+
+    void RecurseSortChildren(const CItem *item, CArray<CItem *, CItem *>& scratch)
+    {
+        if(item->GetChildrenCount() == 0)
+        {
+            return;
+        }
+
+        scratch.SetSize(item->GetChildrenCount());
+        for(int i = 0; i < item->GetChildrenCount(); i++)
+        {
+            scratch[i] = item->GetChild(i);
+        }
+        qsort(scratch.GetData(), scratch.GetSize(), sizeof(CItem *), &CompareSiblings);
+
+        for(int i = 0; i < item->GetChildrenCount(); i++)
+        {
+            RecurseSortChildren(item->GetChild(i), scratch);
+        }
+    }
+
+    // The cushion colors of the files below item, summed up. lookup: as
+    // they were obtained before the extension ids, one CMap lookup each.
+    ULONGLONG RecurseSumColors(const CItem *item, bool lookup)
+    {
+        if(item->GetType() == IT_FILE)
+        {
+            return lookup ? GetDocument()->GetCushionColor(item->GetExtension()) : item->TmiGetGraphColor();
+        }
+
+        ULONGLONG sum = 0;
+        for(int i = 0; i < item->GetChildrenCount(); i++)
+        {
+            sum += RecurseSumColors(item->GetChild(i), lookup);
+        }
+        return sum;
+    }
+
+    // A node of CSharedTree
+    struct SHAREDNODE
+    {
+        ULONGLONG size;
+        COLORREF color;
+        CArray<const SHAREDNODE *, const SHAREDNODE *> children; // Sorted by size
+    };
+
+    // Read only, for CTreemapCompactTree::Build()
+    struct SharedNodeAccess
+    {
+        typedef const SHAREDNODE *Node;
+
+        static int GetChildrenCount(Node node)      { return (int)node->children.GetSize(); }
+        static Node GetChild(Node node, int i)      { return node->children[i]; }
+        static ULONGLONG GetSize(Node node)         { return node->size; }
+        static bool IsLeaf(Node node)               { return node->children.GetSize() == 0; }
+        static COLORREF GetGraphColor(Node node)    { return node->color; }
+    };
+
+    // A tree of millions of leaves for the treemap engine benchmarks, too
+    // large to be scanned. All folders of a level are alike, so it is
+    // stored as one node per level plus one per file, which the folders share.
+    class CSharedTree
+    {
+    public:
+        CSharedTree(int fanOut, int depth, int filesPerDirectory)
+        {
+            CArray<COLORREF, COLORREF&> palette;
+            CTreemap::GetDefaultPalette(palette);
+
+            // File k has 1 MB / (k + 1), i.e. a few large and many small files.
+            CArray<const SHAREDNODE *, const SHAREDNODE *> files;
+            ULONGLONG filesSize = 0;
+            for(int k = 0; k < filesPerDirectory; k++)
+            {
+                files.Add(NewNode(1024 * 1024 / (k + 1), palette[k % palette.GetSize()]));
+                filesSize += files[k]->size;
+            }
+
+            // From the deepest level up. The subfolders and the files are merged by size.
+            const SHAREDNODE *subfolder = NULL;
+            for(int level = depth; level >= 0; level--)
+            {
+                const int subfolders = (subfolder != NULL) ? fanOut : 0;
+                SHAREDNODE *folder = NewNode(filesSize + (subfolder != NULL ? subfolders * subfolder->size : 0), 0);
+
+                int f = 0;
+                int k = 0;
+                while(f < subfolders || k < files.GetSize())
+                {
+                    if(k == files.GetSize() || (f < subfolders && subfolder->size >= files[k]->size))
+                    {
+                        folder->children.Add(subfolder);
+                        f++;
+                    }
+                    else
+                    {
+                        folder->children.Add(files[k]);
+                        k++;
+                    }
+                }
+                subfolder = folder;
+            }
+            m_root = subfolder;
+        }
+
+        ~CSharedTree()
+        {
+            for(int i = 0; i < m_nodes.GetSize(); i++)
+            {
+                delete m_nodes[i];
+            }
+        }
+
+        const SHAREDNODE *GetRoot() const
+        {
+            return m_root;
+        }
+
+    private:
+        SHAREDNODE *NewNode(ULONGLONG size, COLORREF color)
+        {
+            SHAREDNODE *node = new SHAREDNODE;
+            node->size = size;
+            node->color = color;
+            m_nodes.Add(node);
+            return node;
+        }
+
+        CArray<SHAREDNODE *, SHAREDNODE *> m_nodes;
+        const SHAREDNODE *m_root;
+    };
+
+    INT_PTR CountDifferences(const COLORREF *bits1, const COLORREF *bits2, INT_PTR count)
+    {
+        INT_PTR differences = 0;
+        for(INT_PTR i = 0; i < count; i++)
+        {
+            if(bits1[i] != bits2[i])
+            {
+                differences++;
+            }
+        }
+        return differences;
+    }
+}
+
+CBenchmark::CBenchmark(LPCTSTR baselinePath, bool updateBaseline)
+    : m_updateBaseline(updateBaseline)
+    , m_startMilliseconds(0)
+    , m_startAllocations(0)
+    , m_startPrivateBytes(0)
+    , m_startAccountedBytes(0)
+    , m_failedChecks(0)
+{
+    // The profile functions want a full path.
+    TCHAR fullPath[_MAX_PATH];
+    m_baselinePath = (_tfullpath(fullPath, baselinePath, _countof(fullPath)) != NULL) ? fullPath : baselinePath;
+}
+
+int CBenchmark::Run()
+{
+    static const TREESIZE sizes[] = {
+        { _T("small"),   4, 3,  8 },    //     84 folders,   680 files
+        { _T("medium"),  8, 4, 16 },    //  4,680 folders, 74,896 files
+        { _T("large"),  10, 4, 20 },    // 11,110 folders, 222,220 files
+        { _T("flat"),    0, 0, 250000 } //      1 folder,  250,000 files (worst case of hit testing)
+    };
+
+#ifdef _DEBUG
+    _previousAllocHook = _CrtSetAllocHook(CountingAllocHook);
+#endif
+
+    // The synthetic trees are rooted in an existing folder.
+    CString folder;
+    DWORD len = ::GetTempPath(_MAX_PATH, folder.GetBuffer(_MAX_PATH));
+    folder.ReleaseBuffer(len);
+    folder.TrimRight(wds::chrBackslash);
+
+    for(int i = 0; i < _countof(sizes); i++)
+    {
+        SYNTHETICTREESHAPE shape;
+        shape.root = folder;
+        shape.seed = 1;
+        shape.fanOut = sizes[i].fanOut;
+        shape.depth = sizes[i].depth;
+        shape.filesPerDirectory = sizes[i].filesPerDirectory;
+        SetVirtualFileSystem(new CSyntheticFileSystem(shape));
+
+        if(!Scan(sizes[i], folder))
+        {
+            VTRACE(_T("Benchmark aborted"));
+            break;
+        }
+
+        CItem *root = GetDocument()->GetRootItem();
+
+        // The cushion colors. Not part of any measurement.
+        GetDocument()->GetExtensionData();
+        AddMemorySnapshot(sizes[i]);
+
+        RunExtensions(sizes[i], root);
+        RunSort(sizes[i], root, COL_NAME, _T("sort-name"));
+        RunSort(sizes[i], root, COL_SUBTREETOTAL, _T("sort-size"));
+        RunSort(sizes[i], root, COL_LASTCHANGE, _T("sort-lastchange"));
+        RunTreemap(sizes[i], root, CTreemap::KDirStatStyle, true, _T("treemap-kdirstat"), CSize(TREEMAP_WIDTH, TREEMAP_HEIGHT));
+        RunTreemap(sizes[i], root, CTreemap::KDirStatStyle, false, _T("treemap-kdirstat-solid"), CSize(TREEMAP_WIDTH, TREEMAP_HEIGHT));
+        RunTreemap(sizes[i], root, CTreemap::SequoiaViewStyle, true, _T("treemap-sequoiaview"), CSize(TREEMAP_WIDTH, TREEMAP_HEIGHT));
+        RunTreemap(sizes[i], root, CTreemap::SequoiaViewStyle, false, _T("treemap-sequoiaview-solid"), CSize(TREEMAP_WIDTH, TREEMAP_HEIGHT));
+        RunTreemap(sizes[i], root, CTreemap::KDirStatStyle, true, _T("treemap-kdirstat-uhd"), CSize(TREEMAP_UHD_WIDTH, TREEMAP_UHD_HEIGHT));
+        RunTreemapScaling(sizes[i], root);
+        CheckTreemapThreads(sizes[i], root);
+        RunTreemapReshade(sizes[i], root);
+        RunTreemapProgressive(sizes[i], root);
+        RunHitTest(sizes[i], root);
+        RunFileIndex(sizes[i], root);
+        RunQuery(sizes[i], root);
+        RunVisibleRows(sizes[i], root);
+        RunTreemapEngine(sizes[i], root);
+        RunLeafColors(sizes[i], root);
+    }
+
+    RunTreemapEngineLarge();
+    RunDimming();
+    CheckCushions();
+    if(!CheckVisibleRows())
+    {
+        m_failedChecks++;
+    }
+
+    SetVirtualFileSystem(NULL);
+
+#ifdef _DEBUG
+    _CrtSetAllocHook(_previousAllocHook);
+#endif
+
+    if(m_updateBaseline)
+    {
+        WriteResults(m_baselinePath);
+        return 0;
+    }
+
+    CString resultsPath = m_baselinePath;
+    int dot = resultsPath.ReverseFind(wds::chrDot);
+    if(dot > resultsPath.ReverseFind(wds::chrBackslash))
+    {
+        resultsPath = resultsPath.Left(dot);
+    }
+    resultsPath += _T(".last.ini");
+
+    ::DeleteFile(resultsPath);
+    WriteResults(resultsPath);
+
+    // A failed self check counts as a regression.
+    int regressions = CompareWithBaseline() + m_failedChecks;
+
+    CString s;
+    s.Format(_T("%d"), m_failedChecks);
+    ::WritePrivateProfileString(_T("summary"), _T("failedChecks"), s, resultsPath);
+    s.Format(_T("%d"), regressions);
+    ::WritePrivateProfileString(_T("summary"), _T("regressions"), s, resultsPath);
+
+    return regressions;
+}
+
+// Tree building: CItem::DoSomeWork(), AddChild() and SetDone(), driven
+// by CDirstatDoc::Work() as in CDirstatApp::OnIdle().
+//
+bool CBenchmark::Scan(const TREESIZE& size, LPCTSTR folder)
+{
+    CDirstatDoc *doc = GetDocument();
+
+    BeginMeasurement();
+
+    if(!doc->ScanToEnd(folder))
+    {
+        return false;
+    }
+
+    MEASUREMENT m = EndMeasurement();
+    AddResult(_T("scan"), size, doc->GetRootItem()->GetItemsCount(), m);
+    return true;
+}
+
+void CBenchmark::RunExtensions(const TREESIZE& size, CItem *root)
+{
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        CExtensionData ed;
+
+        BeginMeasurement();
+        CollectExtensionData(root, ed);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("extensions"), size, root->GetFilesCount(), best);
+}
+
+void CBenchmark::RunSort(const TREESIZE& size, CItem *root, int subitem, LPCTSTR benchmark)
+{
+    _sortSubitem = subitem;
+
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        CArray<CItem *, CItem *> scratch;
+
+        BeginMeasurement();
+        RecurseSortChildren(root, scratch);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(benchmark, size, root->GetItemsCount(), best);
+}
+
+void CBenchmark::RunTreemap(const TREESIZE& size, CItem *root, int style, bool cushions, LPCTSTR benchmark, const CSize& resolution)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+    options.style = (CTreemap::STYLE)style;
+    if(!cushions)
+    {
+        options.height = 0; // --> DrawSolidRect()
+    }
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, resolution.cx, resolution.cy);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(CPoint(0, 0), resolution);
+
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        treemap.DrawTreemap(&dcmem, rc, root, &options);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(benchmark, size, root->GetItemsCount(), best);
+}
+
+// CTreemapEngine on the scanned tree (compare with "treemap-kdirstat")
+// and on a compact copy of it.
+void CBenchmark::RunTreemapEngine(const TREESIZE& size, CItem *root)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+    options.style = CTreemap::KDirStatStyle;
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(0, 0, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        DrawTreemapStatic<CItemTreemapAccess>(treemap, &dcmem, rc, root, &options);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("treemap-engine-kdirstat"), size, root->GetItemsCount(), best);
+
+    CTreemapCompactTree tree;
+    tree.Build<CItemTreemapAccess>(root);
+
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        DrawTreemapStatic<CTreemapCompactTree::Access>(treemap, &dcmem, rc, tree.GetRoot(), &options);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("treemap-engine-compact-kdirstat"), size, root->GetItemsCount(), best);
+}
+
+// CTreemapEngine against CTreemap::DrawTreemap(), i.e. the virtual
+// interface, on the same compact trees of 1 and 10 million leaves.
+// Without cushions, so that the layout dominates.
+void CBenchmark::RunTreemapEngineLarge()
+{
+    static const TREESIZE sizes[] = {
+        { _T("1m-leaves"),  10, 5, 9 },     //   111,111 folders,   999,999 files
+        { _T("10m-leaves"), 10, 6, 9 }      // 1,111,111 folders, 9,999,999 files
+    };
+    static const struct
+    {
+        CTreemap::STYLE style;
+        LPCTSTR name;
+    } styles[] = {
+        { CTreemap::KDirStatStyle, _T("kdirstat") },
+        { CTreemap::SequoiaViewStyle, _T("sequoiaview") }
+    };
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(0, 0, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+
+    for(int i = 0; i < _countof(sizes); i++)
+    {
+        CSharedTree shared(sizes[i].fanOut, sizes[i].depth, sizes[i].filesPerDirectory);
+        CTreemapCompactTree tree;
+        try
+        {
+            tree.Build<SharedNodeAccess>(shared.GetRoot());
+        }
+        catch (CException *pe)
+        {
+            // Millions of nodes may not fit into a 32 bit process.
+            pe->Delete();
+            VTRACE(_T("%s: not enough memory"), sizes[i].name);
+            continue;
+        }
+
+        for(int s = 0; s < _countof(styles); s++)
+        {
+            CTreemap::Options options = CTreemap::GetDefaultOptions();
+            options.style = styles[s].style;
+            options.height = 0; // --> DrawSolidRect()
+
+            MEASUREMENT bestVirtual;
+            MEASUREMENT bestEngine;
+            for(int r = 0; r < REPETITIONS; r++)
+            {
+                BeginMeasurement();
+                treemap.DrawTreemap(&dcmem, rc, tree.GetRoot(), &options);
+                MEASUREMENT m = EndMeasurement();
+
+                if(r == 0 || m.milliseconds < bestVirtual.milliseconds)
+                {
+                    bestVirtual = m;
+                }
+
+                BeginMeasurement();
+                DrawTreemapStatic<CTreemapCompactTree::Access>(treemap, &dcmem, rc, tree.GetRoot(), &options);
+                m = EndMeasurement();
+
+                if(r == 0 || m.milliseconds < bestEngine.milliseconds)
+                {
+                    bestEngine = m;
+                }
+            }
+
+            CString benchmark;
+            benchmark.Format(_T("treemap-virtual-%s"), styles[s].name);
+            AddResult(benchmark, sizes[i], tree.GetNodeCount(), bestVirtual);
+            benchmark.Format(_T("treemap-engine-%s"), styles[s].name);
+            AddResult(benchmark, sizes[i], tree.GetNodeCount(), bestEngine);
+        }
+    }
+}
+
+// CGraphView::Inactivate() on a UHD treemap: SetPixel() on every other
+// pixel of every other row ("dim-setpixel"), as it used to be, and
+// CFramebuffer::DimBitmap() ("dim-framebuffer").
+// SetPixel() takes seconds here, so it runs once.
+void CBenchmark::RunDimming()
+{
+    static const TREESIZE size = { _T("uhd"), 0, 0, 0 };
+    const CSize resolution(TREEMAP_UHD_WIDTH, TREEMAP_UHD_HEIGHT);
+    const ULONGLONG pixels = ULONGLONG(resolution.cx) * resolution.cy;
+
+    CClientDC screen(AfxGetMainWnd());
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, resolution.cx, resolution.cy);
+
+    {
+        CDC dcmem;
+        dcmem.CreateCompatibleDC(&screen);
+        CSelectObject sobmp(&dcmem, &bitmap);
+
+        BeginMeasurement();
+        for(int x = 0; x < resolution.cx; x += 2)
+        for(int y = 0; y < resolution.cy; y += 2)
+        {
+            dcmem.SetPixel(x, y, RGB(100,100,100));
+        }
+        AddResult(_T("dim-setpixel"), size, pixels, EndMeasurement());
+    }
+
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        CFramebuffer::DimBitmap(&screen, bitmap, RGB(100,100,100));
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("dim-framebuffer"), size, pixels, best);
+}
+
+// The share of the color in the treemap drawing: what TmiGetGraphColor()
+// costs per file now ("colors-cached"), and what it cost with a lookup
+// of the extension per file ("colors-lookup"). The first run of the
+// cached colors assigns the extension ids.
+void CBenchmark::RunLeafColors(const TREESIZE& size, CItem *root)
+{
+    ULONGLONG lookupSum = 0;
+    ULONGLONG cachedSum = 0;
+
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        lookupSum = RecurseSumColors(root, true);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("colors-lookup"), size, root->GetFilesCount(), best);
+
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        cachedSum = RecurseSumColors(root, false);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("colors-cached"), size, root->GetFilesCount(), best);
+
+    ASSERT(cachedSum == lookupSum);
+    VTRACE(_T("colors: sum %I64u"), cachedSum);
+}
+
+// Rasterization with 1 to 16 threads. 1 is the serial rendering.
+void CBenchmark::RunTreemapScaling(const TREESIZE& size, CItem *root)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, TREEMAP_UHD_WIDTH, TREEMAP_UHD_HEIGHT);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(0, 0, TREEMAP_UHD_WIDTH, TREEMAP_UHD_HEIGHT);
+
+    for(int threads = 1; threads <= TREEMAP_MAX_THREADS; threads *= 2)
+    {
+        treemap.SetRenderThreads(threads);
+
+        MEASUREMENT best;
+        for(int r = 0; r < REPETITIONS; r++)
+        {
+            BeginMeasurement();
+            treemap.DrawTreemap(&dcmem, rc, root, &options);
+            MEASUREMENT m = EndMeasurement();
+
+            if(r == 0 || m.milliseconds < best.milliseconds)
+            {
+                best = m;
+            }
+        }
+
+        CString benchmark;
+        benchmark.Format(_T("treemap-uhd-threads-%d"), threads);
+        AddResult(benchmark, size, root->GetItemsCount(), best);
+    }
+}
+
+// Not a measurement: the band threads must not change a pixel. DrawTreemap()
+// with TREEMAP_MAX_THREADS threads and the final image of a progressive
+// drawing with as many are compared with DrawTreemap() by one thread.
+// A 32 bit DIB section, so that the pixels are compared unconverted.
+void CBenchmark::CheckTreemapThreads(const TREESIZE& size, CItem *root)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+    const CSize resolution(TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    const INT_PTR pixels = INT_PTR(resolution.cx) * resolution.cy;
+
+    CClientDC screen(AfxGetMainWnd());
+    BITMAPINFO bmi;
+    CFramebuffer::GetBitmapInfo(bmi, resolution.cx, resolution.cy);
+    void *bits = NULL;
+    HBITMAP hbm = ::CreateDIBSection(screen.m_hDC, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if(hbm == NULL)
+    {
+        VTRACE(_T("%s: CreateDIBSection() failed"), size.name);
+        m_failedChecks++;
+        return;
+    }
+
+    CBitmap bitmap;
+    bitmap.Attach(hbm);
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(CPoint(0, 0), resolution);
+
+    treemap.SetRenderThreads(1);
+    treemap.DrawTreemap(&dcmem, rc, root, &options);
+    ::GdiFlush();
+
+    CArray<COLORREF, COLORREF> serial;
+    serial.SetSize(pixels);
+    memcpy(serial.GetData(), bits, pixels * sizeof(COLORREF));
+
+    treemap.SetRenderThreads(TREEMAP_MAX_THREADS);
+    treemap.DrawTreemap(&dcmem, rc, root, &options);
+    ::GdiFlush();
+
+    INT_PTR differences = CountDifferences(serial.GetData(), (const COLORREF *)bits, pixels);
+    if(differences > 0)
+    {
+        VTRACE(_T("%s: %Id pixels differ with %d render threads"), size.name, differences, TREEMAP_MAX_THREADS);
+        m_failedChecks++;
+    }
+
+    CWorkLimiter limiter;
+    limiter.Start(TREEMAP_DRAWING_TICKS);
+    treemap.BeginDrawing(&dcmem, rc, root, &options);
+    while(!treemap.ContinueDrawing(&limiter))
+    {
+        limiter.Start(TREEMAP_DRAWING_TICKS);
+    }
+    treemap.PaintDrawing(&dcmem);
+    treemap.EndDrawing();
+    ::GdiFlush();
+
+    differences = CountDifferences(serial.GetData(), (const COLORREF *)bits, pixels);
+    if(differences > 0)
+    {
+        VTRACE(_T("%s: %Id pixels differ in the progressive drawing"), size.name, differences);
+        m_failedChecks++;
+    }
+}
+
+// Not a measurement: DrawCushion() against the per-pixel formula
+void CBenchmark::CheckCushions()
+{
+    CTreemap treemap;
+    const INT_PTR errors = treemap.CheckCushions(CSize(TREEMAP_WIDTH, TREEMAP_HEIGHT), CHECK_CUSHIONS);
+    if(errors > 0)
+    {
+        VTRACE(_T("CheckCushions: %Id wrong pixels"), errors);
+        m_failedChecks++;
+    }
+}
+
+// A change of the shading options (like dragging a slider of the
+// treemap options page), which leaves the cached layout valid.
+void CBenchmark::RunTreemapReshade(const TREESIZE& size, CItem *root)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    treemap.SetCacheLayout(true);
+    CRect rc(0, 0, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    treemap.DrawTreemap(&dcmem, rc, root, &options);
+
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        options.height = (r % 2 == 0) ? 0.5 : 0.4;
+        options.brightness = (r % 2 == 0) ? 0.8 : 0.9;
+
+        BeginMeasurement();
+        treemap.DrawTreemap(&dcmem, rc, root, &options);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("treemap-reshade"), size, root->GetItemsCount(), best);
+}
+
+// Progressive drawing as done by CGraphView: the time to the first image
+// (the top levels) and the time to the complete one.
+void CBenchmark::RunTreemapProgressive(const TREESIZE& size, CItem *root)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(0, 0, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+
+    MEASUREMENT bestFirst;
+    MEASUREMENT bestComplete;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+
+        CWorkLimiter limiter;
+        limiter.Start(TREEMAP_FIRSTIMAGE_TICKS);
+        treemap.BeginDrawing(&dcmem, rc, root, &options);
+        bool done = treemap.ContinueDrawing(&limiter);
+        treemap.PaintDrawing(&dcmem);
+        MEASUREMENT first = EndMeasurement();
+
+        while(!done)
+        {
+            limiter.Start(TREEMAP_DRAWING_TICKS);
+            done = treemap.ContinueDrawing(&limiter);
+            treemap.PaintDrawing(&dcmem);
+        }
+        treemap.EndDrawing();
+        MEASUREMENT complete = EndMeasurement();
+
+        if(r == 0 || first.milliseconds < bestFirst.milliseconds)
+        {
+            bestFirst = first;
+        }
+        if(r == 0 || complete.milliseconds < bestComplete.milliseconds)
+        {
+            bestComplete = complete;
+        }
+    }
+    AddResult(_T("treemap-first-image"), size, root->GetItemsCount(), bestFirst);
+    AddResult(_T("treemap-final-image"), size, root->GetItemsCount(), bestComplete);
+}
+
+void CBenchmark::RunHitTest(const TREESIZE& size, CItem *root)
+{
+    CTreemap::Options options = CTreemap::GetDefaultOptions();
+
+    CClientDC screen(AfxGetMainWnd());
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&screen);
+    CBitmap bitmap;
+    bitmap.CreateCompatibleBitmap(&screen, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    CSelectObject sobmp(&dcmem, &bitmap);
+
+    CTreemap treemap;
+    CRect rc(0, 0, TREEMAP_WIDTH, TREEMAP_HEIGHT);
+    treemap.DrawTreemap(&dcmem, rc, root, &options);
+
+    // Walking down the tree
+    ULONGLONG state = 1;
+    int scanFound = 0;
+
+    BeginMeasurement();
+    for(int i = 0; i < HITTEST_SCAN_POINTS; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        CPoint pt((int)((state >> 33) % TREEMAP_WIDTH), (int)((state >> 13) % TREEMAP_HEIGHT));
+        if(treemap.FindItemByPoint(root, pt) != NULL)
+        {
+            scanFound++;
+        }
+    }
+    MEASUREMENT m = EndMeasurement();
+    AddResult(_T("hittest-scan"), size, HITTEST_SCAN_POINTS, m);
+
+    // The drawing, which builds the index. Its accounted bytes are those of the index.
+    treemap.SetHitIndex(true);
+    BeginMeasurement();
+    treemap.DrawTreemap(&dcmem, rc, root, &options);
+    m = EndMeasurement();
+    AddResult(_T("hittest-index-build"), size, root->GetItemsCount(), m);
+
+    // Same points in every run, the first of which are those above
+    state = 1;
+    int found = 0;
+
+    BeginMeasurement();
+    for(int i = 0; i < HITTEST_POINTS; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        CPoint pt((int)((state >> 33) % TREEMAP_WIDTH), (int)((state >> 13) % TREEMAP_HEIGHT));
+        if(treemap.FindItemByPoint(root, pt) != NULL)
+        {
+            found++;
+        }
+    }
+    m = EndMeasurement();
+    AddResult(_T("hittest"), size, HITTEST_POINTS, m);
+
+#ifdef _DEBUG
+    // The index must agree with the walk.
+    CTreemap walker;
+    walker.DrawTreemap(&dcmem, rc, root, &options);
+    int mismatches = 0;
+    state = 1;
+    for(int i = 0; i < HITTEST_SCAN_POINTS; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        CPoint pt((int)((state >> 33) % TREEMAP_WIDTH), (int)((state >> 13) % TREEMAP_HEIGHT));
+        if(treemap.FindItemByPoint(root, pt) != walker.FindItemByPoint(root, pt))
+        {
+            mismatches++;
+        }
+    }
+    ASSERT(mismatches == 0);
+#endif
+
+    VTRACE(_T("hittest: %d of %d points found"), found, HITTEST_POINTS);
+}
+
+void CBenchmark::RunFileIndex(const TREESIZE& size, CItem *root)
+{
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        CFileIndex index;
+
+        BeginMeasurement();
+        index.Build(root);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("fileindex-build"), size, root->GetFilesCount(), best);
+
+    const CFileIndex *index = GetDocument()->GetFileIndex();
+    ASSERT(index != NULL);
+
+    CArray<CItem *, CItem *> files;
+    BeginMeasurement();
+    for(int i = 0; i < FILEINDEX_QUERIES; i++)
+    {
+        index->GetLargest(100, files);
+    }
+    MEASUREMENT m = EndMeasurement();
+    AddResult(_T("fileindex-top100"), size, FILEINDEX_QUERIES, m);
+}
+
+void CBenchmark::RunQuery(const TREESIZE& size, CItem *root)
+{
+    MEASUREMENT best;
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        BeginMeasurement();
+        CQueryEngine engine(root);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("query-snapshot"), size, root->GetItemsCount(), best);
+
+    const CQueryEngine *engine = GetDocument()->GetQueryEngine();
+    ASSERT(engine != NULL);
+
+    ITEMQUERY query;
+    VERIFY(query.Parse(_T("name=*.log;minsize=1M;attr=-h;type=files")));
+
+    for(int r = 0; r < REPETITIONS; r++)
+    {
+        QUERYRESULT result;
+
+        BeginMeasurement();
+        engine->Run(query, result);
+        MEASUREMENT m = EndMeasurement();
+
+        if(r == 0 || m.milliseconds < best.milliseconds)
+        {
+            best = m;
+        }
+    }
+    AddResult(_T("query-run"), size, engine->GetItemCount(), best);
+}
+
+// The rows of a huge, completely expanded tree list: the items of the
+// tree in pre-order, repeated up to VISIBLEROWS rows.
+void CBenchmark::RunVisibleRows(const TREESIZE& size, CItem *root)
+{
+    CArray<CTreeListItem *, CTreeListItem *> items;
+    CollectPreOrder(root, items);
+
+    CArray<CTreeListItem *, CTreeListItem *> rows;
+    rows.SetSize(VISIBLEROWS);
+    for(int i = 0; i < VISIBLEROWS; i++)
+    {
+        rows[i] = items[i % items.GetSize()];
+    }
+
+    CArray<CVisibleRowModel::NODE *, CVisibleRowModel::NODE *> nodes;
+    nodes.SetSize(VISIBLEROWS);
+
+    CVisibleRowModel model;
+
+    BeginMeasurement();
+    model.Insert(0, rows.GetData(), VISIBLEROWS, nodes.GetData());
+    MEASUREMENT m = EndMeasurement();
+    AddResult(_T("visiblerows-build"), size, VISIBLEROWS, m);
+
+    // Row to item and node to row, at the same rows in every run
+    ULONGLONG state = 1;
+    BeginMeasurement();
+    for(int i = 0; i < VISIBLEROWS_LOOKUPS; i++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        const int row = (int)((state >> 33) % VISIBLEROWS);
+        VERIFY(model.GetItem(row) == rows[row]);
+        VERIFY(model.GetRow(nodes[row]) == row);
+    }
+    m = EndMeasurement();
+    AddResult(_T("visiblerows-lookup"), size, VISIBLEROWS_LOOKUPS, m);
+
+    // Collapse and expand a folder with a tenth of the rows
+    const int block = VISIBLEROWS / 10;
+    BeginMeasurement();
+    model.Remove(VISIBLEROWS / 2, block);
+    model.Insert(VISIBLEROWS / 2, rows.GetData(), block, NULL);
+    m = EndMeasurement();
+    AddResult(_T("visiblerows-toggle"), size, block, m);
+}
+
+// Not a measurement: expands, collapses and moves random blocks of rows
+// and compares CVisibleRowModel after every step with a plain array of
+// the rows and their nodes (row to item, node to row, GetItems()).
+// The items are never dereferenced, so they are just distinct numbers.
+bool CBenchmark::CheckVisibleRows()
+{
+    CVisibleRowModel model;
+    CArray<CTreeListItem *, CTreeListItem *> rows;
+    CArray<CVisibleRowModel::NODE *, CVisibleRowModel::NODE *> nodes;
+    CArray<CTreeListItem *, CTreeListItem *> items;
+    CArray<CVisibleRowModel::NODE *, CVisibleRowModel::NODE *> newNodes;
+    INT_PTR nextItem = 1;
+
+    ULONGLONG state = 1;
+    for(int step = 0; step < VISIBLEROWS_CHECK_STEPS; step++)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        const unsigned random = (unsigned)(state >> 33);
+        const int count = model.GetCount();
+        const int block = 1 + (int)((random >> 2) % 50);
+
+        switch (random % 4)
+        {
+        case 0:
+        case 1:
+            {
+                // Expand: insert a block of new rows
+                const int row = (int)((random >> 8) % (count + 1));
+                items.SetSize(block);
+                newNodes.SetSize(block);
+                for(int i = 0; i < block; i++)
+                {
+                    items[i] = (CTreeListItem *)(nextItem++ * sizeof(void *));
+                }
+                model.Insert(row, items.GetData(), block, newNodes.GetData());
+                rows.InsertAt(row, &items);
+                nodes.InsertAt(row, &newNodes);
+            }
+            break;
+
+        case 2:
+            if(count > 0)
+            {
+                // Collapse: remove a block of rows
+                const int row = (int)((random >> 8) % count);
+                const int removed = min(block, count - row);
+                model.Remove(row, removed);
+                rows.RemoveAt(row, removed);
+                nodes.RemoveAt(row, removed);
+            }
+            break;
+
+        case 3:
+            if(count > 0)
+            {
+                // Re-sort: move a block of rows
+                const int from = (int)((random >> 8) % count);
+                const int moved = min(block, count - from);
+                const int to = (int)((state >> 13) % (count + 1));
+                model.Move(from, moved, to);
+                if(to < from || to > from + moved)
+                {
+                    const int target = (to > from ? to - moved : to);
+                    items.SetSize(moved);
+                    newNodes.SetSize(moved);
+                    for(int i = 0; i < moved; i++)
+                    {
+                        items[i] = rows[from + i];
+                        newNodes[i] = nodes[from + i];
+                    }
+                    rows.RemoveAt(from, moved);
+                    nodes.RemoveAt(from, moved);
+                    rows.InsertAt(target, &items);
+                    nodes.InsertAt(target, &newNodes);
+                }
+            }
+            break;
+        }
+
+        if(model.GetCount() != rows.GetSize())
+        {
+            VTRACE(_T("CheckVisibleRows: step %d: %d rows instead of %d"), step, model.GetCount(), (int)rows.GetSize());
+            return false;
+        }
+
+        items.SetSize(rows.GetSize());
+        if(rows.GetSize() > 0)
+        {
+            model.GetItems(0, (int)rows.GetSize(), items.GetData());
+        }
+        for(int row = 0; row < rows.GetSize(); row++)
+        {
+            if(model.GetItem(row) != rows[row] || items[row] != rows[row] || model.GetRow(nodes[row]) != row)
+            {
+                VTRACE(_T("CheckVisibleRows: step %d: row %d is inconsistent"), step, row);
+                return false;
+            }
+        }
+    }
+
+    model.RemoveAll();
+    return (model.GetCount() == 0);
+}
+
+void CBenchmark::BeginMeasurement()
+{
+#ifdef _DEBUG
+    m_startAllocations = _allocations;
+#endif
+    m_startPrivateBytes = GetPrivateBytes();
+    m_startAccountedBytes = CMemoryAccounting::GetTotalBytes();
+    m_startMilliseconds = GetMilliseconds();
+}
+
+CBenchmark::MEASUREMENT CBenchmark::EndMeasurement()
+{
+    MEASUREMENT m;
+    m.milliseconds = GetMilliseconds() - m_startMilliseconds;
+#ifdef _DEBUG
+    m.allocations = _allocations - m_startAllocations;
+#else
+    m.allocations = -1;
+#endif
+    m.privateBytes = GetPrivateBytes() - m_startPrivateBytes;
+    m.accountedBytes = CMemoryAccounting::GetTotalBytes() - m_startAccountedBytes;
+    return m;
+}
+
+void CBenchmark::AddResult(LPCTSTR benchmark, const TREESIZE& size, ULONGLONG items, const MEASUREMENT& m)
+{
+    RESULT r;
+    r.benchmark = benchmark;
+    r.size = size.name;
+    r.items = items;
+    r.measurement = m;
+    m_results.Add(r);
+
+    VTRACE(_T("%s/%s: %.3f ms, %I64u items, %I64d allocations, %I64d private bytes, %I64d accounted bytes"),
+        benchmark, size.name, m.milliseconds, items, m.allocations, m.privateBytes, m.accountedBytes
+    );
+}
+
+void CBenchmark::AddMemorySnapshot(const TREESIZE& size)
+{
+    MEMORYSNAPSHOT ms;
+    ms.size = size.name;
+    for(int i = 0; i < MEM_SUBSYSTEMCOUNT; i++)
+    {
+        ms.bytes[i] = CMemoryAccounting::GetBytes((MEMORYSUBSYSTEM)i);
+        ms.allocations[i] = CMemoryAccounting::GetAllocations((MEMORYSUBSYSTEM)i);
+
+        VTRACE(_T("memory/%s: %s %I64d bytes in %I64d allocations"),
+            size.name, CMemoryAccounting::GetSubsystemName((MEMORYSUBSYSTEM)i), ms.bytes[i], ms.allocations[i]
+        );
+    }
+    ms.bytesPerFile = CMemoryAccounting::GetBytesPerFile();
+    ms.bytesPerFolder = CMemoryAccounting::GetBytesPerFolder();
+    m_memory.Add(ms);
+
+    VTRACE(_T("memory/%s: %I64d bytes per file, %I64d bytes per folder"), size.name, ms.bytesPerFile, ms.bytesPerFolder);
+}
+
+// Sections are benchmarks, keys are tree sizes, values are milliseconds.
+// The additional keys are informational and only written to the results.
+//
+void CBenchmark::WriteResults(LPCTSTR path)
+{
+    for(int i = 0; i < m_results.GetSize(); i++)
+    {
+        const RESULT& r = m_results[i];
+
+        CString value;
+        value.Format(_T("%.3f"), r.measurement.milliseconds);
+        ::WritePrivateProfileString(r.benchmark, r.size, value, path);
+
+        if(m_updateBaseline)
+        {
+            continue;
+        }
+
+        const double seconds = max(r.measurement.milliseconds, 0.001) / 1000;
+
+        value.Format(_T("%I64u"), r.items);
+        ::WritePrivateProfileString(r.benchmark, r.size + _T(".items"), value, path);
+        value.Format(_T("%.0f"), r.items / seconds);
+        ::WritePrivateProfileString(r.benchmark, r.size + _T(".itemsPerSecond"), value, path);
+        value.Format(_T("%I64d"), r.measurement.allocations);
+        ::WritePrivateProfileString(r.benchmark, r.size + _T(".allocations"), value, path);
+        value.Format(_T("%I64d"), r.measurement.privateBytes);
+        ::WritePrivateProfileString(r.benchmark, r.size + _T(".privateBytes"), value, path);
+        value.Format(_T("%I64d"), r.measurement.accountedBytes);
+        ::WritePrivateProfileString(r.benchmark, r.size + _T(".accountedBytes"), value, path);
+    }
+
+    if(m_updateBaseline)
+    {
+        return;
+    }
+
+    // [memory] <size>.<subsystem>=bytes, <size>.<subsystem>.allocations=count
+    for(int i = 0; i < m_memory.GetSize(); i++)
+    {
+        const MEMORYSNAPSHOT& ms = m_memory[i];
+
+        CString value;
+        for(int j = 0; j < MEM_SUBSYSTEMCOUNT; j++)
+        {
+            CString key = ms.size + wds::chrDot + CMemoryAccounting::GetSubsystemName((MEMORYSUBSYSTEM)j);
+
+            value.Format(_T("%I64d"), ms.bytes[j]);
+            ::WritePrivateProfileString(_T("memory"), key, value, path);
+            value.Format(_T("%I64d"), ms.allocations[j]);
+            ::WritePrivateProfileString(_T("memory"), key + _T(".allocations"), value, path);
+        }
+        value.Format(_T("%I64d"), ms.bytesPerFile);
+        ::WritePrivateProfileString(_T("memory"), ms.size + _T(".bytesPerFile"), value, path);
+        value.Format(_T("%I64d"), ms.bytesPerFolder);
+        ::WritePrivateProfileString(_T("memory"), ms.size + _T(".bytesPerFolder"), value, path);
+    }
+}
+
+int CBenchmark::CompareWithBaseline()
+{
+    const int tolerance = ::GetPrivateProfileInt(_T("settings"), _T("tolerancePercent"), DEFAULT_TOLERANCE_PERCENT, m_baselinePath);
+
+    int regressions = 0;
+    for(int i = 0; i < m_results.GetSize(); i++)
+    {
+        const RESULT& r = m_results[i];
+
+        TCHAR buffer[64];
+        ::GetPrivateProfileString(r.benchmark, r.size, wds::strEmpty, buffer, _countof(buffer), m_baselinePath);
+        const double baseline = _tcstod(buffer, NULL);
+        if(baseline <= 0)
+        {
+            VTRACE(_T("%s/%s: no baseline"), r.benchmark.GetString(), r.size.GetString());
+            continue;
+        }
+
+        const double change = (r.measurement.milliseconds / baseline - 1) * 100;
+        if(change > tolerance)
+        {
+            VTRACE(_T("%s/%s: REGRESSION %+.1f%% (%.3f ms, baseline %.3f ms)"), r.benchmark.GetString(), r.size.GetString(), change, r.measurement.milliseconds, baseline);
+            regressions++;
+        }
+        else
+        {
+            VTRACE(_T("%s/%s: %+.1f%%"), r.benchmark.GetString(), r.size.GetString(), change);
+        }
+    }
+    return regressions;
+}
@@ -0,0 +1,139 @@
+// Benchmark.h - Declaration of CBenchmark
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_BENCHMARK_H__
+#define __WDS_BENCHMARK_H__
+#pragma once
+
+#include "MemoryAccounting.h"
+
+class CItem;
+
+//
+// CBenchmark. Times the hot paths (scan, extension aggregation, sorting,
+// treemap layout and rendering, hit testing, file index, queries,
+// tree list rows, the treemap engine, dimming) on
+// synthetic trees of several sizes and compares the results with a
+// baseline ini file. A few self checks (cushion kernel, render threads,
+// row model) run along; each failed one counts as a regression.
+// Started by CDirstatApp::InitInstance(), if the environment variable
+// WINDIRSTAT_BENCHMARK names the baseline file. The results are written
+// to "<baseline>.last.ini", or into the baseline itself, if
+// WINDIRSTAT_BENCHMARK_UPDATE is set.
+//
+class CBenchmark
+{
+    // Shape of one benchmark tree (see SYNTHETICTREESHAPE)
+    struct TREESIZE
+    {
+        LPCTSTR name;
+        int fanOut;
+        int depth;
+        int filesPerDirectory;
+    };
+
+    struct MEASUREMENT
+    {
+        double milliseconds;
+        LONGLONG allocations;   // -1 if unknown (release builds)
+        LONGLONG privateBytes;  // Growth of the private bytes of the process
+        LONGLONG accountedBytes;// Growth of CMemoryAccounting::GetTotalBytes()
+    };
+
+    struct RESULT
+    {
+        CString benchmark;
+        CString size;
+        ULONGLONG items;
+        MEASUREMENT measurement;
+    };
+
+    // CMemoryAccounting after a scan
+    struct MEMORYSNAPSHOT
+    {
+        CString size;
+        LONGLONG bytes[MEM_SUBSYSTEMCOUNT];
+        LONGLONG allocations[MEM_SUBSYSTEMCOUNT];
+        LONGLONG bytesPerFile;
+        LONGLONG bytesPerFolder;
+    };
+
+public:
+    CBenchmark(LPCTSTR baselinePath, bool updateBaseline);
+
+    // Returns the number of regressions
+    int Run();
+
+protected:
+    bool Scan(const TREESIZE& size, LPCTSTR folder);
+    void RunExtensions(const TREESIZE& size, CItem *root);
+    void RunSort(const TREESIZE& size, CItem *root, int subitem, LPCTSTR benchmark);
+    void RunTreemap(const TREESIZE& size, CItem *root, int style, bool cushions, LPCTSTR benchmark, const CSize& resolution);
+    void RunTreemapScaling(const TREESIZE& size, CItem *root);
+    void RunTreemapReshade(const TREESIZE& size, CItem *root);
+    void RunTreemapProgressive(const TREESIZE& size, CItem *root);
+    void RunHitTest(const TREESIZE& size, CItem *root);
+    void RunFileIndex(const TREESIZE& size, CItem *root);
+    void RunQuery(const TREESIZE& size, CItem *root);
+    void RunVisibleRows(const TREESIZE& size, CItem *root);
+    bool CheckVisibleRows();
+    void CheckTreemapThreads(const TREESIZE& size, CItem *root);
+    void CheckCushions();
+    void RunTreemapEngine(const TREESIZE& size, CItem *root);
+    void RunTreemapEngineLarge();
+    void RunLeafColors(const TREESIZE& size, CItem *root);
+    void RunDimming();
+
+    void BeginMeasurement();
+    MEASUREMENT EndMeasurement();
+    void AddResult(LPCTSTR benchmark, const TREESIZE& size, ULONGLONG items, const MEASUREMENT& m);
+    void AddMemorySnapshot(const TREESIZE& size);
+
+    void WriteResults(LPCTSTR path);
+    int CompareWithBaseline();
+
+    static const int REPETITIONS = 3;                // The fastest run counts
+    static const int HITTEST_POINTS = 100000;
+    static const int HITTEST_SCAN_POINTS = 1000;     // Without the index. Linear in flat folders.
+    static const int TREEMAP_MAX_THREADS = 16;       // RunTreemapScaling() doubles up to this
+    static const int TREEMAP_FIRSTIMAGE_TICKS = 50;  // The budgets of CGraphView
+    static const int TREEMAP_DRAWING_TICKS = 50;
+    static const int FILEINDEX_QUERIES = 1000;       // Top 100 queries
+    static const int VISIBLEROWS = 10000000;         // Rows of the tree list model
+    static const int VISIBLEROWS_LOOKUPS = 1000000;
+    static const int VISIBLEROWS_CHECK_STEPS = 2000;  // Random edits of CheckVisibleRows()
+    static const int CHECK_CUSHIONS = 200;           // Random cushions of CheckCushions()
+    static const int DEFAULT_TOLERANCE_PERCENT = 10;
+
+    CString m_baselinePath;
+    bool m_updateBaseline;
+    CArray<RESULT, const RESULT&> m_results;
+    CArray<MEMORYSNAPSHOT, const MEMORYSNAPSHOT&> m_memory;
+
+    double m_startMilliseconds;
+    LONGLONG m_startAllocations;
+    LONGLONG m_startPrivateBytes;
+    LONGLONG m_startAccountedBytes;
+
+    int m_failedChecks;     // Of the self checks. Count as regressions.
+};
+
+#endif // __WDS_BENCHMARK_H__
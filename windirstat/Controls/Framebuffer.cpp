@@ -0,0 +1,280 @@
+// Framebuffer.cpp - Implementation of CFramebufferPool and CFramebuffer
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "MemoryAccounting.h"
+#include "Framebuffer.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    CFramebufferPool _framebufferPool;
+
+    // A released buffer grows with some headroom, so that enlarging
+    // the window does not reallocate on every WM_SIZE.
+    const INT_PTR HEADROOM_DIVISOR = 8;
+}
+
+CFramebufferPool *GetFramebufferPool()
+{
+    return &_framebufferPool;
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+bool HasSSE2()
+{
+#ifdef _M_X64
+    return true;
+#else
+    static const bool sse2 = (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != FALSE);
+    return sse2;
+#endif
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+
+CFramebufferPool::CFramebufferPool()
+{
+}
+
+CFramebufferPool::~CFramebufferPool()
+{
+    for(INT_PTR i = m_buffers.GetSize() - 1; i >= 0; i--)
+    {
+        ASSERT(!m_buffers[i].busy);
+        FreeBuffer(i);
+    }
+}
+
+CColorRefArray *CFramebufferPool::Acquire(INT_PTR count, bool clear)
+{
+    ASSERT(count >= 0);
+
+    // The smallest idle buffer which is large enough, else the largest one
+    INT_PTR fit = -1;
+    INT_PTR largest = -1;
+    for(INT_PTR i = 0; i < m_buffers.GetSize(); i++)
+    {
+        const BUFFER& buffer = m_buffers[i];
+        if(buffer.busy)
+        {
+            continue;
+        }
+        if(buffer.capacity >= count && (fit < 0 || buffer.capacity < m_buffers[fit].capacity))
+        {
+            fit = i;
+        }
+        if(largest < 0 || buffer.capacity > m_buffers[largest].capacity)
+        {
+            largest = i;
+        }
+    }
+
+    if(fit < 0)
+    {
+        if(largest < 0)
+        {
+            BUFFER buffer;
+            buffer.bits = new CColorRefArray;
+            buffer.capacity = 0;
+            buffer.busy = false;
+            largest = m_buffers.Add(buffer);
+            CMemoryAccounting::Add(MEM_TREEMAP, 0, 1);
+        }
+
+        // Reallocate. RemoveAll() first, so that the old pixels are not copied.
+        fit = largest;
+        BUFFER& buffer = m_buffers[fit];
+        const INT_PTR capacity = count + count / HEADROOM_DIVISOR;
+
+        CMemoryAccounting::Add(MEM_TREEMAP, -LONGLONG(buffer.capacity) * LONGLONG(sizeof(COLORREF)), 0);
+        buffer.bits->RemoveAll();
+        buffer.capacity = 0;
+        buffer.bits->SetSize(capacity); // Zero-filled
+        buffer.capacity = capacity;
+        CMemoryAccounting::Add(MEM_TREEMAP, LONGLONG(capacity) * LONGLONG(sizeof(COLORREF)), 0);
+
+        // Shrinking within the capacity does not reallocate.
+        buffer.bits->SetSize(count);
+        clear = false;
+    }
+    else
+    {
+        m_buffers[fit].bits->SetSize(count);
+    }
+
+    BUFFER& buffer = m_buffers[fit];
+    buffer.busy = true;
+    if(clear && count > 0)
+    {
+        memset(buffer.bits->GetData(), 0, count * sizeof(COLORREF));
+    }
+    return buffer.bits;
+}
+
+void CFramebufferPool::Release(CColorRefArray *bits)
+{
+    if(bits == NULL)
+    {
+        return;
+    }
+
+    INT_PTR idle = 0;
+    INT_PTR smallest = -1;
+    for(INT_PTR i = 0; i < m_buffers.GetSize(); i++)
+    {
+        BUFFER& buffer = m_buffers[i];
+        if(buffer.bits == bits)
+        {
+            ASSERT(buffer.busy);
+            buffer.busy = false;
+        }
+        if(!buffer.busy)
+        {
+            idle++;
+            if(smallest < 0 || buffer.capacity < m_buffers[smallest].capacity)
+            {
+                smallest = i;
+            }
+        }
+    }
+
+    if(idle > MAX_IDLE)
+    {
+        FreeBuffer(smallest);
+    }
+}
+
+void CFramebufferPool::Trim()
+{
+    for(INT_PTR i = m_buffers.GetSize() - 1; i >= 0; i--)
+    {
+        if(!m_buffers[i].busy)
+        {
+            FreeBuffer(i);
+        }
+    }
+}
+
+void CFramebufferPool::FreeBuffer(INT_PTR i)
+{
+    const BUFFER& buffer = m_buffers[i];
+    CMemoryAccounting::Add(MEM_TREEMAP, -LONGLONG(buffer.capacity) * LONGLONG(sizeof(COLORREF)), -1);
+    delete buffer.bits;
+    m_buffers.RemoveAt(i);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CFramebuffer::CFramebuffer(INT_PTR count, bool clear)
+    : m_bits(GetFramebufferPool()->Acquire(count, clear))
+{
+}
+
+CFramebuffer::~CFramebuffer()
+{
+    GetFramebufferPool()->Release(m_bits);
+}
+
+CColorRefArray& CFramebuffer::GetBits()
+{
+    return *m_bits;
+}
+
+void CFramebuffer::GetBitmapInfo(BITMAPINFO& bmi, int width, int height)
+{
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;   // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+}
+
+void CFramebuffer::Paint(CDC *pdc, int x, int y, const COLORREF *bits, int bitsWidth, int height, int left, int width)
+{
+    // Straight from the buffer, without a temporary bitmap
+    BITMAPINFO bmi;
+    GetBitmapInfo(bmi, bitsWidth, height);
+    VERIFY(SetDIBitsToDevice(pdc->m_hDC, x, y, width, height, left, 0, 0, height, bits, &bmi, DIB_RGB_COLORS) != 0);
+}
+
+void CFramebuffer::Dim(COLORREF *bits, int width, int height, COLORREF color)
+{
+    for(int y = 0; y < height; y += 2)
+    {
+        COLORREF *row = bits + INT_PTR(y) * width;
+        int x = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+        if(HasSSE2())
+        {
+            // 4 pixels at a time: color, keep, color, keep
+            const __m128i keep = _mm_set_epi32(-1, 0, -1, 0);
+            const __m128i fill = _mm_set_epi32(0, int(color), 0, int(color));
+            for(; x + 4 <= width; x += 4)
+            {
+                __m128i *p = reinterpret_cast<__m128i *>(row + x);
+                _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p), keep), fill));
+            }
+        }
+#endif
+
+        for(; x < width; x += 2)
+        {
+            row[x] = color;
+        }
+    }
+}
+
+void CFramebuffer::DimBitmap(CDC *pdc, CBitmap& bitmap, COLORREF color)
+{
+    BITMAP bm;
+    if(bitmap.GetBitmap(&bm) == 0 || bm.bmWidth <= 0 || bm.bmHeight <= 0)
+    {
+        return;
+    }
+    const CSize size(bm.bmWidth, bm.bmHeight);
+
+    BITMAPINFO bmi;
+    GetBitmapInfo(bmi, size.cx, size.cy);
+
+    // GetDIBits() overwrites all pixels
+    CFramebuffer frame(INT_PTR(size.cx) * size.cy, false);
+    COLORREF *bits = frame.GetBits().GetData();
+
+    if(GetDIBits(pdc->m_hDC, bitmap, 0, size.cy, bits, &bmi, DIB_RGB_COLORS) != size.cy)
+    {
+        return;
+    }
+    Dim(bits, size.cx, size.cy, color);
+    VERIFY(SetDIBits(pdc->m_hDC, bitmap, 0, size.cy, bits, &bmi, DIB_RGB_COLORS) == size.cy);
+}
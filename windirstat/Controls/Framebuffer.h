@@ -0,0 +1,107 @@
+// Framebuffer.h - Declaration of CFramebufferPool and CFramebuffer
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_FRAMEBUFFER_H__
+#define __WDS_FRAMEBUFFER_H__
+#pragma once
+
+typedef CArray<COLORREF, COLORREF> CColorRefArray;
+typedef CArray<COLORREF, COLORREF&> CColorRefRArray;
+
+//
+// CFramebufferPool. The pixel buffers of the treemap drawings
+// (0x00RRGGBB, width per row). A released buffer keeps its memory, so
+// that the next drawing of the same or a smaller size neither allocates
+// nor commits fresh pages. At most MAX_IDLE buffers are kept.
+// The active instance is returned by GetFramebufferPool().
+// Main thread only. Accounted as MEM_TREEMAP.
+//
+class CFramebufferPool
+{
+    struct BUFFER
+    {
+        CColorRefArray *bits;
+        INT_PTR capacity;       // Pixels allocated
+        bool busy;
+    };
+
+public:
+    CFramebufferPool();
+    ~CFramebufferPool();
+
+    // A buffer of count pixels. They are 0, if clear is true.
+    CColorRefArray *Acquire(INT_PTR count, bool clear = true);
+    void Release(CColorRefArray *bits);
+
+    // Frees the idle buffers
+    void Trim();
+
+protected:
+    void FreeBuffer(INT_PTR i);
+
+    static const int MAX_IDLE = 2;
+
+    CArray<BUFFER, const BUFFER&> m_buffers;
+};
+
+CFramebufferPool *GetFramebufferPool();
+
+#if defined(_M_IX86) || defined(_M_X64)
+// Whether the SSE2 kernels (CFramebuffer::Dim(), CTreemap::DrawCushion()) may run
+bool HasSSE2();
+#endif
+
+//
+// CFramebuffer. A buffer of the pool for the lifetime of the object,
+// plus the routines which work on such buffers.
+//
+class CFramebuffer
+{
+public:
+    CFramebuffer(INT_PTR count, bool clear = true);
+    ~CFramebuffer();
+
+    CColorRefArray& GetBits();
+
+    // 32 bit, top-down
+    static void GetBitmapInfo(BITMAPINFO& bmi, int width, int height);
+
+    // Copies the columns [left, left + width) of bits (bitsWidth pixels
+    // per row, height rows) to pdc at (x, y).
+    static void Paint(CDC *pdc, int x, int y, const COLORREF *bits, int bitsWidth, int height, int left, int width);
+
+    // Sets every other pixel of every other row, starting at (0, 0),
+    // to color (0x00RRGGBB).
+    static void Dim(COLORREF *bits, int width, int height, COLORREF color);
+
+    // Dim() on a device dependent bitmap. The bitmap must not be
+    // selected into a device context.
+    static void DimBitmap(CDC *pdc, CBitmap& bitmap, COLORREF color);
+
+private:
+    CFramebuffer(const CFramebuffer&);
+    CFramebuffer& operator=(const CFramebuffer&);
+
+    CColorRefArray *m_bits;
+};
+
+#endif // __WDS_FRAMEBUFFER_H__
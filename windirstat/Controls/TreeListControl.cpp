@@ -61,6 +61,10 @@ CTreeListItem::CTreeListItem()
 
 CTreeListItem::~CTreeListItem()
 {
+    if(m_vi != NULL && m_vi->resortPending)
+    {
+        GetTreeListControl()->OnItemDeleted(this);
+    }
     delete m_vi;
 }
 
@@ -169,6 +173,161 @@ int __cdecl CTreeListItem::_compareProc(const void *p1, const void *p2)
     return item1->CompareS(item2, GetTreeListControl()->GetSorting());
 }
 
+int __cdecl CTreeListItem::_compareStableProc(const void *p1, const void *p2)
+{
+    const SORTEDCHILD *child1 = (const SORTEDCHILD *)p1;
+    const SORTEDCHILD *child2 = (const SORTEDCHILD *)p2;
+
+    int r = child1->item->CompareS(child2->item, GetTreeListControl()->GetSorting());
+    if(r == 0)
+    {
+        r = child1->oldIndex - child2->oldIndex;
+    }
+    return r;
+}
+
+// Inserts a new child into sortedChildren (binary search)
+// and returns its index.
+int CTreeListItem::InsertSortedChild(CTreeListItem *child)
+{
+    ASSERT(IsVisible());
+    const SSorting& sorting = GetTreeListControl()->GetSorting();
+
+    // Behind all children which are equal to the new one
+    int lo = 0;
+    int hi = int(m_vi->sortedChildren.GetSize());
+    while(lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if(child->CompareS(m_vi->sortedChildren[mid], sorting) < 0)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    m_vi->sortedChildren.InsertAt(lo, child);
+    return lo;
+}
+
+void CTreeListItem::RemoveSortedChild(const CTreeListItem *child)
+{
+    ASSERT(IsVisible());
+    for(int i = 0; i < m_vi->sortedChildren.GetSize(); i++)
+    {
+        if(m_vi->sortedChildren[i] == child)
+        {
+            m_vi->sortedChildren.RemoveAt(i);
+            return;
+        }
+    }
+    ASSERT(0);
+}
+
+// Brings sortedChildren into order again after some children have changed.
+// moved receives the new indexes of the children, whose rows have to be
+// moved, in ascending order. These are as few as possible: all the others
+// keep their relative order (they form a longest increasing subsequence
+// of the old indexes).
+void CTreeListItem::ResortChildren(CArray<int, int>& moved)
+{
+    ASSERT(IsVisible());
+    moved.RemoveAll();
+
+    CArray<CTreeListItem *, CTreeListItem *>& sorted = m_vi->sortedChildren;
+    const SSorting& sorting = GetTreeListControl()->GetSorting();
+    const int count = int(sorted.GetSize());
+
+    int i = 1;
+    while(i < count && sorted[i - 1]->CompareS(sorted[i], sorting) <= 0)
+    {
+        i++;
+    }
+    if(i >= count)
+    {
+        return;
+    }
+
+    // Stable, so that equal children don't change places on every frame.
+    CArray<SORTEDCHILD, const SORTEDCHILD&> order;
+    order.SetSize(count);
+    for(i = 0; i < count; i++)
+    {
+        order[i].item = sorted[i];
+        order[i].oldIndex = i;
+    }
+    qsort(order.GetData(), count, sizeof(SORTEDCHILD), &_compareStableProc);
+
+    // Longest increasing subsequence of the old indexes (patience sorting).
+    // tails[l] is the position in order, where the smallest known end of
+    // an increasing subsequence of length l + 1 is.
+    CArray<int, int> tails;
+    CArray<int, int> predecessor;
+    predecessor.SetSize(count);
+    for(i = 0; i < count; i++)
+    {
+        int lo = 0;
+        int hi = int(tails.GetSize());
+        while(lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if(order[tails[mid]].oldIndex < order[i].oldIndex)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        predecessor[i] = (lo > 0 ? tails[lo - 1] : -1);
+        if(lo == tails.GetSize())
+        {
+            tails.Add(i);
+        }
+        else
+        {
+            tails[lo] = i;
+        }
+    }
+
+    CArray<bool, bool> stays;
+    stays.SetSize(count);
+    for(i = 0; i < count; i++)
+    {
+        stays[i] = false;
+    }
+    for(i = tails[tails.GetSize() - 1]; i != -1; i = predecessor[i])
+    {
+        stays[i] = true;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        sorted[i] = order[i].item;
+        if(!stays[i])
+        {
+            moved.Add(i);
+        }
+    }
+}
+
+bool CTreeListItem::IsResortPending() const
+{
+    ASSERT(IsVisible());
+    return m_vi->resortPending;
+}
+
+void CTreeListItem::SetResortPending(bool pending)
+{
+    ASSERT(IsVisible());
+    m_vi->resortPending = pending;
+}
+
 CTreeListItem *CTreeListItem::GetSortedChild(int i)
 {
     return m_vi->sortedChildren[i];
@@ -273,6 +432,34 @@ void CTreeListItem::SetVisible(bool visible)
         m_vi = NULL;
     }
 }
+CVisibleRowModel::NODE *CTreeListItem::GetRowNode() const
+{
+    ASSERT(IsVisible());
+    return m_vi->row;
+}
+void CTreeListItem::SetRowNode(CVisibleRowModel::NODE *row)
+{
+    ASSERT(IsVisible());
+    m_vi->row = row;
+}
+// Rows of this item and its visible descendants
+int CTreeListItem::GetVisibleRowCount() const
+{
+    ASSERT(IsVisible());
+    return m_vi->visibleRows;
+}
+// Our row has been inserted (rows = 1) or is being deleted (rows = -1).
+// The ancestors, which are being deleted as well, are skipped.
+void CTreeListItem::AddAncestorRows(int rows)
+{
+    for(CTreeListItem *p = GetParent(); p != NULL; p = p->GetParent())
+    {
+        if(p->IsVisible())
+        {
+            p->m_vi->visibleRows += rows;
+        }
+    }
+}
 int CTreeListItem::GetIndent() const
 {
     ASSERT(IsVisible());
@@ -324,6 +511,7 @@ IMPLEMENT_DYNAMIC(CTreeListControl, COwnerDrawnListControl)
 CTreeListControl::CTreeListControl(CDirstatView *dirstatView, int rowHeight)
     : COwnerDrawnListControl(_T("treelist"), rowHeight)
     , m_dirstatView(dirstatView)
+    , m_movingRows(false)
 {
     ASSERT(_theTreeListControl == NULL);
     _theTreeListControl = this;
@@ -336,11 +524,12 @@ CTreeListControl::CTreeListControl(CDirstatView *dirstatView, int rowHeight)
 
 CTreeListControl::~CTreeListControl()
 {
+    ClearResortPending();
 }
 
 void CTreeListControl::SortItems()
 {
-    COwnerDrawnListControl::SortItems();
+    Sort();
 
     // re-init document selection array
     UpdateDocumentSelection();
@@ -413,7 +602,7 @@ BOOL CTreeListControl::CreateEx(DWORD dwExStyle, DWORD dwStyle, const RECT& rect
     BOOL bRet = FALSE;
     InitializeNodeBitmaps();
 
-    dwStyle|= LVS_OWNERDRAWFIXED;
+    dwStyle|= LVS_OWNERDRAWFIXED | LVS_OWNERDATA;
 
     bRet = COwnerDrawnListControl::Create(dwStyle, rect, pParentWnd, nID);
     VERIFY(bRet);
@@ -432,13 +621,26 @@ void CTreeListControl::SysColorChanged()
 
 CTreeListItem *CTreeListControl::GetItem(int i)
 {
-    CTreeListItem *item = (CTreeListItem *)GetItemData(i);
-    return item;
+    return m_rows.GetItem(i);
+}
+
+int CTreeListControl::FindListItem(const COwnerDrawnListItem *item)
+{
+    return FindTreeItem((const CTreeListItem *)item);
+}
+
+CSortingListItem *CTreeListControl::GetSortingListItem(int i)
+{
+    return GetItem(i);
 }
 
 void CTreeListControl::SetRootItem(CTreeListItem *root)
 {
+    ClearResortPending();
+
+    // The old items have been deleted already.
     DeleteAllItems();
+    m_rows.RemoveAll();
 
     m_selectionAnchor = root;
 
@@ -451,9 +653,10 @@ void CTreeListControl::SetRootItem(CTreeListItem *root)
 
 void CTreeListControl::DeselectAll()
 {
-    for(int i = 0; i < GetItemCount(); i++)
+    POSITION pos = GetFirstSelectedItemPosition();
+    while(pos != NULL)
     {
-        DeselectItem(i);
+        DeselectItem(GetNextSelectedItem(pos));
     }
 }
 
@@ -529,27 +732,177 @@ void CTreeListControl::InitializeNodeBitmaps()
     VERIFY(m_bmNodes1.LoadMappedBitmap(IDB_NODES, 0, cm, 1));
 }
 
+void CTreeListControl::SaveRowStates(ROWSTATES& states)
+{
+    ASSERT(!m_movingRows);
+    m_movingRows = true;
+
+    states.focused = NULL;
+    int focus = GetNextItem(-1, LVNI_FOCUSED);
+    if(focus != -1)
+    {
+        states.focused = GetItem(focus);
+        SetItemState(focus, 0, LVIS_FOCUSED);
+    }
+
+    POSITION pos = GetFirstSelectedItemPosition();
+    while(pos != NULL)
+    {
+        int i = GetNextSelectedItem(pos);
+        states.selected.Add(GetItem(i));
+        DeselectItem(i);
+    }
+}
+
+// Must be called after every change of m_rows.
+void CTreeListControl::RestoreRowStates(const ROWSTATES& states)
+{
+    ASSERT(m_movingRows);
+
+    SetItemCountEx(m_rows.GetCount(), LVSICF_NOSCROLL);
+
+    for(int i = 0; i < states.selected.GetSize(); i++)
+    {
+        if(states.selected[i]->IsVisible())
+        {
+            SelectItem(FindTreeItem(states.selected[i]));
+        }
+    }
+    if(states.focused != NULL && states.focused->IsVisible())
+    {
+        FocusItem(FindTreeItem(states.focused));
+    }
+
+    m_movingRows = false;
+}
+
 void CTreeListControl::InsertItem(int i, CTreeListItem *item)
 {
-    COwnerDrawnListControl::InsertListItem(i, item);
-    item->SetVisible(true);
+    InsertItems(i, &item, 1);
+}
+
+void CTreeListControl::InsertItems(int i, CTreeListItem * const *items, int count)
+{
+    ROWSTATES states;
+    SaveRowStates(states);
+
+    CArray<CVisibleRowModel::NODE *, CVisibleRowModel::NODE *> nodes;
+    nodes.SetSize(count);
+    m_rows.Insert(i, items, count, nodes.GetData());
+    for(int k = 0; k < count; k++)
+    {
+        items[k]->SetVisible(true);
+        items[k]->SetRowNode(nodes[k]);
+        items[k]->AddAncestorRows(1);
+    }
+
+    RestoreRowStates(states);
 }
 
 void CTreeListControl::DeleteItem(int i)
 {
-    if (GetItem(i) == m_selectionAnchor)
+    DeleteItems(i, 1);
+}
+
+void CTreeListControl::DeleteItems(int i, int count)
+{
+    ROWSTATES states;
+    SaveRowStates(states);
+
+    CArray<CTreeListItem *, CTreeListItem *> items;
+    items.SetSize(count);
+    m_rows.GetItems(i, count, items.GetData());
+    m_rows.Remove(i, count);
+
+    bool anchorDeleted = false;
+    for(int k = 0; k < count; k++)
+    {
+        CTreeListItem *item = items[k];
+        if(item == m_selectionAnchor)
+        {
+            anchorDeleted = true;
+        }
+        if(item->IsResortPending())
+        {
+            OnItemDeleted(item);
+        }
+        item->AddAncestorRows(-1);
+        item->SetExpanded(false);
+        item->SetVisible(false);
+    }
+
+    if(anchorDeleted)
+    {
+        m_selectionAnchor = (m_rows.GetCount() > 0 ? GetItem(0) : NULL);
+    }
+
+    RestoreRowStates(states);
+}
+
+// Number of rows of item i and its visible descendants. O(log n).
+int CTreeListControl::GetBlockRowCount(int i)
+{
+    return GetItem(i)->GetVisibleRowCount();
+}
+
+// Moves the rows of the sorted child sortedIndex (with its visible
+// descendants) behind the rows of its new predecessor.
+void CTreeListControl::MoveChildRows(CTreeListItem *parent, int sortedIndex)
+{
+    int from = FindTreeItem(parent->GetSortedChild(sortedIndex));
+    ASSERT(from != -1);
+
+    int to;
+    if(sortedIndex == 0)
+    {
+        to = FindTreeItem(parent) + 1;
+    }
+    else
+    {
+        int predecessor = FindTreeItem(parent->GetSortedChild(sortedIndex - 1));
+        ASSERT(predecessor != -1);
+        to = predecessor + GetBlockRowCount(predecessor);
+    }
+
+    MoveRows(from, GetBlockRowCount(from), to);
+}
+
+// Moves count rows from from to before row to.
+// The items stay visible and keep their VISIBLEINFO.
+void CTreeListControl::MoveRows(int from, int count, int to)
+{
+    if(to >= from && to <= from + count)
     {
-        m_selectionAnchor = GetItem(0);
+        return;
     }
 
-    GetItem(i)->SetExpanded(false);
-    GetItem(i)->SetVisible(false);
-    COwnerDrawnListControl::DeleteItem(i);
+    ROWSTATES states;
+    SaveRowStates(states);
+    m_rows.Move(from, count, to);
+    RestoreRowStates(states);
+}
+
+// Appends item and its visible descendants in sorted order to rows.
+void CTreeListControl::CollectRows(CTreeListItem *item, CArray<CTreeListItem *, CTreeListItem *>& rows)
+{
+    rows.Add(item);
+    if(item->IsExpanded())
+    {
+        item->SortChildren();
+        for(int i = 0; i < item->GetChildrenCount(); i++)
+        {
+            CollectRows(item->GetSortedChild(i), rows);
+        }
+    }
 }
 
 int CTreeListControl::FindTreeItem(const CTreeListItem *item)
 {
-    return COwnerDrawnListControl::FindListItem(item);
+    if(item == NULL || !item->IsVisible())
+    {
+        return -1;
+    }
+    return m_rows.GetRow(item->GetRowNode());
 }
 
 BEGIN_MESSAGE_MAP(CTreeListControl, COwnerDrawnListControl)
@@ -558,8 +911,67 @@ BEGIN_MESSAGE_MAP(CTreeListControl, COwnerDrawnListControl)
     ON_WM_KEYDOWN()
     ON_WM_LBUTTONDBLCLK()
     ON_WM_DESTROY()
+#pragma warning(suppress: 26454)
+    ON_NOTIFY_REFLECT_EX(LVN_ITEMCHANGED, OnLvnItemchanged)
+#pragma warning(suppress: 26454)
+    ON_NOTIFY_REFLECT(LVN_ODFINDITEM, OnLvnOdfinditem)
 END_MESSAGE_MAP()
 
+// While rows move, selection and focus only follow their items.
+// The parent must not take this for a change (returning TRUE stops the notification).
+BOOL CTreeListControl::OnLvnItemchanged(NMHDR * /*pNMHDR*/, LRESULT *pResult)
+{
+    *pResult = 0;
+    return m_movingRows;
+}
+
+// Type-ahead. An owner-data list cannot search for itself.
+void CTreeListControl::OnLvnOdfinditem(NMHDR *pNMHDR, LRESULT *pResult)
+{
+    NMLVFINDITEM *fi = reinterpret_cast<NMLVFINDITEM *>(pNMHDR);
+    *pResult = -1;
+
+    const int count = GetItemCount();
+    if((fi->lvfi.flags & (LVFI_STRING | LVFI_PARTIAL)) == 0 || count == 0)
+    {
+        return;
+    }
+
+    const CString search = fi->lvfi.psz;
+    const bool partial = (fi->lvfi.flags & LVFI_PARTIAL) != 0;
+    const bool wrap = (fi->lvfi.flags & LVFI_WRAP) != 0;
+
+    int start = fi->iStart;
+    if(start < 0 || start >= count)
+    {
+        start = 0;
+    }
+
+    for(int k = 0; k < count; k++)
+    {
+        int i = start + k;
+        if(i >= count)
+        {
+            if(!wrap)
+            {
+                break;
+            }
+            i -= count;
+        }
+
+        CString text = GetItem(i)->GetText(0);
+        if(partial)
+        {
+            text = text.Left(search.GetLength());
+        }
+        if(text.CompareNoCase(search) == 0)
+        {
+            *pResult = i;
+            return;
+        }
+    }
+}
+
 
 void CTreeListControl::DrawNode(CDC *pdc, CRect& rc, CRect& rcPlusMinus, const CTreeListItem *item, int *width)
 {
@@ -844,24 +1256,18 @@ void CTreeListControl::CollapseItem(int i)
     CWaitCursor wc;
     SetRedraw(FALSE);
     bool selectNode = false;
-    int todelete = 0;
-    for(int k = i+1; k < GetItemCount(); k++)
+    const int todelete = item->GetVisibleRowCount() - 1;
+    POSITION pos = GetFirstSelectedItemPosition();
+    while(pos != NULL)
     {
-        CTreeListItem *child = GetItem(k);
-        if(child->GetIndent() <= item->GetIndent())
-        {
-            break;
-        }
-        if(GetItemState(k, LVIS_SELECTED) == LVIS_SELECTED)
+        int k = GetNextSelectedItem(pos);
+        if(k > i && k <= i + todelete)
         {
             selectNode = true;
+            break;
         }
-        todelete++;
-    }
-    for(int m = 0; m < todelete; m++)
-    {
-        DeleteItem(i + 1);
     }
+    DeleteItems(i + 1, todelete);
     item->SetExpanded(false);
     if(selectNode)
     {
@@ -923,18 +1329,22 @@ void CTreeListControl::ExpandItem(int i, bool scroll)
 
     item->SortChildren();
 
-    int maxwidth = GetSubItemWidth(item, 0);
+    // All rows at once
+    CArray<CTreeListItem *, CTreeListItem *> children;
+    children.SetSize(item->GetChildrenCount());
     for(int c = 0; c < item->GetChildrenCount(); c++)
     {
-        CTreeListItem *child = item->GetSortedChild(c);
-        InsertItem(i + 1 + c, child);
-        if(scroll)
+        children[c] = item->GetSortedChild(c);
+    }
+    InsertItems(i + 1, children.GetData(), int(children.GetSize()));
+
+    int maxwidth = GetSubItemWidth(item, 0);
+    for(int c = 0; scroll && c < children.GetSize(); c++)
+    {
+        int w = GetSubItemWidth(children[c], 0);
+        if(w > maxwidth)
         {
-            int w = GetSubItemWidth(child, 0);
-            if(w > maxwidth)
-            {
-                maxwidth = w;
-            }
+            maxwidth = w;
         }
     }
 
@@ -1098,14 +1508,25 @@ void CTreeListControl::OnChildAdded(CTreeListItem *parent, CTreeListItem *child)
 
     if(parent->IsExpanded())
     {
-        InsertItem(p + 1, child);
-        RedrawItems(p, p);
-        Sort();
-    }
-    else
-    {
-        RedrawItems(p, p);
+        // The new row goes before the row of its sorted successor
+        // or, if there is none, behind the last row of parent.
+        int c = parent->InsertSortedChild(child);
+        int i;
+        if(c + 1 < parent->GetChildrenCount())
+        {
+            i = FindTreeItem(parent->GetSortedChild(c + 1));
+            ASSERT(i != -1);
+        }
+        else
+        {
+            i = p + parent->GetVisibleRowCount();
+        }
+        InsertItem(i, child);
     }
+    RedrawItems(p, p);
+
+    // parent has grown, so its place among its siblings may have changed.
+    OnChildrenChanged(parent->GetParent());
 }
 
 void CTreeListControl::OnChildRemoved(CTreeListItem *parent, CTreeListItem *child)
@@ -1120,18 +1541,16 @@ void CTreeListControl::OnChildRemoved(CTreeListItem *parent, CTreeListItem *chil
 
     if(parent->IsExpanded())
     {
-        for(int i = 0; i < child->GetChildrenCount(); i++)
-        {
-            OnChildRemoved(child, child->GetTreeListChild(i));
-        }
-
+        // child and its visible descendants
         int c = FindTreeItem(child);
         ASSERT(c != -1);
-        DeleteItem(c);
-        parent->SortChildren();
+        DeleteItems(c, GetBlockRowCount(c));
+        parent->RemoveSortedChild(child);
     }
 
     RedrawItems(p, p);
+
+    OnChildrenChanged(parent->GetParent());
 }
 
 void CTreeListControl::OnRemovingAllChildren(CTreeListItem *parent)
@@ -1147,16 +1566,125 @@ void CTreeListControl::OnRemovingAllChildren(CTreeListItem *parent)
     CollapseItem(p);
 }
 
+// Some children of parent have changed (or parent is NULL).
+// Their order is restored in the next ResortPending().
+void CTreeListControl::OnChildrenChanged(CTreeListItem *parent)
+{
+    // The ancestors have changed, too. As the ancestors of a pending
+    // item are always pending themselves, we can stop at the first one.
+    for(CTreeListItem *p = parent; p != NULL; p = p->GetParent())
+    {
+        if(!p->IsVisible() || !p->IsExpanded())
+        {
+            continue;
+        }
+        if(p->IsResortPending())
+        {
+            break;
+        }
+        p->SetResortPending();
+        m_resortPending.Add(p);
+    }
+}
+
+// Called before a pending item loses its VISIBLEINFO.
+void CTreeListControl::OnItemDeleted(CTreeListItem *item)
+{
+    for(int i = 0; i < m_resortPending.GetSize(); i++)
+    {
+        if(m_resortPending[i] == item)
+        {
+            m_resortPending.RemoveAt(i);
+            break;
+        }
+    }
+    item->SetResortPending(false);
+}
+
+void CTreeListControl::ClearResortPending()
+{
+    for(int i = 0; i < m_resortPending.GetSize(); i++)
+    {
+        m_resortPending[i]->SetResortPending(false);
+    }
+    m_resortPending.RemoveAll();
+}
+
+// Sorts the children of all expanded items and rebuilds the rows.
 void CTreeListControl::Sort()
 {
-    for(int i = 0; i < GetItemCount(); i++)
+    ClearResortPending();
+
+    if(GetItemCount() > 0)
     {
-        if(GetItem(i)->IsExpanded())
+        CArray<CTreeListItem *, CTreeListItem *> rows;
+        rows.SetSize(0, GetItemCount());
+        CollectRows(GetItem(0), rows);
+
+        ROWSTATES states;
+        SaveRowStates(states);
+
+        CArray<CVisibleRowModel::NODE *, CVisibleRowModel::NODE *> nodes;
+        nodes.SetSize(rows.GetSize());
+        m_rows.RemoveAll();
+        m_rows.Insert(0, rows.GetData(), int(rows.GetSize()), nodes.GetData());
+        for(int i = 0; i < rows.GetSize(); i++)
         {
-            GetItem(i)->SortChildren();
+            rows[i]->SetRowNode(nodes[i]);
         }
+
+        RestoreRowStates(states);
+    }
+
+    IndicateSorting();
+}
+
+// Called once per frame while scanning. Restores the order of the
+// children of the pending items. Only the rows of the children, which
+// have changed their places, are moved, so the work is bounded by
+// the number of changed rows and not by the number of all rows.
+void CTreeListControl::ResortPending()
+{
+    if(m_resortPending.GetSize() == 0)
+    {
+        return;
+    }
+
+    bool redrawOff = false;
+    CArray<int, int> moved;
+    for(int i = 0; i < m_resortPending.GetSize(); i++)
+    {
+        CTreeListItem *item = m_resortPending[i];
+        item->SetResortPending(false);
+        if(!item->IsExpanded())
+        {
+            continue;
+        }
+
+        item->ResortChildren(moved);
+        if(moved.GetSize() > 0 && !redrawOff)
+        {
+            SetRedraw(FALSE);
+            redrawOff = true;
+        }
+        for(int k = 0; k < moved.GetSize(); k++)
+        {
+            MoveChildRows(item, moved[k]);
+        }
+    }
+    m_resortPending.RemoveAll();
+
+    if(redrawOff)
+    {
+        SetRedraw(TRUE);
+    }
+
+    // The sizes have changed anyway: repaint the visible rows.
+    if(GetItemCount() > 0)
+    {
+        int top = GetTopIndex();
+        RedrawItems(top, min(top + GetCountPerPage(), GetItemCount() - 1));
     }
-    COwnerDrawnListControl::SortItems();
 }
 
 void CTreeListControl::EnsureItemVisible(const CTreeListItem *item)
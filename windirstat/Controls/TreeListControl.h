@@ -25,6 +25,7 @@
 
 #include "ownerdrawnlistcontrol.h"
 #include "pacman.h"
+#include "VisibleRowModel.h"
 
 class CDirstatView;
 class CTreeListItem;
@@ -47,6 +48,8 @@ class CTreeListItem: public COwnerDrawnListItem
         CRect rcPlusMinus;  // Coordinates of the little +/- rectangle, relative to the upper left corner of the item.
         CRect rcTitle;      // Coordinates of the label, relative to the upper left corner of the item.
         bool isExpanded;    // Whether item is expanded.
+        CVisibleRowModel::NODE *row; // Our row in CTreeListControl::m_rows.
+        int visibleRows;    // Rows of this item and its visible descendants. See AddAncestorRows().
 
         // sortedChildren: This member contains our children (the same set of
         // children as in CItem::m_children) and is initialized as soon as
@@ -54,15 +57,29 @@ class CTreeListItem: public COwnerDrawnListItem
         // sorted depending on the current user-defined sort column and -order.
         CArray<CTreeListItem *, CTreeListItem *> sortedChildren;
 
+        // resortPending: Some children have changed since sortedChildren
+        // was last brought into order (see CTreeListControl::OnChildrenChanged()).
+        bool resortPending;
+
         CPacman pacman;
 
         VISIBLEINFO(int iIndent)
             : indent(iIndent)
             , image(-1)
             , isExpanded(false)
+            , row(NULL)
+            , visibleRows(1)
+            , resortPending(false)
         {}
     };
 
+    // Used by ResortChildren()
+    struct SORTEDCHILD
+    {
+        CTreeListItem *item;
+        int oldIndex;
+    };
+
 public:
     CTreeListItem();
     virtual ~CTreeListItem();
@@ -80,6 +97,11 @@ public:
     void DrawPacman(CDC *pdc, const CRect& rc, COLORREF bgColor) const;
     void UncacheImage();
     void SortChildren();
+    int InsertSortedChild(CTreeListItem *child);
+    void RemoveSortedChild(const CTreeListItem *child);
+    void ResortChildren(CArray<int, int>& moved);
+    bool IsResortPending() const;
+    void SetResortPending(bool pending =true);
     CTreeListItem *GetSortedChild(int i);
     int FindSortedChild(const CTreeListItem *child);
     CTreeListItem *GetParent() const;
@@ -90,6 +112,10 @@ public:
     void SetExpanded(bool expanded =true);
     bool IsVisible() const;
     void SetVisible(bool visible =true);
+    CVisibleRowModel::NODE *GetRowNode() const;
+    void SetRowNode(CVisibleRowModel::NODE *row);
+    int GetVisibleRowCount() const;
+    void AddAncestorRows(int rows);
     int GetIndent() const;
     CRect GetPlusMinusRect() const;
     void SetPlusMinusRect(const CRect& rc) const;
@@ -98,6 +124,7 @@ public:
 
 protected:
     static int __cdecl _compareProc(const void *p1, const void *p2);
+    static int __cdecl _compareStableProc(const void *p1, const void *p2);
     static CTreeListControl *GetTreeListControl();
     void StartPacman(bool start);
     bool DrivePacman(ULONGLONG readJobs);
@@ -112,6 +139,8 @@ private:
 
 //
 // CTreeListControl. A CListCtrl, which additionally behaves an looks like a tree control.
+// It runs in owner-data mode: the rows are kept in a CVisibleRowModel,
+// the list control only knows their number.
 //
 class CTreeListControl: public COwnerDrawnListControl
 {
@@ -133,13 +162,18 @@ public:
     void OnChildAdded(CTreeListItem *parent, CTreeListItem *child);
     void OnChildRemoved(CTreeListItem *parent, CTreeListItem *childdata);
     void OnRemovingAllChildren(CTreeListItem *parent);
-    CTreeListItem *GetItem(int i);
+    void OnChildrenChanged(CTreeListItem *parent);
+    void OnItemDeleted(CTreeListItem *item);
+    virtual CTreeListItem *GetItem(int i);
+    virtual int FindListItem(const COwnerDrawnListItem *item);
+    virtual CSortingListItem *GetSortingListItem(int i);
     void DeselectAll();
     void ExpandPathToItem(const CTreeListItem *item);
     void DrawNode(CDC *pdc, CRect& rc, CRect& rcPlusMinus, const CTreeListItem *item, int *width);
     void SelectItem(const CTreeListItem *item);
     void SelectSingleItem(const CTreeListItem *item);
     void Sort();
+    void ResortPending();
     void EnsureItemVisible(const CTreeListItem *item);
     void ExpandItem(CTreeListItem *item);
     int FindTreeItem(const CTreeListItem *item);
@@ -157,8 +191,25 @@ protected:
     void InitializeNodeBitmaps();
 
 
+    // Selection and focus of an owner-data list belong to row numbers,
+    // so they have to follow the items when rows are inserted, removed or moved.
+    struct ROWSTATES
+    {
+        CArray<CTreeListItem *, CTreeListItem *> selected;
+        CTreeListItem *focused;
+    };
+
+    void SaveRowStates(ROWSTATES& states);
+    void RestoreRowStates(const ROWSTATES& states);
     void InsertItem(int i, CTreeListItem *item);
+    void InsertItems(int i, CTreeListItem * const *items, int count);
     void DeleteItem(int i);
+    void DeleteItems(int i, int count);
+    void CollectRows(CTreeListItem *item, CArray<CTreeListItem *, CTreeListItem *>& rows);
+    int GetBlockRowCount(int i);
+    void MoveChildRows(CTreeListItem *parent, int sortedIndex);
+    void MoveRows(int from, int count, int to);
+    void ClearResortPending();
     void CollapseItem(int i);
     void ExpandItem(int i, bool scroll = true);
     void ToggleExpansion(int i);
@@ -185,12 +236,22 @@ protected:
     int m_lButtonDownItem;      // Set in OnLButtonDown(). -1 if not item hit.
     bool m_lButtonDownOnPlusMinusRect;  // Set in OnLButtonDown(). True, if plus-minus-rect hit.
 
+    // The rows. The list control itself runs in owner-data mode and knows only their number.
+    CVisibleRowModel m_rows;
+    bool m_movingRows;          // Between SaveRowStates() and RestoreRowStates()
+
+    // Expanded items whose children must be brought into order again.
+    // Filled by OnChildrenChanged(), emptied by ResortPending() once per frame.
+    CArray<CTreeListItem *, CTreeListItem *> m_resortPending;
+
     DECLARE_MESSAGE_MAP()
 
     afx_msg void MeasureItem(LPMEASUREITEMSTRUCT mis);
     afx_msg void OnLButtonDown(UINT nFlags, CPoint point);
     afx_msg void OnLButtonDblClk(UINT nFlags, CPoint point);
     afx_msg void OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
+    afx_msg BOOL OnLvnItemchanged(NMHDR *pNMHDR, LRESULT *pResult);
+    afx_msg void OnLvnOdfinditem(NMHDR *pNMHDR, LRESULT *pResult);
     // afx_msg BOOL OnEraseBkgnd(CDC* pDC);
 };
 
@@ -0,0 +1,68 @@
+// TreemapEngine.cpp - Implementation of CTreemapCompactTree
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "MemoryAccounting.h"
+#include "TreemapEngine.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+CTreemapCompactTree::CTreemapCompactTree()
+    : m_bytes(0)
+{
+}
+
+CTreemapCompactTree::~CTreemapCompactTree()
+{
+    RemoveAll();
+}
+
+void CTreemapCompactTree::RemoveAll()
+{
+    m_nodes.RemoveAll();
+    CMemoryAccounting::Add(MEM_TREEMAP, -m_bytes, (m_bytes > 0) ? -1 : 0);
+    m_bytes = 0;
+}
+
+CTreemapCompactTree::CNode *CTreemapCompactTree::GetRoot()
+{
+    return (m_nodes.GetSize() > 0) ? &m_nodes[0] : NULL;
+}
+
+INT_PTR CTreemapCompactTree::GetNodeCount() const
+{
+    return m_nodes.GetSize();
+}
+
+// Once per Build(): the children are addressed by offsets, so the
+// array must not move afterwards.
+void CTreemapCompactTree::SetNodeCount(INT_PTR count)
+{
+    ASSERT(m_nodes.GetSize() == 0);
+
+    m_nodes.SetSize(count);
+
+    m_bytes = LONGLONG(count) * LONGLONG(sizeof(CNode));
+    CMemoryAccounting::Add(MEM_TREEMAP, m_bytes, 1);
+}
@@ -0,0 +1,940 @@
+// TreemapEngine.h - Declaration of CTreemapLayout, CTreemapEngine and CTreemapCompactTree
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_TREEMAPENGINE_H__
+#define __WDS_TREEMAPENGINE_H__
+#pragma once
+
+#include "MemoryAccounting.h"
+#include "treemap.h"
+
+//
+// Access policies. CTreemapLayout and CTreemapEngine reach the tree only
+// through a policy with these static members, so that they can be
+// instantiated for a concrete item class, whose accessors are inlined:
+//
+//     typedef ... Node;
+//     static int GetChildrenCount(Node node);
+//     static Node GetChild(Node node, int i);
+//     static ULONGLONG GetSize(Node node);
+//     static bool IsLeaf(Node node);
+//     static COLORREF GetGraphColor(Node node);
+//     static void SetRectangle(Node node, const CRect& rc);
+//
+// CTreemapItemAccess is the policy for the interface CTreemap::Item.
+// CItemTreemapAccess (item.h), CTreemapPreview::CItem::Access and
+// CTreemapCompactTree::Access are those of concrete classes.
+//
+struct CTreemapItemAccess
+{
+    typedef CTreemap::Item *Node;
+
+    static int GetChildrenCount(Node node)                  { return node->TmiGetChildrenCount(); }
+    static Node GetChild(Node node, int i)                  { return node->TmiGetChild(i); }
+    static ULONGLONG GetSize(Node node)                     { return node->TmiGetSize(); }
+    static bool IsLeaf(Node node)                           { return node->TmiIsLeaf(); }
+    static COLORREF GetGraphColor(Node node)                { return node->TmiGetGraphColor(); }
+    static void SetRectangle(Node node, const CRect& rc)    { node->TmiSetRectangle(rc); }
+};
+
+//
+// CTreemapLayout. The squarification methods of CTreemap. Each one divides
+// the rectangle rc of parent among its children and calls
+// visitor.Child(child, rcChild, flags) for each child, which it places.
+// The first child without room gets the rectangle (-1, -1, -1, -1) and
+// no call, the children after it get nothing.
+//
+template<class Access>
+class CTreemapLayout
+{
+public:
+    typedef typename Access::Node Node;
+
+    // KDirStat-like squarification
+    template<class Visitor> static void KDirStat(Node parent, const CRect& rc, Visitor& visitor);
+
+    // Classical SequoiaView-like squarification
+    template<class Visitor> static void SequoiaView(Node parent, const CRect& rc, Visitor& visitor);
+
+    // No squarification (simple style, not used in WinDirStat)
+    template<class Visitor> static void Simple(Node parent, const CRect& rc, DWORD flags, Visitor& visitor);
+
+protected:
+    static bool KDirStat_ArrangeChildren(Node parent, const CRect& rc, CArray<double, double>& childWidth, CArray<double, double>& rows, CArray<int, int>& childrenPerRow);
+    static double KDirStat_CalcutateNextRow(Node parent, const int nextChild, double width, int& childrenUsed, CArray<double, double>& childWidth);
+};
+
+//
+// CTreemapEngine. Draws like CTreemap::DrawTreemap(), with the options
+// of the given CTreemap, but the tree is reached through Access, and the
+// style is a template argument. So there is neither a virtual call per
+// child nor a switch per node. There is no layout cache, no hit index
+// and no progressive drawing, so CTreemapPreview draws with it, while
+// CGraphView keeps CTreemap::DrawTreemap().
+// DrawTreemapStatic() picks the instance for the current style.
+//
+template<class Access, int style>
+class CTreemapEngine
+{
+public:
+    typedef typename Access::Node Node;
+
+    CTreemapEngine(CTreemap& treemap);
+
+    void DrawTreemap(CDC *pdc, CRect rc, Node root);
+
+protected:
+    // The visitor of CTreemapLayout: the children of one parent
+    struct CHILDREN
+    {
+        CTreemapEngine *engine;
+        const double *surface;
+        double h;
+
+        void Child(Node child, const CRect& rc, DWORD flags) { engine->RecurseDrawGraph(child, rc, false, surface, h, flags); }
+    };
+
+    void RecurseDrawGraph(Node item, const CRect& rc, bool asroot, const double *psurface, double h, DWORD flags);
+    void DrawChildren(Node parent, const CRect& rc, const double *surface, double h, DWORD flags);
+
+    CTreemap& m_treemap;
+    CColorRefArray *m_bitmap;   // While drawing
+    bool m_cushionShading;
+    int m_gridWidth;
+};
+
+// Same as CTreemap::DrawTreemap(treemap, pdc, rc, root, options), but by CTreemapEngine
+template<class Access>
+void DrawTreemapStatic(CTreemap& treemap, CDC *pdc, const CRect& rc, typename Access::Node root, const CTreemap::Options *options = NULL);
+
+//
+// CTreemapCompactTree. A copy of a tree in one array, breadth first,
+// so that the children of each node are adjacent. No allocation per
+// node and no pointers between them. The nodes implement CTreemap::Item,
+// so that CTreemap can draw the copy as well; Access is the policy for
+// CTreemapEngine. Accounted as MEM_TREEMAP.
+//
+class CTreemapCompactTree
+{
+public:
+    class CNode: public CTreemap::Item
+    {
+    public:
+        virtual         bool TmiIsLeaf()                const   { return m_childCount == 0; }
+        virtual        CRect TmiGetRectangle()          const   { return m_rect; }
+        virtual         void TmiSetRectangle(const CRect& rc)   { m_rect = rc; }
+        virtual     COLORREF TmiGetGraphColor()         const   { return m_color; }
+        virtual          int TmiGetChildrenCount()      const   { return m_childCount; }
+        virtual        Item *TmiGetChild(int c)         const   { return const_cast<CNode *>(this) + m_childOffset + c; }
+        virtual    ULONGLONG TmiGetSize()               const   { return m_size; }
+
+        ULONGLONG m_size;
+        CRect m_rect;
+        COLORREF m_color;       // Leaves only
+        int m_childCount;
+        int m_childOffset;      // From this node to its first child
+    };
+
+    struct Access
+    {
+        typedef CNode *Node;
+
+        static int GetChildrenCount(const CNode *node)          { return node->m_childCount; }
+        static CNode *GetChild(const CNode *node, int i)        { return const_cast<CNode *>(node) + node->m_childOffset + i; }
+        static ULONGLONG GetSize(const CNode *node)             { return node->m_size; }
+        static bool IsLeaf(const CNode *node)                   { return node->m_childCount == 0; }
+        static COLORREF GetGraphColor(const CNode *node)        { return node->m_color; }
+        static void SetRectangle(CNode *node, const CRect& rc)  { node->m_rect = rc; }
+    };
+
+public:
+    CTreemapCompactTree();
+    ~CTreemapCompactTree();
+
+    // Copies the tree below root, which SourceAccess reaches (see above).
+    // Throws CMemoryException.
+    template<class SourceAccess> void Build(typename SourceAccess::Node root);
+    void RemoveAll();
+
+    CNode *GetRoot();               // NULL if empty
+    INT_PTR GetNodeCount() const;
+
+protected:
+    template<class SourceAccess> static INT_PTR RecurseCount(typename SourceAccess::Node node);
+    void SetNodeCount(INT_PTR count);
+
+    CArray<CNode, const CNode&> m_nodes;
+    LONGLONG m_bytes;           // Accounted
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+// I learned this squarification style from the KDirStat executable.
+// It's the most complex one here but also the clearest, imho.
+//
+template<class Access>
+template<class Visitor>
+void CTreemapLayout<Access>::KDirStat(Node parent, const CRect& rc, Visitor& visitor)
+{
+    ASSERT(Access::GetChildrenCount(parent) > 0);
+
+    CArray<double, double> rows;    // Our rectangle is divided into rows, each of which gets this height (fraction of total height).
+    CArray<int, int> childrenPerRow;// childrenPerRow[i] = # of children in rows[i]
+
+    CArray<double, double> childWidth; // Widths of the children (fraction of row width).
+    childWidth.SetSize(Access::GetChildrenCount(parent));
+
+    bool horizontalRows = KDirStat_ArrangeChildren(parent, rc, childWidth, rows, childrenPerRow);
+
+    const int width = horizontalRows ? rc.Width() : rc.Height();
+    const int height = horizontalRows ? rc.Height() : rc.Width();
+    ASSERT(width >= 0);
+    ASSERT(height >= 0);
+
+    int c = 0;
+    double top = horizontalRows ? rc.top : rc.left;
+    for(int row = 0; row < rows.GetSize(); row++)
+    {
+        double fBottom = top + rows[row] * height;
+        int bottom = (int)fBottom;
+        if(row == rows.GetSize() - 1)
+        {
+            bottom = horizontalRows ? rc.bottom : rc.right;
+        }
+        double left = horizontalRows ? rc.left : rc.top;
+        for(int i = 0; i < childrenPerRow[row]; i++, c++)
+        {
+            Node child = Access::GetChild(parent, c);
+            ASSERT(childWidth[c] >= 0);
+            double fRight = left + childWidth[c] * width;
+            int right = (int)fRight;
+
+            bool lastChild = (i == childrenPerRow[row] - 1 || childWidth[c + 1] == 0);
+
+            if(lastChild)
+            {
+                right = horizontalRows ? rc.right : rc.bottom;
+            }
+
+            CRect rcChild;
+            if(horizontalRows)
+            {
+                rcChild.left = (int)left;
+                rcChild.right = right;
+                rcChild.top = (int)top;
+                rcChild.bottom = bottom;
+            }
+            else
+            {
+                rcChild.left = (int)top;
+                rcChild.right = bottom;
+                rcChild.top = (int)left;
+                rcChild.bottom = right;
+            }
+
+            #ifdef _DEBUG
+            if(rcChild.Width() > 0 && rcChild.Height() > 0)
+            {
+                CRect test;
+                test.IntersectRect(rc, rcChild);
+                ASSERT(test == rcChild);
+            }
+            #endif
+
+            visitor.Child(child, rcChild, 0);
+
+            if(lastChild)
+            {
+                i++, c++;
+
+                if(i < childrenPerRow[row])
+                {
+                    Access::SetRectangle(Access::GetChild(parent, c), CRect(-1,-1,-1,-1));
+                }
+
+                c += childrenPerRow[row] - i;
+                break;
+            }
+
+            left = fRight;
+        }
+        // This asserts due to rounding error: ASSERT(left == (horizontalRows ? rc.right : rc.bottom));
+        top = fBottom;
+    }
+    // This asserts due to rounding error: ASSERT(top == (horizontalRows ? rc.bottom : rc.right));
+}
+
+
+// return: whether the rows are horizontal.
+//
+template<class Access>
+bool CTreemapLayout<Access>::KDirStat_ArrangeChildren(
+    Node parent,
+    const CRect& rc,
+    CArray<double, double>& childWidth,
+    CArray<double, double>& rows,
+    CArray<int, int>& childrenPerRow
+)
+{
+    ASSERT(!Access::IsLeaf(parent));
+    ASSERT(Access::GetChildrenCount(parent) > 0);
+
+    const int childrenCount = Access::GetChildrenCount(parent);
+
+    if(Access::GetSize(parent) == 0)
+    {
+        rows.Add(1.0);
+        childrenPerRow.Add(childrenCount);
+        for(int i = 0; i < childrenCount; i++)
+        {
+            childWidth[i]= 1.0 / childrenCount;
+        }
+        return true;
+    }
+
+    bool horizontalRows = (rc.Width() >= rc.Height());
+
+    double width = 1.0;
+    if(horizontalRows)
+    {
+        if(rc.Height() > 0)
+        {
+            width = (double)rc.Width() / rc.Height();
+        }
+    }
+    else
+    {
+        if(rc.Width() > 0)
+        {
+            width = (double)rc.Height() / rc.Width();
+        }
+    }
+
+    int nextChild = 0;
+    while(nextChild < childrenCount)
+    {
+        int childrenUsed;
+        rows.Add(KDirStat_CalcutateNextRow(parent, nextChild, width, childrenUsed, childWidth));
+        childrenPerRow.Add(childrenUsed);
+        nextChild += childrenUsed;
+    }
+
+    return horizontalRows;
+}
+
+template<class Access>
+double CTreemapLayout<Access>::KDirStat_CalcutateNextRow(Node parent, const int nextChild, double width, int& childrenUsed, CArray<double, double>& childWidth)
+{
+    int i = 0;
+    static const double _minProportion = 0.4;
+    ASSERT(_minProportion < 1);
+
+    const int childrenCount = Access::GetChildrenCount(parent);
+    ASSERT(nextChild < childrenCount);
+    ASSERT(width >= 1.0);
+
+    const double mySize = (double)Access::GetSize(parent);
+    ASSERT(mySize > 0);
+    ULONGLONG sizeUsed = 0;
+    double rowHeight = 0;
+
+    for(i = nextChild; i < childrenCount; i++)
+    {
+        ULONGLONG childSize = Access::GetSize(Access::GetChild(parent, i));
+        if(childSize == 0)
+        {
+            ASSERT(i > nextChild);  // first child has size > 0
+            break;
+        }
+
+        sizeUsed += childSize;
+        double virtualRowHeight = sizeUsed / mySize;
+        ASSERT(virtualRowHeight > 0);
+        ASSERT(virtualRowHeight <= 1);
+
+        // Rectangle(mySize)    = width * 1.0
+        // Rectangle(childSize) = childWidth * virtualRowHeight
+        // Rectangle(childSize) = childSize / mySize * width
+
+        double childWidth_ = childSize / mySize * width / virtualRowHeight;
+
+        if(childWidth_ / virtualRowHeight < _minProportion)
+        {
+            ASSERT(i > nextChild); // because width >= 1 and _minProportion < 1.
+            // For the first child we have:
+            // childWidth / rowHeight
+            // = childSize / mySize * width / rowHeight / rowHeight
+            // = childSize * width / sizeUsed / sizeUsed * mySize
+            // > childSize * mySize / sizeUsed / sizeUsed
+            // > childSize * childSize / childSize / childSize
+            // = 1 > _minProportion.
+            break;
+        }
+        rowHeight = virtualRowHeight;
+    }
+    ASSERT(i > nextChild);
+
+    // Now i-1 is the last child used
+    // and rowHeight is the height of the row.
+
+    // We add the rest of the children, if their size is 0.
+    while(i < childrenCount && Access::GetSize(Access::GetChild(parent, i)) == 0)
+    {
+        i++;
+    }
+
+    childrenUsed = i - nextChild;
+
+    // Now as we know the rowHeight, we compute the widths of our children.
+    for(i = 0; i < childrenUsed; i++)
+    {
+        // Rectangle(1.0 * 1.0) = mySize
+        double rowSize = mySize * rowHeight;
+        double childSize = (double)Access::GetSize(Access::GetChild(parent, nextChild + i));
+        double cw = childSize / rowSize;
+        ASSERT(cw >= 0);
+        childWidth[nextChild + i]= cw;
+    }
+
+    return rowHeight;
+}
+
+
+// The classical squarification method.
+//
+template<class Access>
+template<class Visitor>
+void CTreemapLayout<Access>::SequoiaView(Node parent, const CRect& rc, Visitor& visitor)
+{
+    // Rest rectangle to fill
+    CRect remaining(rc);
+
+    ASSERT(remaining.Width() > 0);
+    ASSERT(remaining.Height() > 0);
+
+    const int childrenCount = Access::GetChildrenCount(parent);
+
+    // Size of rest rectangle
+    ULONGLONG remainingSize = Access::GetSize(parent);
+    ASSERT(remainingSize > 0);
+
+    // Scale factor
+    const double sizePerSquarePixel = (double)Access::GetSize(parent) / remaining.Width() / remaining.Height();
+
+    // First child for next row
+    int head = 0;
+
+    // At least one child left
+    while(head < childrenCount)
+    {
+        ASSERT(remaining.Width() > 0);
+        ASSERT(remaining.Height() > 0);
+
+        // How we divide the remaining rectangle
+        bool horizontal = (remaining.Width() >= remaining.Height());
+
+        // Height of the new row
+        const int height = horizontal ? remaining.Height() : remaining.Width();
+
+        // Square of height in size scale for ratio formula
+        const double hh = (height * height) * sizePerSquarePixel;
+        ASSERT(hh > 0);
+
+        // Row will be made up of child(rowBegin)...child(rowEnd - 1)
+        int rowBegin = head;
+        int rowEnd = head;
+
+        // Worst ratio so far
+        double worst = DBL_MAX;
+
+        // Maximum size of children in row
+        ULONGLONG rmax = Access::GetSize(Access::GetChild(parent, rowBegin));
+
+        // Sum of sizes of children in row
+        ULONGLONG sum = 0;
+
+        // This condition will hold at least once.
+        while(rowEnd < childrenCount)
+        {
+            // We check a virtual row made up of child(rowBegin)...child(rowEnd) here.
+
+            // Minimum size of child in virtual row
+            ULONGLONG rmin = Access::GetSize(Access::GetChild(parent, rowEnd));
+
+            // If sizes of the rest of the children is zero, we add all of them
+            if(rmin == 0)
+            {
+                rowEnd = childrenCount;
+                break;
+            }
+
+            // Calculate the worst ratio in virtual row.
+            // Formula taken from the "Squarified Treemaps" paper.
+            // (http://http://www.win.tue.nl/~vanwijk/)
+
+            const double ss = ((double)sum + rmin) * ((double)sum + rmin);
+            const double ratio1 = hh * rmax / ss;
+            const double ratio2 = ss / hh / rmin;
+
+            const double nextWorst = max(ratio1, ratio2);
+
+            // Will the ratio get worse?
+            if(nextWorst > worst)
+            {
+                // Yes. Don't take the virtual row, but the
+                // real row (child(rowBegin)..child(rowEnd - 1))
+                // made so far.
+                break;
+            }
+
+            // Here we have decided to add child(rowEnd) to the row.
+            sum += rmin;
+            rowEnd++;
+
+            worst = nextWorst;
+        }
+
+        // Row will be made up of child(rowBegin)...child(rowEnd - 1).
+        // sum is the size of the row.
+
+        // As the size of parent is greater than zero, the size of
+        // the first child must have been greater than zero, too.
+        ASSERT(sum > 0);
+
+        // Width of row
+        int width = (horizontal ? remaining.Width() : remaining.Height());
+        ASSERT(width > 0);
+
+        if(sum < remainingSize)
+            width = (int)((double)sum / remainingSize * width);
+        // else: use up the whole width
+        // width may be 0 here.
+
+        // Build the rectangles of children.
+        CRect rcChild;
+        double fBegin;
+        if(horizontal)
+        {
+            rcChild.left = remaining.left;
+            rcChild.right = remaining.left + width;
+            fBegin = remaining.top;
+        }
+        else
+        {
+            rcChild.top = remaining.top;
+            rcChild.bottom = remaining.top + width;
+            fBegin = remaining.left;
+        }
+
+        // Now put the children into their places
+        for(int i = rowBegin; i < rowEnd; i++)
+        {
+            Node child = Access::GetChild(parent, i);
+            int begin = (int)fBegin;
+            double fraction = (double)(Access::GetSize(child)) / sum;
+            double fEnd = fBegin + fraction * height;
+            int end = (int)fEnd;
+
+            bool lastChild = (i == rowEnd - 1 || Access::GetSize(Access::GetChild(parent, i + 1)) == 0);
+
+            if(lastChild)
+            {
+                // Use up the whole height
+                end = (horizontal ? remaining.top + height : remaining.left + height);
+            }
+
+            if(horizontal)
+            {
+                rcChild.top = begin;
+                rcChild.bottom = end;
+            }
+            else
+            {
+                rcChild.left = begin;
+                rcChild.right = end;
+            }
+
+            ASSERT(rcChild.left <= rcChild.right);
+            ASSERT(rcChild.top <= rcChild.bottom);
+
+            ASSERT(rcChild.left >= remaining.left);
+            ASSERT(rcChild.right <= remaining.right);
+            ASSERT(rcChild.top >= remaining.top);
+            ASSERT(rcChild.bottom <= remaining.bottom);
+
+            visitor.Child(child, rcChild, 0);
+
+            if(lastChild)
+                break;
+
+            fBegin = fEnd;
+        }
+
+        // Put the next row into the rest of the rectangle
+        if(horizontal)
+        {
+            remaining.left += width;
+        }
+        else
+        {
+            remaining.top += width;
+        }
+
+        remainingSize -= sum;
+
+        ASSERT(remaining.left <= remaining.right);
+        ASSERT(remaining.top <= remaining.bottom);
+
+        ASSERT(remainingSize >= 0);
+
+        head += (rowEnd - rowBegin);
+
+        if(remaining.Width() <= 0 || remaining.Height() <= 0)
+        {
+            if(head < childrenCount)
+            {
+                Access::SetRectangle(Access::GetChild(parent, head), CRect(-1, -1, -1, -1));
+            }
+
+            break;
+        }
+    }
+    ASSERT(remainingSize == 0);
+    ASSERT(remaining.left == remaining.right || remaining.top == remaining.bottom);
+}
+
+
+// No squarification. Children are arranged alternately horizontally and vertically.
+//
+template<class Access>
+template<class Visitor>
+void CTreemapLayout<Access>::Simple(Node parent, const CRect& rc, DWORD flags, Visitor& visitor)
+{
+#if 1
+    ASSERT(0); // Not used in WinDirStat.
+
+    parent; rc; flags; visitor;
+
+#else
+    ASSERT(Access::GetChildrenCount(parent) > 0);
+    ASSERT(Access::GetSize(parent) > 0);
+
+    const int childrenCount = Access::GetChildrenCount(parent);
+
+    bool horizontal = (flags == 0);
+
+    int width = horizontal ? rc.Width() : rc.Height();
+    ASSERT(width >= 0);
+
+    double fBegin = horizontal ? rc.left : rc.top;
+    int veryEnd = horizontal ? rc.right : rc.bottom;
+
+    int i;
+    for(i = 0; i < childrenCount; i++)
+    {
+        double fraction = (double)(Access::GetSize(Access::GetChild(parent, i))) / Access::GetSize(parent);
+
+        double fEnd = fBegin + fraction * width;
+
+        bool lastChild = (i == childrenCount - 1 || Access::GetSize(Access::GetChild(parent, i + 1)) == 0);
+
+        if(lastChild)
+        {
+            fEnd = veryEnd;
+        }
+
+        int begin = (int)fBegin;
+        int end = (int)fEnd;
+
+        ASSERT(begin <= end);
+        ASSERT(end <= veryEnd);
+
+        CRect rcChild;
+        if(horizontal)
+        {
+            rcChild.left = begin;
+            rcChild.right = end;
+            rcChild.top = rc.top;
+            rcChild.bottom = rc.bottom;
+        }
+        else
+        {
+            rcChild.top = begin;
+            rcChild.bottom = end;
+            rcChild.left = rc.left;
+            rcChild.right = rc.right;
+        }
+
+        visitor.Child(Access::GetChild(parent, i), rcChild, flags == 0 ? 1 : 0);
+
+        if(lastChild)
+        {
+            i++;
+            break;
+        }
+
+        fBegin = fEnd;
+    }
+    if(i < childrenCount)
+    {
+        Access::SetRectangle(Access::GetChild(parent, i), CRect(-1, -1, -1, -1));
+    }
+#endif
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+template<class Access, int style>
+CTreemapEngine<Access, style>::CTreemapEngine(CTreemap& treemap)
+    : m_treemap(treemap)
+    , m_bitmap(NULL)
+    , m_cushionShading(false)
+    , m_gridWidth(0)
+{
+}
+
+template<class Access, int style>
+void CTreemapEngine<Access, style>::DrawTreemap(CDC *pdc, CRect rc, Node root)
+{
+    ASSERT(m_treemap.m_options.style == style);
+
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    m_treemap.DrawFrame(pdc, rc);
+
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    m_treemap.m_renderArea = rc;
+
+    // The rectangles are those of this drawing now.
+    m_treemap.m_hitIndexValid = false;
+
+    if(Access::GetSize(root) == 0)
+    {
+        pdc->FillSolidRect(rc, RGB(0,0,0));
+        return;
+    }
+
+    double surface[4];
+    for(int i = 0; i < _countof(surface); i++)
+    {
+        surface[i]= 0;
+    }
+
+    // The pixels, reused from the last drawing
+    CFramebuffer frame(rc.Width() * rc.Height());
+    CColorRefArray& bitmap_bits = frame.GetBits();
+
+    // As in CTreemap::DrawTreemap()
+    const int threadCount = m_treemap.GetRenderThreadCount(rc.Height());
+    m_treemap.m_collectLeaves = (threadCount > 1);
+    m_treemap.m_leafCount = 0;
+
+    m_bitmap = &bitmap_bits;
+    m_cushionShading = m_treemap.IsCushionShading();
+    m_gridWidth = m_treemap.m_options.grid ? 1 : 0;
+
+    RecurseDrawGraph(root, rc, true, surface, m_treemap.m_options.height, 0);
+
+    m_bitmap = NULL;
+
+    m_treemap.m_collectLeaves = false;
+    if(threadCount > 1)
+    {
+        m_treemap.RenderLeaves(bitmap_bits, threadCount);
+    }
+
+    m_treemap.PaintBitmap(pdc, rc, bitmap_bits);
+}
+
+// CTreemap::RecurseDrawGraph() without the hit index, the layout cache,
+// the strips and the pending nodes.
+template<class Access, int style>
+void CTreemapEngine<Access, style>::RecurseDrawGraph(Node item, const CRect& rc, bool asroot, const double *psurface, double h, DWORD flags)
+{
+    ASSERT(rc.Width() >= 0);
+    ASSERT(rc.Height() >= 0);
+
+    ASSERT(Access::GetSize(item) > 0);
+
+    if(m_treemap.m_callback != NULL)
+    {
+        m_treemap.m_callback->TreemapDrawingCallback();
+    }
+
+    Access::SetRectangle(item, rc);
+
+    if(rc.Width() <= m_gridWidth || rc.Height() <= m_gridWidth)
+    {
+        return;
+    }
+
+    double surface[4];
+
+    if(m_cushionShading)
+    {
+        for(int i = 0; i < _countof(surface); i++)
+        {
+            surface[i]= psurface[i];
+        }
+
+        if(!asroot)
+        {
+            CTreemap::AddRidge(rc, surface, h);
+        }
+    }
+
+    if(Access::IsLeaf(item))
+    {
+        m_treemap.RenderLeaf(*m_bitmap, rc, surface, Access::GetGraphColor(item));
+    }
+    else
+    {
+        ASSERT(Access::GetChildrenCount(item) > 0);
+
+        DrawChildren(item, rc, surface, h, flags);
+    }
+}
+
+template<class Access, int style>
+void CTreemapEngine<Access, style>::DrawChildren(Node parent, const CRect& rc, const double *surface, double h, DWORD flags)
+{
+    CHILDREN children = { this, surface, h * m_treemap.m_options.scaleFactor };
+
+    // style is a constant here, so this switch costs nothing.
+    switch (style)
+    {
+    case CTreemap::KDirStatStyle:
+        {
+            CTreemapLayout<Access>::KDirStat(parent, rc, children);
+        }
+        break;
+
+    case CTreemap::SequoiaViewStyle:
+        {
+            CTreemapLayout<Access>::SequoiaView(parent, rc, children);
+        }
+        break;
+
+    case CTreemap::SimpleStyle:
+        {
+            CTreemapLayout<Access>::Simple(parent, rc, flags, children);
+        }
+        break;
+    }
+}
+
+template<class Access>
+void DrawTreemapStatic(CTreemap& treemap, CDC *pdc, const CRect& rc, typename Access::Node root, const CTreemap::Options *options)
+{
+    if(options != NULL)
+    {
+        treemap.SetOptions(options);
+    }
+
+    switch (treemap.GetOptions().style)
+    {
+    case CTreemap::KDirStatStyle:
+        {
+            CTreemapEngine<Access, CTreemap::KDirStatStyle> engine(treemap);
+            engine.DrawTreemap(pdc, rc, root);
+        }
+        break;
+
+    case CTreemap::SequoiaViewStyle:
+        {
+            CTreemapEngine<Access, CTreemap::SequoiaViewStyle> engine(treemap);
+            engine.DrawTreemap(pdc, rc, root);
+        }
+        break;
+
+    case CTreemap::SimpleStyle:
+        {
+            CTreemapEngine<Access, CTreemap::SimpleStyle> engine(treemap);
+            engine.DrawTreemap(pdc, rc, root);
+        }
+        break;
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+template<class SourceAccess>
+void CTreemapCompactTree::Build(typename SourceAccess::Node root)
+{
+    typedef typename SourceAccess::Node SourceNode;
+
+    RemoveAll();
+
+    const INT_PTR count = RecurseCount<SourceAccess>(root);
+
+    // Where each node comes from. The nodes are their own queue:
+    // node i appends its children, when it is copied.
+    CArray<SourceNode, SourceNode> sources;
+    sources.SetSize(count);
+    SetNodeCount(count);
+
+    sources[0] = root;
+    INT_PTR next = 1;
+    for(INT_PTR i = 0; i < count; i++)
+    {
+        const SourceNode source = sources[i];
+        CNode& node = m_nodes[i];
+
+        node.m_size = SourceAccess::GetSize(source);
+        node.m_rect.SetRectEmpty();
+        node.m_childCount = SourceAccess::IsLeaf(source) ? 0 : SourceAccess::GetChildrenCount(source);
+        node.m_childOffset = int(next - i);
+        node.m_color = (node.m_childCount == 0) ? SourceAccess::GetGraphColor(source) : 0;
+
+        for(int c = 0; c < node.m_childCount; c++)
+        {
+            sources[next++] = SourceAccess::GetChild(source, c);
+        }
+    }
+    ASSERT(next == count);
+}
+
+template<class SourceAccess>
+INT_PTR CTreemapCompactTree::RecurseCount(typename SourceAccess::Node node)
+{
+    INT_PTR count = 1;
+    if(!SourceAccess::IsLeaf(node))
+    {
+        for(int i = 0; i < SourceAccess::GetChildrenCount(node); i++)
+        {
+            count += RecurseCount<SourceAccess>(SourceAccess::GetChild(node, i));
+        }
+    }
+    return count;
+}
+
+#endif // __WDS_TREEMAPENGINE_H__
@@ -0,0 +1,335 @@
+// VisibleRowModel.cpp - Implementation of CVisibleRowModel
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "VisibleRowModel.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+CVisibleRowModel::CVisibleRowModel()
+    : m_root(NULL)
+    , m_random(2463534242u)
+{
+}
+
+CVisibleRowModel::~CVisibleRowModel()
+{
+    Free(m_root);
+}
+
+int CVisibleRowModel::GetCount() const
+{
+    return Size(m_root);
+}
+
+CTreeListItem *CVisibleRowModel::GetItem(int row) const
+{
+    ASSERT(row >= 0 && row < GetCount());
+
+    const NODE *t = m_root;
+    for(;;)
+    {
+        const int left = Size(t->left);
+        if(row < left)
+        {
+            t = t->left;
+        }
+        else if(row == left)
+        {
+            return t->item;
+        }
+        else
+        {
+            row -= left + 1;
+            t = t->right;
+        }
+    }
+}
+
+int CVisibleRowModel::GetRow(const NODE *node) const
+{
+    int row = Size(node->left);
+    for(const NODE *t = node; t->parent != NULL; t = t->parent)
+    {
+        if(t == t->parent->right)
+        {
+            row += Size(t->parent->left) + 1;
+        }
+    }
+    return row;
+}
+
+void CVisibleRowModel::GetItems(int row, int count, CTreeListItem **items) const
+{
+    ASSERT(row >= 0 && count >= 0 && row + count <= GetCount());
+    if(count == 0)
+    {
+        return;
+    }
+
+    // Find the first node, then walk in order.
+    const NODE *t = m_root;
+    for(;;)
+    {
+        const int left = Size(t->left);
+        if(row < left)
+        {
+            t = t->left;
+        }
+        else if(row == left)
+        {
+            break;
+        }
+        else
+        {
+            row -= left + 1;
+            t = t->right;
+        }
+    }
+
+    for(int i = 0; i < count; i++)
+    {
+        items[i] = t->item;
+
+        if(t->right != NULL)
+        {
+            t = t->right;
+            while(t->left != NULL)
+            {
+                t = t->left;
+            }
+        }
+        else
+        {
+            while(t->parent != NULL && t == t->parent->right)
+            {
+                t = t->parent;
+            }
+            t = t->parent;
+        }
+    }
+}
+
+void CVisibleRowModel::Insert(int row, CTreeListItem * const *items, int count, NODE **nodes)
+{
+    ASSERT(row >= 0 && row <= GetCount());
+    if(count == 0)
+    {
+        return;
+    }
+
+    NODE *left;
+    NODE *right;
+    Split(m_root, row, left, right);
+    m_root = Merge(Merge(left, Build(items, count, nodes)), right);
+    m_root->parent = NULL;
+}
+
+void CVisibleRowModel::Remove(int row, int count)
+{
+    ASSERT(row >= 0 && count >= 0 && row + count <= GetCount());
+    if(count == 0)
+    {
+        return;
+    }
+
+    NODE *left;
+    NODE *middle;
+    NODE *right;
+    Split(m_root, row, left, right);
+    Split(right, count, middle, right);
+    Free(middle);
+    m_root = Merge(left, right);
+    if(m_root != NULL)
+    {
+        m_root->parent = NULL;
+    }
+}
+
+void CVisibleRowModel::RemoveAll()
+{
+    Free(m_root);
+    m_root = NULL;
+}
+
+void CVisibleRowModel::Move(int from, int count, int to)
+{
+    ASSERT(from >= 0 && count >= 0 && from + count <= GetCount());
+    ASSERT(to >= 0 && to <= GetCount());
+    if(count == 0 || (to >= from && to <= from + count))
+    {
+        return;
+    }
+
+    NODE *left;
+    NODE *middle;
+    NODE *right;
+    Split(m_root, from, left, right);
+    Split(right, count, middle, right);
+    m_root = Merge(left, right);
+
+    if(to > from)
+    {
+        to -= count;
+    }
+    Split(m_root, to, left, right);
+    m_root = Merge(Merge(left, middle), right);
+    m_root->parent = NULL;
+}
+
+int CVisibleRowModel::Size(const NODE *t)
+{
+    return (t == NULL ? 0 : t->size);
+}
+
+void CVisibleRowModel::Update(NODE *t)
+{
+    t->size = 1 + Size(t->left) + Size(t->right);
+    if(t->left != NULL)
+    {
+        t->left->parent = t;
+    }
+    if(t->right != NULL)
+    {
+        t->right->parent = t;
+    }
+}
+
+// left receives the first count rows of t, right the rest.
+void CVisibleRowModel::Split(NODE *t, int count, NODE *& left, NODE *& right)
+{
+    if(t == NULL)
+    {
+        left = right = NULL;
+        return;
+    }
+
+    if(Size(t->left) < count)
+    {
+        Split(t->right, count - Size(t->left) - 1, t->right, right);
+        Update(t);
+        left = t;
+    }
+    else
+    {
+        Split(t->left, count, left, t->left);
+        Update(t);
+        right = t;
+    }
+}
+
+CVisibleRowModel::NODE *CVisibleRowModel::Merge(NODE *left, NODE *right)
+{
+    if(left == NULL)
+    {
+        return right;
+    }
+    if(right == NULL)
+    {
+        return left;
+    }
+
+    if(left->priority > right->priority)
+    {
+        left->right = Merge(left->right, right);
+        Update(left);
+        return left;
+    }
+    else
+    {
+        right->left = Merge(left, right->left);
+        Update(right);
+        return right;
+    }
+}
+
+// Sets sizes and parents in a freshly built subtree and returns its size.
+int CVisibleRowModel::FixSubtree(NODE *t)
+{
+    if(t == NULL)
+    {
+        return 0;
+    }
+    t->size = 1 + FixSubtree(t->left) + FixSubtree(t->right);
+    Update(t);
+    return t->size;
+}
+
+void CVisibleRowModel::Free(NODE *t)
+{
+    if(t == NULL)
+    {
+        return;
+    }
+    Free(t->left);
+    Free(t->right);
+    delete t;
+}
+
+// Builds a treap of the items in linear time: the nodes come in row order,
+// so the right spine of the tree built so far is all we have to look at.
+CVisibleRowModel::NODE *CVisibleRowModel::Build(CTreeListItem * const *items, int count, NODE **nodes)
+{
+    NODE **spine = new NODE *[count];
+    int height = 0;
+
+    for(int i = 0; i < count; i++)
+    {
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+
+        NODE *node = new NODE;
+        node->left = NULL;
+        node->right = NULL;
+        node->parent = NULL;
+        node->item = items[i];
+        node->size = 1;
+        node->priority = m_random;
+
+        NODE *last = NULL;
+        while(height > 0 && spine[height - 1]->priority < node->priority)
+        {
+            last = spine[--height];
+        }
+        node->left = last;
+        if(height > 0)
+        {
+            spine[height - 1]->right = node;
+        }
+        spine[height++] = node;
+
+        if(nodes != NULL)
+        {
+            nodes[i] = node;
+        }
+    }
+
+    NODE *root = spine[0];
+    delete [] spine;
+
+    FixSubtree(root);
+    root->parent = NULL;
+    return root;
+}
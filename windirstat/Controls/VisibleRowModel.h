@@ -0,0 +1,83 @@
+// VisibleRowModel.h - Declaration of CVisibleRowModel
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_VISIBLEROWMODEL_H__
+#define __WDS_VISIBLEROWMODEL_H__
+#pragma once
+
+class CTreeListItem;
+
+//
+// CVisibleRowModel. The rows of the CTreeListControl, i.e. the flattened
+// tree of the visible items, as an order-statistics tree (a treap whose
+// nodes know the sizes of their subtrees).
+// Row to item and item to row (via the item's NODE) take O(log n),
+// inserting or removing a block of k rows O(k + log n), moving a block
+// O(log n). The list control runs in owner-data mode on top of this.
+// Nothing here depends on MFC or Windows.
+//
+class CVisibleRowModel
+{
+public:
+    struct NODE
+    {
+        NODE *left;
+        NODE *right;
+        NODE *parent;
+        CTreeListItem *item;
+        int size;           // Rows in this subtree
+        unsigned priority;  // Heap order of the treap
+    };
+
+    CVisibleRowModel();
+    ~CVisibleRowModel();
+
+    int GetCount() const;
+    CTreeListItem *GetItem(int row) const;
+    int GetRow(const NODE *node) const;
+
+    // Copies the items of count rows beginning at row into items.
+    void GetItems(int row, int count, CTreeListItem **items) const;
+
+    // Inserts count rows before row. nodes (if not NULL) receives their nodes.
+    void Insert(int row, CTreeListItem * const *items, int count, NODE **nodes);
+    void Remove(int row, int count);
+    void RemoveAll();
+
+    // Moves count rows beginning at from before row to (counted
+    // before the move). The nodes stay valid.
+    void Move(int from, int count, int to);
+
+private:
+    static int Size(const NODE *t);
+    static void Update(NODE *t);
+    static void Split(NODE *t, int count, NODE *& left, NODE *& right);
+    static NODE *Merge(NODE *left, NODE *right);
+    static int FixSubtree(NODE *t);
+    static void Free(NODE *t);
+    NODE *Build(CTreeListItem * const *items, int count, NODE **nodes);
+
+    NODE *m_root;
+    unsigned m_random;      // xorshift state for the priorities
+};
+
+#endif // __WDS_VISIBLEROWMODEL_H__
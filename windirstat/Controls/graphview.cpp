@@ -26,6 +26,9 @@
 #include "dirstatview.h"
 #include "item.h"
 #include "selectobject.h"
+#include "MemoryAccounting.h"
+#include "DuplicateFinder.h"
+#include "WorkLimiter.h"
 
 #include "graphview.h"
 
@@ -33,6 +36,91 @@
 #define new DEBUG_NEW
 #endif
 
+namespace
+{
+    const ULONGLONG FIRSTIMAGE_TICKS = 50;  // Budget of the first image of a progressive drawing
+    const ULONGLONG DRAWING_TICKS = 50;     // Budget of each further step (ContinueDrawing())
+    const ULONGLONG DIRTY_MAX_TICKS = 2000; // How long a refresh may show the old treemap
+
+    bool IsChildOf(const CItem *parent, const CItem *item)
+    {
+        for(int i = 0; i < parent->GetChildrenCount(); i++)
+        {
+            if(parent->GetChild(i) == item)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Size of the pixels of a (device dependent) bitmap
+    LONGLONG GetBitmapBytes(CBitmap& bitmap)
+    {
+        BITMAP bm;
+        if(bitmap.m_hObject == NULL || bitmap.GetBitmap(&bm) == 0)
+        {
+            return 0;
+        }
+        return LONGLONG(bm.bmWidthBytes) * bm.bmHeight;
+    }
+
+    void DeleteAccountedBitmap(CBitmap& bitmap)
+    {
+        CMemoryAccounting::Add(MEM_TREEMAP, -GetBitmapBytes(bitmap), -1);
+        bitmap.DeleteObject();
+    }
+
+    // One group per extension
+    class CExtensionClassifier: public CTreemapHighlight::Classifier
+    {
+    public:
+        CExtensionClassifier(CMap<CString, LPCTSTR, int, int>& groups)
+            : m_groups(groups)
+        {
+            m_groups.RemoveAll();
+        }
+
+        virtual int Classify(const CItem *item)
+        {
+            if(item->GetType() != IT_FILE)
+            {
+                return -1;
+            }
+
+            CString extension = item->GetExtension();
+            extension.MakeLower();
+
+            int group;
+            if(!m_groups.Lookup(extension, group))
+            {
+                group = (int)m_groups.GetCount();
+                m_groups.SetAt(extension, group);
+            }
+            return group;
+        }
+
+    private:
+        CMap<CString, LPCTSTR, int, int>& m_groups;
+    };
+
+    class CDuplicateClassifier: public CTreemapHighlight::Classifier
+    {
+    public:
+        CDuplicateClassifier(const CDuplicateFinder *duplicates)
+            : m_duplicates(duplicates)
+        {
+        }
+
+        virtual int Classify(const CItem *item)
+        {
+            return m_duplicates->IsRedundantCopy(item) ? 0 : -1;
+        }
+
+    private:
+        const CDuplicateFinder *m_duplicates;
+    };
+}
 
 IMPLEMENT_DYNCREATE(CGraphView, CView)
 
@@ -54,11 +142,28 @@ CGraphView::CGraphView()
     m_showTreemap = true;
     m_size.cx = m_size.cy = 0;
     m_dimmedSize.cx = m_dimmedSize.cy = 0;
+    m_bitmapZoom = NULL;
+    m_bitmapOptionsHash = 0;
+    m_bitmapColorSerial = 0;
     m_timer = 0;
+    m_showLiveTreemap = true;
+    m_liveSize.cx = m_liveSize.cy = 0;
+    m_dirtySince = 0;
+    m_dirtyColorSerial = 0;
+    m_overlaySize.cx = m_overlaySize.cy = 0;
+    m_overlayValid = false;
+    m_overlayShowsExtension = false;
+    m_overlayDuplicates = false;
+    m_overlayColor = 0;
+
+    // Changes of the shading options only re-shade.
+    m_treemap.SetCacheLayout(true);
+    m_treemap.SetHitIndex(true);
 }
 
 CGraphView::~CGraphView()
 {
+    EmptyView();
 }
 
 void CGraphView::TreemapDrawingCallback()
@@ -85,6 +190,21 @@ void CGraphView::ShowTreemap(bool show)
     m_showTreemap = show;
 }
 
+bool CGraphView::IsShowLiveTreemap()
+{
+    return m_showLiveTreemap;
+}
+
+void CGraphView::ShowLiveTreemap(bool show)
+{
+    m_showLiveTreemap = show;
+    if(!show)
+    {
+        FreeLiveTreemap();
+        Invalidate();
+    }
+}
+
 BOOL CGraphView::PreCreateWindow(CREATESTRUCT& cs)
 {
     // We don't want a background brush
@@ -166,11 +286,10 @@ void CGraphView::OnDraw(CDC* pDC)
             CDC dcmem;
             dcmem.CreateCompatibleDC(pDC);
 
-            if(!IsDrawn())
+            if(!IsDrawn() && !RestoreFromCache())
             {
-                CWaitCursor wc;
-
                 m_bitmap.CreateCompatibleBitmap(pDC, m_size.cx, m_size.cy);
+                CMemoryAccounting::Add(MEM_TREEMAP, GetBitmapBytes(m_bitmap), 1);
 
                 CSelectObject sobmp(&dcmem, &m_bitmap);
 
@@ -179,25 +298,423 @@ void CGraphView::OnDraw(CDC* pDC)
                     DrawZoomFrame(&dcmem, rc);
                 }
 
-                m_treemap.DrawTreemap(&dcmem, rc, GetDocument()->GetZoomItem(), GetOptions()->GetTreemapOptions());
+                // The top levels now, the rest in OnIdle() (ContinueDrawing()).
+                m_treemap.BeginDrawing(&dcmem, rc, GetDocument()->GetZoomItem(), GetOptions()->GetTreemapOptions());
+                if(m_treemap.IsDrawing())
+                {
+                    CWorkLimiter limiter;
+                    limiter.Start(FIRSTIMAGE_TICKS);
+                    const bool done = m_treemap.ContinueDrawing(&limiter);
+                    m_treemap.PaintDrawing(&dcmem);
+                    if(done)
+                    {
+                        m_treemap.EndDrawing();
+                    }
+                }
 
                 // Cause OnIdle() to be called once.
                 ::PostThreadMessage(::GetCurrentThreadId(), WM_NULL, 0, 0);
             }
 
-            CSelectObject sobmp2(&dcmem, &m_bitmap);
+            // The rectangles of the deeper items are not yet valid.
+            CBitmap *image = (m_treemap.IsDrawing() ? &m_bitmap : PrepareOverlay(pDC));
+
+            CSelectObject sobmp2(&dcmem, image);
 
             pDC->BitBlt(0, 0, m_size.cx, m_size.cy, &dcmem, 0, 0, SRCCOPY);
 
-            DrawHighlights(pDC);
+            if(!m_treemap.IsDrawing())
+            {
+                DrawHighlights(pDC);
+            }
         }
     }
+    else if(root != NULL && IsUpdatePending())
+    {
+        // The old treemap, until DrawDirtyRegions() updates it
+        CDC dcmem;
+        dcmem.CreateCompatibleDC(pDC);
+        CSelectObject sobmp(&dcmem, &m_bitmap);
+        pDC->BitBlt(0, 0, m_size.cx, m_size.cy, &dcmem, 0, 0, SRCCOPY);
+    }
+    else if(root != NULL && m_live.m_hObject != NULL && m_showTreemap && !m_recalculationSuspended)
+    {
+        DrawLiveTreemap(pDC);
+    }
     else
     {
         DrawEmptyView(pDC);
     }
 }
 
+void CGraphView::DrawLiveTreemap(CDC *pDC)
+{
+    const COLORREF gray = RGB(160, 160, 160);
+
+    CRect rc;
+    GetClientRect(rc);
+
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(pDC);
+    CSelectObject sobmp(&dcmem, &m_live);
+    pDC->BitBlt(rc.left, rc.top, m_liveSize.cx, m_liveSize.cy, &dcmem, 0, 0, SRCCOPY);
+
+    // Until the next update after a resize
+    if(rc.Width() > m_liveSize.cx)
+    {
+        CRect r = rc;
+        r.left = r.left + m_liveSize.cx;
+        pDC->FillSolidRect(r, gray);
+    }
+
+    if(rc.Height() > m_liveSize.cy)
+    {
+        CRect r = rc;
+        r.top = r.top + m_liveSize.cy;
+        pDC->FillSolidRect(r, gray);
+    }
+}
+
+// Called by CDirstatApp::OnIdle() during a scan. Draws the partially
+// scanned tree, at most as often as m_liveTreemap allows.
+void CGraphView::UpdateLiveTreemap()
+{
+    CItem *root = GetDocument()->GetRootItem();
+    if(root == NULL || root->IsDone())
+    {
+        return;
+    }
+
+    if(IsUpdatePending())
+    {
+        // Most refreshes are quick. A long one gets the dimmed or the live treemap.
+        if(_GetTickCount64() - m_dirtySince > DIRTY_MAX_TICKS)
+        {
+            CancelDirtyRegions();
+        }
+        return;
+    }
+
+    if(!m_showTreemap || !m_showLiveTreemap || m_recalculationSuspended)
+    {
+        return;
+    }
+
+    if(m_size.cx <= 0 || m_size.cy <= 0 || !m_liveTreemap.IsUpdateDue())
+    {
+        return;
+    }
+
+    CClientDC dc(this);
+
+    if(m_live.m_hObject != NULL && m_liveSize != m_size)
+    {
+        DeleteAccountedBitmap(m_live);
+    }
+    if(m_live.m_hObject == NULL)
+    {
+        m_live.CreateCompatibleBitmap(&dc, m_size.cx, m_size.cy);
+        CMemoryAccounting::Add(MEM_TREEMAP, GetBitmapBytes(m_live), 1);
+        m_liveSize = m_size;
+    }
+
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&dc);
+    CSelectObject sobmp(&dcmem, &m_live);
+    m_liveTreemap.Update(&dcmem, CRect(CPoint(0, 0), m_liveSize), root, GetOptions()->GetTreemapOptions(), GetDocument()->GetExtensionColorSerial());
+
+    Invalidate();
+}
+
+void CGraphView::FreeLiveTreemap()
+{
+    m_liveTreemap.Reset();
+
+    if(m_live.m_hObject != NULL)
+    {
+        DeleteAccountedBitmap(m_live);
+    }
+}
+
+bool CGraphView::IsUpdatePending()
+{
+    return m_dirtyItems.GetSize() > 0;
+}
+
+// Remembers item and the rectangles around it, which are needed to
+// find out later, what has moved. Returns false, if only a complete
+// redraw will do.
+bool CGraphView::RecordDirtyItem(CItem *item)
+{
+    CItem *root = GetDocument()->GetRootItem();
+    CItem *zoom = GetDocument()->GetZoomItem();
+
+    if(root == NULL || !IsDrawn() || m_treemap.IsDrawing())
+    {
+        return false;
+    }
+
+    if(!IsUpdatePending() && !root->IsDone())
+    {
+        return false;
+    }
+
+    if(item == zoom || !zoom->IsAncestorOf(item))
+    {
+        return false;
+    }
+
+    // The items must not overlap. The earlier dirty items may be gone
+    // already, so they are only compared.
+    for(INT_PTR i = 0; i < m_dirtyItems.GetSize(); i++)
+    {
+        const INT_PTR end = (i + 1 < m_dirtyItems.GetSize() ? m_dirtyPathStarts[i + 1] : m_dirtyPaths.GetSize());
+        if(item->IsAncestorOf(m_dirtyPaths[end - 1]))
+        {
+            return false;
+        }
+
+        for(const CItem *p = item; p != NULL; p = p->GetParent())
+        {
+            if(p == m_dirtyItems[i])
+            {
+                return false;
+            }
+        }
+    }
+
+    if(!IsUpdatePending())
+    {
+        m_dirtySince = _GetTickCount64();
+        m_dirtyColorSerial = GetDocument()->GetExtensionColorSerial();
+    }
+
+    const INT_PTR start = m_dirtyPaths.GetSize();
+    m_dirtyItems.Add(item);
+    m_dirtyPathStarts.Add(start);
+    for(CItem *p = item->GetParent(); p != zoom; p = p->GetParent())
+    {
+        m_dirtyPaths.InsertAt(start, p);
+    }
+    m_dirtyPaths.InsertAt(start, zoom);
+
+    // CItem::SetDone() resets the rectangles of the refreshed ones.
+    for(INT_PTR i = start; i < m_dirtyPaths.GetSize(); i++)
+    {
+        CItem *node = m_dirtyPaths[i];
+        RememberRect(node);
+        for(int c = 0; c < node->GetChildrenCount(); c++)
+        {
+            RememberRect(node->GetChild(c));
+        }
+    }
+
+    return true;
+}
+
+// The first rectangle counts: that of the drawing.
+void CGraphView::RememberRect(CItem *item)
+{
+    CRect rc;
+    if(!m_oldRects.Lookup(item, rc))
+    {
+        m_oldRects.SetAt(item, item->TmiGetRectangle());
+    }
+}
+
+void CGraphView::ClearDirtyItems()
+{
+    m_dirtyItems.RemoveAll();
+    m_dirtyPathStarts.RemoveAll();
+    m_dirtyPaths.RemoveAll();
+    m_oldRects.RemoveAll();
+}
+
+// Falls back to the complete redraw
+void CGraphView::CancelDirtyRegions()
+{
+    const bool pending = IsUpdatePending();
+    ClearDirtyItems();
+
+    if(pending && !GetDocument()->IsRootDone())
+    {
+        Inactivate();
+        m_treemap.DiscardLayout();
+        Invalidate();
+    }
+}
+
+// Called, when the tree is done again. Redraws, per dirty item, the
+// topmost item on its path, whose children have moved, or else the
+// item itself. If the zoom item is concerned, the whole treemap is
+// redrawn as usual.
+void CGraphView::DrawDirtyRegions()
+{
+    ASSERT(IsDrawn());
+
+    CArray<CTreemap::Item *, CTreemap::Item *> targets; // The paths down to the items to redraw
+    CArray<INT_PTR, INT_PTR> targetStarts;
+    CArray<CItem *, CItem *> targetItems;
+    CArray<int, int> targetCounts;
+
+    // Other extension colors change the whole treemap.
+    bool complete = (GetDocument()->GetExtensionColorSerial() != m_dirtyColorSerial);
+
+    for(INT_PTR i = 0; i < m_dirtyItems.GetSize() && !complete; i++)
+    {
+        const INT_PTR end = (i + 1 < m_dirtyItems.GetSize() ? m_dirtyPathStarts[i + 1] : m_dirtyPaths.GetSize());
+
+        CArray<CItem *, CItem *> path;
+        for(INT_PTR j = m_dirtyPathStarts[i]; j < end; j++)
+        {
+            path.Add(m_dirtyPaths[j]);
+        }
+        path.Add(m_dirtyItems[i]);
+
+        const int level = FindChangedLevel(path);
+        if(level < 0)
+        {
+            complete = true;
+            break;
+        }
+
+        targetStarts.Add(targets.GetSize());
+        targetCounts.Add(level + 1);
+        targetItems.Add(path[level]);
+        for(int j = 0; j <= level; j++)
+        {
+            targets.Add(path[j]);
+        }
+    }
+
+    ClearDirtyItems();
+
+    if(complete)
+    {
+        Inactivate();
+        m_treemap.DiscardLayout();
+        return;
+    }
+
+    CClientDC dc(this);
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&dc);
+    CSelectObject sobmp(&dcmem, &m_bitmap);
+
+    for(INT_PTR i = 0; i < targetStarts.GetSize(); i++)
+    {
+        // Within another target?
+        bool contained = false;
+        for(INT_PTR j = 0; j < targetItems.GetSize() && !contained; j++)
+        {
+            contained = (j != i && targetItems[j]->IsAncestorOf(targetItems[i]) && (targetItems[j] != targetItems[i] || j < i));
+        }
+
+        if(!contained)
+        {
+            m_treemap.DrawTreemapPart(&dcmem, targets.GetData() + targetStarts[i], targetCounts[i]);
+        }
+    }
+
+    DiscardHighlights();
+}
+
+// path is the zoom item ... dirty item. Lays out the path anew, down
+// from the zoom item, until the children of a node have moved. Returns
+// the level of that node, or -1, if the zoom item itself has changed.
+// The dirty item may be gone; it is only compared.
+int CGraphView::FindChangedLevel(const CArray<CItem *, CItem *>& path)
+{
+    if(path[0] != GetDocument()->GetZoomItem())
+    {
+        return -1;
+    }
+
+    CRect rc;
+    VERIFY(m_oldRects.Lookup(path[0], rc));
+    path[0]->TmiSetRectangle(rc);
+
+    const int gridWidth = m_treemap.GetOptions().grid ? 1 : 0;
+    const int last = (int)path.GetSize() - 1;
+    for(int level = 0; level < last; level++)
+    {
+        CItem *node = path[level];
+        if(node->TmiGetSize() == 0)
+        {
+            return level - 1;
+        }
+
+        // Not subdivided
+        const CRect& rcNode = node->TmiGetRectangle();
+        if(rcNode.Width() <= gridWidth || rcNode.Height() <= gridWidth)
+        {
+            return level;
+        }
+
+        m_treemap.LayoutChildren(node);
+
+        if(!IsChildOf(node, path[level + 1]) || HaveChildrenMoved(node))
+        {
+            return level;
+        }
+    }
+
+    return (path[last]->TmiGetSize() > 0 ? last : last - 1);
+}
+
+bool CGraphView::HaveChildrenMoved(const CItem *parent)
+{
+    for(int i = 0; i < parent->GetChildrenCount(); i++)
+    {
+        const CItem *child = parent->GetChild(i);
+
+        CRect rc;
+        if(!m_oldRects.Lookup(const_cast<CItem *>(child), rc))
+        {
+            // New
+            if(child->TmiGetSize() > 0)
+            {
+                return true;
+            }
+        }
+        else if(child->TmiGetSize() > 0 ? rc != child->TmiGetRectangle() : !rc.IsRectEmpty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called by CDirstatApp::OnIdle(). Renders the next levels of a
+// progressive drawing. Returns true, if there is nothing more to do.
+bool CGraphView::ContinueDrawing()
+{
+    if(!m_treemap.IsDrawing())
+    {
+        return true;
+    }
+
+    CWorkLimiter limiter;
+    limiter.Start(DRAWING_TICKS);
+    const bool done = m_treemap.ContinueDrawing(&limiter);
+
+    CClientDC dc(this);
+    CDC dcmem;
+    dcmem.CreateCompatibleDC(&dc);
+    CSelectObject sobmp(&dcmem, &m_bitmap);
+    m_treemap.PaintDrawing(&dcmem);
+    DiscardHighlights();
+
+    if(done)
+    {
+        m_treemap.EndDrawing();
+    }
+
+    Invalidate();
+
+    return done;
+}
+
 void CGraphView::DrawZoomFrame(CDC *pdc, CRect& rc)
 {
     const int w = 4;
@@ -222,62 +739,124 @@ void CGraphView::DrawZoomFrame(CDC *pdc, CRect& rc)
     rc.DeflateRect(w, w);
 }
 
+// The extension and duplicate highlights are in the overlay.
 void CGraphView::DrawHighlights(CDC *pdc)
 {
-    switch (GetMainFrame()->GetLogicalFocus())
+    if(GetMainFrame()->GetLogicalFocus() == LF_DIRECTORYLIST)
     {
-    case LF_DIRECTORYLIST:
         DrawSelection(pdc);
-        break;
-    case LF_EXTENSIONLIST:
-        DrawHighlightExtension(pdc);
-        break;
     }
 }
 
-void CGraphView::DrawHighlightExtension(CDC *pdc)
+// Returns m_overlay, or m_bitmap, if nothing is highlighted. Collects
+// the rectangles, if the treemap has changed, and renders the overlay,
+// if the highlighting has changed. Otherwise it only returns m_overlay.
+CBitmap *CGraphView::PrepareOverlay(CDC *pdc)
 {
-    CWaitCursor wc;
+    const bool extension = (GetMainFrame()->GetLogicalFocus() == LF_EXTENSIONLIST);
+    const bool duplicates = GetDocument()->IsHighlightingDuplicates();
+    if(!extension && !duplicates)
+    {
+        return &m_bitmap;
+    }
 
-    CPen pen(PS_SOLID, 1, GetOptions()->GetTreemapHighlightColor());
-    CSelectObject sopen(pdc, &pen);
-    CSelectStockObject sobrush(pdc, NULL_BRUSH);
-    RecurseHighlightExtension(pdc, GetDocument()->GetZoomItem());
-}
+    CString highlightExtension;
+    if(extension)
+    {
+        highlightExtension = GetDocument()->GetHighlightExtension();
+        highlightExtension.MakeLower();
 
-void CGraphView::RecurseHighlightExtension(CDC *pdc, const CItem *item)
-{
-    CRect rc(item->TmiGetRectangle());
-    if(rc.Width() <= 0 || rc.Height() <= 0)
+        if(!m_extensionHighlight.IsValid())
+        {
+            CExtensionClassifier classifier(m_extensionGroups);
+            m_extensionHighlight.Build(GetDocument()->GetZoomItem(), &classifier);
+        }
+    }
+
+    if(duplicates && !m_duplicateHighlight.IsValid())
     {
-        return;
+        CDuplicateClassifier classifier(GetDocument()->GetDuplicates());
+        m_duplicateHighlight.Build(GetDocument()->GetZoomItem(), &classifier);
     }
 
-    GetWDSApp()->PeriodicalUpdateRamUsage();
+    const COLORREF color = GetOptions()->GetTreemapHighlightColor();
+    if(m_overlayValid
+        && m_overlayShowsExtension == extension
+        && m_overlayExtension == highlightExtension
+        && m_overlayDuplicates == duplicates
+        && m_overlayColor == color)
+    {
+        return &m_overlay;
+    }
 
-    if(item->TmiIsLeaf())
+    if(m_overlay.m_hObject != NULL && m_overlaySize != m_size)
     {
-        if((item->GetType() == IT_FILE) && (item->GetExtension().CompareNoCase(GetDocument()->GetHighlightExtension()) == 0))
-        {
-            RenderHighlightRectangle(pdc, rc);
-        }
+        DeleteAccountedBitmap(m_overlay);
     }
-    else
+    if(m_overlay.m_hObject == NULL)
     {
-        for(int i = 0; i < item->TmiGetChildrenCount(); i++)
+        m_overlay.CreateCompatibleBitmap(pdc, m_size.cx, m_size.cy);
+        CMemoryAccounting::Add(MEM_TREEMAP, GetBitmapBytes(m_overlay), 1);
+        m_overlaySize = m_size;
+    }
+
+    CDC dcbitmap;
+    dcbitmap.CreateCompatibleDC(pdc);
+    CSelectObject sobmp(&dcbitmap, &m_bitmap);
+
+    CDC dcoverlay;
+    dcoverlay.CreateCompatibleDC(pdc);
+    CSelectObject sooverlay(&dcoverlay, &m_overlay);
+
+    dcoverlay.BitBlt(0, 0, m_size.cx, m_size.cy, &dcbitmap, 0, 0, SRCCOPY);
+
+    CPen pen(PS_SOLID, 1, color);
+    CSelectObject sopen(&dcoverlay, &pen);
+    CSelectStockObject sobrush(&dcoverlay, NULL_BRUSH);
+
+    if(extension)
+    {
+        int group;
+        if(m_extensionGroups.Lookup(highlightExtension, group))
         {
-            const CItem *child = item->GetChild(i);
-            if(child->TmiGetSize() == 0)
-            {
-                break;
-            }
-            if(child->TmiGetRectangle().left == -1)
-            {
-                break;
-            }
-            RecurseHighlightExtension(pdc, child);
+            RenderHighlights(&dcoverlay, m_extensionHighlight, group);
         }
     }
+
+    if(duplicates)
+    {
+        RenderHighlights(&dcoverlay, m_duplicateHighlight, 0);
+    }
+
+    m_overlayValid = true;
+    m_overlayShowsExtension = extension;
+    m_overlayExtension = highlightExtension;
+    m_overlayDuplicates = duplicates;
+    m_overlayColor = color;
+
+    return &m_overlay;
+}
+
+// A pen and the null brush must be selected.
+void CGraphView::RenderHighlights(CDC *pdc, const CTreemapHighlight& highlight, int group)
+{
+    INT_PTR begin;
+    INT_PTR end;
+    highlight.GetGroup(group, begin, end);
+
+    for(INT_PTR i = begin; i < end; i++)
+    {
+        CRect rc = highlight.GetRect(i);
+        RenderHighlightRectangle(pdc, rc);
+    }
+}
+
+// The rectangles have changed. m_overlay is kept for the next one.
+void CGraphView::DiscardHighlights()
+{
+    m_extensionHighlight.Reset();
+    m_duplicateHighlight.Reset();
+    m_overlayValid = false;
 }
 
 void CGraphView::DrawSelection(CDC *pdc)
@@ -446,39 +1025,88 @@ bool CGraphView::IsDrawn()
     return m_bitmap.m_hObject != NULL;
 }
 
+// Notes what the new m_bitmap will show, and takes it from the cache,
+// if it has been drawn before.
+bool CGraphView::RestoreFromCache()
+{
+    ASSERT(!IsDrawn());
+
+    m_bitmapZoom = GetDocument()->GetZoomItem();
+    m_bitmapOptionsHash = CTreemapCache::HashOptions(*GetOptions()->GetTreemapOptions());
+    m_bitmapColorSerial = GetDocument()->GetExtensionColorSerial();
+    DiscardHighlights();
+
+    if(!m_cache.Restore(m_bitmap, m_size, m_bitmapZoom, m_bitmapOptionsHash, m_bitmapColorSerial, m_treemap))
+    {
+        return false;
+    }
+
+    CMemoryAccounting::Add(MEM_TREEMAP, GetBitmapBytes(m_bitmap), 1);
+    m_treemap.SetOptions(GetOptions()->GetTreemapOptions());
+    return true;
+}
+
+// Only complete treemaps of the current tree
+void CGraphView::StoreInCache()
+{
+    CItem *root = GetDocument()->GetRootItem();
+    if(!IsDrawn() || m_bitmapZoom == NULL || m_treemap.IsDrawing() || IsUpdatePending() || root == NULL || !root->IsDone())
+    {
+        return;
+    }
+
+    CClientDC dc(this);
+    m_cache.Store(&dc, m_bitmap, m_size, m_bitmapZoom, m_bitmapOptionsHash, m_bitmapColorSerial, m_treemap);
+}
+
 void CGraphView::Inactivate()
 {
+    m_treemap.EndDrawing();
+    ClearDirtyItems();
+    DiscardHighlights();
+
     if(m_bitmap.m_hObject != NULL)
     {
         // Move the old bitmap to m_dimmed
-        m_dimmed.DeleteObject();
+        if(m_dimmed.m_hObject != NULL)
+        {
+            DeleteAccountedBitmap(m_dimmed);
+        }
         m_dimmed.Attach(m_bitmap.Detach());
         m_dimmedSize = m_size;
 
-        // Dim m_inactive
+        // Dim m_dimmed. Gray, so the byte order does not matter.
         CClientDC dc(this);
-        CDC dcmem;
-        dcmem.CreateCompatibleDC(&dc);
-        CSelectObject sobmp(&dcmem, &m_dimmed);
-        for(int x = 0; x < m_dimmedSize.cx; x += 2)
-        for(int y = 0; y < m_dimmedSize.cy; y += 2)
-        {
-            dcmem.SetPixel(x, y, RGB(100,100,100));
-        }
+        CFramebuffer::DimBitmap(&dc, m_dimmed, RGB(100,100,100));
     }
 }
 
 void CGraphView::EmptyView()
 {
+    m_treemap.EndDrawing();
+    FreeLiveTreemap();
+    m_cache.RemoveAll();
+    m_bitmapZoom = NULL;
+    ClearDirtyItems();
+    DiscardHighlights();
+
     if(m_bitmap.m_hObject != NULL)
     {
-        m_bitmap.DeleteObject();
+        DeleteAccountedBitmap(m_bitmap);
+    }
+
+    if(m_overlay.m_hObject != NULL)
+    {
+        DeleteAccountedBitmap(m_overlay);
     }
 
     if(m_dimmed.m_hObject != NULL)
     {
-        m_dimmed.DeleteObject();
+        DeleteAccountedBitmap(m_dimmed);
     }
+
+    // The pixel buffers of the last drawings
+    GetFramebufferPool()->Trim();
 }
 
 void CGraphView::OnSetFocus(CWnd* /*pOldWnd*/)
@@ -490,21 +1118,40 @@ void CGraphView::OnUpdate(CView* pSender, LPARAM lHint, CObject* pHint)
 {
     if(!GetDocument()->IsRootDone())
     {
-        Inactivate();
+        // While a refresh is pending, m_bitmap stays as it is.
+        if(!IsUpdatePending())
+        {
+            Inactivate();
+            m_treemap.DiscardLayout();
+        }
+    }
+    else if(m_live.m_hObject != NULL)
+    {
+        // The real treemap takes over.
+        FreeLiveTreemap();
     }
 
     switch (lHint)
     {
     case HINT_NEWROOT:
         {
+            m_treemap.DiscardLayout();
             EmptyView();
             CView::OnUpdate(pSender, lHint, pHint);
         }
         break;
 
+    case HINT_SELECTIONSTYLECHANGED:
+        {
+            // The duplicates may have been found anew.
+            m_duplicateHighlight.Reset();
+            m_overlayValid = false;
+            CView::OnUpdate(pSender, lHint, pHint);
+        }
+        break;
+
     case HINT_SELECTIONCHANGED:
     case HINT_SHOWNEWSELECTION:
-    case HINT_SELECTIONSTYLECHANGED:
     case HINT_EXTENSIONSELECTIONCHANGED:
         {
             CView::OnUpdate(pSender, lHint, pHint);
@@ -513,6 +1160,8 @@ void CGraphView::OnUpdate(CView* pSender, LPARAM lHint, CObject* pHint)
 
     case HINT_ZOOMCHANGED:
         {
+            // Zooming back will be a blit.
+            StoreInCache();
             Inactivate();
             CView::OnUpdate(pSender, lHint, pHint);
         }
@@ -526,13 +1175,50 @@ void CGraphView::OnUpdate(CView* pSender, LPARAM lHint, CObject* pHint)
 
     case HINT_TREEMAPSTYLECHANGED:
         {
+            // The layout is kept, unless style or grid have changed.
             Inactivate();
             CView::OnUpdate(pSender, lHint, pHint);
         }
         break;
 
+    case HINT_REFRESHITEM:
+        {
+            CItem *item = reinterpret_cast<CItem *>(pHint);
+
+            m_cache.InvalidateItem(item);
+            if(m_bitmapZoom != NULL && item->IsAncestorOf(m_bitmapZoom))
+            {
+                // m_bitmapZoom may be gone.
+                m_bitmapZoom = NULL;
+            }
+
+            if(!RecordDirtyItem(item))
+            {
+                CancelDirtyRegions();
+            }
+        }
+        break;
+
     case 0:
         {
+            // The tree may have changed.
+            if(m_treemap.IsDrawing())
+            {
+                // The pending items may be gone. Start over.
+                Inactivate();
+            }
+
+            if(!IsUpdatePending())
+            {
+                m_treemap.DiscardLayout();
+            }
+            else if(GetDocument()->IsRootDone())
+            {
+                DrawDirtyRegions();
+            }
+
+            // Items may have been deleted.
+            m_liveTreemap.Reset();
             CView::OnUpdate(pSender, lHint, pHint);
         }
         break;
@@ -24,6 +24,9 @@
 #pragma once
 
 #include "treemap.h"
+#include "LiveTreemap.h"
+#include "TreemapHighlight.h"
+#include "TreemapCache.h"
 
 class CDirstatDoc;
 class CItem;
@@ -48,22 +51,40 @@ public:
     void SuspendRecalculation(bool suspend);
     bool IsShowTreemap();
     void ShowTreemap(bool show);
+    bool IsShowLiveTreemap();
+    void ShowLiveTreemap(bool show);
     void DrawEmptyView();
+    bool ContinueDrawing();
+    void UpdateLiveTreemap();
 
 protected:
     virtual BOOL PreCreateWindow(CREATESTRUCT& cs);
     virtual void OnInitialUpdate();
     virtual void OnDraw(CDC* pDC);
     bool IsDrawn();
+    bool RestoreFromCache();
+    void StoreInCache();
     void Inactivate();
     void EmptyView();
     void DrawEmptyView(CDC *pDC);
+    void DrawLiveTreemap(CDC *pDC);
+    void FreeLiveTreemap();
+
+    bool IsUpdatePending();
+    bool RecordDirtyItem(CItem *item);
+    void RememberRect(CItem *item);
+    void ClearDirtyItems();
+    void CancelDirtyRegions();
+    void DrawDirtyRegions();
+    int FindChangedLevel(const CArray<CItem *, CItem *>& path);
+    bool HaveChildrenMoved(const CItem *parent);
 
     void DrawZoomFrame(CDC *pdc, CRect& rc);
     void DrawHighlights(CDC *pdc);
 
-    void DrawHighlightExtension(CDC *pdc);
-    void RecurseHighlightExtension(CDC *pdc, const CItem *item);
+    CBitmap *PrepareOverlay(CDC *pdc);
+    void RenderHighlights(CDC *pdc, const CTreemapHighlight& highlight, int group);
+    void DiscardHighlights();
 
     void DrawSelection(CDC *pdc);
 
@@ -75,9 +96,39 @@ protected:
     CSize m_size;                   // Current size of view
     CTreemap m_treemap;             // Treemap generator
     CBitmap m_bitmap;               // Cached view. If m_hObject is NULL, the view must be recalculated.
+    CItem *m_bitmapZoom;            // What m_bitmap shows. NULL, if it must not be cached.
+    ULONGLONG m_bitmapOptionsHash;
+    UINT m_bitmapColorSerial;
+    CTreemapCache m_cache;          // Earlier bitmaps, for zooming back
     CSize m_dimmedSize;             // Size of bitmap m_dimmed
     CBitmap m_dimmed;               // Dimmed view. Used during refresh to avoid the ooops-effect.
     UINT_PTR m_timer;               // We need a timer to realize when the mouse left our window.
+    bool m_showLiveTreemap;         // Show the partially scanned tree during a scan
+    CLiveTreemap m_liveTreemap;     // Its generator
+    CSize m_liveSize;               // Size of bitmap m_live
+    CBitmap m_live;                 // The last live treemap
+
+    // Dirty regions. During a refresh (HINT_REFRESHITEM) m_bitmap is kept,
+    // and when the tree is done again, only the changed parts are redrawn.
+    CArray<CItem *, CItem *> m_dirtyItems;      // The refreshed items. May be gone, only compared.
+    CArray<INT_PTR, INT_PTR> m_dirtyPathStarts; // Into m_dirtyPaths, per dirty item
+    CArray<CItem *, CItem *> m_dirtyPaths;      // Zoom item ... parent, per dirty item
+    CMap<CItem *, CItem *, CRect, const CRect&> m_oldRects; // Of the path nodes and their children
+    ULONGLONG m_dirtySince;         // _GetTickCount64() of the first dirty item
+    UINT m_dirtyColorSerial;        // CDirstatDoc::GetExtensionColorSerial() of the old treemap
+
+    // Extension and duplicate highlighting. The rectangles are collected
+    // once per drawing, and m_overlay is m_bitmap with the highlights.
+    CTreemapHighlight m_extensionHighlight;     // One group per extension
+    CMap<CString, LPCTSTR, int, int> m_extensionGroups; // Lower case extension -> group
+    CTreemapHighlight m_duplicateHighlight;     // Group 0: the redundant copies
+    CBitmap m_overlay;
+    CSize m_overlaySize;            // Size of bitmap m_overlay
+    bool m_overlayValid;
+    bool m_overlayShowsExtension;   // What m_overlay shows
+    CString m_overlayExtension;
+    bool m_overlayDuplicates;
+    COLORREF m_overlayColor;
 
     DECLARE_MESSAGE_MAP()
     afx_msg void OnSize(UINT nType, int cx, int cy);
@@ -235,6 +235,14 @@ void COwnerDrawnListControl::OnColumnsInserted()
         GetItemRect(0, rc, LVIR_BOUNDS);
         m_yFirstItem = rc.top;
     }
+    else if((GetStyle() & LVS_OWNERDATA) != 0)
+    {
+        SetItemCount(1);
+        CRect rc;
+        GetItemRect(0, rc, LVIR_BOUNDS);
+        SetItemCount(0);
+        m_yFirstItem = rc.top;
+    }
     else
     {
         InsertItem(0, _T("_tmp"), 0);
@@ -446,7 +454,7 @@ void COwnerDrawnListControl::InitializeColors()
 
 void COwnerDrawnListControl::DrawItem(LPDRAWITEMSTRUCT pdis)
 {
-    COwnerDrawnListItem *item = (COwnerDrawnListItem *)(pdis->itemData);
+    COwnerDrawnListItem *item = GetItem(pdis->itemID); // itemData is 0 in owner-data mode
     CDC *pdc = CDC::FromHandle(pdis->hDC);
     CRect rcItem(pdis->rcItem);
     if(m_showGrid)
@@ -95,8 +95,8 @@ public:
     COLORREF GetItemSelectionBackgroundColor(const COwnerDrawnListItem *item);
     COLORREF GetItemSelectionTextColor(int i);
 
-    COwnerDrawnListItem *GetItem(int i);
-    int FindListItem(const COwnerDrawnListItem *item);
+    virtual COwnerDrawnListItem *GetItem(int i);
+    virtual int FindListItem(const COwnerDrawnListItem *item);
     int GetTextXMargin();
     int GetGeneralLeftIndent();
     void AdjustColumnWidth(int col);
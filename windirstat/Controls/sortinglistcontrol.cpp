@@ -204,7 +204,12 @@ CSortingListItem *CSortingListControl::GetSortingListItem(int i)
 void CSortingListControl::SortItems()
 {
     VERIFY(CListCtrl::SortItems(&_CompareFunc, (DWORD_PTR)&m_sorting));
+    IndicateSorting();
+}
 
+// Adds "< " or "> " to the header item of the sort column.
+void CSortingListControl::IndicateSorting()
+{
     HDITEM hditem;
     ZeroMemory(&hditem, sizeof(hditem));
 
@@ -279,7 +284,7 @@ void CSortingListControl::OnLvnGetdispinfo(NMHDR *pNMHDR, LRESULT *pResult)
     NMLVDISPINFO *di = reinterpret_cast<NMLVDISPINFO*>(pNMHDR);
     *pResult = 0;
 
-    CSortingListItem *item = (CSortingListItem *)(di->item.lParam);
+    CSortingListItem *item = GetSortingListItem(di->item.iItem);
 
     if((di->item.mask & LVIF_TEXT) != 0)
     {
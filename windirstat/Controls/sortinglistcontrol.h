@@ -81,9 +81,9 @@ public:
     void SetSorting(int sortColumn, bool ascending);
 
     void InsertListItem(int i, CSortingListItem *item);
-    CSortingListItem *GetSortingListItem(int i);
 
     // Overridables
+    virtual CSortingListItem *GetSortingListItem(int i);
     virtual void SortItems();
     virtual bool GetAscendingDefault(int column);
     virtual bool HasImages();
@@ -92,6 +92,9 @@ public:
     BOOL GetColumnOrderArray(LPINT piArray, INT_PTR iCount = -1);
 #   endif
 
+protected:
+    void IndicateSorting();
+
 private:
     void SavePersistentAttributes();
     static int CALLBACK _CompareFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort);
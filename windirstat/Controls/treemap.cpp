@@ -21,7 +21,14 @@
 
 #include "stdafx.h"
 #include "selectobject.h"
+#include "MemoryAccounting.h"
+#include "WorkLimiter.h"
 #include "treemap.h"
+#include "TreemapEngine.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -37,6 +44,55 @@
 
 static const double PALETTE_BRIGHTNESS = 0.6;
 
+// The flat rectangles, which stand for the levels a progressive
+// drawing has not yet reached. A gray of PALETTE_BRIGHTNESS.
+static const COLORREF PLACEHOLDER_COLOR = RGB(153, 153, 153);
+
+// 0 ... range - 1 (0, if range <= 0). The random rectangles of CheckCushions().
+static int NextRandom(ULONGLONG& state, int range)
+{
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (range <= 0 ? 0 : (int)((state >> 33) % range));
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+//
+// CTreemapBandThread. Renders bands of a CTreemap::BANDJOB.
+//
+class CTreemapBandThread: public CWinThread
+{
+public:
+    CTreemapBandThread(CTreemap *treemap, CTreemap::BANDJOB *job);
+    bool Start();
+    virtual BOOL InitInstance();
+
+private:
+    CTreemap *m_treemap;
+    CTreemap::BANDJOB *m_job;
+};
+
+CTreemapBandThread::CTreemapBandThread(CTreemap *treemap, CTreemap::BANDJOB *job)
+    : m_treemap(treemap)
+    , m_job(job)
+{
+    // CTreemap::RenderLeaves() waits for us and deletes us.
+    m_bAutoDelete = false;
+}
+
+// False, if the thread could not be created. The other threads claim its bands then.
+bool CTreemapBandThread::Start()
+{
+    return (CreateThread() != FALSE);
+}
+
+BOOL CTreemapBandThread::InitInstance()
+{
+    m_treemap->RenderBands(m_job);
+    return false;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 
@@ -218,10 +274,67 @@ CTreemap::CTreemap(Callback *callback)
     : m_Lx(0.)
     , m_Ly(0.)
     , m_Lz(0.)
+    , m_renderThreads(0)
+    , m_sse2(false)
+    , m_stripTop(0)
+    , m_stripBottom(INT_MAX)
+    , m_collectLeaves(false)
+    , m_leafCount(0)
+    , m_cacheLayout(false)
+    , m_recordLayout(false)
+    , m_layoutValid(false)
+    , m_layoutRoot(NULL)
+    , m_layoutStyle(KDirStatStyle)
+    , m_layoutGrid(false)
+    , m_layoutCount(0)
+    , m_layoutDepth(0)
+    , m_layoutMaxDepth(0)
+    , m_layoutParentSlot(-1)
+    , m_slotCount(0)
+    , m_drawing(false)
+    , m_reshadeLayout(false)
+    , m_drawingRoot(NULL)
+    , m_drawingBits(NULL)
+    , m_depthLimit(INT_MAX)
+    , m_pendingHead(0)
+    , m_pendingCount(0)
+    , m_hitIndex(false)
+    , m_hitIndexValid(false)
+    , m_hitRoot(NULL)
+    , m_hitItemCount(0)
 {
     m_callback = callback;
     SetOptions(&_defaultOptions);
     SetBrightnessFor256();
+
+#if defined(_M_IX86) || defined(_M_X64)
+    m_sse2 = HasSSE2();
+#endif
+}
+
+CTreemap::~CTreemap()
+{
+    EndDrawing();
+    if(m_leaves.GetSize() > 0)
+    {
+        CMemoryAccounting::Add(MEM_TREEMAP, -LONGLONG(m_leaves.GetSize()) * LONGLONG(sizeof(LEAF)), -1);
+    }
+    if(m_layout.GetSize() > 0)
+    {
+        CMemoryAccounting::Add(MEM_TREEMAP, -LONGLONG(m_layout.GetSize()) * LONGLONG(sizeof(LAYOUTNODE)), -1);
+    }
+    if(m_pending.GetSize() > 0)
+    {
+        CMemoryAccounting::Add(MEM_TREEMAP, -LONGLONG(m_pending.GetSize()) * LONGLONG(sizeof(PENDINGNODE)), -1);
+    }
+    if(m_hitPixels.GetSize() > 0)
+    {
+        CMemoryAccounting::Add(MEM_TREEMAPINDEX, -LONGLONG(m_hitPixels.GetSize()) * LONGLONG(sizeof(UINT)), -1);
+    }
+    if(m_hitItems.GetSize() > 0)
+    {
+        CMemoryAccounting::Add(MEM_TREEMAPINDEX, -LONGLONG(m_hitItems.GetSize()) * LONGLONG(sizeof(Item *)), -1);
+    }
 }
 
 void CTreemap::SetOptions(const Options *options)
@@ -247,6 +360,111 @@ CTreemap::Options CTreemap::GetOptions()
     return m_options;
 }
 
+void CTreemap::SetRenderThreads(int threads)
+{
+    ASSERT(threads >= 0 && threads <= MAX_RENDERTHREADS);
+    m_renderThreads = threads;
+}
+
+void CTreemap::SetCacheLayout(bool cache)
+{
+    m_cacheLayout = cache;
+    DiscardLayout();
+}
+
+void CTreemap::DiscardLayout()
+{
+    m_layoutValid = false;
+    m_layoutRoot = NULL;
+    m_hitIndexValid = false;
+    m_hitRoot = NULL;
+}
+
+void CTreemap::SetHitIndex(bool index)
+{
+    m_hitIndex = index;
+    DiscardLayout();
+}
+
+void CTreemap::BeginHitIndex(Item *root)
+{
+    m_hitIndexValid = m_hitIndex;
+    m_hitRoot = root;
+    m_hitArea = m_renderArea;
+    m_hitItemCount = 0;
+
+    if(!m_hitIndexValid)
+    {
+        return;
+    }
+
+    const INT_PTR pixels = INT_PTR(m_hitArea.Width()) * m_hitArea.Height();
+    if(pixels != m_hitPixels.GetSize())
+    {
+        const INT_PTR oldSize = m_hitPixels.GetSize();
+        m_hitPixels.SetSize(pixels);
+        CMemoryAccounting::Add(MEM_TREEMAPINDEX, LONGLONG(pixels - oldSize) * LONGLONG(sizeof(UINT)), (oldSize == 0) ? 1 : 0);
+    }
+
+    // Pixels, which no item covers, belong to the root.
+    AddHitItem(root, m_hitArea);
+}
+
+void CTreemap::AddHitItem(Item *item, const CRect& rc)
+{
+    if(m_hitItemCount == m_hitItems.GetSize())
+    {
+        const INT_PTR oldSize = m_hitItems.GetSize();
+        m_hitItems.SetSize(max(INT_PTR(1024), 2 * oldSize));
+        CMemoryAccounting::Add(MEM_TREEMAPINDEX, LONGLONG(m_hitItems.GetSize() - oldSize) * LONGLONG(sizeof(Item *)), oldSize == 0 ? 1 : 0);
+    }
+
+    const UINT id = (UINT)m_hitItemCount;
+    m_hitItems[m_hitItemCount++] = item;
+
+    const int width = m_hitArea.Width();
+    UINT *pixels = m_hitPixels.GetData();
+    for(int y = rc.top; y < rc.bottom; y++)
+    {
+        UINT *row = pixels + INT_PTR(y - m_hitArea.top) * width - m_hitArea.left;
+        for(int x = rc.left; x < rc.right; x++)
+        {
+            row[x] = id;
+        }
+    }
+}
+
+bool CTreemap::IsLayoutCached(Item *root) const
+{
+    return m_layoutValid
+        && m_layoutRoot == root
+        && m_layoutArea == m_renderArea
+        && m_layoutStyle == m_options.style
+        && m_layoutGrid == m_options.grid;
+}
+
+void CTreemap::ValidateLayout(Item *root)
+{
+    m_recordLayout = false;
+    m_layoutValid = true;
+    m_layoutRoot = root;
+    m_layoutArea = m_renderArea;
+    m_layoutStyle = m_options.style;
+    m_layoutGrid = m_options.grid;
+}
+
+int CTreemap::GetRenderThreadCount(int rows) const
+{
+    int threads = m_renderThreads;
+    if(threads == 0)
+    {
+        SYSTEM_INFO si;
+        ::GetSystemInfo(&si);
+        threads = min((int)si.dwNumberOfProcessors, MAX_RENDERTHREADS);
+    }
+    return max(1, min(threads, rows / MIN_BANDROWS));
+}
+
 void CTreemap::SetBrightnessFor256()
 {
     if(CColorSpace::Is256Colors())
@@ -293,6 +511,86 @@ void CTreemap::DrawTreemap(CDC *pdc, CRect rc, Item *root, const Options *option
         return;
     }
 
+    DrawFrame(pdc, rc);
+
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    m_renderArea = rc;
+
+    if(root->TmiGetSize() > 0)
+    {
+        double surface[4];
+        for(int i = 0; i < _countof(surface); i++)
+        {
+            surface[i]= 0;
+        }
+
+        // The pixels, reused from the last drawing
+        CFramebuffer frame(rc.Width() * rc.Height());
+        CColorRefArray& bitmap_bits = frame.GetBits();
+
+        // Recursively draw the tree graph. With more than one thread,
+        // the leaves are collected and rasterized afterwards.
+        const int threadCount = GetRenderThreadCount(rc.Height());
+        m_collectLeaves = (threadCount > 1);
+        m_leafCount = 0;
+
+        if(IsLayoutCached(root))
+        {
+            // Only the shading has changed.
+            RenderLayout(bitmap_bits);
+        }
+        else
+        {
+            m_layoutValid = false;
+            m_recordLayout = m_cacheLayout;
+            m_layoutCount = 0;
+            m_layoutDepth = 0;
+            m_layoutMaxDepth = 0;
+            m_layoutParentSlot = -1;
+            m_slotCount = 0;
+            BeginHitIndex(root);
+
+            RecurseDrawGraph(bitmap_bits, root, rc, true, surface, m_options.height, 0);
+
+            if(m_recordLayout)
+            {
+                ValidateLayout(root);
+            }
+        }
+
+        m_collectLeaves = false;
+        if(threadCount > 1)
+        {
+            RenderLeaves(bitmap_bits, threadCount);
+        }
+
+        PaintBitmap(pdc, rc, bitmap_bits);
+
+#ifdef STRONGDEBUG  // slow, but finds bugs!
+#ifdef _DEBUG
+        for(int x = rc.left; x < rc.right - m_options.grid; x++)
+        {
+            for(int y = rc.top; y < rc.bottom - m_options.grid; y++)
+            {
+                ASSERT(FindItemByPoint(root, CPoint(x, y)) != NULL);
+            }
+        }
+#endif
+#endif
+    }
+    else
+    {
+        m_hitIndexValid = false;
+        pdc->FillSolidRect(rc, RGB(0,0,0));
+    }
+}
+
+void CTreemap::DrawFrame(CDC *pdc, CRect& rc)
+{
     if(m_options.grid)
     {
         pdc->FillSolidRect(rc, m_options.gridColor);
@@ -312,6 +610,32 @@ void CTreemap::DrawTreemap(CDC *pdc, CRect rc, Item *root, const Options *option
 
     rc.right--;
     rc.bottom--;
+}
+
+void CTreemap::PaintBitmap(CDC *pdc, const CRect& rc, CColorRefArray &bitmap)
+{
+    CFramebuffer::Paint(pdc, rc.left, rc.top, bitmap.GetData(), rc.Width(), rc.Height(), 0, rc.Width());
+}
+
+void CTreemap::BeginDrawing(CDC *pdc, CRect rc, Item *root, const Options *options)
+{
+#ifdef _DEBUG
+    RecurseCheckTree(root);
+#endif // _DEBUG
+
+    EndDrawing();
+
+    if(options != NULL)
+    {
+        SetOptions(options);
+    }
+
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    DrawFrame(pdc, rc);
 
     if(rc.Width() <= 0 || rc.Height() <= 0)
     {
@@ -320,58 +644,142 @@ void CTreemap::DrawTreemap(CDC *pdc, CRect rc, Item *root, const Options *option
 
     m_renderArea = rc;
 
-    if(root->TmiGetSize() > 0)
+    if(root->TmiGetSize() == 0)
+    {
+        m_hitIndexValid = false;
+        pdc->FillSolidRect(rc, RGB(0,0,0));
+        return;
+    }
+
+    m_drawing = true;
+    m_drawingRoot = root;
+    m_drawingBits = GetFramebufferPool()->Acquire(rc.Width() * rc.Height());
+
+    m_pendingHead = 0;
+    m_pendingCount = 0;
+
+    m_reshadeLayout = IsLayoutCached(root);
+    if(!m_reshadeLayout)
     {
+        m_layoutValid = false;
+        m_recordLayout = m_cacheLayout;
+        m_layoutCount = 0;
+        m_layoutDepth = 0;
+        m_layoutMaxDepth = 0;
+        m_layoutParentSlot = -1;
+        m_slotCount = 0;
+        BeginHitIndex(root);
+
         double surface[4];
         for(int i = 0; i < _countof(surface); i++)
         {
             surface[i]= 0;
         }
 
-        // Create a temporary CDC that represents only the tree map
-        CDC dcTreeView;
-        VERIFY(dcTreeView.CreateCompatibleDC(pdc));
+        AddPendingNode(root, rc, surface, m_options.height);
+    }
+}
 
-        // This bitmap will be blitted onto the temporary DC
-        CBitmap bmp;
+// Takes the pending nodes in FIFO order and lays out and renders
+// LEVELS_PER_STEP levels of each, queueing the nodes below. At least one
+// node is done per call. Each node is drawn exactly as by DrawTreemap(),
+// so the complete image is the same.
+// As there, the leaves of a step are collected and rasterized in bands at
+// its end. The grid and the placeholders are drawn directly; they never
+// cover a leaf laid out after them in the same step.
+bool CTreemap::ContinueDrawing(CWorkLimiter *limiter)
+{
+    ASSERT(m_drawing);
 
-        // That bitmap in turn will be created from this array
-        CColorRefArray bitmap_bits;
-        bitmap_bits.SetSize(rc.Width() * rc.Height());
+    const int threadCount = GetRenderThreadCount(m_renderArea.Height());
+    m_collectLeaves = (threadCount > 1);
+    m_leafCount = 0;
 
-        // Recursively draw the tree graph
-        RecurseDrawGraph(bitmap_bits, root, rc, true, surface, m_options.height, 0);
+    if(m_reshadeLayout)
+    {
+        m_reshadeLayout = false;
+        RenderLayout(*m_drawingBits);
+    }
 
-        // Fill the bitmap with the array
-        VERIFY(bmp.CreateBitmap(rc.Width(), rc.Height(), 1, 32, &bitmap_bits[0]));
+    while(m_pendingCount > 0)
+    {
+        // A copy, as AddPendingNode() may move the queue.
+        const PENDINGNODE node = m_pending[m_pendingHead];
+        m_pendingHead++;
+        m_pendingCount--;
 
-        // Render bitmap to the temporary CDC
-        dcTreeView.SelectObject(&bmp);
+        if(m_options.grid)
+        {
+            // The placeholder has covered the grid lines of the children.
+            DrawSolidRect(*m_drawingBits, CRect(node.rc.left + 1, node.rc.top + 1, node.rc.right, node.rc.bottom), RGB(0,0,0), m_options.brightness);
+        }
 
-        // And lastly, draw the temporary CDC to the real one
-        VERIFY(pdc->BitBlt(rc.TopLeft().x, rc.TopLeft().y, rc.Width(), rc.Height(), &dcTreeView, 0, 0, SRCCOPY));
+        m_layoutDepth = node.depth;
+        m_layoutParentSlot = node.parentSlot;
+        m_depthLimit = node.depth + LEVELS_PER_STEP;
 
-        // Free memory
-        VERIFY(bmp.DeleteObject());
-        VERIFY(dcTreeView.DeleteDC());
+        RecurseDrawGraph(*m_drawingBits, node.item, node.rc, node.depth == 0, node.surface, node.h, 0);
 
+        m_depthLimit = INT_MAX;
+        m_layoutParentSlot = -1;
 
-#ifdef STRONGDEBUG  // slow, but finds bugs!
-#ifdef _DEBUG
-        for(int x = rc.left; x < rc.right - m_options.grid; x++)
+        if(limiter->IsDone())
         {
-            for(int y = rc.top; y < rc.bottom - m_options.grid; y++)
-            {
-                ASSERT(FindItemByPoint(root, CPoint(x, y)) != NULL);
-            }
+            break;
         }
-#endif
-#endif
     }
-    else
+
+    m_collectLeaves = false;
+    if(threadCount > 1 && m_leafCount > 0)
     {
-        pdc->FillSolidRect(rc, RGB(0,0,0));
+        RenderLeaves(*m_drawingBits, threadCount);
+    }
+
+    if(m_pendingCount > 0)
+    {
+        return false;
+    }
+
+    if(m_recordLayout)
+    {
+        ValidateLayout(m_drawingRoot);
+    }
+
+    return true;
+}
+
+void CTreemap::PaintDrawing(CDC *pdc)
+{
+    if(m_drawing)
+    {
+        PaintBitmap(pdc, m_renderArea, *m_drawingBits);
+    }
+}
+
+void CTreemap::EndDrawing()
+{
+    if(!m_drawing)
+    {
+        return;
+    }
+
+    if(m_pendingCount > 0)
+    {
+        // Cancelled. The layout is incomplete.
+        m_recordLayout = false;
+        m_hitIndexValid = false;
+        m_pendingCount = 0;
     }
+
+    GetFramebufferPool()->Release(m_drawingBits);
+    m_drawingBits = NULL;
+    m_drawingRoot = NULL;
+    m_drawing = false;
+}
+
+bool CTreemap::IsDrawing() const
+{
+    return m_drawing;
 }
 
 void CTreemap::DrawTreemapDoubleBuffered(CDC *pdc, const CRect& rc, Item *root, const Options *options)
@@ -401,52 +809,306 @@ void CTreemap::DrawTreemapDoubleBuffered(CDC *pdc, const CRect& rc, Item *root,
     VERIFY(pdc->BitBlt(rc.left, rc.top, rc.Width(), rc.Height(), &dc, 0, 0, SRCCOPY));
 }
 
-CTreemap::Item *CTreemap::FindItemByPoint(Item *item, CPoint point)
+bool CTreemap::DrawTreemapStrips(StripSink *sink, CSize size, Item *root, int stripRows, const Options *options)
 {
-    ASSERT(item != NULL);
-    const CRect& rc = item->TmiGetRectangle();
+#ifdef _DEBUG
+    RecurseCheckTree(root);
+#endif // _DEBUG
 
-    if(!rc.PtInRect(point))
+    ASSERT(!m_drawing);
+    ASSERT(stripRows > 0);
+
+    if(options != NULL)
     {
-        // The only case that this function returns NULL is that
-        // point is not inside the rectangle of item.
-        //
-        // Take notice of
-        // (a) the very right an bottom lines, which can be "grid" and
-        //     are not covered by the root rectangle,
-        // (b) the fact, that WM_MOUSEMOVEs can occur after WM_SIZE but
-        //     before WM_PAINT.
-        //
-        return NULL;
+        SetOptions(options);
     }
 
-    ASSERT(rc.PtInRect(point));
+    if(size.cx <= 1 || size.cy <= 1)
+    {
+        return true;
+    }
 
-    Item *ret = NULL;
+    // The item rectangles will be those of this drawing.
+    DiscardLayout();
+    m_recordLayout = false;
+    m_collectLeaves = false;
 
-    int gridWidth = m_options.grid ? 1: 0;
+    // As DrawFrame(): the grid color, or shadow lines at the right and
+    // at the bottom, and the area inside.
+    const COLORREF frameColor = m_options.grid ? m_options.gridColor : ::GetSysColor(COLOR_3DSHADOW);
+    const COLORREF frame = BGR(GetBValue(frameColor), GetGValue(frameColor), GetRValue(frameColor));
+    const COLORREF background = (root->TmiGetSize() > 0 ? frame : BGR(0,0,0));
 
-    if(rc.Width() <= gridWidth || rc.Height() <= gridWidth)
-    {
-        ret = item;
-    }
-    else if(item->TmiIsLeaf())
+    m_renderArea = CRect(0, 0, size.cx - 1, size.cy - 1);
+    const int width = m_renderArea.Width();
+
+    double surface[4];
+    for(int i = 0; i < _countof(surface); i++)
     {
-        ret = item;
+        surface[i]= 0;
     }
-    else
+
+    CColorRefArray bitmap_bits;     // The area inside, width per row
+    bitmap_bits.SetSize(width * stripRows);
+    CColorRefArray strip;           // With the frame, size.cx per row
+    strip.SetSize(size.cx * stripRows);
+    const LONGLONG bitsBytes = LONGLONG(bitmap_bits.GetSize() + strip.GetSize()) * LONGLONG(sizeof(COLORREF));
+    CMemoryAccounting::Add(MEM_TREEMAP, bitsBytes, 2);
+
+    bool complete = true;
+    for(int top = 0; top < size.cy && complete; top += stripRows)
     {
-        ASSERT(item->TmiGetSize() > 0);
-        ASSERT(item->TmiGetChildrenCount() > 0);
+        const int rows = min(stripRows, size.cy - top);
 
-        for(int i = 0; i < item->TmiGetChildrenCount(); i++)
+        m_stripTop = top;
+        m_stripBottom = min(top + rows, m_renderArea.bottom);
+
+        for(INT_PTR i = 0; i < bitmap_bits.GetSize(); i++)
         {
-            Item *child = item->TmiGetChild(i);
+            bitmap_bits[i] = background;
+        }
 
-            ASSERT(child->TmiGetSize() > 0);
+        if(m_stripBottom > m_stripTop && root->TmiGetSize() > 0)
+        {
+            RecurseDrawGraph(bitmap_bits, root, m_renderArea, true, surface, m_options.height, 0);
+        }
 
-#ifdef _DEBUG
-            CRect rcChild(child->TmiGetRectangle());
+        for(int y = 0; y < rows; y++)
+        {
+            COLORREF *row = strip.GetData() + y * size.cx;
+            if(top + y < m_renderArea.bottom)
+            {
+                memcpy(row, bitmap_bits.GetData() + y * width, width * sizeof(COLORREF));
+                row[width] = frame;
+            }
+            else
+            {
+                for(int x = 0; x < size.cx; x++)
+                {
+                    row[x] = frame;
+                }
+            }
+        }
+
+        complete = sink->TreemapStrip(strip.GetData(), size.cx, rows);
+    }
+
+    m_stripTop = 0;
+    m_stripBottom = INT_MAX;
+
+    CMemoryAccounting::Add(MEM_TREEMAP, -bitsBytes, -2);
+
+    return complete;
+}
+
+void CTreemap::LayoutChildren(Item *parent)
+{
+    ASSERT(!m_drawing);
+    ASSERT(!parent->TmiIsLeaf());
+    ASSERT(parent->TmiGetSize() > 0);
+
+    const bool hitIndexValid = m_hitIndexValid;
+    m_hitIndexValid = false;
+    m_recordLayout = false;
+    m_collectLeaves = false;
+
+    // An empty strip: RecurseDrawGraph() sets the rectangle of each child
+    // and returns.
+    m_stripTop = INT_MAX;
+    m_stripBottom = INT_MAX;
+
+    double surface[4];
+    for(int i = 0; i < _countof(surface); i++)
+    {
+        surface[i]= 0;
+    }
+
+    CColorRefArray none;
+    DrawChildren(none, parent, surface, 0, 0);
+
+    m_stripTop = 0;
+    m_stripBottom = INT_MAX;
+    m_hitIndexValid = hitIndexValid;
+}
+
+void CTreemap::DrawTreemapPart(CDC *pdc, Item *const *path, int count)
+{
+    ASSERT(!m_drawing);
+    ASSERT(count > 0);
+
+    Item *item = path[count - 1];
+    const CRect rc = item->TmiGetRectangle();
+    ASSERT(item->TmiGetSize() > 0);
+
+    // The cached layout is that of the old tree.
+    m_layoutValid = false;
+    m_recordLayout = false;
+    m_collectLeaves = false;
+
+    if(m_hitIndexValid && m_hitRoot == path[0])
+    {
+        // Pixels, which no item covers any more, belong to item.
+        AddHitItem(item, rc);
+    }
+    else
+    {
+        m_hitIndexValid = false;
+    }
+
+    // item gets the ridges of its ancestors, as in RecurseDrawGraph().
+    double surface[4];
+    for(int i = 0; i < _countof(surface); i++)
+    {
+        surface[i]= 0;
+    }
+
+    double h = m_options.height;
+    for(int i = 1; i < count; i++)
+    {
+        h *= m_options.scaleFactor;
+        if(i < count - 1)
+        {
+            AddRidge(path[i]->TmiGetRectangle(), surface, h);
+        }
+    }
+
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    // The rows of rc, as a strip of the whole drawing
+    const int width = m_renderArea.Width();
+    CFramebuffer frame(width * rc.Height());
+    CColorRefArray& bitmap_bits = frame.GetBits();
+
+    m_stripTop = rc.top;
+    m_stripBottom = rc.bottom;
+    RecurseDrawGraph(bitmap_bits, item, rc, count == 1, surface, h, 0);
+    m_stripTop = 0;
+    m_stripBottom = INT_MAX;
+
+    CFramebuffer::Paint(pdc, m_renderArea.left + rc.left, m_renderArea.top + rc.top, bitmap_bits.GetData(), width, rc.Height(), rc.left, rc.Width());
+}
+
+void CTreemap::SaveDrawingState(DRAWINGSTATE& state) const
+{
+    ASSERT(!m_drawing);
+
+    state.renderArea = m_renderArea;
+    state.hitIndexValid = m_hitIndexValid;
+    state.hitRoot = m_hitRoot;
+    state.hitArea = m_hitArea;
+
+    if(m_hitIndexValid)
+    {
+        state.hitPixels.Copy(m_hitPixels);
+        state.hitItems.SetSize(m_hitItemCount);
+        memcpy(state.hitItems.GetData(), m_hitItems.GetData(), m_hitItemCount * sizeof(Item *));
+    }
+    else
+    {
+        state.hitPixels.RemoveAll();
+        state.hitItems.RemoveAll();
+    }
+}
+
+void CTreemap::RestoreDrawingState(const DRAWINGSTATE& state)
+{
+    ASSERT(!m_drawing);
+
+    m_renderArea = state.renderArea;
+    m_hitIndexValid = (state.hitIndexValid && m_hitIndex);
+    m_hitRoot = state.hitRoot;
+    m_hitArea = state.hitArea;
+    m_hitItemCount = 0;
+
+    if(!m_hitIndexValid)
+    {
+        return;
+    }
+
+    if(state.hitPixels.GetSize() != m_hitPixels.GetSize())
+    {
+        const INT_PTR oldSize = m_hitPixels.GetSize();
+        m_hitPixels.SetSize(state.hitPixels.GetSize());
+        CMemoryAccounting::Add(MEM_TREEMAPINDEX, LONGLONG(m_hitPixels.GetSize() - oldSize) * LONGLONG(sizeof(UINT)), (oldSize == 0) ? 1 : 0);
+    }
+    memcpy(m_hitPixels.GetData(), state.hitPixels.GetData(), state.hitPixels.GetSize() * sizeof(UINT));
+
+    if(state.hitItems.GetSize() > m_hitItems.GetSize())
+    {
+        const INT_PTR oldSize = m_hitItems.GetSize();
+        m_hitItems.SetSize(state.hitItems.GetSize());
+        CMemoryAccounting::Add(MEM_TREEMAPINDEX, LONGLONG(m_hitItems.GetSize() - oldSize) * LONGLONG(sizeof(Item *)), oldSize == 0 ? 1 : 0);
+    }
+    memcpy(m_hitItems.GetData(), state.hitItems.GetData(), state.hitItems.GetSize() * sizeof(Item *));
+    m_hitItemCount = state.hitItems.GetSize();
+}
+
+CTreemap::Item *CTreemap::FindItemByPoint(Item *root, CPoint point)
+{
+    if(m_hitIndexValid && root == m_hitRoot)
+    {
+        if(!m_hitArea.PtInRect(point))
+        {
+            return NULL;
+        }
+        return m_hitItems[m_hitPixels[INT_PTR(point.y - m_hitArea.top) * m_hitArea.Width() + point.x - m_hitArea.left]];
+    }
+
+    // Below the depth of the next pending node the rectangles
+    // may be those of an earlier layout.
+    const int levels = (m_drawing && m_pendingCount > 0) ? m_pending[m_pendingHead].depth : INT_MAX;
+    return RecurseFindItemByPoint(root, point, levels);
+}
+
+CTreemap::Item *CTreemap::RecurseFindItemByPoint(Item *item, CPoint point, int levels)
+{
+    ASSERT(item != NULL);
+    const CRect& rc = item->TmiGetRectangle();
+
+    if(!rc.PtInRect(point))
+    {
+        // The only case that this function returns NULL is that
+        // point is not inside the rectangle of item.
+        //
+        // Take notice of
+        // (a) the very right an bottom lines, which can be "grid" and
+        //     are not covered by the root rectangle,
+        // (b) the fact, that WM_MOUSEMOVEs can occur after WM_SIZE but
+        //     before WM_PAINT.
+        //
+        return NULL;
+    }
+
+    ASSERT(rc.PtInRect(point));
+
+    Item *ret = NULL;
+
+    int gridWidth = m_options.grid ? 1: 0;
+
+    if(rc.Width() <= gridWidth || rc.Height() <= gridWidth)
+    {
+        ret = item;
+    }
+    else if(item->TmiIsLeaf() || levels == 0)
+    {
+        ret = item;
+    }
+    else
+    {
+        ASSERT(item->TmiGetSize() > 0);
+        ASSERT(item->TmiGetChildrenCount() > 0);
+
+        for(int i = 0; i < item->TmiGetChildrenCount(); i++)
+        {
+            Item *child = item->TmiGetChild(i);
+
+            ASSERT(child->TmiGetSize() > 0);
+
+#ifdef _DEBUG
+            CRect rcChild(child->TmiGetRectangle());
             ASSERT(rcChild.right >= rcChild.left);
             ASSERT(rcChild.bottom >= rcChild.top);
             ASSERT(rcChild.left >= rc.left);
@@ -456,7 +1118,7 @@ CTreemap::Item *CTreemap::FindItemByPoint(Item *item, CPoint point)
 #endif
             if(child->TmiGetRectangle().PtInRect(point))
             {
-                ret = FindItemByPoint(child, point);
+                ret = RecurseFindItemByPoint(child, point, levels - 1);
                 ASSERT(ret != NULL);
 #ifdef STRONGDEBUG
 #ifdef _DEBUG
@@ -582,6 +1244,16 @@ void CTreemap::RecurseDrawGraph(
 
     if(rc.Width() <= gridWidth || rc.Height() <= gridWidth)
     {
+        if(m_hitIndexValid && rc.Width() > 0 && rc.Height() > 0)
+        {
+            AddHitItem(item, rc);
+        }
+        return;
+    }
+
+    if(rc.bottom <= m_stripTop || rc.top >= m_stripBottom)
+    {
+        // Not in the current strip of DrawTreemapStrips()
         return;
     }
 
@@ -602,14 +1274,42 @@ void CTreemap::RecurseDrawGraph(
 
     if(item->TmiIsLeaf())
     {
-        RenderLeaf(bitmap, item, surface);
+        if(m_hitIndexValid)
+        {
+            AddHitItem(item, rc);
+        }
+
+        const DWORD color = item->TmiGetGraphColor();
+        if(m_recordLayout)
+        {
+            AddLayoutNode(rc, true, color);
+        }
+
+        RenderLeaf(bitmap, rc, surface, color);
+    }
+    else if(m_layoutDepth >= m_depthLimit)
+    {
+        // Left to a later step of ContinueDrawing()
+        if(m_hitIndexValid)
+        {
+            AddHitItem(item, rc);
+        }
+        AddPendingNode(item, rc, psurface, h);
+        RenderPlaceholder(bitmap, rc);
     }
     else
     {
         ASSERT(item->TmiGetChildrenCount() > 0);
         ASSERT(item->TmiGetSize() > 0);
 
+        if(m_recordLayout)
+        {
+            AddLayoutNode(rc, false, 0);
+        }
+
+        m_layoutDepth++;
         DrawChildren(bitmap, item, surface, h, flags);
+        m_layoutDepth--;
     }
 }
 
@@ -626,547 +1326,319 @@ void CTreemap::DrawChildren(
     DWORD flags
 )
 {
+    CHILDREN children = { this, &bitmap, surface, h * m_options.scaleFactor };
+    const CRect rc = parent->TmiGetRectangle();
+
     switch (m_options.style)
     {
     case KDirStatStyle:
         {
-            KDirStat_DrawChildren(bitmap, parent, surface, h, flags);
+            CTreemapLayout<CTreemapItemAccess>::KDirStat(parent, rc, children);
         }
         break;
 
     case SequoiaViewStyle:
         {
-            SequoiaView_DrawChildren(bitmap, parent, surface, h, flags);
+            CTreemapLayout<CTreemapItemAccess>::SequoiaView(parent, rc, children);
         }
         break;
 
     case SimpleStyle:
         {
-            Simple_DrawChildren(bitmap, parent, surface, h, flags);
+            CTreemapLayout<CTreemapItemAccess>::Simple(parent, rc, flags, children);
         }
         break;
     }
 }
 
-
-// I learned this squarification style from the KDirStat executable.
-// It's the most complex one here but also the clearest, imho.
-//
-void CTreemap::KDirStat_DrawChildren(CColorRefArray &bitmap, Item *parent, const double *surface, double h, DWORD /*flags*/)
+void CTreemap::CHILDREN::Child(Item *child, const CRect& rc, DWORD flags)
 {
-    ASSERT(parent->TmiGetChildrenCount() > 0);
-
-    const CRect& rc = parent->TmiGetRectangle();
-
-    CArray<double, double> rows;    // Our rectangle is divided into rows, each of which gets this height (fraction of total height).
-    CArray<int, int> childrenPerRow;// childrenPerRow[i] = # of children in rows[i]
-
-    CArray<double, double> childWidth; // Widths of the children (fraction of row width).
-    childWidth.SetSize(parent->TmiGetChildrenCount());
-
-    bool horizontalRows = KDirStat_ArrangeChildren(parent, childWidth, rows, childrenPerRow);
-
-    const int width = horizontalRows ? rc.Width() : rc.Height();
-    const int height = horizontalRows ? rc.Height() : rc.Width();
-    ASSERT(width >= 0);
-    ASSERT(height >= 0);
-
-    int c = 0;
-    double top = horizontalRows ? rc.top : rc.left;
-    for(int row = 0; row < rows.GetSize(); row++)
-    {
-        double fBottom = top + rows[row] * height;
-        int bottom = (int)fBottom;
-        if(row == rows.GetSize() - 1)
-        {
-            bottom = horizontalRows ? rc.bottom : rc.right;
-        }
-        double left = horizontalRows ? rc.left : rc.top;
-        for(int i = 0; i < childrenPerRow[row]; i++, c++)
-        {
-            Item *child = parent->TmiGetChild(c);
-            ASSERT(childWidth[c] >= 0);
-            double fRight = left + childWidth[c] * width;
-            int right = (int)fRight;
-
-            bool lastChild = (i == childrenPerRow[row] - 1 || childWidth[c + 1] == 0);
-
-            if(lastChild)
-            {
-                right = horizontalRows ? rc.right : rc.bottom;
-            }
-
-            CRect rcChild;
-            if(horizontalRows)
-            {
-                rcChild.left = (int)left;
-                rcChild.right = right;
-                rcChild.top = (int)top;
-                rcChild.bottom = bottom;
-            }
-            else
-            {
-                rcChild.left = (int)top;
-                rcChild.right = bottom;
-                rcChild.top = (int)left;
-                rcChild.bottom = right;
-            }
-
-            #ifdef _DEBUG
-            if(rcChild.Width() > 0 && rcChild.Height() > 0)
-            {
-                CRect test;
-                test.IntersectRect(parent->TmiGetRectangle(), rcChild);
-                ASSERT(test == rcChild);
-            }
-            #endif
-
-            RecurseDrawGraph(bitmap, child, rcChild, false, surface, h * m_options.scaleFactor, 0);
-
-            if(lastChild)
-            {
-                i++, c++;
-
-                if(i < childrenPerRow[row])
-                {
-                    parent->TmiGetChild(c)->TmiSetRectangle(CRect(-1,-1,-1,-1));
-                }
-
-                c += childrenPerRow[row] - i;
-                break;
-            }
-
-            left = fRight;
-        }
-        // This asserts due to rounding error: ASSERT(left == (horizontalRows ? rc.right : rc.bottom));
-        top = fBottom;
-    }
-    // This asserts due to rounding error: ASSERT(top == (horizontalRows ? rc.bottom : rc.right));
+    treemap->RecurseDrawGraph(*bitmap, child, rc, false, surface, h, flags);
 }
 
-
-// return: whether the rows are horizontal.
-//
-bool CTreemap::KDirStat_ArrangeChildren(
-    Item *parent,
-    CArray<double, double>& childWidth,
-    CArray<double, double>& rows,
-    CArray<int, int>& childrenPerRow
-)
+bool CTreemap::IsCushionShading()
 {
-    ASSERT(!parent->TmiIsLeaf());
-    ASSERT(parent->TmiGetChildrenCount() > 0);
+    return m_options.ambientLight < 1.0
+        && m_options.height > 0.0
+        && m_options.scaleFactor > 0.0;
+}
 
-    if(parent->TmiGetSize() == 0)
+void CTreemap::RenderLeaf(CColorRefArray &bitmap, CRect rc, const double *surface, DWORD color)
+{
+    if(m_options.grid)
     {
-        rows.Add(1.0);
-        childrenPerRow.Add(parent->TmiGetChildrenCount());
-        for(int i = 0; i < parent->TmiGetChildrenCount(); i++)
-        {
-            childWidth[i]= 1.0 / parent->TmiGetChildrenCount();
-        }
-        return true;
+        rc.top++;
+        rc.left++;
     }
 
-    bool horizontalRows = (parent->TmiGetRectangle().Width() >= parent->TmiGetRectangle().Height());
+    rc.top = max(rc.top, m_stripTop);
+    rc.bottom = min(rc.bottom, m_stripBottom);
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
 
-    double width = 1.0;
-    if(horizontalRows)
+    if(m_collectLeaves)
     {
-        if(parent->TmiGetRectangle().Height() > 0)
-        {
-            width = (double)parent->TmiGetRectangle().Width() / parent->TmiGetRectangle().Height();
-        }
+        AddLeaf(rc, surface, color);
     }
     else
     {
-        if(parent->TmiGetRectangle().Width() > 0)
-        {
-            width = (double)parent->TmiGetRectangle().Height() / parent->TmiGetRectangle().Width();
-        }
+        RenderRectangle(bitmap, rc, surface, color);
     }
+}
 
-    int nextChild = 0;
-    while(nextChild < parent->TmiGetChildrenCount())
+void CTreemap::AddLayoutNode(const CRect& rc, bool leaf, DWORD color)
+{
+    if(m_layoutCount == m_layout.GetSize())
     {
-        int childrenUsed;
-        rows.Add(KDirStat_CalcutateNextRow(parent, nextChild, width, childrenUsed, childWidth));
-        childrenPerRow.Add(childrenUsed);
-        nextChild += childrenUsed;
+        const INT_PTR oldSize = m_layout.GetSize();
+        m_layout.SetSize(max(INT_PTR(1024), 2 * oldSize));
+        CMemoryAccounting::Add(MEM_TREEMAP, LONGLONG(m_layout.GetSize() - oldSize) * LONGLONG(sizeof(LAYOUTNODE)), oldSize == 0 ? 1 : 0);
     }
 
-    return horizontalRows;
+    if(m_layoutDepth >= m_layoutPath.GetSize())
+    {
+        m_layoutPath.SetSize(m_layoutDepth + 1);
+    }
+    m_layoutPath[m_layoutDepth] = m_layoutCount;
+
+    LAYOUTNODE& node = m_layout[m_layoutCount++];
+    node.rc = rc;
+    node.depth = m_layoutDepth;
+    node.leaf = leaf;
+    node.color = color;
+    node.slot = -1;
+    node.parentSlot = m_layoutParentSlot;
+    m_layoutParentSlot = -1;
+
+    m_layoutMaxDepth = max(m_layoutMaxDepth, m_layoutDepth);
 }
 
-double CTreemap::KDirStat_CalcutateNextRow(Item *parent, const int nextChild, double width, int& childrenUsed, CArray<double, double>& childWidth)
+void CTreemap::AddPendingNode(Item *item, const CRect& rc, const double *psurface, double h)
 {
-    int i = 0;
-    static const double _minProportion = 0.4;
-    ASSERT(_minProportion < 1);
-
-    ASSERT(nextChild < parent->TmiGetChildrenCount());
-    ASSERT(width >= 1.0);
-
-    const double mySize = (double)parent->TmiGetSize();
-    ASSERT(mySize > 0);
-    ULONGLONG sizeUsed = 0;
-    double rowHeight = 0;
-
-    for(i = nextChild; i < parent->TmiGetChildrenCount(); i++)
+    if(m_pendingHead + m_pendingCount == m_pending.GetSize())
     {
-        ULONGLONG childSize = parent->TmiGetChild(i)->TmiGetSize();
-        if(childSize == 0)
+        if(m_pendingHead > 0 && m_pendingHead >= m_pendingCount)
         {
-            ASSERT(i > nextChild);  // first child has size > 0
-            break;
+            // The front half has been consumed. Move the queue there.
+            for(INT_PTR i = 0; i < m_pendingCount; i++)
+            {
+                m_pending[i] = m_pending[m_pendingHead + i];
+            }
         }
-
-        sizeUsed += childSize;
-        double virtualRowHeight = sizeUsed / mySize;
-        ASSERT(virtualRowHeight > 0);
-        ASSERT(virtualRowHeight <= 1);
-
-        // Rectangle(mySize)    = width * 1.0
-        // Rectangle(childSize) = childWidth * virtualRowHeight
-        // Rectangle(childSize) = childSize / mySize * width
-
-        double childWidth_ = childSize / mySize * width / virtualRowHeight;
-
-        if(childWidth_ / virtualRowHeight < _minProportion)
+        else
         {
-            ASSERT(i > nextChild); // because width >= 1 and _minProportion < 1.
-            // For the first child we have:
-            // childWidth / rowHeight
-            // = childSize / mySize * width / rowHeight / rowHeight
-            // = childSize * width / sizeUsed / sizeUsed * mySize
-            // > childSize * mySize / sizeUsed / sizeUsed
-            // > childSize * childSize / childSize / childSize
-            // = 1 > _minProportion.
-            break;
+            const INT_PTR oldSize = m_pending.GetSize();
+            m_pending.SetSize(max(INT_PTR(1024), 2 * oldSize));
+            CMemoryAccounting::Add(MEM_TREEMAP, LONGLONG(m_pending.GetSize() - oldSize) * LONGLONG(sizeof(PENDINGNODE)), oldSize == 0 ? 1 : 0);
+
+            for(INT_PTR i = 0; i < m_pendingCount; i++)
+            {
+                m_pending[i] = m_pending[m_pendingHead + i];
+            }
         }
-        rowHeight = virtualRowHeight;
+        m_pendingHead = 0;
     }
-    ASSERT(i > nextChild);
 
-    // Now i-1 is the last child used
-    // and rowHeight is the height of the row.
-
-    // We add the rest of the children, if their size is 0.
-    while(i < parent->TmiGetChildrenCount() && parent->TmiGetChild(i)->TmiGetSize() == 0)
+    PENDINGNODE& node = m_pending[m_pendingHead + m_pendingCount++];
+    node.item = item;
+    node.rc = rc;
+    if(IsCushionShading())
     {
-        i++;
+        for(int i = 0; i < _countof(node.surface); i++)
+        {
+            node.surface[i] = psurface[i];
+        }
     }
+    node.h = h;
+    node.depth = m_layoutDepth;
+    node.parentSlot = -1;
 
-    childrenUsed = i - nextChild;
-
-    // Now as we know the rowHeight, we compute the widths of our children.
-    for(i = 0; i < childrenUsed; i++)
+    if(m_recordLayout && m_layoutDepth > 0)
     {
-        // Rectangle(1.0 * 1.0) = mySize
-        double rowSize = mySize * rowHeight;
-        double childSize = (double)parent->TmiGetChild(nextChild + i)->TmiGetSize();
-        double cw = childSize / rowSize;
-        ASSERT(cw >= 0);
-        childWidth[nextChild + i]= cw;
+        // The parent is being laid out, so it is the last node one level up.
+        LAYOUTNODE& parent = m_layout[m_layoutPath[m_layoutDepth - 1]];
+        if(parent.slot < 0)
+        {
+            parent.slot = m_slotCount++;
+        }
+        node.parentSlot = parent.slot;
     }
-
-    return rowHeight;
 }
 
-
-// The classical squarification method.
-//
-void CTreemap::SequoiaView_DrawChildren(CColorRefArray &bitmap, Item *parent, const double *surface, double h, DWORD /*flags*/)
+// Redoes the shading of RecurseDrawGraph() from the cached layout, without
+// touching the items. The surface of a node is that of its parent plus its
+// own ridge, so we keep one surface and one height per depth, and those
+// in the slots for the runs of a progressive drawing.
+void CTreemap::RenderLayout(CColorRefArray &bitmap)
 {
-    // Rest rectangle to fill
-    CRect remaining(parent->TmiGetRectangle());
+    const bool cushions = IsCushionShading();
 
-    ASSERT(remaining.Width() > 0);
-    ASSERT(remaining.Height() > 0);
+    CArray<double, double> surfaces;    // 4 per depth
+    CArray<double, double> heights;     // The h of RecurseDrawGraph()
+    CArray<double, double> slots;       // 4 per slot
+    surfaces.SetSize((m_layoutMaxDepth + 1) * 4);
+    heights.SetSize(m_layoutMaxDepth + 1);
+    slots.SetSize(m_slotCount * 4);
 
-    // Size of rest rectangle
-    ULONGLONG remainingSize = parent->TmiGetSize();
-    ASSERT(remainingSize > 0);
-
-    // Scale factor
-    const double sizePerSquarePixel = (double)parent->TmiGetSize() / remaining.Width() / remaining.Height();
-
-    // First child for next row
-    int head = 0;
-
-    // At least one child left
-    while(head < parent->TmiGetChildrenCount())
+    heights[0] = m_options.height;
+    for(int d = 1; d <= m_layoutMaxDepth; d++)
     {
-        ASSERT(remaining.Width() > 0);
-        ASSERT(remaining.Height() > 0);
-
-        // How we divide the remaining rectangle
-        bool horizontal = (remaining.Width() >= remaining.Height());
-
-        // Height of the new row
-        const int height = horizontal ? remaining.Height() : remaining.Width();
-
-        // Square of height in size scale for ratio formula
-        const double hh = (height * height) * sizePerSquarePixel;
-        ASSERT(hh > 0);
-
-        // Row will be made up of child(rowBegin)...child(rowEnd - 1)
-        int rowBegin = head;
-        int rowEnd = head;
-
-        // Worst ratio so far
-        double worst = DBL_MAX;
-
-        // Maximum size of children in row
-        ULONGLONG rmax = parent->TmiGetChild(rowBegin)->TmiGetSize();
+        heights[d] = heights[d - 1] * m_options.scaleFactor;
+    }
 
-        // Sum of sizes of children in row
-        ULONGLONG sum = 0;
+    for(INT_PTR i = 0; i < m_layoutCount; i++)
+    {
+        const LAYOUTNODE& node = m_layout[i];
+        double *surface = &surfaces[node.depth * 4];
 
-        // This condition will hold at least once.
-        while(rowEnd < parent->TmiGetChildrenCount())
+        if(cushions)
         {
-            // We check a virtual row made up of child(rowBegin)...child(rowEnd) here.
-
-            // Minimum size of child in virtual row
-            ULONGLONG rmin = parent->TmiGetChild(rowEnd)->TmiGetSize();
-
-            // If sizes of the rest of the children is zero, we add all of them
-            if(rmin == 0)
+            const double *parent = (node.parentSlot >= 0) ? &slots[node.parentSlot * 4] : surface - 4;
+            for(int j = 0; j < 4; j++)
             {
-                rowEnd = parent->TmiGetChildrenCount();
-                break;
+                surface[j] = (node.depth == 0) ? 0 : parent[j];
             }
-
-            // Calculate the worst ratio in virtual row.
-            // Formula taken from the "Squarified Treemaps" paper.
-            // (http://http://www.win.tue.nl/~vanwijk/)
-
-            const double ss = ((double)sum + rmin) * ((double)sum + rmin);
-            const double ratio1 = hh * rmax / ss;
-            const double ratio2 = ss / hh / rmin;
-
-            const double nextWorst = max(ratio1, ratio2);
-
-            // Will the ratio get worse?
-            if(nextWorst > worst)
+            if(node.depth > 0)
             {
-                // Yes. Don't take the virtual row, but the
-                // real row (child(rowBegin)..child(rowEnd - 1))
-                // made so far.
-                break;
+                AddRidge(node.rc, surface, heights[node.depth]);
+            }
+            if(node.slot >= 0)
+            {
+                for(int j = 0; j < 4; j++)
+                {
+                    slots[node.slot * 4 + j] = surface[j];
+                }
             }
-
-            // Here we have decided to add child(rowEnd) to the row.
-            sum += rmin;
-            rowEnd++;
-
-            worst = nextWorst;
         }
 
-        // Row will be made up of child(rowBegin)...child(rowEnd - 1).
-        // sum is the size of the row.
-
-        // As the size of parent is greater than zero, the size of
-        // the first child must have been greater than zero, too.
-        ASSERT(sum > 0);
-
-        // Width of row
-        int width = (horizontal ? remaining.Width() : remaining.Height());
-        ASSERT(width > 0);
-
-        if(sum < remainingSize)
-            width = (int)((double)sum / remainingSize * width);
-        // else: use up the whole width
-        // width may be 0 here.
-
-        // Build the rectangles of children.
-        CRect rc;
-        double fBegin;
-        if(horizontal)
+        if(node.leaf)
         {
-            rc.left = remaining.left;
-            rc.right = remaining.left + width;
-            fBegin = remaining.top;
+            RenderLeaf(bitmap, node.rc, surface, node.color);
         }
-        else
-        {
-            rc.top = remaining.top;
-            rc.bottom = remaining.top + width;
-            fBegin = remaining.left;
-        }
-
-        // Now put the children into their places
-        for(int i = rowBegin; i < rowEnd; i++)
-        {
-            int begin = (int)fBegin;
-            double fraction = (double)(parent->TmiGetChild(i)->TmiGetSize()) / sum;
-            double fEnd = fBegin + fraction * height;
-            int end = (int)fEnd;
-
-            bool lastChild = (i == rowEnd - 1 || parent->TmiGetChild(i+1)->TmiGetSize() == 0);
-
-            if(lastChild)
-            {
-                // Use up the whole height
-                end = (horizontal ? remaining.top + height : remaining.left + height);
-            }
+    }
+}
 
-            if(horizontal)
-            {
-                rc.top = begin;
-                rc.bottom = end;
-            }
-            else
-            {
-                rc.left = begin;
-                rc.right = end;
-            }
+void CTreemap::AddLeaf(const CRect& rc, const double *surface, DWORD color)
+{
+    if(m_leafCount == m_leaves.GetSize())
+    {
+        const INT_PTR oldSize = m_leaves.GetSize();
+        m_leaves.SetSize(max(INT_PTR(1024), 2 * oldSize));
+        CMemoryAccounting::Add(MEM_TREEMAP, LONGLONG(m_leaves.GetSize() - oldSize) * LONGLONG(sizeof(LEAF)), oldSize == 0 ? 1 : 0);
+    }
 
-            ASSERT(rc.left <= rc.right);
-            ASSERT(rc.top <= rc.bottom);
+    LEAF& leaf = m_leaves[m_leafCount++];
+    leaf.rc = rc;
+    if(IsCushionShading())
+    {
+        for(int i = 0; i < _countof(leaf.surface); i++)
+        {
+            leaf.surface[i] = surface[i];
+        }
+    }
+    leaf.color = color;
+}
 
-            ASSERT(rc.left >= remaining.left);
-            ASSERT(rc.right <= remaining.right);
-            ASSERT(rc.top >= remaining.top);
-            ASSERT(rc.bottom <= remaining.bottom);
+// Rasterizes the collected leaves in horizontal bands of the bitmap.
+// The leaves are sorted into the bands they touch (a counting sort,
+// which keeps their order), and the threads claim bands one after the
+// other. A band is written by its owner only, so no locks are needed,
+// and every pixel gets the same value as in the serial rendering.
+void CTreemap::RenderLeaves(CColorRefArray &bitmap, int threadCount)
+{
+    const int rows = m_renderArea.Height();
 
-            RecurseDrawGraph(bitmap, parent->TmiGetChild(i), rc, false, surface, h * m_options.scaleFactor, 0);
+    BANDJOB job;
+    job.bitmap = &bitmap;
+    job.bandRows = max(MIN_BANDROWS, (rows + threadCount * BANDS_PER_THREAD - 1) / (threadCount * BANDS_PER_THREAD));
+    job.bandCount = (rows + job.bandRows - 1) / job.bandRows;
+    job.nextBand = 0;
 
-            if(lastChild)
-                break;
+    m_bandStarts.SetSize(job.bandCount + 1);
+    for(int b = 0; b <= job.bandCount; b++)
+    {
+        m_bandStarts[b] = 0;
+    }
 
-            fBegin = fEnd;
+    for(INT_PTR i = 0; i < m_leafCount; i++)
+    {
+        const CRect& rc = m_leaves[i].rc;
+        for(int b = (rc.top - m_renderArea.top) / job.bandRows; b <= (rc.bottom - 1 - m_renderArea.top) / job.bandRows; b++)
+        {
+            m_bandStarts[b + 1]++;
         }
+    }
+    for(int b = 0; b < job.bandCount; b++)
+    {
+        m_bandStarts[b + 1] += m_bandStarts[b];
+    }
 
-        // Put the next row into the rest of the rectangle
-        if(horizontal)
+    m_bandLeaves.SetSize(m_bandStarts[job.bandCount]);
+    CArray<INT_PTR, INT_PTR> next;
+    next.Copy(m_bandStarts);
+    for(INT_PTR i = 0; i < m_leafCount; i++)
+    {
+        const CRect& rc = m_leaves[i].rc;
+        for(int b = (rc.top - m_renderArea.top) / job.bandRows; b <= (rc.bottom - 1 - m_renderArea.top) / job.bandRows; b++)
         {
-            remaining.left += width;
+            m_bandLeaves[next[b]++] = i;
         }
-        else
+    }
+
+    // The calling thread renders bands, too.
+    CTreemapBandThread *threads[MAX_RENDERTHREADS];
+    for(int i = 1; i < threadCount; i++)
+    {
+        threads[i] = new CTreemapBandThread(this, &job);
+        if(!threads[i]->Start())
         {
-            remaining.top += width;
+            delete threads[i];
+            threads[i] = NULL;
         }
+    }
 
-        remainingSize -= sum;
-
-        ASSERT(remaining.left <= remaining.right);
-        ASSERT(remaining.top <= remaining.bottom);
-
-        ASSERT(remainingSize >= 0);
-
-        head += (rowEnd - rowBegin);
+    RenderBands(&job);
 
-        if(remaining.Width() <= 0 || remaining.Height() <= 0)
+    for(int i = 1; i < threadCount; i++)
+    {
+        if(threads[i] != NULL)
         {
-            if(head < parent->TmiGetChildrenCount())
-            {
-                parent->TmiGetChild(head)->TmiSetRectangle(CRect(-1, -1, -1, -1));
-            }
-
-            break;
+            ::WaitForSingleObject(threads[i]->m_hThread, INFINITE);
+            delete threads[i];
         }
     }
-    ASSERT(remainingSize == 0);
-    ASSERT(remaining.left == remaining.right || remaining.top == remaining.bottom);
 }
 
-
-// No squarification. Children are arranged alternately horizontally and vertically.
-//
-void CTreemap::Simple_DrawChildren(CColorRefArray &bitmap, Item *parent, const double *surface, double h, DWORD flags)
+void CTreemap::RenderBands(BANDJOB *job)
 {
-#if 1
-    ASSERT(0); // Not used in WinDirStat.
-
-    bitmap; parent; surface; h; flags;
-
-#else
-    ASSERT(parent->TmiGetChildrenCount() > 0);
-    ASSERT(parent->TmiGetSize() > 0);
-
-    const CRect& rc = parent->TmiGetRectangle();
-
-    bool horizontal = (flags == 0);
-
-    int width = horizontal ? rc.Width() : rc.Height();
-    ASSERT(width >= 0);
-
-    double fBegin = horizontal ? rc.left : rc.top;
-    int veryEnd = horizontal ? rc.right : rc.bottom;
-
-    for(int i = 0; i < parent->TmiGetChildrenCount(); i++)
+    for(;;)
     {
-        double fraction = (double)(parent->TmiGetChild(i)->TmiGetSize()) / parent->TmiGetSize();
-
-        double fEnd = fBegin + fraction * width;
-
-        bool lastChild = (i == parent->TmiGetChildrenCount() - 1 || parent->TmiGetChild(i + 1)->TmiGetSize() == 0);
-
-        if(lastChild)
+        const int b = ::InterlockedIncrement(&job->nextBand) - 1;
+        if(b >= job->bandCount)
         {
-            fEnd = veryEnd;
+            break;
         }
 
-        int begin = (int)fBegin;
-        int end = (int)fEnd;
-
-        ASSERT(begin <= end);
-        ASSERT(end <= veryEnd);
+        const int top = m_renderArea.top + b * job->bandRows;
+        const int bottom = min(top + job->bandRows, m_renderArea.bottom);
 
-        CRect rcChild;
-        if(horizontal)
-        {
-            rcChild.left = begin;
-            rcChild.right = end;
-            rcChild.top = rc.top;
-            rcChild.bottom = rc.bottom;
-        }
-        else
+        for(INT_PTR j = m_bandStarts[b]; j < m_bandStarts[b + 1]; j++)
         {
-            rcChild.top = begin;
-            rcChild.bottom = end;
-            rcChild.left = rc.left;
-            rcChild.right = rc.right;
-        }
+            const LEAF& leaf = m_leaves[m_bandLeaves[j]];
 
-        RecurseDrawGraph(
-            bitmap,
-            parent->TmiGetChild(i),
-            rcChild,
-            false,
-            surface,
-            h * m_options.scaleFactor,
-            flags == 0 ? 1 : 0
-        );
-
-        if(lastChild)
-        {
-            i++;
-            break;
-        }
+            CRect rc = leaf.rc;
+            rc.top = max(rc.top, top);
+            rc.bottom = min(rc.bottom, bottom);
 
-        fBegin = fEnd;
-    }
-    if(i < parent->TmiGetChildrenCount())
-    {
-        parent->TmiGetChild(i)->TmiSetRectangle(CRect(-1, -1, -1, -1));
+            RenderRectangle(*job->bitmap, rc, leaf.surface, leaf.color);
+        }
     }
-#endif
 }
 
-bool CTreemap::IsCushionShading()
+void CTreemap::RenderPlaceholder(CColorRefArray &bitmap, CRect rc)
 {
-    return m_options.ambientLight < 1.0
-        && m_options.height > 0.0
-        && m_options.scaleFactor > 0.0;
-}
-
-void CTreemap::RenderLeaf(CColorRefArray &bitmap, Item *item, const double *surface)
-{
-    CRect rc = item->TmiGetRectangle();
-
     if(m_options.grid)
     {
         rc.top++;
@@ -1177,7 +1649,7 @@ void CTreemap::RenderLeaf(CColorRefArray &bitmap, Item *item, const double *surf
         }
     }
 
-    RenderRectangle(bitmap, rc, surface, item->TmiGetGraphColor());
+    DrawSolidRect(bitmap, rc, PLACEHOLDER_COLOR, m_options.brightness);
 }
 
 void CTreemap::RenderRectangle(CColorRefArray &bitmap, const CRect& rc, const double *surface, DWORD color)
@@ -1231,11 +1703,18 @@ void CTreemap::DrawSolidRect(CColorRefArray &bitmap, const CRect& rc, COLORREF c
     {
         for (int ix = rc.left; ix < rc.right; ix++)
         {
-            bitmap[ix + iy * m_renderArea.Width()] = BGR(blue, green, red);
+            bitmap[ix + (iy - m_stripTop) * m_renderArea.Width()] = BGR(blue, green, red);
         }
     }
 }
 
+// The cushion is evaluated in blocks of CUSHION_COLUMNS columns.
+// The terms, which depend only on the column (nx), are computed once per
+// block, those which depend only on the row (ny) once per row. What
+// remains per pixel is a loop without branches over contiguous arrays,
+// two pixels at a time with SSE2, followed by the conversion to BGR.
+// The operations and their order are those of CushionPixel(), so the
+// result is identical (CheckCushions() verifies it).
 void CTreemap::DrawCushion(CColorRefArray &bitmap, const CRect& rc, const double *surface, COLORREF col, double brightness)
 {
     // Cushion parameters
@@ -1248,47 +1727,205 @@ void CTreemap::DrawCushion(CColorRefArray &bitmap, const CRect& rc, const double
     const double colG = RGB_GET_GVALUE(col);
     const double colB = RGB_GET_BVALUE(col);
 
-    for(int iy  =  rc.top; iy < rc.bottom; iy++)
-    for(int ix  =  rc.left; ix < rc.right; ix++)
+    // Apply "brightness"
+    const double factor = brightness / PALETTE_BRIGHTNESS;
+
+    const double Lx = m_Lx;
+    const double Ly = m_Ly;
+    const double Lz = m_Lz;
+
+    double nxLx[CUSHION_COLUMNS];   // nx * m_Lx
+    double nx2[CUSHION_COLUMNS];    // nx * nx
+    double light[CUSHION_COLUMNS];  // The brightness of the pixels of one row
+
+    const int stride = m_renderArea.Width();
+    COLORREF *bits = bitmap.GetData();
+
+#if defined(_M_IX86) || defined(_M_X64)
+    const __m128d vLz = _mm_set1_pd(Lz);
+    const __m128d vOne = _mm_set1_pd(1.0);
+    const __m128d vZero = _mm_setzero_pd();
+    const __m128d vIs = _mm_set1_pd(Is);
+    const __m128d vIa = _mm_set1_pd(Ia);
+    const __m128d vFactor = _mm_set1_pd(factor);
+#endif
+
+    for(int left = rc.left; left < rc.right; left += CUSHION_COLUMNS)
     {
-        double nx = -(2 * surface[0] * (ix + 0.5) + surface[2]);
-        double ny = -(2 * surface[1] * (iy + 0.5) + surface[3]);
-        double cosa = (nx*m_Lx + ny*m_Ly + m_Lz) / sqrt(nx*nx + ny*ny + 1.0);
-        if(cosa > 1.0)
+        const int count = min(CUSHION_COLUMNS, rc.right - left);
+
+        for(int i = 0; i < count; i++)
         {
-            cosa = 1.0;
+            const double nx = -(2 * surface[0] * (left + i + 0.5) + surface[2]);
+            nxLx[i] = nx * Lx;
+            nx2[i] = nx * nx;
         }
 
-        double pixel = Is * cosa;
-        if(pixel < 0)
+        for(int iy = rc.top; iy < rc.bottom; iy++)
         {
-            pixel = 0;
+            const double ny = -(2 * surface[1] * (iy + 0.5) + surface[3]);
+            const double nyLy = ny * Ly;
+            const double ny2 = ny * ny;
+
+            int i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+            if(m_sse2)
+            {
+                const __m128d vnyLy = _mm_set1_pd(nyLy);
+                const __m128d vny2 = _mm_set1_pd(ny2);
+                for(; i + 2 <= count; i += 2)
+                {
+                    const __m128d numerator = _mm_add_pd(_mm_add_pd(_mm_loadu_pd(&nxLx[i]), vnyLy), vLz);
+                    const __m128d denominator = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_loadu_pd(&nx2[i]), vny2), vOne));
+                    const __m128d cosa = _mm_min_pd(_mm_div_pd(numerator, denominator), vOne);
+                    const __m128d pixel = _mm_max_pd(_mm_mul_pd(vIs, cosa), vZero);
+                    _mm_storeu_pd(&light[i], _mm_mul_pd(_mm_add_pd(pixel, vIa), vFactor));
+                }
+            }
+#endif
+
+            for(; i < count; i++)
+            {
+                double cosa = (nxLx[i] + nyLy + Lz) / sqrt(nx2[i] + ny2 + 1.0);
+                cosa = cosa > 1.0 ? 1.0 : cosa;
+
+                double pixel = Is * cosa;
+                pixel = pixel < 0 ? 0 : pixel;
+
+                // Now, pixel + Ia is the brightness of the pixel, 0...1.0.
+
+                // Apply contrast.
+                // Not implemented.
+                // Costs performance and nearly the same effect can be
+                // made width the m_options->ambientLight parameter.
+                // pixel = pow(pixel, m_options->contrast);
+
+                light[i] = (pixel + Ia) * factor;
+            }
+
+            COLORREF *row = bits + left + (iy - m_stripTop) * stride;
+            for(int i = 0; i < count; i++)
+            {
+                // Make color value
+                int red     = (int)(colR * light[i]);
+                int green   = (int)(colG * light[i]);
+                int blue    = (int)(colB * light[i]);
+
+                CColorSpace::NormalizeColor(red, green, blue);
+
+                // ... and set!
+                row[i] = BGR(blue, green, red);
+            }
         }
+    }
+}
+
+// The straight per-pixel formula, which DrawCushion() must match
+COLORREF CTreemap::CushionPixel(int ix, int iy, const double *surface, COLORREF col, double brightness) const
+{
+    const double Ia = m_options.ambientLight;
+    const double Is = 1 - Ia;
+
+    double nx = -(2 * surface[0] * (ix + 0.5) + surface[2]);
+    double ny = -(2 * surface[1] * (iy + 0.5) + surface[3]);
+    double cosa = (nx*m_Lx + ny*m_Ly + m_Lz) / sqrt(nx*nx + ny*ny + 1.0);
+    if(cosa > 1.0)
+    {
+        cosa = 1.0;
+    }
+
+    double pixel = Is * cosa;
+    if(pixel < 0)
+    {
+        pixel = 0;
+    }
+
+    pixel += Ia;
+    ASSERT(pixel <= 1.0);
 
-        pixel += Ia;
-        ASSERT(pixel <= 1.0);
+    pixel*= brightness / PALETTE_BRIGHTNESS;
 
-        // Now, pixel is the brightness of the pixel, 0...1.0.
+    int red     = (int)(RGB_GET_RVALUE(col) * pixel);
+    int green   = (int)(RGB_GET_GVALUE(col) * pixel);
+    int blue    = (int)(RGB_GET_BVALUE(col) * pixel);
 
-        // Apply contrast.
-        // Not implemented.
-        // Costs performance and nearly the same effect can be
-        // made width the m_options->ambientLight parameter.
-        // pixel = pow(pixel, m_options->contrast);
+    CColorSpace::NormalizeColor(red, green, blue);
+
+    return BGR(blue, green, red);
+}
 
-        // Apply "brightness"
-        pixel*= brightness / PALETTE_BRIGHTNESS;
+INT_PTR CTreemap::CheckCushions(CSize size, int cushions)
+{
+    const CRect renderArea = m_renderArea;
+    const int stripTop = m_stripTop;
+    const bool sse2 = m_sse2;
 
-        // Make color value
-        int red     = (int)(colR * pixel);
-        int green   = (int)(colG * pixel);
-        int blue    = (int)(colB * pixel);
+    m_renderArea = CRect(CPoint(0, 0), size);
+    m_stripTop = 0;
+
+    CFramebuffer frame(size.cx * size.cy);
+    CColorRefArray& bits = frame.GetBits();
+
+    INT_PTR errors = 0;
+    ULONGLONG state = 1;
+    for(int k = 0; k < cushions; k++)
+    {
+        // Nested rectangles with the ridges of their ancestors, as in RecurseDrawGraph()
+        CRect rc(CPoint(0, 0), size);
+        double surface[4] = { 0, 0, 0, 0 };
+        double h = m_options.height;
+        for(int depth = 0; depth < CHECK_CUSHION_DEPTH; depth++)
+        {
+            CRect child;
+            child.left = rc.left + NextRandom(state, rc.Width() / 2);
+            child.top = rc.top + NextRandom(state, rc.Height() / 2);
+            child.right = child.left + 1 + NextRandom(state, rc.right - child.left - 1);
+            child.bottom = child.top + 1 + NextRandom(state, rc.bottom - child.top - 1);
+            rc = child;
+
+            h *= m_options.scaleFactor;
+            AddRidge(rc, surface, h);
+        }
 
-        CColorSpace::NormalizeColor(red, green, blue);
+        const COLORREF color = _defaultCushionColors[k % _countof(_defaultCushionColors)];
 
-        // ... and set!
-        bitmap[ix + iy * m_renderArea.Width()] = BGR(blue, green, red);
+        // The scalar loop, then the SSE2 one
+        for(int variant = 0; variant < 2; variant++)
+        {
+#if defined(_M_IX86) || defined(_M_X64)
+            m_sse2 = (variant == 1 && HasSSE2());
+            if(variant == 1 && !m_sse2)
+            {
+                break;
+            }
+#else
+            if(variant == 1)
+            {
+                break;
+            }
+#endif
+
+            DrawCushion(bits, rc, surface, color, m_options.brightness);
+
+            for(int iy = rc.top; iy < rc.bottom; iy++)
+            {
+                for(int ix = rc.left; ix < rc.right; ix++)
+                {
+                    if(bits[ix + iy * size.cx] != CushionPixel(ix, iy, surface, color, m_options.brightness))
+                    {
+                        errors++;
+                    }
+                }
+            }
+        }
     }
+
+    m_renderArea = renderArea;
+    m_stripTop = stripTop;
+    m_sse2 = sse2;
+
+    return errors;
 }
 
 void CTreemap::AddRidge(const CRect& rc, double *surface, double h)
@@ -1413,5 +2050,23 @@ void CTreemapPreview::OnPaint()
     CPaintDC dc(this);
     CRect rc;
     GetClientRect(rc);
-    m_treemap.DrawTreemapDoubleBuffered(&dc, rc, m_root);
+
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    // Double buffered, as CTreemap::DrawTreemapDoubleBuffered(), but the
+    // demo tree is drawn by CTreemapEngine.
+    CDC dcmem;
+    VERIFY(dcmem.CreateCompatibleDC(&dc));
+
+    CBitmap bmp;
+    VERIFY(bmp.CreateCompatibleBitmap(&dc, rc.Width(), rc.Height()));
+
+    CSelectObject sobmp(&dcmem, &bmp);
+
+    DrawTreemapStatic<CItem::Access>(m_treemap, &dcmem, CRect(CPoint(0, 0), rc.Size()), m_root);
+
+    VERIFY(dc.BitBlt(rc.left, rc.top, rc.Width(), rc.Height(), &dcmem, 0, 0, SRCCOPY));
 }
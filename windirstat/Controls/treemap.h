@@ -23,6 +23,10 @@
 #define __WDS_TREEMAP_H__
 #pragma once
 
+#include "Framebuffer.h"
+
+class CWorkLimiter;
+
 //
 // CColorSpace. Helper class for manipulating colors. Static members only.
 //
@@ -46,17 +50,17 @@ protected:
     static void DistributeFirst(int& first, int& second, int& third);
 };
 
-typedef CArray<COLORREF, COLORREF> CColorRefArray;
-typedef CArray<COLORREF, COLORREF&> CColorRefRArray;
-
 //
 // CTreemap. Can create a treemap. Knows 3 squarification methods:
-// KDirStat-like, SequoiaView-like and Simple.
+// KDirStat-like, SequoiaView-like and Simple (see CTreemapLayout).
 //
 // This class is fairly reusable.
 //
 class CTreemap
 {
+    friend class CTreemapBandThread;
+    template<class Access, int style> friend class CTreemapEngine;
+
 public:
     // One of these flags can be added to the COLORREF returned
     // by TmiGetGraphColor(). Used for <Free space> (darker)
@@ -100,6 +104,32 @@ public:
         virtual void TreemapDrawingCallback() = 0;
     };
 
+    //
+    // StripSink. Receives the image of DrawTreemapStrips(), a strip
+    // of rows at a time, top to bottom. The pixels are laid out as in
+    // a 32 bit bitmap (0x00RRGGBB), width per row. Returning false
+    // cancels the drawing.
+    //
+    class StripSink
+    {
+    public:
+        virtual bool TreemapStrip(const COLORREF *bits, int width, int rows) = 0;
+    };
+
+    //
+    // DRAWINGSTATE. What FindItemByPoint() and DrawTreemapPart() need of
+    // the last drawing, besides the rectangles of the items.
+    //
+    struct DRAWINGSTATE
+    {
+        CRect renderArea;
+        bool hitIndexValid;
+        Item *hitRoot;
+        CRect hitArea;
+        CArray<UINT, UINT> hitPixels;
+        CArray<Item *, Item *> hitItems;
+    };
+
     //
     // Treemap squarification style.
     //
@@ -160,11 +190,26 @@ public:
 public:
     // Construct the treemap generator and register the callback interface.
     CTreemap(Callback *callback = NULL);
+    ~CTreemap();
 
     // Alter the options
     void SetOptions(const Options *options);
     Options GetOptions();
 
+    // 0 (default): one per processor, at most MAX_RENDERTHREADS. For benchmarks.
+    void SetRenderThreads(int threads);
+
+    // If enabled, DrawTreemap() keeps the layout and only re-shades it, as long
+    // as root, size, style and grid are the same. The owner must discard it,
+    // whenever the tree changes.
+    void SetCacheLayout(bool cache);
+    void DiscardLayout();
+
+    // If enabled, drawing records which item each pixel shows (4 bytes
+    // per pixel), and FindItemByPoint() looks the point up there instead
+    // of walking down the tree. Discarded with the layout.
+    void SetHitIndex(bool index);
+
 #ifdef _DEBUG
     // DEBUG function
     void RecurseCheckTree(Item *item);
@@ -176,14 +221,115 @@ public:
     // Same as above but double buffered
     void DrawTreemapDoubleBuffered(CDC *pdc, const CRect& rc, Item *root, const Options *options =NULL);
 
+    // Without a CDC, for images larger than any bitmap. Only stripRows
+    // rows are held in memory: each strip is laid out anew, but only the
+    // items which touch it are subdivided. Frame and grid as DrawTreemap().
+    // Returns false, if the sink has cancelled.
+    bool DrawTreemapStrips(StripSink *sink, CSize size, Item *root, int stripRows, const Options *options =NULL);
+
+    // Partial redrawing after the tree has changed below an item.
+    // LayoutChildren() sets the rectangles of the children of parent, as
+    // DrawTreemap() would, but renders nothing. DrawTreemapPart() redraws
+    // path[count - 1] into its rectangle. path[0] must be the root of the
+    // last DrawTreemap() into pdc, and the rectangles along the path those
+    // of that drawing. The hit index is updated, the layout is discarded.
+    void LayoutChildren(Item *parent);
+    void DrawTreemapPart(CDC *pdc, Item *const *path, int count);
+
+    // For a cache of drawings. RestoreDrawingState() makes an earlier
+    // drawing the last one again; the owner restores the rectangles.
+    void SaveDrawingState(DRAWINGSTATE& state) const;
+    void RestoreDrawingState(const DRAWINGSTATE& state);
+
+    // Progressive drawing. BeginDrawing() draws the frame, ContinueDrawing()
+    // lays out and renders the next levels until the limiter is done and
+    // returns true, when the treemap is complete. The levels not yet
+    // reached are flat rectangles. PaintDrawing() blits the current state,
+    // EndDrawing() frees it (or cancels the drawing).
+    // The tree must not change in between.
+    void BeginDrawing(CDC *pdc, CRect rc, Item *root, const Options *options =NULL);
+    bool ContinueDrawing(CWorkLimiter *limiter);
+    void PaintDrawing(CDC *pdc);
+    void EndDrawing();
+    bool IsDrawing() const;
+
     // In the resulting treemap, find the item below a given coordinate.
     // Return value can be NULL, iff point is outside root rect.
+    // While drawing progressively without hit index, the items below
+    // the levels laid out so far are not found.
     Item *FindItemByPoint(Item *root, CPoint point);
 
     // Draws a sample rectangle in the given style (for color legend)
     void DrawColorPreview(CDC *pdc, const CRect& rc, COLORREF color, const Options *options =NULL);
 
+    // Self check for the benchmark: draws random cushions of size with
+    // DrawCushion(), with and without SSE2, and compares them with the
+    // straight per-pixel formula. Returns the number of wrong pixels.
+    INT_PTR CheckCushions(CSize size, int cushions);
+
 protected:
+    // A leaf rectangle, as collected by RenderLeaf() for RenderLeaves()
+    struct LEAF
+    {
+        CRect rc;
+        double surface[4];
+        DWORD color;            // TmiGetGraphColor()
+    };
+
+    // A node of the cached layout. Only those which got a cushion ridge.
+    // In pre-order, so the parent of a node is the last one with depth - 1.
+    // A progressive drawing records one pre-order run per pending node;
+    // the first node of such a run finds the surface of its parent in a slot.
+    struct LAYOUTNODE
+    {
+        CRect rc;
+        int depth;              // The root has 0
+        bool leaf;
+        DWORD color;            // Leaves only. TmiGetGraphColor()
+        int slot;               // >= 0: keeps its surface there for pending children
+        int parentSlot;         // >= 0: the slot with the surface of the parent
+    };
+
+    // A node, which a progressive drawing has left to a later step
+    struct PENDINGNODE
+    {
+        Item *item;
+        CRect rc;
+        double surface[4];      // Of the parent
+        double h;
+        int depth;
+        int parentSlot;         // See LAYOUTNODE
+    };
+
+    // What the band threads of RenderLeaves() share
+    struct BANDJOB
+    {
+        CColorRefArray *bitmap;
+        int bandRows;
+        int bandCount;
+        volatile LONG nextBand;     // The next band to be claimed
+    };
+
+    int GetRenderThreadCount(int rows) const;
+    void AddLeaf(const CRect& rc, const double *surface, DWORD color);
+    bool IsLayoutCached(Item *root) const;
+    void ValidateLayout(Item *root);
+    void AddLayoutNode(const CRect& rc, bool leaf, DWORD color);
+    void AddPendingNode(Item *item, const CRect& rc, const double *psurface, double h);
+    void BeginHitIndex(Item *root);
+    void AddHitItem(Item *item, const CRect& rc);
+    void RenderLayout(CColorRefArray &bitmap);
+    void RenderLeaves(CColorRefArray &bitmap, int threadCount);
+    void RenderBands(BANDJOB *job);
+
+    // Draws the grid background or the shadow lines and shrinks rc
+    void DrawFrame(CDC *pdc, CRect& rc);
+
+    // Blits the bitmap to rc
+    void PaintBitmap(CDC *pdc, const CRect& rc, CColorRefArray &bitmap);
+
+    Item *RecurseFindItemByPoint(Item *item, CPoint point, int levels);
+
     // The recursive drawing function
     void RecurseDrawGraph(
         CColorRefArray &bitmap,
@@ -195,7 +341,8 @@ protected:
         DWORD flags
     );
 
-    // This function switches to KDirStat-, SequoiaView- or Simple_DrawChildren
+    // This function switches to the KDirStat-, SequoiaView- or Simple
+    // method of CTreemapLayout
     void DrawChildren(
         CColorRefArray &bitmap,
         Item *parent,
@@ -204,16 +351,16 @@ protected:
         DWORD flags
     );
 
-    // KDirStat-like squarification
-    void KDirStat_DrawChildren(CColorRefArray &bitmap, Item *parent, const double *surface, double h, DWORD flags);
-    bool KDirStat_ArrangeChildren(Item *parent, CArray<double, double>& childWidth, CArray<double, double>& rows, CArray<int, int>& childrenPerRow);
-    double KDirStat_CalcutateNextRow(Item *parent, const int nextChild, double width, int& childrenUsed, CArray<double, double>& childWidth);
-
-    // Classical SequoiaView-like squarification
-    void SequoiaView_DrawChildren(CColorRefArray &bitmap, Item *parent, const double *surface, double h, DWORD flags);
+    // The visitor of CTreemapLayout: the children of one parent
+    struct CHILDREN
+    {
+        CTreemap *treemap;
+        CColorRefArray *bitmap;
+        const double *surface;
+        double h;
 
-    // No squarification (simple style, not used in WinDirStat)
-    void Simple_DrawChildren(CColorRefArray &bitmap, Item *parent, const double *surface, double h, DWORD flags);
+        void Child(Item *child, const CRect& rc, DWORD flags);
+    };
 
     // Sets brightness to a good value, if system has only 256 colors
     void SetBrightnessFor256();
@@ -221,15 +368,19 @@ protected:
     // Returns true, if height and scaleFactor are > 0 and ambientLight is < 1.0
     bool IsCushionShading();
 
-    // Leaves space for grid and then calls RenderRectangle()
-    void RenderLeaf(CColorRefArray &bitmap, Item *item, const double *surface);
+    // Leaves space for grid and then calls RenderRectangle() or AddLeaf()
+    void RenderLeaf(CColorRefArray &bitmap, CRect rc, const double *surface, DWORD color);
+
+    // Stands for a pending node
+    void RenderPlaceholder(CColorRefArray &bitmap, CRect rc);
 
     // Either calls DrawCushion() or DrawSolidRect()
     void RenderRectangle(CColorRefArray &bitmap, const CRect& rc, const double *surface, DWORD color);
     // void RenderRectangle(CDC *pdc, const CRect& rc, const double *surface, DWORD color);
 
-    // Draws the surface using SetPixel()
+    // Draws the surface, a row of pixels at a time
     void DrawCushion(CColorRefArray &bitmap, const CRect& rc, const double *surface, COLORREF col, double brightness);
+    COLORREF CushionPixel(int ix, int iy, const double *surface, COLORREF col, double brightness) const;
 
     // Draws the surface using FillSolidRect()
     void DrawSolidRect(CColorRefArray &bitmap, const CRect& rc, COLORREF col, double brightness);
@@ -237,6 +388,13 @@ protected:
     // Adds a new ridge to surface
     static void AddRidge(const CRect& rc, double *surface, double h);
 
+    static const int CUSHION_COLUMNS = 256;             // Block width of DrawCushion()
+    static const int CHECK_CUSHION_DEPTH = 4;           // Ridges of a cushion of CheckCushions()
+    static const int MAX_RENDERTHREADS = 16;
+    static const int MIN_BANDROWS = 16;                 // Smaller bands are not worth the overhead
+    static const int BANDS_PER_THREAD = 4;              // Many bands balance the threads
+    static const int LEVELS_PER_STEP = 2;               // Of a progressive drawing
+
     static const Options  _defaultOptions;              // Good values. Default for WinDirStat 1.0.2
     static const Options  _defaultOptionsOld;           // WinDirStat 1.0.1 default options
     static const COLORREF _defaultCushionColors[];      // Standard palette for WinDirStat
@@ -250,6 +408,63 @@ protected:
     double m_Lz;
 
     Callback *m_callback;   // Current callback
+
+    int m_renderThreads;    // See SetRenderThreads()
+    bool m_sse2;            // DrawCushion() may use SSE2
+
+    // DrawTreemapStrips(): only the rows m_stripTop..m_stripBottom-1 are
+    // rendered, and the bitmap starts with row m_stripTop.
+    // 0 and INT_MAX otherwise.
+    int m_stripTop;
+    int m_stripBottom;
+
+    // Parallel rasterization: RecurseDrawGraph() only lays out and collects
+    // the leaves, which RenderLeaves() then renders in horizontal bands.
+    bool m_collectLeaves;
+    CArray<LEAF, const LEAF&> m_leaves;     // Grows only, m_leafCount are valid
+    INT_PTR m_leafCount;
+    CArray<INT_PTR, INT_PTR> m_bandStarts;  // Into m_bandLeaves, per band
+    CArray<INT_PTR, INT_PTR> m_bandLeaves;  // Indexes into m_leaves, sorted by band
+
+    // The layout cache. Geometry and colors only, the shading is redone
+    // from it by RenderLayout().
+    bool m_cacheLayout;
+    bool m_recordLayout;                    // RecurseDrawGraph() fills m_layout
+    bool m_layoutValid;
+    Item *m_layoutRoot;                     // The key
+    CRect m_layoutArea;
+    STYLE m_layoutStyle;
+    bool m_layoutGrid;
+    CArray<LAYOUTNODE, const LAYOUTNODE&> m_layout; // Grows only, m_layoutCount are valid
+    INT_PTR m_layoutCount;
+    int m_layoutDepth;                      // Of the current node in RecurseDrawGraph()
+    int m_layoutMaxDepth;
+    int m_layoutParentSlot;                 // For the next AddLayoutNode()
+    int m_slotCount;
+    CArray<INT_PTR, INT_PTR> m_layoutPath;  // Index of the last node per depth
+
+    // Progressive drawing. RecurseDrawGraph() stops at m_depthLimit and
+    // queues the deeper nodes. They are refined in FIFO order, so the
+    // treemap gets finer level by level.
+    bool m_drawing;
+    bool m_reshadeLayout;                   // The layout was cached
+    Item *m_drawingRoot;
+    CColorRefArray *m_drawingBits;          // Of GetFramebufferPool()
+    int m_depthLimit;                       // INT_MAX, unless in ContinueDrawing()
+    CArray<PENDINGNODE, const PENDINGNODE&> m_pending; // Grows only
+    INT_PTR m_pendingHead;                  // m_pendingCount are valid from here
+    INT_PTR m_pendingCount;
+
+    // The hit index. RecurseDrawGraph() writes the id of each item, which
+    // it does not subdivide, into its pixels. Built along with the layout,
+    // so it stays valid while the layout is only re-shaded.
+    bool m_hitIndex;                        // See SetHitIndex()
+    bool m_hitIndexValid;
+    Item *m_hitRoot;
+    CRect m_hitArea;
+    CArray<UINT, UINT> m_hitPixels;         // Item ids, m_hitArea.Width() per row
+    CArray<Item *, Item *> m_hitItems;      // Grows only, m_hitItemCount are valid
+    INT_PTR m_hitItemCount;
 };
 
 
@@ -302,6 +517,19 @@ class CTreemapPreview: public CStatic
         virtual        Item *TmiGetChild(int c)         const   { return m_children[c]; }
         virtual     ULONGLONG TmiGetSize()              const   { return m_size; }
 
+        // The policy of CTreemapEngine (see TreemapEngine.h)
+        struct Access
+        {
+            typedef CItem *Node;
+
+            static int GetChildrenCount(const CItem *item)          { return (int)item->m_children.GetSize(); }
+            static CItem *GetChild(const CItem *item, int i)        { return item->m_children[i]; }
+            static ULONGLONG GetSize(const CItem *item)             { return item->m_size; }
+            static bool IsLeaf(const CItem *item)                   { return item->m_children.GetSize() == 0; }
+            static COLORREF GetGraphColor(const CItem *item)        { return item->m_color; }
+            static void SetRectangle(CItem *item, const CRect& rc)  { item->m_rect = rc; }
+        };
+
     private:
         CArray<CItem *, CItem *> m_children;    // Our children
         int m_size;                             // Our size (in fantasy units)
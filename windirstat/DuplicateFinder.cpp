@@ -0,0 +1,836 @@
+// DuplicateFinder.cpp - Implementation of CDuplicateFinder
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "globalhelpers.h"
+#include "DuplicateFinder.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+//
+// CDuplicateReaderThread. One thread of the reader pool.
+//
+class CDuplicateReaderThread: public CWinThread
+{
+public:
+    CDuplicateReaderThread(CDuplicateFinder *finder);
+    bool Start();
+    virtual BOOL InitInstance();
+
+private:
+    CDuplicateFinder *m_finder;
+};
+
+CDuplicateReaderThread::CDuplicateReaderThread(CDuplicateFinder *finder)
+    : m_finder(finder)
+{
+    // The finder waits for us and deletes us.
+    m_bAutoDelete = false;
+}
+
+// False, if the thread could not be created. The finder deletes us then.
+bool CDuplicateReaderThread::Start()
+{
+    return (CreateThread() != FALSE);
+}
+
+BOOL CDuplicateReaderThread::InitInstance()
+{
+    HCRYPTPROV provider = NULL;
+    if(!::CryptAcquireContext(&provider, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT))
+    {
+        VTRACE(_T("CryptAcquireContext() failed: %u"), ::GetLastError());
+        provider = NULL;
+    }
+
+    while(!m_finder->IsCanceled() && !m_finder->IsDone())
+    {
+        int candidate;
+        CDuplicateFinder::STAGE stage;
+        if(!m_finder->TakeJob(candidate, stage))
+        {
+            ::WaitForSingleObject(m_finder->m_wakeup, 100);
+            continue;
+        }
+
+        m_finder->DoJob(provider, candidate, stage);
+    }
+
+    if(provider != NULL)
+    {
+        ::CryptReleaseContext(provider, 0);
+    }
+
+    return false; // no Run(), please!
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+ULONGLONG DUPLICATESET::GetWastedBytes() const
+{
+    return size * (items.GetSize() - 1);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+
+const CDuplicateFinder *CDuplicateFinder::_qsortFinder;
+CDuplicateFinder::STAGE CDuplicateFinder::_qsortStage;
+
+CDuplicateFinder::CDuplicateFinder(CItem *root)
+    : m_stage(STAGE_SIZE)
+    , m_completed(0)
+    , m_nextDevice(0)
+    , m_bytesDone(0)
+    , m_cacheHits(0)
+    , m_canceled(false)
+    , m_progressRange(0)
+    , m_wastedBytes(0)
+    , m_linkCount(0)
+    , m_provider(NULL)
+{
+    CWaitCursor wc;
+
+    CString cachePath = CHashCache::GetDefaultPath();
+    if(!cachePath.IsEmpty())
+    {
+        m_cache.Open(cachePath, HEADTAILBYTES);
+    }
+
+    RecurseCollectCandidates(root);
+
+    // Stage 1: size
+    m_live.SetSize(m_candidates.GetSize());
+    for(int i = 0; i < m_candidates.GetSize(); i++)
+    {
+        m_live[i] = i;
+    }
+    Regroup(STAGE_SIZE);
+
+    // The progress counts the bytes to read. Stage 3 gets
+    // the worst case, in which stage 2 splits nothing.
+    for(int i = 0; i < m_live.GetSize(); i++)
+    {
+        const ULONGLONG size = m_candidates[m_live[i]].size;
+        m_progressRange += min(size, 2 * HEADTAILBYTES);
+        if(size > 2 * HEADTAILBYTES)
+        {
+            m_progressRange += size;
+        }
+    }
+
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    const int readers = max(1, min((int)si.dwNumberOfProcessors, MAX_READERS));
+
+    StartStage(STAGE_HEADTAIL);
+
+    for(int i = 0; i < readers && m_stage != STAGE_DONE; i++)
+    {
+        CDuplicateReaderThread *reader = new CDuplicateReaderThread(this);
+        if(reader->Start())
+        {
+            m_readers.Add(reader);
+        }
+        else
+        {
+            delete reader;
+        }
+    }
+
+    if(m_readers.GetSize() == 0 && m_stage != STAGE_DONE)
+    {
+        // Work() does the jobs then, one per call.
+        VTRACE(_T("No reader thread could be started"));
+        if(!::CryptAcquireContext(&m_provider, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT))
+        {
+            VTRACE(_T("CryptAcquireContext() failed: %u"), ::GetLastError());
+            m_provider = NULL;
+        }
+    }
+}
+
+CDuplicateFinder::~CDuplicateFinder()
+{
+    m_canceled = true;
+    m_wakeup.SetEvent();
+
+    for(int i = 0; i < m_readers.GetSize(); i++)
+    {
+        ::WaitForSingleObject(m_readers[i]->m_hThread, INFINITE);
+        delete m_readers[i];
+    }
+
+    if(m_provider != NULL)
+    {
+        ::CryptReleaseContext(m_provider, 0);
+    }
+
+    for(int i = 0; i < m_sets.GetSize(); i++)
+    {
+        delete m_sets[i];
+    }
+}
+
+bool CDuplicateFinder::Work()
+{
+    if(m_stage == STAGE_DONE)
+    {
+        return true;
+    }
+
+    if(m_readers.GetSize() > 0)
+    {
+        // Sleep until a reader has finished a job, but not longer
+        // than the user would notice, and not if there is input.
+        HANDLE h = m_jobFinished;
+        ::MsgWaitForMultipleObjects(1, &h, false, 50, QS_ALLINPUT);
+    }
+    else
+    {
+        // Without readers, the gui thread reads.
+        int candidate;
+        STAGE stage;
+        if(TakeJob(candidate, stage))
+        {
+            DoJob(m_provider, candidate, stage);
+        }
+    }
+
+    bool stageDone;
+    {
+        CSingleLock lock(&m_cs, true);
+        stageDone = (m_completed == m_jobs.GetSize());
+    }
+
+    if(stageDone)
+    {
+        AdvanceStage();
+    }
+
+    return m_stage == STAGE_DONE;
+}
+
+bool CDuplicateFinder::IsDone() const
+{
+    return m_stage == STAGE_DONE;
+}
+
+ULONGLONG CDuplicateFinder::GetProgressRange() const
+{
+    return m_progressRange;
+}
+
+ULONGLONG CDuplicateFinder::GetProgressPos()
+{
+    CSingleLock lock(&m_cs, true);
+    return m_bytesDone;
+}
+
+INT_PTR CDuplicateFinder::GetSetCount() const
+{
+    return m_sets.GetSize();
+}
+
+const DUPLICATESET *CDuplicateFinder::GetSet(INT_PTR i) const
+{
+    return m_sets[i];
+}
+
+ULONGLONG CDuplicateFinder::GetWastedBytes() const
+{
+    return m_wastedBytes;
+}
+
+INT_PTR CDuplicateFinder::GetRedundantCount() const
+{
+    return m_redundant.GetCount();
+}
+
+bool CDuplicateFinder::IsRedundantCopy(const CItem *item) const
+{
+    return m_redundant.Lookup(item) != FALSE;
+}
+
+// One line per set: the wasted bytes, the count and size of the files,
+// followed by the paths, one per line.
+//
+CString CDuplicateFinder::FormatReport() const
+{
+    CString report;
+    for(int i = 0; i < m_sets.GetSize(); i++)
+    {
+        const DUPLICATESET *set = m_sets[i];
+
+        CString line;
+        line.Format(_T("%s wasted: %d x %s\r\n"),
+            FormatBytes(set->GetWastedBytes()).GetString(),
+            (int)set->items.GetSize(),
+            FormatBytes(set->size).GetString()
+        );
+        report += line;
+
+        for(int j = 0; j < set->items.GetSize(); j++)
+        {
+            report += _T("    ") + set->items[j]->GetPath() + _T("\r\n");
+        }
+        report += _T("\r\n");
+    }
+    return report;
+}
+
+void CDuplicateFinder::RecurseCollectCandidates(CItem *item)
+{
+    if(item->GetType() == IT_FILE)
+    {
+        // Empty files are all equal, but waste nothing.
+        if(item->GetSize() > 0)
+        {
+            CANDIDATE c;
+            c.item = item;
+            c.path = item->GetPath();
+            c.size = item->GetSize();
+            c.device = GetDevice(c.path);
+            ZeroMemory(&c.headTail, sizeof(c.headTail));
+            ZeroMemory(&c.full, sizeof(c.full));
+            ZeroMemory(&c.id, sizeof(c.id));
+            c.identified = false;
+            c.complete = false;
+            c.failed = false;
+            m_candidates.Add(c);
+        }
+        return;
+    }
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        RecurseCollectCandidates(item->GetChild(i));
+    }
+}
+
+// "C:" for "C:\...", "\\server" for "\\server\share\...".
+// Reads on different devices don't slow each other down.
+//
+int CDuplicateFinder::GetDevice(const CString& path)
+{
+    CString name;
+    if(path.Left(2) == _T("\\\\"))
+    {
+        int i = path.Find(wds::chrBackslash, 2);
+        name = (i == -1) ? path : path.Left(i);
+    }
+    else
+    {
+        name = path.Left(2);
+    }
+    name.MakeLower();
+
+    for(int i = 0; i < m_devices.GetSize(); i++)
+    {
+        if(m_devices[i].name == name)
+        {
+            return i;
+        }
+    }
+
+    DEVICE d;
+    d.name = name;
+    d.next = 0;
+    d.end = 0;
+    d.active = 0;
+    return (int)m_devices.Add(d);
+}
+
+// Removes the hard links from m_live: of the candidates, which are
+// names of the same file, only the first one in tree order stays.
+// Links have the same size, so they are in the same group of m_live,
+// which keeps the order of the tree within a group.
+//
+void CDuplicateFinder::CollapseLinks()
+{
+    CMap<HASHCACHEID, const HASHCACHEID&, int, int> files;
+    files.InitHashTable(max((UINT)17, (UINT)(m_live.GetSize() * 5 / 4) | 1));
+
+    CArray<int, int> live;
+    live.SetSize(0, m_live.GetSize());
+
+    for(INT_PTR i = 0; i < m_live.GetSize(); i++)
+    {
+        const CANDIDATE& c = m_candidates[m_live[i]];
+        if(c.identified && !c.failed)
+        {
+            int first;
+            if(files.Lookup(c.id, first))
+            {
+                m_linkCount++;
+                continue;
+            }
+            files.SetAt(c.id, m_live[i]);
+        }
+        live.Add(m_live[i]);
+    }
+
+    m_live.Copy(live);
+}
+
+// Sorts m_live by the key of the given stage (the size and the digest,
+// which has been computed so far), and removes failed candidates and
+// candidates, which have no partner with the same key.
+//
+void CDuplicateFinder::Regroup(STAGE stage)
+{
+    _qsortFinder = this;
+    _qsortStage = stage;
+    qsort(m_live.GetData(), m_live.GetSize(), sizeof(int), &_compareCandidates);
+
+    CArray<int, int> live;
+    live.SetSize(0, m_live.GetSize());
+
+    INT_PTR i = 0;
+    while(i < m_live.GetSize())
+    {
+        INT_PTR j = i + 1;
+        while(j < m_live.GetSize() && CompareKeys(m_candidates[m_live[i]], m_candidates[m_live[j]], stage) == 0)
+        {
+            j++;
+        }
+
+        if(j - i >= 2 && !m_candidates[m_live[i]].failed)
+        {
+            for(INT_PTR k = i; k < j; k++)
+            {
+                live.Add(m_live[k]);
+            }
+        }
+        i = j;
+    }
+
+    m_live.Copy(live);
+}
+
+// Queues the jobs of a stage, sorted by device.
+// Stage 3 skips the small files, which stage 2 has read completely.
+//
+void CDuplicateFinder::StartStage(STAGE stage)
+{
+    CSingleLock lock(&m_cs, true);
+
+    m_jobs.RemoveAll();
+    for(int d = 0; d < m_devices.GetSize(); d++)
+    {
+        m_devices[d].next = m_jobs.GetSize();
+        for(int i = 0; i < m_live.GetSize(); i++)
+        {
+            const CANDIDATE& c = m_candidates[m_live[i]];
+            if(c.device != d)
+            {
+                continue;
+            }
+            if(stage == STAGE_FULL && c.complete)
+            {
+                continue;
+            }
+            m_jobs.Add(m_live[i]);
+        }
+        m_devices[d].end = m_jobs.GetSize();
+        m_devices[d].active = 0;
+    }
+
+    m_stage = m_jobs.GetSize() > 0 ? stage : STAGE_DONE;
+    m_completed = 0;
+
+    lock.Unlock();
+
+    if(m_stage == STAGE_DONE)
+    {
+        BuildSets();
+    }
+    else
+    {
+        m_wakeup.SetEvent();
+    }
+}
+
+void CDuplicateFinder::AdvanceStage()
+{
+    switch (m_stage)
+    {
+    case STAGE_HEADTAIL:
+        {
+            for(int i = 0; i < m_live.GetSize(); i++)
+            {
+                CANDIDATE& c = m_candidates[m_live[i]];
+                if(c.complete)
+                {
+                    c.full = c.headTail;
+                }
+            }
+            CollapseLinks();
+            Regroup(STAGE_HEADTAIL);
+            StartStage(STAGE_FULL);
+        }
+        break;
+
+    case STAGE_FULL:
+        {
+            {
+                CSingleLock lock(&m_cs, true);
+                m_stage = STAGE_DONE;
+            }
+            BuildSets();
+        }
+        break;
+
+    default:
+        ASSERT(0);
+    }
+}
+
+void CDuplicateFinder::BuildSets()
+{
+    Regroup(STAGE_FULL);
+
+    INT_PTR i = 0;
+    while(i < m_live.GetSize())
+    {
+        DUPLICATESET *set = new DUPLICATESET;
+        set->size = m_candidates[m_live[i]].size;
+
+        INT_PTR j = i;
+        while(j < m_live.GetSize() && CompareKeys(m_candidates[m_live[i]], m_candidates[m_live[j]], STAGE_FULL) == 0)
+        {
+            CItem *item = m_candidates[m_live[j]].item;
+            if(j > i)
+            {
+                m_redundant.SetKey(item);
+            }
+            set->items.Add(item);
+            j++;
+        }
+
+        m_wastedBytes += set->GetWastedBytes();
+        m_sets.Add(set);
+        i = j;
+    }
+
+    qsort(m_sets.GetData(), m_sets.GetSize(), sizeof(DUPLICATESET *), &_compareSets);
+
+    // The readers are through with it. Don't lock out other instances,
+    // as long as the result is shown.
+    m_cache.Close();
+
+    VTRACE(_T("%d duplicate sets, %I64u bytes wasted, %I64u digests from the cache, %d hard links skipped"), (int)m_sets.GetSize(), m_wastedBytes, m_cacheHits, (int)m_linkCount);
+}
+
+int CDuplicateFinder::CompareKeys(const CANDIDATE& c1, const CANDIDATE& c2, STAGE stage)
+{
+    int r = usignum(c1.size, c2.size);
+    if(r == 0)
+    {
+        r = signum((int)c1.failed - (int)c2.failed);
+    }
+    if(r == 0 && stage >= STAGE_HEADTAIL)
+    {
+        r = memcmp(c1.headTail.bytes, c2.headTail.bytes, sizeof(c1.headTail.bytes));
+    }
+    if(r == 0 && stage >= STAGE_FULL)
+    {
+        r = memcmp(c1.full.bytes, c2.full.bytes, sizeof(c1.full.bytes));
+    }
+    return r;
+}
+
+// Within a group, the candidates keep the order of the tree.
+//
+int __cdecl CDuplicateFinder::_compareCandidates(const void *p1, const void *p2)
+{
+    const int i1 = *(const int *)p1;
+    const int i2 = *(const int *)p2;
+
+    int r = CompareKeys(_qsortFinder->m_candidates[i1], _qsortFinder->m_candidates[i2], _qsortStage);
+    if(r == 0)
+    {
+        r = signum(i1 - i2);
+    }
+    return r;
+}
+
+int __cdecl CDuplicateFinder::_compareSets(const void *p1, const void *p2)
+{
+    const DUPLICATESET *set1 = *(const DUPLICATESET **)p1;
+    const DUPLICATESET *set2 = *(const DUPLICATESET **)p2;
+    return usignum(set2->GetWastedBytes(), set1->GetWastedBytes());
+}
+
+bool CDuplicateFinder::TakeJob(int& candidate, STAGE& stage)
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(m_stage == STAGE_DONE)
+    {
+        return false;
+    }
+
+    for(int n = 0; n < m_devices.GetSize(); n++)
+    {
+        DEVICE& d = m_devices[m_nextDevice];
+        m_nextDevice = (m_nextDevice + 1) % (int)m_devices.GetSize();
+
+        if(d.next < d.end && d.active < MAX_READERS_PER_DEVICE)
+        {
+            candidate = m_jobs[d.next++];
+            d.active++;
+            stage = m_stage;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hashes one candidate for stage. provider may be NULL; the job fails then.
+//
+void CDuplicateFinder::DoJob(HCRYPTPROV provider, int candidate, STAGE stage)
+{
+    CANDIDATE& c = m_candidates[candidate];
+
+    bool success = false;
+    if(provider != NULL)
+    {
+        if(stage == STAGE_HEADTAIL)
+        {
+            success = HashHeadTail(provider, c);
+        }
+        else
+        {
+            success = HashFull(provider, c);
+        }
+    }
+
+    FinishJob(candidate, success);
+}
+
+void CDuplicateFinder::FinishJob(int candidate, bool success)
+{
+    {
+        CSingleLock lock(&m_cs, true);
+
+        CANDIDATE& c = m_candidates[candidate];
+        c.failed = !success;
+        m_devices[c.device].active--;
+        m_completed++;
+    }
+
+    m_wakeup.SetEvent();
+    m_jobFinished.SetEvent();
+}
+
+// cached: the digest came from m_cache and nothing was read.
+//
+void CDuplicateFinder::AddBytesDone(ULONGLONG bytes, bool cached)
+{
+    CSingleLock lock(&m_cs, true);
+    m_bytesDone += bytes;
+    if(cached)
+    {
+        m_cacheHits++;
+    }
+}
+
+bool CDuplicateFinder::IsCanceled() const
+{
+    return m_canceled;
+}
+
+namespace
+{
+    HANDLE OpenForReading(LPCTSTR path)
+    {
+        return ::CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    }
+
+    // Reads up to length bytes, less only at the end of the file.
+    bool ReadBlock(HANDLE file, BYTE *buffer, DWORD length, DWORD& read)
+    {
+        read = 0;
+        while(read < length)
+        {
+            DWORD n = 0;
+            if(!::ReadFile(file, buffer + read, length - read, &n, NULL))
+            {
+                return false;
+            }
+            if(n == 0)
+            {
+                break;
+            }
+            read += n;
+        }
+        return true;
+    }
+
+    bool FinishHash(HCRYPTHASH hash, BYTE *digest, DWORD length)
+    {
+        DWORD size = length;
+        return ::CryptGetHashParam(hash, HP_HASHVAL, digest, &size, 0) && size == length;
+    }
+}
+
+// Files of up to 2 * HEADTAILBYTES are read completely.
+//
+bool CDuplicateFinder::HashHeadTail(HCRYPTPROV provider, CANDIDATE& c)
+{
+    HANDLE file = OpenForReading(c.path);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    HASHCACHERECORD cached;
+    const bool identified = CHashCache::GetRecordKey(file, cached);
+    if(identified)
+    {
+        c.id = cached.id;
+        c.identified = true;
+    }
+    if(identified && m_cache.Lookup(cached) && (cached.flags & HASHCACHERECORD::HCR_HEADTAIL) != 0)
+    {
+        memcpy(c.headTail.bytes, cached.headTail, sizeof(c.headTail.bytes));
+        c.complete = ((cached.flags & HASHCACHERECORD::HCR_COMPLETE) != 0);
+        ::CloseHandle(file);
+
+        AddBytesDone(min(c.size, 2 * HEADTAILBYTES), true);
+        return true;
+    }
+
+    HCRYPTHASH hash = NULL;
+    bool success = (::CryptCreateHash(provider, CALG_SHA1, 0, 0, &hash) != FALSE);
+
+    BYTE buffer[2 * HEADTAILBYTES];
+    DWORD head = 0;
+    DWORD tail = 0;
+    if(success)
+    {
+        success = ReadBlock(file, buffer, HEADTAILBYTES, head);
+    }
+
+    bool complete = (head < HEADTAILBYTES);
+    if(success && !complete)
+    {
+        // Up to HEADTAILBYTES of the rest, ending at the end of the file
+        LARGE_INTEGER size;
+        success = (::GetFileSizeEx(file, &size) != FALSE);
+        complete = (size.QuadPart <= 2 * HEADTAILBYTES);
+        if(success && !complete)
+        {
+            LARGE_INTEGER pos;
+            pos.QuadPart = size.QuadPart - HEADTAILBYTES;
+            success = (::SetFilePointerEx(file, pos, NULL, FILE_BEGIN) != FALSE);
+        }
+        if(success)
+        {
+            success = ReadBlock(file, buffer + head, HEADTAILBYTES, tail);
+        }
+    }
+
+    if(success)
+    {
+        success = ::CryptHashData(hash, buffer, head + tail, 0) && FinishHash(hash, c.headTail.bytes, sizeof(c.headTail.bytes));
+        c.complete = complete;
+        AddBytesDone(head + tail, false);
+    }
+
+    if(success && identified)
+    {
+        memcpy(cached.headTail, c.headTail.bytes, sizeof(cached.headTail));
+        cached.flags |= HASHCACHERECORD::HCR_HEADTAIL | (complete ? HASHCACHERECORD::HCR_COMPLETE : 0);
+        m_cache.Store(cached);
+    }
+
+    if(hash != NULL)
+    {
+        ::CryptDestroyHash(hash);
+    }
+    ::CloseHandle(file);
+
+    return success;
+}
+
+bool CDuplicateFinder::HashFull(HCRYPTPROV provider, CANDIDATE& c)
+{
+    HANDLE file = OpenForReading(c.path);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    HASHCACHERECORD cached;
+    const bool identified = CHashCache::GetRecordKey(file, cached);
+    if(identified && m_cache.Lookup(cached) && (cached.flags & HASHCACHERECORD::HCR_FULL) != 0)
+    {
+        memcpy(c.full.bytes, cached.full, sizeof(c.full.bytes));
+        ::CloseHandle(file);
+
+        AddBytesDone(c.size, true);
+        return true;
+    }
+
+    HCRYPTHASH hash = NULL;
+    bool success = (::CryptCreateHash(provider, CALG_SHA1, 0, 0, &hash) != FALSE);
+
+    CArray<BYTE, BYTE> buffer;
+    buffer.SetSize(READBLOCKSIZE);
+
+    while(success && !IsCanceled())
+    {
+        DWORD read = 0;
+        success = ReadBlock(file, buffer.GetData(), READBLOCKSIZE, read);
+        if(!success || read == 0)
+        {
+            break;
+        }
+        success = (::CryptHashData(hash, buffer.GetData(), read, 0) != FALSE);
+        AddBytesDone(read, false);
+    }
+
+    if(success && !IsCanceled())
+    {
+        success = FinishHash(hash, c.full.bytes, sizeof(c.full.bytes));
+        if(success && identified)
+        {
+            memcpy(cached.full, c.full.bytes, sizeof(cached.full));
+            cached.flags |= HASHCACHERECORD::HCR_FULL;
+            m_cache.Store(cached);
+        }
+    }
+
+    if(hash != NULL)
+    {
+        ::CryptDestroyHash(hash);
+    }
+    ::CloseHandle(file);
+
+    return success && !IsCanceled();
+}
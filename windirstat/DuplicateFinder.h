@@ -0,0 +1,173 @@
+// DuplicateFinder.h - Declaration of CDuplicateFinder
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_DUPLICATEFINDER_H__
+#define __WDS_DUPLICATEFINDER_H__
+#pragma once
+
+#include "set.h"
+#include "HashCache.h"
+
+class CItem;
+
+//
+// DUPLICATESET. Files with equal contents.
+//
+struct DUPLICATESET
+{
+    ULONGLONG size;                 // Of each of the files
+    CArray<CItem *, CItem *> items; // The first one counts as the original
+
+    ULONGLONG GetWastedBytes() const;
+};
+
+//
+// CDuplicateFinder. Finds files with equal contents in a finished item tree.
+// The files run through a pipeline of stages, each of which can only split
+// the groups formed by the previous one:
+//   1. Size. Files with a unique size are never opened.
+//   2. Hash of the first and the last HEADTAILBYTES. The readers also
+//      identify the files, and hard links to one file collapse to the
+//      first of them: deleting a link would free nothing.
+//   3. Hash of the whole contents, read sequentially in large blocks.
+// The digests are kept in a CHashCache, so unchanged files are read only once.
+// Stages 2 and 3 are executed by a bounded pool of reader threads, which
+// start at most MAX_READERS_PER_DEVICE concurrent reads on one drive or server.
+// The readers only see paths. The items are touched by the gui thread only,
+// so the owner must delete the finder before it deletes any item.
+//
+class CDuplicateFinder
+{
+    friend class CDuplicateReaderThread;
+
+    struct DIGEST
+    {
+        BYTE bytes[HASHCACHE_DIGESTSIZE];
+    };
+
+    struct CANDIDATE
+    {
+        CItem *item;                // Gui thread only
+        CString path;
+        ULONGLONG size;
+        int device;                 // Index into m_devices
+        DIGEST headTail;
+        DIGEST full;
+        HASHCACHEID id;             // Valid, if identified
+        bool identified;
+        bool complete;              // headTail covers the whole file
+        bool failed;                // Could not be read. Drops out.
+    };
+
+    // Reads on one drive or server. The jobs of a device are m_jobs[next..end[.
+    struct DEVICE
+    {
+        CString name;
+        INT_PTR next;
+        INT_PTR end;
+        int active;
+    };
+
+    enum STAGE
+    {
+        STAGE_SIZE,
+        STAGE_HEADTAIL,
+        STAGE_FULL,
+        STAGE_DONE
+    };
+
+public:
+    CDuplicateFinder(CItem *root);
+    ~CDuplicateFinder(); // Cancels the readers and waits for them.
+
+    // Called by the gui thread while the readers work. Returns true, when done.
+    bool Work();
+    bool IsDone() const;
+
+    ULONGLONG GetProgressRange() const;
+    ULONGLONG GetProgressPos();
+
+    INT_PTR GetSetCount() const;
+    const DUPLICATESET *GetSet(INT_PTR i) const; // Sorted by wasted bytes, descending
+    ULONGLONG GetWastedBytes() const;
+    INT_PTR GetRedundantCount() const;
+    bool IsRedundantCopy(const CItem *item) const;
+
+    CString FormatReport() const;
+
+protected:
+    static const int HEADTAILBYTES = 4 * 1024;
+    static const int READBLOCKSIZE = 1024 * 1024;
+    static const int MAX_READERS = 8;
+    static const int MAX_READERS_PER_DEVICE = 2;
+
+    void RecurseCollectCandidates(CItem *item);
+    int GetDevice(const CString& path);
+    void CollapseLinks();
+    void Regroup(STAGE stage);
+    void StartStage(STAGE stage);
+    void AdvanceStage();
+    void BuildSets();
+
+    static int CompareKeys(const CANDIDATE& c1, const CANDIDATE& c2, STAGE stage);
+    static const CDuplicateFinder *_qsortFinder;
+    static STAGE _qsortStage;
+    static int __cdecl _compareCandidates(const void *p1, const void *p2);
+    static int __cdecl _compareSets(const void *p1, const void *p2);
+
+    // Called by the readers (by Work(), if there are none)
+    bool TakeJob(int& candidate, STAGE& stage);
+    void DoJob(HCRYPTPROV provider, int candidate, STAGE stage);
+    void FinishJob(int candidate, bool success);
+    void AddBytesDone(ULONGLONG bytes, bool cached);
+    bool IsCanceled() const;
+    bool HashHeadTail(HCRYPTPROV provider, CANDIDATE& c);
+    bool HashFull(HCRYPTPROV provider, CANDIDATE& c);
+
+    CArray<CANDIDATE, const CANDIDATE&> m_candidates;   // Not resized while the readers run
+    CArray<int, int> m_live;        // Candidates still in the race, grouped
+    CArray<DEVICE, const DEVICE&> m_devices;
+    CArray<int, int> m_jobs;        // Candidates to read in the current stage, sorted by device
+    CArray<CWinThread *, CWinThread *> m_readers;
+    HCRYPTPROV m_provider;          // Only if no reader could be started
+
+    CCriticalSection m_cs;          // Protects the following members
+    STAGE m_stage;
+    INT_PTR m_completed;            // Jobs finished in this stage
+    int m_nextDevice;               // Round robin
+    ULONGLONG m_bytesDone;          // Read or found in m_cache
+    ULONGLONG m_cacheHits;
+    volatile bool m_canceled;
+
+    CEvent m_wakeup;                // Readers: new jobs or free device slots
+    CEvent m_jobFinished;           // Gui thread
+
+    CHashCache m_cache;             // Digests of earlier runs
+
+    ULONGLONG m_progressRange;
+    CArray<DUPLICATESET *, DUPLICATESET *> m_sets;
+    CSet<const CItem *, const CItem *> m_redundant;
+    ULONGLONG m_wastedBytes;
+    INT_PTR m_linkCount;            // Candidates dropped by CollapseLinks()
+};
+
+#endif // __WDS_DUPLICATEFINDER_H__
@@ -0,0 +1,333 @@
+// ExtensionCollector.cpp - Implementation of CExtensionTable
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "ExtensionCollector.h"
+#include "item.h"
+#include "MemoryAccounting.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const int MAX_COLLECTTHREADS = 16;
+    const ULONGLONG MIN_PARTITEMS = 256 * 1024;    // Smaller trees are not worth a thread
+    const int SUBTREES_PER_THREAD = 8;             // Many small subtrees balance the threads
+
+    // The share of one thread
+    struct COLLECTPART
+    {
+        CArray<CItem *, CItem *> subtrees;
+        ULONGLONG items;
+        CExtensionTable table;
+    };
+
+    void CollectPart(COLLECTPART& part)
+    {
+        for(INT_PTR i = 0; i < part.subtrees.GetSize(); i++)
+        {
+            part.subtrees[i]->RecurseCollectExtensionData(&part.table);
+        }
+    }
+
+    // Largest first
+    int __cdecl CompareByItemsCount(const void *p1, const void *p2)
+    {
+        const CItem *item1 = *(const CItem **)p1;
+        const CItem *item2 = *(const CItem **)p2;
+        return usignum(item2->GetItemsCount(), item1->GetItemsCount());
+    }
+
+    // Splits the largest folder until no subtree holds more than its share
+    // of the items. The files met on the way are returned separately.
+    void SplitTree(CItem *root, int subtreeCount, CArray<CItem *, CItem *>& subtrees, CArray<CItem *, CItem *>& files)
+    {
+        const ULONGLONG share = root->GetItemsCount() / subtreeCount;
+
+        subtrees.Add(root);
+        while(subtrees.GetSize() > 0 && subtrees.GetSize() < subtreeCount)
+        {
+            INT_PTR largest = 0;
+            for(INT_PTR i = 1; i < subtrees.GetSize(); i++)
+            {
+                if(subtrees[i]->GetItemsCount() > subtrees[largest]->GetItemsCount())
+                {
+                    largest = i;
+                }
+            }
+
+            CItem *item = subtrees[largest];
+            if(item->GetItemsCount() <= share)
+            {
+                break;
+            }
+
+            subtrees.RemoveAt(largest);
+            for(int i = 0; i < item->GetChildrenCount(); i++)
+            {
+                CItem *child = item->GetChild(i);
+                if(IsLeaf(child->GetType()))
+                {
+                    files.Add(child);
+                }
+                else
+                {
+                    subtrees.Add(child);
+                }
+            }
+        }
+    }
+}
+
+//
+// CCollectPartThread. Collects one COLLECTPART.
+//
+class CCollectPartThread: public CWinThread
+{
+public:
+    CCollectPartThread(COLLECTPART *part);
+    bool Start();
+    virtual BOOL InitInstance();
+
+private:
+    COLLECTPART *m_part;
+};
+
+CCollectPartThread::CCollectPartThread(COLLECTPART *part)
+    : m_part(part)
+{
+    // CollectExtensionData() waits for us and deletes us.
+    m_bAutoDelete = false;
+}
+
+// False, if the thread could not be created. The caller collects the part then.
+bool CCollectPartThread::Start()
+{
+    return (CreateThread() != FALSE);
+}
+
+BOOL CCollectPartThread::InitInstance()
+{
+    CollectPart(*m_part);
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CExtensionTable::CExtensionTable()
+    : m_count(0)
+    , m_cachedBytes(0)
+    , m_cachedAllocations(0)
+{
+}
+
+void CExtensionTable::Add(const CString& ext, ULONGLONG files, ULONGLONG bytes)
+{
+    Add(ext, HashKey<LPCTSTR>(ext), files, bytes);
+}
+
+void CExtensionTable::Add(const CString& ext, UINT hash, ULONGLONG files, ULONGLONG bytes)
+{
+    if((m_count + 1) * 2 > m_slots.GetSize())
+    {
+        Grow();
+    }
+
+    // HashKey() is weak in the low bits, which select the slot.
+    const INT_PTR mask = m_slots.GetSize() - 1;
+    INT_PTR i = INT_PTR(hash ^ (hash >> 16)) & mask;
+    while(m_slots[i].files > 0)
+    {
+        SLOT& slot = m_slots[i];
+        if(slot.hash == hash && slot.ext == ext)
+        {
+            slot.files += files;
+            slot.bytes += bytes;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    SLOT& slot = m_slots[i];
+    slot.ext = ext;
+    slot.hash = hash;
+    slot.files = files;
+    slot.bytes = bytes;
+    m_count++;
+}
+
+void CExtensionTable::Grow()
+{
+    CArray<SLOT, const SLOT&> old;
+    old.Copy(m_slots);
+
+    SLOT free;
+    free.hash = 0;
+    free.files = 0;
+    free.bytes = 0;
+
+    m_slots.RemoveAll();
+    m_slots.SetSize(max(INITIAL_SLOTS, old.GetSize() * 2));
+    for(INT_PTR i = 0; i < m_slots.GetSize(); i++)
+    {
+        m_slots[i] = free;
+    }
+
+    m_count = 0;
+    for(INT_PTR i = 0; i < old.GetSize(); i++)
+    {
+        if(old[i].files > 0)
+        {
+            Add(old[i].ext, old[i].hash, old[i].files, old[i].bytes);
+        }
+    }
+}
+
+void CExtensionTable::AddTable(const CExtensionTable& other)
+{
+    for(INT_PTR i = 0; i < other.m_slots.GetSize(); i++)
+    {
+        const SLOT& slot = other.m_slots[i];
+        if(slot.files > 0)
+        {
+            Add(slot.ext, slot.hash, slot.files, slot.bytes);
+        }
+    }
+    m_cachedBytes += other.m_cachedBytes;
+    m_cachedAllocations += other.m_cachedAllocations;
+}
+
+void CExtensionTable::CopyTo(CExtensionData& ed) const
+{
+    for(INT_PTR i = 0; i < m_slots.GetSize(); i++)
+    {
+        const SLOT& slot = m_slots[i];
+        if(slot.files > 0)
+        {
+            SExtensionRecord r;
+            r.files = slot.files;
+            r.bytes = slot.bytes;
+            r.color = RGB(0, 0, 0);     // See CDirstatDoc::SetExtensionColors()
+            ed.SetAt(slot.ext, r);
+        }
+    }
+}
+
+INT_PTR CExtensionTable::GetCount() const
+{
+    return m_count;
+}
+
+void CExtensionTable::AddCachedExtension(LONGLONG bytes)
+{
+    m_cachedBytes += bytes;
+    m_cachedAllocations += bytes > 0 ? 1 : 0;
+}
+
+void CExtensionTable::AccountCachedExtensions() const
+{
+    CMemoryAccounting::Add(MEM_NAMES, m_cachedBytes, m_cachedAllocations);
+    CMemoryAccounting::AddItem(true, m_cachedBytes, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void CollectExtensionData(CItem *root, CExtensionData& ed)
+{
+    ASSERT(ed.IsEmpty());
+
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    int partCount = int(max(1, min(min(ULONGLONG(si.dwNumberOfProcessors), ULONGLONG(MAX_COLLECTTHREADS)), root->GetItemsCount() / MIN_PARTITEMS)));
+
+    COLLECTPART parts[MAX_COLLECTTHREADS];
+    for(int i = 0; i < partCount; i++)
+    {
+        parts[i].items = 0;
+    }
+
+    if(partCount == 1 || IsLeaf(root->GetType()))
+    {
+        partCount = 1;
+        parts[0].subtrees.Add(root);
+    }
+    else
+    {
+        CArray<CItem *, CItem *> subtrees;
+        CArray<CItem *, CItem *> files;
+        SplitTree(root, partCount * SUBTREES_PER_THREAD, subtrees, files);
+
+        // The calling thread takes the loose files.
+        parts[0].subtrees.Append(files);
+        parts[0].items = files.GetSize();
+
+        // Largest first, each to the part with the least items so far
+        qsort(subtrees.GetData(), subtrees.GetSize(), sizeof(CItem *), &CompareByItemsCount);
+        for(INT_PTR i = 0; i < subtrees.GetSize(); i++)
+        {
+            int least = 0;
+            for(int j = 1; j < partCount; j++)
+            {
+                if(parts[j].items < parts[least].items)
+                {
+                    least = j;
+                }
+            }
+            parts[least].subtrees.Add(subtrees[i]);
+            parts[least].items += subtrees[i]->GetItemsCount() + 1;
+        }
+    }
+
+    CCollectPartThread *threads[MAX_COLLECTTHREADS];
+    for(int i = 1; i < partCount; i++)
+    {
+        threads[i] = new CCollectPartThread(&parts[i]);
+        if(!threads[i]->Start())
+        {
+            delete threads[i];
+            threads[i] = NULL;
+        }
+    }
+
+    CollectPart(parts[0]);
+
+    for(int i = 1; i < partCount; i++)
+    {
+        if(threads[i] != NULL)
+        {
+            ::WaitForSingleObject(threads[i]->m_hThread, INFINITE);
+            delete threads[i];
+        }
+        else
+        {
+            CollectPart(parts[i]);
+        }
+        parts[0].table.AddTable(parts[i].table);
+    }
+
+    // 2048 is a rough estimate for amount of different extensions
+    ed.InitHashTable(UINT(max(INT_PTR(2048), parts[0].table.GetCount() + parts[0].table.GetCount() / 4)));
+    parts[0].table.CopyTo(ed);
+    parts[0].table.AccountCachedExtensions();
+}
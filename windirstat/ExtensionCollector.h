@@ -0,0 +1,77 @@
+// ExtensionCollector.h - Declaration of CExtensionTable
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_EXTENSIONCOLLECTOR_H__
+#define __WDS_EXTENSIONCOLLECTOR_H__
+#pragma once
+
+#include "dirstatdoc.h" // CExtensionData
+
+class CItem;
+
+//
+// CExtensionTable. Files and bytes per extension, collected by one thread.
+// Open addressing with linear probing over a power of two array of slots,
+// so a file costs one hash and usually one string compare, and nothing
+// is allocated except when the table grows.
+//
+class CExtensionTable
+{
+    struct SLOT
+    {
+        CString ext;
+        UINT hash;
+        ULONGLONG files;        // 0: the slot is free
+        ULONGLONG bytes;
+    };
+
+public:
+    CExtensionTable();
+
+    void Add(const CString& ext, ULONGLONG files, ULONGLONG bytes);
+    void AddTable(const CExtensionTable& other);
+    void CopyTo(CExtensionData& ed) const;
+    INT_PTR GetCount() const;
+
+    // Extension caches filled by CItem::RecurseCollectExtensionData(),
+    // which cannot tell CMemoryAccounting from a worker thread.
+    void AddCachedExtension(LONGLONG bytes);
+    void AccountCachedExtensions() const;
+
+protected:
+    void Add(const CString& ext, UINT hash, ULONGLONG files, ULONGLONG bytes);
+    void Grow();
+
+    static const INT_PTR INITIAL_SLOTS = 1024;
+
+    CArray<SLOT, const SLOT&> m_slots;
+    INT_PTR m_count;
+    LONGLONG m_cachedBytes;
+    LONGLONG m_cachedAllocations;
+};
+
+// Fills ed (which must be empty) with the statistics of the files below root.
+// Large trees are split into subtrees, which are collected in parallel
+// into one CExtensionTable per thread. The tables are merged at the end.
+void CollectExtensionData(CItem *root, CExtensionData& ed);
+
+#endif // __WDS_EXTENSIONCOLLECTOR_H__
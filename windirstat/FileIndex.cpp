@@ -0,0 +1,612 @@
+// FileIndex.cpp - Implementation of CFileIndex
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "FileIndex.h"
+#include "item.h"
+#include "MemoryAccounting.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const int RADIX_BITS = 8;
+    const int RADIX_BUCKETS = 1 << RADIX_BITS;
+    const int MAX_SORTTHREADS = 16;
+    const INT_PTR MIN_CHUNKSIZE = 64 * 1024;    // Smaller arrays are not worth a thread
+
+    // One thread's share of a radix sort pass
+    struct RADIXCHUNK
+    {
+        const FILEINDEXENTRY *source;
+        FILEINDEXENTRY *target;
+        INT_PTR begin;
+        INT_PTR end;
+        int shift;
+        INT_PTR counts[RADIX_BUCKETS];          // Histogram of the digits, then target positions
+    };
+
+    // Items are at least 4-byte aligned, so bit 0 is free for the mark.
+    bool IsRemoved(const FILEINDEXENTRY& e)
+    {
+        return (UINT_PTR(e.item) & 1) != 0;
+    }
+
+    void MarkRemoved(FILEINDEXENTRY& e)
+    {
+        e.item = reinterpret_cast<CItem *>(UINT_PTR(e.item) | 1);
+    }
+
+    // The order of the runs: key, then item (marked or not)
+    bool IsLess(const FILEINDEXENTRY& e, ULONGLONG key, const CItem *item)
+    {
+        if(e.key != key)
+        {
+            return e.key < key;
+        }
+        return (UINT_PTR(e.item) & ~UINT_PTR(1)) < UINT_PTR(item);
+    }
+
+    int __cdecl CompareItems(const void *p1, const void *p2)
+    {
+        const UINT_PTR item1 = UINT_PTR(((const FILEINDEXENTRY *)p1)->item);
+        const UINT_PTR item2 = UINT_PTR(((const FILEINDEXENTRY *)p2)->item);
+        return usignum(item1, item2);
+    }
+
+    void CountChunk(RADIXCHUNK& chunk)
+    {
+        ZeroMemory(chunk.counts, sizeof(chunk.counts));
+        for(INT_PTR i = chunk.begin; i < chunk.end; i++)
+        {
+            chunk.counts[(chunk.source[i].key >> chunk.shift) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    void ScatterChunk(RADIXCHUNK& chunk)
+    {
+        for(INT_PTR i = chunk.begin; i < chunk.end; i++)
+        {
+            const FILEINDEXENTRY& e = chunk.source[i];
+            chunk.target[chunk.counts[(e.key >> chunk.shift) & (RADIX_BUCKETS - 1)]++] = e;
+        }
+    }
+}
+
+//
+// CRadixSortThread. Counts or scatters one RADIXCHUNK.
+//
+class CRadixSortThread: public CWinThread
+{
+public:
+    CRadixSortThread(RADIXCHUNK *chunk, bool scatter);
+    bool Start();
+    virtual BOOL InitInstance();
+
+private:
+    RADIXCHUNK *m_chunk;
+    bool m_scatter;
+};
+
+CRadixSortThread::CRadixSortThread(RADIXCHUNK *chunk, bool scatter)
+    : m_chunk(chunk)
+    , m_scatter(scatter)
+{
+    // RunRadixPhase() waits for us and deletes us.
+    m_bAutoDelete = false;
+}
+
+// False, if the thread could not be created. The caller does the chunk then.
+bool CRadixSortThread::Start()
+{
+    return (CreateThread() != FALSE);
+}
+
+BOOL CRadixSortThread::InitInstance()
+{
+    if(m_scatter)
+    {
+        ScatterChunk(*m_chunk);
+    }
+    else
+    {
+        CountChunk(*m_chunk);
+    }
+    return false;
+}
+
+namespace
+{
+    void RunRadixChunk(RADIXCHUNK& chunk, bool scatter)
+    {
+        if(scatter)
+        {
+            ScatterChunk(chunk);
+        }
+        else
+        {
+            CountChunk(chunk);
+        }
+    }
+
+    // The calling thread takes the first chunk itself, and those whose
+    // thread could not be started.
+    void RunRadixPhase(RADIXCHUNK *chunks, int count, bool scatter)
+    {
+        CRadixSortThread *threads[MAX_SORTTHREADS];
+        for(int i = 1; i < count; i++)
+        {
+            threads[i] = new CRadixSortThread(&chunks[i], scatter);
+            if(!threads[i]->Start())
+            {
+                delete threads[i];
+                threads[i] = NULL;
+            }
+        }
+
+        RunRadixChunk(chunks[0], scatter);
+
+        for(int i = 1; i < count; i++)
+        {
+            if(threads[i] != NULL)
+            {
+                ::WaitForSingleObject(threads[i]->m_hThread, INFINITE);
+                delete threads[i];
+            }
+            else
+            {
+                RunRadixChunk(chunks[i], scatter);
+            }
+        }
+    }
+}
+
+CFileIndex::CFileIndex()
+    : m_count(0)
+    , m_accountedBytes(0)
+    , m_accountedArrays(0)
+{
+    for(int i = 0; i < FIK_COUNT; i++)
+    {
+        m_orders[i].removed = 0;
+    }
+}
+
+CFileIndex::~CFileIndex()
+{
+    CMemoryAccounting::Add(MEM_FILEINDEX, -m_accountedBytes, -m_accountedArrays);
+}
+
+void CFileIndex::Build(CItem *root)
+{
+    CFileIndexEntryArray& bySize = m_orders[FIK_SIZE].main;
+    bySize.SetSize(0, max(1024, int(root->GetFilesCount())));
+    RecurseCollectFiles(root, bySize);
+
+    CFileIndexEntryArray& byLastChange = m_orders[FIK_LASTCHANGE].main;
+    byLastChange.Copy(bySize);
+    for(INT_PTR i = 0; i < byLastChange.GetSize(); i++)
+    {
+        byLastChange[i].key = GetKey(FIK_LASTCHANGE, byLastChange[i].item);
+    }
+
+    for(int i = 0; i < FIK_COUNT; i++)
+    {
+        RadixSort(m_orders[i].main);
+        SortEqualKeys(m_orders[i].main);
+        m_orders[i].recent.RemoveAll();
+        m_orders[i].removed = 0;
+    }
+    m_count = bySize.GetSize();
+    Account();
+}
+
+void CFileIndex::Add(CItem *file)
+{
+    ASSERT(file->GetType() == IT_FILE);
+
+    for(int i = 0; i < FIK_COUNT; i++)
+    {
+        ORDER& order = m_orders[i];
+        FILEINDEXENTRY e = { GetKey(FILEINDEXKEY(i), file), file };
+        order.recent.InsertAt(LowerBound(order.recent, e.key, file), e);
+
+        if(order.recent.GetSize() > max(MIN_MERGETHRESHOLD, INT_PTR(sqrt(double(order.main.GetSize())))))
+        {
+            Merge(order);
+        }
+    }
+    m_count++;
+    Account();
+}
+
+// A file, which is not in the index (any more), is ignored.
+void CFileIndex::Remove(CItem *file)
+{
+    bool found = false;
+    for(int i = 0; i < FIK_COUNT; i++)
+    {
+        ORDER& order = m_orders[i];
+        const ULONGLONG key = GetKey(FILEINDEXKEY(i), file);
+
+        found = false;
+        INT_PTR j = LowerBound(order.recent, key, file);
+        if(j < order.recent.GetSize() && order.recent[j].key == key && order.recent[j].item == file)
+        {
+            order.recent.RemoveAt(j);
+            found = true;
+        }
+
+        // A marked entry has another item value and is not found again.
+        j = LowerBound(order.main, key, file);
+        if(!found && j < order.main.GetSize() && order.main[j].key == key && order.main[j].item == file)
+        {
+            MarkRemoved(order.main[j]);
+            order.removed++;
+            found = true;
+        }
+
+        if(order.removed > order.main.GetSize() / 4)
+        {
+            Compact(order);
+        }
+    }
+
+    if(found)
+    {
+        m_count--;
+    }
+    Account();
+}
+
+INT_PTR CFileIndex::GetCount() const
+{
+    return m_count;
+}
+
+void CFileIndex::Query(FILEINDEXKEY order, ULONGLONG minKey, ULONGLONG maxKey, bool descending, INT_PTR maxCount, CArray<CItem *, CItem *>& result) const
+{
+    result.RemoveAll();
+    if(minKey > maxKey)
+    {
+        return;
+    }
+
+    const ORDER& o = m_orders[order];
+    const FILEINDEXENTRY *main = o.main.GetData();
+    const FILEINDEXENTRY *recent = o.recent.GetData();
+
+    INT_PTR mainBegin = LowerBound(o.main, minKey);
+    INT_PTR mainEnd = UpperBound(o.main, maxKey);
+    INT_PTR recentBegin = LowerBound(o.recent, minKey);
+    INT_PTR recentEnd = UpperBound(o.recent, maxKey);
+
+    // Merge the two runs
+    while((maxCount < 0 || result.GetSize() < maxCount) && (mainBegin < mainEnd || recentBegin < recentEnd))
+    {
+        const FILEINDEXENTRY *e;
+        if(descending)
+        {
+            const bool takeMain = recentBegin == recentEnd || (mainBegin < mainEnd && main[mainEnd - 1].key >= recent[recentEnd - 1].key);
+            e = takeMain ? &main[--mainEnd] : &recent[--recentEnd];
+        }
+        else
+        {
+            const bool takeMain = recentBegin == recentEnd || (mainBegin < mainEnd && main[mainBegin].key <= recent[recentBegin].key);
+            e = takeMain ? &main[mainBegin++] : &recent[recentBegin++];
+        }
+
+        if(!IsRemoved(*e))
+        {
+            result.Add(e->item);
+        }
+    }
+}
+
+void CFileIndex::GetLargest(INT_PTR count, CArray<CItem *, CItem *>& result) const
+{
+    Query(FIK_SIZE, 0, _UI64_MAX, true, count, result);
+}
+
+void CFileIndex::GetLargerThan(ULONGLONG bytes, CArray<CItem *, CItem *>& result) const
+{
+    if(bytes == _UI64_MAX)
+    {
+        result.RemoveAll();
+        return;
+    }
+    Query(FIK_SIZE, bytes + 1, _UI64_MAX, true, -1, result);
+}
+
+// Oldest first
+void CFileIndex::GetNotChangedSince(const FILETIME& t, CArray<CItem *, CItem *>& result) const
+{
+    const ULONGLONG key = FileTimeToKey(t);
+    if(key == 0)
+    {
+        result.RemoveAll();
+        return;
+    }
+    Query(FIK_LASTCHANGE, 0, key - 1, false, -1, result);
+}
+
+ULONGLONG CFileIndex::GetKey(FILEINDEXKEY order, const CItem *file)
+{
+    switch (order)
+    {
+    case FIK_SIZE:
+        return file->GetSize();
+
+    case FIK_LASTCHANGE:
+        return FileTimeToKey(file->GetLastChange());
+
+    default:
+        ASSERT(0);
+        return 0;
+    }
+}
+
+ULONGLONG CFileIndex::FileTimeToKey(const FILETIME& t)
+{
+    ULARGE_INTEGER u;
+    u.LowPart = t.dwLowDateTime;
+    u.HighPart = t.dwHighDateTime;
+    return u.QuadPart;
+}
+
+// Stable LSD radix sort by key, one byte per pass. Bytes, in which all keys
+// agree (like the high bytes of most sizes), are skipped. Each pass is split
+// into chunks: the chunks count their digits in parallel, then the positions
+// are assigned digit by digit and chunk by chunk, and then the chunks scatter
+// their entries in parallel.
+void CFileIndex::RadixSort(CFileIndexEntryArray& entries)
+{
+    const INT_PTR n = entries.GetSize();
+    if(n < 2)
+    {
+        return;
+    }
+
+    ULONGLONG differing = 0;
+    const ULONGLONG first = entries[0].key;
+    for(INT_PTR i = 1; i < n; i++)
+    {
+        differing |= entries[i].key ^ first;
+    }
+
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    const int chunkCount = int(max(1, min(min(INT_PTR(si.dwNumberOfProcessors), INT_PTR(MAX_SORTTHREADS)), n / MIN_CHUNKSIZE)));
+
+    CFileIndexEntryArray buffer;
+    buffer.SetSize(n);
+
+    FILEINDEXENTRY *source = entries.GetData();
+    FILEINDEXENTRY *target = buffer.GetData();
+
+    RADIXCHUNK chunks[MAX_SORTTHREADS];
+
+    for(int shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        if(((differing >> shift) & (RADIX_BUCKETS - 1)) == 0)
+        {
+            continue;
+        }
+
+        for(int c = 0; c < chunkCount; c++)
+        {
+            chunks[c].source = source;
+            chunks[c].target = target;
+            chunks[c].begin = n * c / chunkCount;
+            chunks[c].end = n * (c + 1) / chunkCount;
+            chunks[c].shift = shift;
+        }
+
+        RunRadixPhase(chunks, chunkCount, false);
+
+        INT_PTR position = 0;
+        for(int digit = 0; digit < RADIX_BUCKETS; digit++)
+        {
+            for(int c = 0; c < chunkCount; c++)
+            {
+                const INT_PTR count = chunks[c].counts[digit];
+                chunks[c].counts[digit] = position;
+                position += count;
+            }
+        }
+        ASSERT(position == n);
+
+        RunRadixPhase(chunks, chunkCount, true);
+
+        FILEINDEXENTRY *swap = source;
+        source = target;
+        target = swap;
+    }
+
+    if(source != entries.GetData())
+    {
+        memcpy(entries.GetData(), source, n * sizeof(FILEINDEXENTRY));
+    }
+}
+
+void CFileIndex::RecurseCollectFiles(CItem *item, CFileIndexEntryArray& entries)
+{
+    if(item->GetType() == IT_FILE)
+    {
+        FILEINDEXENTRY e = { item->GetSize(), item };
+        entries.Add(e);
+        return;
+    }
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        RecurseCollectFiles(item->GetChild(i), entries);
+    }
+}
+
+// First index with key >= given key
+INT_PTR CFileIndex::LowerBound(const CFileIndexEntryArray& entries, ULONGLONG key)
+{
+    INT_PTR low = 0;
+    INT_PTR high = entries.GetSize();
+    while(low < high)
+    {
+        const INT_PTR middle = low + (high - low) / 2;
+        if(entries[middle].key < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// First index with key > given key
+INT_PTR CFileIndex::UpperBound(const CFileIndexEntryArray& entries, ULONGLONG key)
+{
+    INT_PTR low = 0;
+    INT_PTR high = entries.GetSize();
+    while(low < high)
+    {
+        const INT_PTR middle = low + (high - low) / 2;
+        if(entries[middle].key <= key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// First index with (key, item) >= the given pair
+INT_PTR CFileIndex::LowerBound(const CFileIndexEntryArray& entries, ULONGLONG key, const CItem *item)
+{
+    INT_PTR low = 0;
+    INT_PTR high = entries.GetSize();
+    while(low < high)
+    {
+        const INT_PTR middle = low + (high - low) / 2;
+        if(IsLess(entries[middle], key, item))
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// After RadixSort(), which orders by key only
+void CFileIndex::SortEqualKeys(CFileIndexEntryArray& entries)
+{
+    FILEINDEXENTRY *e = entries.GetData();
+    INT_PTR i = 0;
+    while(i < entries.GetSize())
+    {
+        INT_PTR j = i + 1;
+        while(j < entries.GetSize() && e[j].key == e[i].key)
+        {
+            j++;
+        }
+        if(j - i > 1)
+        {
+            qsort(e + i, j - i, sizeof(FILEINDEXENTRY), &CompareItems);
+        }
+        i = j;
+    }
+}
+
+// Merges the recent run into the main run, from the back, in place.
+// There are no marked entries (Compact()), and an item is never in both runs.
+
+void CFileIndex::Merge(ORDER& order)
+{
+    Compact(order);
+
+    INT_PTR i = order.main.GetSize();
+    INT_PTR j = order.recent.GetSize();
+    INT_PTR k = i + j;
+    order.main.SetSize(k);
+
+    FILEINDEXENTRY *main = order.main.GetData();
+    const FILEINDEXENTRY *recent = order.recent.GetData();
+    while(j > 0)
+    {
+        if(i > 0 && IsLess(recent[j - 1], main[i - 1].key, main[i - 1].item))
+        {
+            main[--k] = main[--i];
+        }
+        else
+        {
+            main[--k] = recent[--j];
+        }
+    }
+
+    order.recent.RemoveAll();
+}
+
+// Drops the removed entries from the main run.
+void CFileIndex::Compact(ORDER& order)
+{
+    if(order.removed == 0)
+    {
+        return;
+    }
+
+    FILEINDEXENTRY *main = order.main.GetData();
+    INT_PTR kept = 0;
+    for(INT_PTR i = 0; i < order.main.GetSize(); i++)
+    {
+        if(!IsRemoved(main[i]))
+        {
+            main[kept++] = main[i];
+        }
+    }
+    order.main.SetSize(kept);
+    order.removed = 0;
+}
+
+// Books the entries of the runs. Their spare capacity is not known.
+void CFileIndex::Account()
+{
+    LONGLONG bytes = 0;
+    LONGLONG arrays = 0;
+    for(int i = 0; i < FIK_COUNT; i++)
+    {
+        const ORDER& order = m_orders[i];
+        bytes += LONGLONG(order.main.GetSize() + order.recent.GetSize()) * LONGLONG(sizeof(FILEINDEXENTRY));
+        arrays += (order.main.GetSize() > 0 ? 1 : 0) + (order.recent.GetSize() > 0 ? 1 : 0);
+    }
+
+    CMemoryAccounting::Add(MEM_FILEINDEX, bytes - m_accountedBytes, arrays - m_accountedArrays);
+    m_accountedBytes = bytes;
+    m_accountedArrays = arrays;
+}
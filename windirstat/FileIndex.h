@@ -0,0 +1,111 @@
+// FileIndex.h - Declaration of CFileIndex
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_FILEINDEX_H__
+#define __WDS_FILEINDEX_H__
+#pragma once
+
+class CItem;
+
+// The orders maintained by CFileIndex
+enum FILEINDEXKEY
+{
+    FIK_SIZE,
+    FIK_LASTCHANGE,
+    FIK_COUNT
+};
+
+struct FILEINDEXENTRY
+{
+    ULONGLONG key;
+    CItem *item;        // Bit 0 is set, if the entry has been removed (see CFileIndex)
+};
+
+typedef CArray<FILEINDEXENTRY, const FILEINDEXENTRY&> CFileIndexEntryArray;
+
+//
+// CFileIndex. All files (IT_FILE items) of a finished tree, ordered by
+// size and by last change, so that questions like "the 100 largest files"
+// or "files not written to for 2 years" are answered in O(log n + k)
+// without a traversal.
+// The index is built in one go with a parallel radix sort. Afterwards
+// CItem reports each file it adds or deletes. A key is a snapshot, so
+// a file must be removed before its size or time changes and added again
+// afterwards.
+// Each order is kept in two sorted runs: the large main run, in which
+// removed entries are only marked, and a small run of recent additions,
+// which is merged into the main run when it grows beyond about sqrt(n).
+// Both runs are sorted by key and, within equal keys, by item, so that
+// Remove() finds an entry by binary search even among thousands of files
+// of the same size. A removed entry keeps its item with bit 0 set, so
+// that it keeps its place in this order.
+// Accounted as MEM_FILEINDEX.
+//
+class CFileIndex
+{
+    struct ORDER
+    {
+        CFileIndexEntryArray main;
+        CFileIndexEntryArray recent;
+        INT_PTR removed;            // Marked entries in main
+    };
+
+public:
+    CFileIndex();
+    ~CFileIndex();
+
+    void Build(CItem *root);
+    void Add(CItem *file);
+    void Remove(CItem *file);
+    INT_PTR GetCount() const;
+
+    // Files with minKey <= key <= maxKey in the given order, at most maxCount (-1: all) of them.
+    void Query(FILEINDEXKEY order, ULONGLONG minKey, ULONGLONG maxKey, bool descending, INT_PTR maxCount, CArray<CItem *, CItem *>& result) const;
+
+    void GetLargest(INT_PTR count, CArray<CItem *, CItem *>& result) const;
+    void GetLargerThan(ULONGLONG bytes, CArray<CItem *, CItem *>& result) const;
+    void GetNotChangedSince(const FILETIME& t, CArray<CItem *, CItem *>& result) const;
+
+    static ULONGLONG GetKey(FILEINDEXKEY order, const CItem *file);
+    static ULONGLONG FileTimeToKey(const FILETIME& t);
+    static void RadixSort(CFileIndexEntryArray& entries);
+
+protected:
+    static void RecurseCollectFiles(CItem *item, CFileIndexEntryArray& entries);
+    static INT_PTR LowerBound(const CFileIndexEntryArray& entries, ULONGLONG key);
+    static INT_PTR UpperBound(const CFileIndexEntryArray& entries, ULONGLONG key);
+    static INT_PTR LowerBound(const CFileIndexEntryArray& entries, ULONGLONG key, const CItem *item);
+    static void SortEqualKeys(CFileIndexEntryArray& entries);
+
+    void Merge(ORDER& order);
+    void Compact(ORDER& order);
+    void Account();
+
+    static const INT_PTR MIN_MERGETHRESHOLD = 4096;
+
+    ORDER m_orders[FIK_COUNT];
+    INT_PTR m_count;
+    LONGLONG m_accountedBytes;
+    LONGLONG m_accountedArrays;
+};
+
+#endif // __WDS_FILEINDEX_H__
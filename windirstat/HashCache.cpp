@@ -0,0 +1,382 @@
+// HashCache.cpp - Implementation of CHashCache
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "HashCache.h"
+#include <common/wds_constants.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    int __cdecl CompareRecordNumbers(const void *p1, const void *p2)
+    {
+        return usignum(*(const ULONGLONG *)p1, *(const ULONGLONG *)p2);
+    }
+}
+
+CHashCache::CHashCache()
+    : m_headTailBytes(0)
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(NULL)
+    , m_header(NULL)
+    , m_capacity(0)
+{
+}
+
+CHashCache::~CHashCache()
+{
+    Close();
+}
+
+bool CHashCache::Open(LPCTSTR path, DWORD headTailBytes)
+{
+    CSingleLock lock(&m_cs, true);
+
+    ASSERT(m_file == INVALID_HANDLE_VALUE);
+
+    // Not shared: a second instance of WinDirStat works without cache.
+    m_file = ::CreateFile(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(m_file == INVALID_HANDLE_VALUE)
+    {
+        VTRACE(_T("Cannot open hash cache %s: %u"), path, ::GetLastError());
+        return false;
+    }
+    m_path = path;
+    m_headTailBytes = headTailBytes;
+
+    LARGE_INTEGER fileSize;
+    if(!::GetFileSizeEx(m_file, &fileSize))
+    {
+        fileSize.QuadPart = 0;
+    }
+
+    ULONGLONG capacity = 0;
+    if((ULONGLONG)fileSize.QuadPart > sizeof(HEADER))
+    {
+        capacity = ((ULONGLONG)fileSize.QuadPart - sizeof(HEADER)) / sizeof(HASHCACHERECORD);
+    }
+
+    if(!Map(max(capacity, MIN_CAPACITY)))
+    {
+        Close();
+        return false;
+    }
+
+    if(m_header->magic != MAGIC
+    || m_header->version != VERSION
+    || m_header->recordSize != sizeof(HASHCACHERECORD)
+    || m_header->headTailBytes != m_headTailBytes
+    || m_header->count > capacity)
+    {
+        Reset();
+    }
+
+    m_header->generation++;
+    BuildIndex();
+    Compact();
+
+    VTRACE(_T("Hash cache %s: %I64u records, %I64u superseded"), path, m_header->count, m_header->superseded);
+    return true;
+}
+
+// Truncates the file to the records in use, after compacting them if worthwhile.
+//
+void CHashCache::Close()
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(m_file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    if(m_header != NULL)
+    {
+        if(m_header->superseded > m_header->count / 2)
+        {
+            Compact();
+        }
+        const ULONGLONG count = m_header->count;
+
+        Unmap();
+
+        LARGE_INTEGER end;
+        end.QuadPart = sizeof(HEADER) + count * sizeof(HASHCACHERECORD);
+        if(::SetFilePointerEx(m_file, end, NULL, FILE_BEGIN))
+        {
+            ::SetEndOfFile(m_file);
+        }
+    }
+
+    ::CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+    m_index.RemoveAll();
+}
+
+bool CHashCache::IsOpen()
+{
+    CSingleLock lock(&m_cs, true);
+    return m_header != NULL;
+}
+
+bool CHashCache::GetRecordKey(HANDLE file, HASHCACHERECORD& record)
+{
+    BY_HANDLE_FILE_INFORMATION fi;
+    if(!::GetFileInformationByHandle(file, &fi))
+    {
+        return false;
+    }
+
+    ZeroMemory(&record, sizeof(record));
+    record.id.volumeSerial = fi.dwVolumeSerialNumber;
+    record.id.fileIndexHigh = fi.nFileIndexHigh;
+    record.id.fileIndexLow = fi.nFileIndexLow;
+    record.size = ((ULONGLONG)fi.nFileSizeHigh << 32) | fi.nFileSizeLow;
+    record.lastWriteTime = fi.ftLastWriteTime;
+    return true;
+}
+
+bool CHashCache::Lookup(HASHCACHERECORD& record)
+{
+    CSingleLock lock(&m_cs, true);
+
+    ULONGLONG i;
+    if(m_header == NULL || !m_index.Lookup(record.id, i))
+    {
+        return false;
+    }
+
+    HASHCACHERECORD& cached = GetRecords()[i];
+    if(cached.size != record.size || ::CompareFileTime(&cached.lastWriteTime, &record.lastWriteTime) != 0)
+    {
+        return false; // Modified
+    }
+
+    cached.generation = m_header->generation;
+    record = cached;
+    return true;
+}
+
+// Digests of the same version of the file, which the cache already
+// has, are merged into the new record.
+//
+void CHashCache::Store(const HASHCACHERECORD& record)
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(m_header == NULL)
+    {
+        return;
+    }
+
+    HASHCACHERECORD r = record;
+    r.generation = m_header->generation;
+
+    ULONGLONG i;
+    const bool known = (m_index.Lookup(r.id, i) != FALSE);
+    if(known)
+    {
+        const HASHCACHERECORD& old = GetRecords()[i];
+        if(old.size == r.size && ::CompareFileTime(&old.lastWriteTime, &r.lastWriteTime) == 0)
+        {
+            if((r.flags & HASHCACHERECORD::HCR_HEADTAIL) == 0 && (old.flags & HASHCACHERECORD::HCR_HEADTAIL) != 0)
+            {
+                memcpy(r.headTail, old.headTail, sizeof(r.headTail));
+                r.flags |= old.flags & (HASHCACHERECORD::HCR_HEADTAIL | HASHCACHERECORD::HCR_COMPLETE);
+            }
+            if((r.flags & HASHCACHERECORD::HCR_FULL) == 0 && (old.flags & HASHCACHERECORD::HCR_FULL) != 0)
+            {
+                memcpy(r.full, old.full, sizeof(r.full));
+                r.flags |= HASHCACHERECORD::HCR_FULL;
+            }
+        }
+    }
+
+    if(m_header->count == m_capacity && !Map(m_capacity * 2))
+    {
+        return;
+    }
+
+    GetRecords()[m_header->count] = r;
+    m_index.SetAt(r.id, m_header->count);
+    m_header->count++;
+    if(known)
+    {
+        m_header->superseded++;
+    }
+}
+
+// Moves the newest record of each file to the front and drops the
+// expired ones. The records keep their order, so a record never
+// overwrites one, which is still needed.
+//
+void CHashCache::Compact()
+{
+    CSingleLock lock(&m_cs, true);
+
+    if(m_header == NULL)
+    {
+        return;
+    }
+
+    CArray<ULONGLONG, ULONGLONG> live;
+    live.SetSize(0, m_index.GetCount());
+    CArray<HASHCACHEID, const HASHCACHEID&> expired;
+
+    const HASHCACHERECORD *newest = GetRecords();
+    POSITION pos = m_index.GetStartPosition();
+    while(pos != NULL)
+    {
+        HASHCACHEID id;
+        ULONGLONG i;
+        m_index.GetNextAssoc(pos, id, i);
+        if(IsExpired(newest[i]))
+        {
+            expired.Add(id);
+        }
+        else
+        {
+            live.Add(i);
+        }
+    }
+
+    if((ULONGLONG)live.GetSize() == m_header->count)
+    {
+        return; // Nothing superseded or expired
+    }
+
+    for(INT_PTR i = 0; i < expired.GetSize(); i++)
+    {
+        m_index.RemoveKey(expired[i]);
+    }
+    qsort(live.GetData(), live.GetSize(), sizeof(ULONGLONG), &CompareRecordNumbers);
+
+    HASHCACHERECORD *records = GetRecords();
+    for(INT_PTR i = 0; i < live.GetSize(); i++)
+    {
+        if((ULONGLONG)i != live[i])
+        {
+            records[i] = records[live[i]];
+        }
+        m_index.SetAt(records[i].id, i);
+    }
+
+    VTRACE(_T("Hash cache compacted from %I64u to %I64u records"), m_header->count, (ULONGLONG)live.GetSize());
+
+    m_header->count = live.GetSize();
+    m_header->superseded = 0;
+}
+
+CString CHashCache::GetDefaultPath()
+{
+    TCHAR folder[MAX_PATH];
+    if(!::SHGetSpecialFolderPath(NULL, folder, CSIDL_LOCAL_APPDATA, true))
+    {
+        return wds::strEmpty;
+    }
+
+    CString path = folder;
+    path += _T("\\WinDirStat");
+    ::CreateDirectory(path, NULL);
+
+    return path + _T("\\hashcache.dat");
+}
+
+// (Re)maps the file with room for capacity records. Grows the file if needed.
+//
+bool CHashCache::Map(ULONGLONG capacity)
+{
+    Unmap();
+
+    const ULONGLONG size = sizeof(HEADER) + capacity * sizeof(HASHCACHERECORD);
+
+    m_mapping = ::CreateFileMapping(m_file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+    if(m_mapping == NULL)
+    {
+        VTRACE(_T("CreateFileMapping() failed: %u"), ::GetLastError());
+        return false;
+    }
+
+    m_header = (HEADER *)::MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+    if(m_header == NULL)
+    {
+        VTRACE(_T("MapViewOfFile() failed: %u"), ::GetLastError());
+        ::CloseHandle(m_mapping);
+        m_mapping = NULL;
+        return false;
+    }
+
+    m_capacity = capacity;
+    return true;
+}
+
+void CHashCache::Unmap()
+{
+    if(m_header != NULL)
+    {
+        ::FlushViewOfFile(m_header, 0);
+        ::UnmapViewOfFile(m_header);
+        m_header = NULL;
+    }
+    if(m_mapping != NULL)
+    {
+        ::CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    m_capacity = 0;
+}
+
+HASHCACHERECORD *CHashCache::GetRecords()
+{
+    return (HASHCACHERECORD *)(m_header + 1);
+}
+
+void CHashCache::Reset()
+{
+    ZeroMemory(m_header, sizeof(*m_header));
+    m_header->magic = MAGIC;
+    m_header->version = VERSION;
+    m_header->recordSize = sizeof(HASHCACHERECORD);
+    m_header->headTailBytes = m_headTailBytes;
+}
+
+bool CHashCache::IsExpired(const HASHCACHERECORD& record)
+{
+    return m_header->generation - record.generation > MAX_UNUSED_GENERATIONS;
+}
+
+// Later records supersede earlier ones.
+//
+void CHashCache::BuildIndex()
+{
+    m_index.RemoveAll();
+    m_index.InitHashTable(max((UINT)17, (UINT)(m_header->count * 5 / 4) | 1));
+
+    const HASHCACHERECORD *records = GetRecords();
+    for(ULONGLONG i = 0; i < m_header->count; i++)
+    {
+        m_index.SetAt(records[i].id, i);
+    }
+}
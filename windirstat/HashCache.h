@@ -0,0 +1,148 @@
+// HashCache.h - Declaration of CHashCache
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_HASHCACHE_H__
+#define __WDS_HASHCACHE_H__
+#pragma once
+
+const int HASHCACHE_DIGESTSIZE = 20;   // SHA-1
+
+//
+// HASHCACHEID. Identity of a file: volume serial number and file index
+// (the NTFS file reference). Survives renames and moves within a volume.
+//
+struct HASHCACHEID
+{
+    DWORD volumeSerial;
+    DWORD fileIndexHigh;
+    DWORD fileIndexLow;
+};
+
+inline bool operator== (const HASHCACHEID& id1, const HASHCACHEID& id2)
+{
+    return id1.volumeSerial == id2.volumeSerial && id1.fileIndexHigh == id2.fileIndexHigh && id1.fileIndexLow == id2.fileIndexLow;
+}
+
+template<> inline UINT AFXAPI HashKey<const HASHCACHEID&>(const HASHCACHEID& id)
+{
+    return id.fileIndexLow ^ (id.fileIndexHigh * 31) ^ (id.volumeSerial * 1031);
+}
+
+//
+// HASHCACHERECORD. The digests of one version of a file.
+// The version is identified by size and last write time.
+// This is also the on-disk record, so don't change it without
+// incrementing CHashCache::VERSION.
+//
+struct HASHCACHERECORD
+{
+    enum
+    {
+        HCR_HEADTAIL = 0x01,        // headTail is valid
+        HCR_FULL     = 0x02,        // full is valid
+        HCR_COMPLETE = 0x04         // headTail covers the whole file
+    };
+
+    HASHCACHEID id;
+    DWORD flags;
+    DWORD generation;               // Of the last run, which used the record
+    ULONGLONG size;
+    FILETIME lastWriteTime;
+    BYTE headTail[HASHCACHE_DIGESTSIZE];
+    BYTE full[HASHCACHE_DIGESTSIZE];
+};
+
+//
+// CHashCache. Persistent cache of content digests, so that repeated
+// analyses read only new or modified files.
+// The file is a header followed by an array of HASHCACHERECORDs. It is
+// memory mapped and only appended to: a record for a file, which is already
+// known, supersedes the older record. An index in memory maps each file to
+// its newest record. Close() compacts the file, if more than half of the
+// records have been superseded.
+// Each Open() starts a new generation. Records, which no generation has
+// used for MAX_UNUSED_GENERATIONS, belong to deleted files or to files
+// out of reach. Open() drops them, so the file does not grow forever.
+// All methods are thread safe.
+//
+class CHashCache
+{
+    struct HEADER
+    {
+        DWORD magic;
+        DWORD version;
+        DWORD recordSize;
+        DWORD headTailBytes;        // Parameter of the head and tail digests
+        ULONGLONG count;            // Records in use
+        ULONGLONG superseded;       // Of these
+        DWORD generation;           // Incremented by Open()
+        DWORD reserved;
+    };
+
+public:
+    CHashCache();
+    ~CHashCache();
+
+    // headTailBytes: the cached head and tail digests are only valid for this value.
+    bool Open(LPCTSTR path, DWORD headTailBytes);
+    void Close();
+    bool IsOpen();
+
+    // Fills in the identity and the version of an open file.
+    static bool GetRecordKey(HANDLE file, HASHCACHERECORD& record);
+
+    // record.id, size and lastWriteTime are in. Returns false, if the
+    // cache has no digests for this version of the file.
+    bool Lookup(HASHCACHERECORD& record);
+
+    // Adds the digests of a record to the cache.
+    void Store(const HASHCACHERECORD& record);
+
+    void Compact();
+
+    // In the local application data folder
+    static CString GetDefaultPath();
+
+protected:
+    static const DWORD MAGIC = 0x48534457;  // "WDSH"
+    static const DWORD VERSION = 2;
+    static const ULONGLONG MIN_CAPACITY = 4096;
+    static const DWORD MAX_UNUSED_GENERATIONS = 16;
+
+    bool Map(ULONGLONG capacity);
+    void Unmap();
+    HASHCACHERECORD *GetRecords();
+    void Reset();
+    void BuildIndex();
+    bool IsExpired(const HASHCACHERECORD& record);
+
+    CCriticalSection m_cs;
+    CString m_path;
+    DWORD m_headTailBytes;
+    HANDLE m_file;
+    HANDLE m_mapping;
+    HEADER *m_header;               // Mapped view
+    ULONGLONG m_capacity;           // Records, which fit into the mapping
+    CMap<HASHCACHEID, const HASHCACHEID&, ULONGLONG, ULONGLONG> m_index; // -> record number
+};
+
+#endif // __WDS_HASHCACHE_H__
@@ -0,0 +1,378 @@
+// LiveTreemap.cpp - Implementation of CLiveTreemap
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "MemoryAccounting.h"
+#include "TreemapCache.h"
+#include "LiveTreemap.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const COLORREF PLACEHOLDER_COLOR = RGB(153,153,153);
+}
+
+CLiveTreemap::CLiveItem::CLiveItem(CItem *item)
+    : m_item(item)
+    , m_placeholder(true)
+    , m_itemSize(0)
+    , m_size(0)
+    , m_drawnSize(0)
+    , m_relayout(true)
+    , m_rect(0, 0, 0, 0)
+{
+}
+
+bool CLiveTreemap::CLiveItem::TmiIsLeaf() const
+{
+    return m_children.GetSize() == 0;
+}
+
+CRect CLiveTreemap::CLiveItem::TmiGetRectangle() const
+{
+    return m_rect;
+}
+
+void CLiveTreemap::CLiveItem::TmiSetRectangle(const CRect& rc)
+{
+    m_rect = rc;
+}
+
+COLORREF CLiveTreemap::CLiveItem::TmiGetGraphColor() const
+{
+    return PLACEHOLDER_COLOR;
+}
+
+int CLiveTreemap::CLiveItem::TmiGetChildrenCount() const
+{
+    return (int)m_children.GetSize();
+}
+
+CTreemap::Item *CLiveTreemap::CLiveItem::TmiGetChild(int c) const
+{
+    return m_children[c];
+}
+
+ULONGLONG CLiveTreemap::CLiveItem::TmiGetSize() const
+{
+    return m_size;
+}
+
+
+CLiveTreemap::CLiveTreemap()
+    : m_root(NULL)
+    , m_nextUpdate(0)
+    , m_drawn(false)
+    , m_drawnRect(0, 0, 0, 0)
+    , m_drawnOptionsHash(0)
+    , m_drawnColorSerial(0)
+    , m_bytes(0)
+{
+}
+
+CLiveTreemap::~CLiveTreemap()
+{
+    Reset();
+}
+
+bool CLiveTreemap::IsUpdateDue() const
+{
+    return _GetTickCount64() >= m_nextUpdate;
+}
+
+void CLiveTreemap::Update(CDC *pdc, const CRect& rc, CItem *root, const CTreemap::Options *options, UINT colorSerial)
+{
+    const ULONGLONG start = _GetTickCount64();
+    const LONGLONG bytes = m_bytes;
+
+    if(m_root != NULL && m_root->m_item != root)
+    {
+        Reset();
+    }
+
+    if(m_root == NULL)
+    {
+        m_root = CreateProxy(root);
+    }
+    else
+    {
+        RefreshProxy(m_root);
+    }
+
+    CMemoryAccounting::Add(MEM_TREEMAP, m_bytes - bytes, 0);
+
+    const ULONGLONG optionsHash = CTreemapCache::HashOptions(*options);
+    if(!m_drawn || rc != m_drawnRect || optionsHash != m_drawnOptionsHash || colorSerial != m_drawnColorSerial || NeedsRelayout(m_root))
+    {
+        m_treemap.DrawTreemap(pdc, rc, m_root, options);
+        m_root->m_drawnSize = m_root->m_size;
+        MarkDrawn(m_root);
+
+        m_drawn = true;
+        m_drawnRect = rc;
+        m_drawnOptionsHash = optionsHash;
+        m_drawnColorSerial = colorSerial;
+    }
+    else
+    {
+        CArray<CTreemap::Item *, CTreemap::Item *> path;
+        path.Add(m_root);
+        DrawChanges(pdc, m_root, path);
+    }
+
+    // Wait long enough to keep the share of the live treemap small.
+    const ULONGLONG cost = _GetTickCount64() - start;
+    m_nextUpdate = _GetTickCount64() + max(ULONGLONG(MIN_INTERVAL), cost * 100 / MAX_COST_PERCENT);
+}
+
+void CLiveTreemap::Reset()
+{
+    if(m_root != NULL)
+    {
+        DeleteProxy(m_root);
+        m_root = NULL;
+    }
+    CMemoryAccounting::Add(MEM_TREEMAP, -m_bytes, 0);
+    m_bytes = 0;
+    m_nextUpdate = 0;
+    m_drawn = false;
+}
+
+CLiveTreemap::CLiveItem *CLiveTreemap::CreateProxy(CItem *item)
+{
+    CLiveItem *proxy = new CLiveItem(item);
+    m_bytes += sizeof(CLiveItem);
+    RebuildProxy(proxy);
+    return proxy;
+}
+
+void CLiveTreemap::DeleteProxy(CLiveItem *proxy)
+{
+    for(int i = 0; i < proxy->m_proxies.GetSize(); i++)
+    {
+        DeleteProxy(proxy->m_proxies[i]);
+    }
+    AccountProxy(proxy, -1);
+    m_bytes -= sizeof(CLiveItem);
+    delete proxy;
+}
+
+// Returns true, if the size of proxy has changed.
+// A snapshot is renewed, if the folder has been read, if a child has
+// become done or if the folder has grown noticeably. Otherwise only the
+// proxies below are refreshed.
+//
+bool CLiveTreemap::RefreshProxy(CLiveItem *proxy)
+{
+    const ULONGLONG size = proxy->m_item->GetSize();
+    const ULONGLONG growth = (size > proxy->m_itemSize ? size - proxy->m_itemSize : proxy->m_itemSize - size);
+
+    bool rebuild = (proxy->m_placeholder && proxy->m_item->IsReadJobDone())
+        || growth * 1000 > proxy->m_itemSize * RELAYOUT_PERMILLE;
+
+    bool changed = false;
+    for(int i = 0; !rebuild && i < proxy->m_proxies.GetSize(); i++)
+    {
+        CLiveItem *child = proxy->m_proxies[i];
+        if(child->m_item->IsDone())
+        {
+            rebuild = true;
+        }
+        else if(RefreshProxy(child))
+        {
+            changed = true;
+        }
+    }
+
+    if(rebuild)
+    {
+        RebuildProxy(proxy);
+        return true;
+    }
+
+    if(changed)
+    {
+        SortProxy(proxy);
+    }
+    return changed;
+}
+
+// Takes a new snapshot of the children. The proxies of the children,
+// which are still unfinished, are kept and refreshed.
+//
+void CLiveTreemap::RebuildProxy(CLiveItem *proxy)
+{
+    CItem *item = proxy->m_item;
+
+    CMap<CItem *, CItem *, CLiveItem *, CLiveItem *> old;
+    for(int i = 0; i < proxy->m_proxies.GetSize(); i++)
+    {
+        old.SetAt(proxy->m_proxies[i]->m_item, proxy->m_proxies[i]);
+    }
+
+    AccountProxy(proxy, -1);
+    proxy->m_children.RemoveAll();
+    proxy->m_proxies.RemoveAll();
+
+    proxy->m_itemSize = item->GetSize();
+    proxy->m_placeholder = !item->IsReadJobDone();
+
+    if(!proxy->m_placeholder)
+    {
+        proxy->m_children.SetSize(0, item->GetChildrenCount());
+        for(int i = 0; i < item->GetChildrenCount(); i++)
+        {
+            CItem *child = item->GetChild(i);
+            if(child->TmiIsLeaf() || child->IsDone())
+            {
+                proxy->m_children.Add(child);
+                continue;
+            }
+
+            CLiveItem *childProxy;
+            if(old.Lookup(child, childProxy))
+            {
+                old.RemoveKey(child);
+                RefreshProxy(childProxy);
+            }
+            else
+            {
+                childProxy = CreateProxy(child);
+            }
+            proxy->m_children.Add(childProxy);
+            proxy->m_proxies.Add(childProxy);
+        }
+    }
+
+    // Children which have gone.
+    POSITION pos = old.GetStartPosition();
+    while(pos != NULL)
+    {
+        CItem *child;
+        CLiveItem *childProxy;
+        old.GetNextAssoc(pos, child, childProxy);
+        DeleteProxy(childProxy);
+    }
+
+    AccountProxy(proxy, 1);
+    SortProxy(proxy);
+    proxy->m_relayout = true;
+}
+
+// Sorts the children and sums up their sizes.
+//
+void CLiveTreemap::SortProxy(CLiveItem *proxy)
+{
+    if(proxy->m_placeholder)
+    {
+        proxy->m_size = proxy->m_itemSize;
+        return;
+    }
+
+    qsort(proxy->m_children.GetData(), proxy->m_children.GetSize(), sizeof(CTreemap::Item *), &_compareBySize);
+
+    proxy->m_size = 0;
+    for(int i = 0; i < proxy->m_children.GetSize(); i++)
+    {
+        proxy->m_size += proxy->m_children[i]->TmiGetSize();
+    }
+}
+
+void CLiveTreemap::AccountProxy(CLiveItem *proxy, int sign)
+{
+    m_bytes += sign * LONGLONG(proxy->m_children.GetSize() + proxy->m_proxies.GetSize()) * LONGLONG(sizeof(void *));
+}
+
+// True, if the rectangles of the children of proxy are outdated: the
+// snapshot has been renewed, or a child proxy has grown noticeably.
+//
+bool CLiveTreemap::NeedsRelayout(const CLiveItem *proxy) const
+{
+    if(proxy->m_relayout)
+    {
+        return true;
+    }
+
+    for(int i = 0; i < proxy->m_proxies.GetSize(); i++)
+    {
+        const CLiveItem *child = proxy->m_proxies[i];
+        const ULONGLONG growth = (child->m_size > child->m_drawnSize ? child->m_size - child->m_drawnSize : child->m_drawnSize - child->m_size);
+        if(growth * 1000 > child->m_drawnSize * RELAYOUT_PERMILLE)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Redraws the child proxies of proxy, which need a new layout, into their
+// old rectangles, and looks further down in the others.
+// path is the root ... proxy.
+//
+void CLiveTreemap::DrawChanges(CDC *pdc, CLiveItem *proxy, CArray<CTreemap::Item *, CTreemap::Item *>& path)
+{
+    for(int i = 0; i < proxy->m_proxies.GetSize(); i++)
+    {
+        CLiveItem *child = proxy->m_proxies[i];
+        path.Add(child);
+
+        if(NeedsRelayout(child))
+        {
+            if(child->m_size > 0)
+            {
+                m_treemap.DrawTreemapPart(pdc, path.GetData(), (int)path.GetSize());
+            }
+            MarkDrawn(child);
+        }
+        else
+        {
+            DrawChanges(pdc, child, path);
+        }
+
+        path.RemoveAt(path.GetSize() - 1);
+    }
+}
+
+// The subtree of proxy has been laid out with the current sizes.
+//
+void CLiveTreemap::MarkDrawn(CLiveItem *proxy)
+{
+    proxy->m_relayout = false;
+    for(int i = 0; i < proxy->m_proxies.GetSize(); i++)
+    {
+        CLiveItem *child = proxy->m_proxies[i];
+        child->m_drawnSize = child->m_size;
+        MarkDrawn(child);
+    }
+}
+
+int __cdecl CLiveTreemap::_compareBySize(const void *p1, const void *p2)
+{
+    const CTreemap::Item *item1 = *(const CTreemap::Item **)p1;
+    const CTreemap::Item *item2 = *(const CTreemap::Item **)p2;
+
+    return usignum(item2->TmiGetSize(), item1->TmiGetSize()); // biggest first
+}
@@ -0,0 +1,113 @@
+// LiveTreemap.h - Declaration of CLiveTreemap
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_LIVETREEMAP_H__
+#define __WDS_LIVETREEMAP_H__
+#pragma once
+
+#include "treemap.h"
+
+class CItem;
+
+//
+// CLiveTreemap. The treemap of a tree which is still being scanned.
+// CTreemap needs children sorted by size, whose sizes sum up to the
+// size of the parent. This holds for the done items only, so the
+// unfinished folders are represented by proxies, which hold a sorted
+// snapshot of their children. A folder not yet read is a placeholder,
+// i.e. one gray block.
+// Update() refreshes only the snapshots of the folders, which have grown
+// by more than RELAYOUT_PERMILLE since they were taken, and IsUpdateDue()
+// spaces the updates such that they take at most MAX_COST_PERCENT of the time.
+// Only the proxies, whose children must be laid out anew, are redrawn
+// (with CTreemap::DrawTreemapPart()). A proxy keeps its rectangle, as long
+// as its size stays within RELAYOUT_PERMILLE of the size it was laid out with.
+// The owner must call Reset(), whenever items are deleted.
+//
+class CLiveTreemap
+{
+    class CLiveItem: public CTreemap::Item
+    {
+    public:
+        CLiveItem(CItem *item);
+
+        virtual            bool TmiIsLeaf()                const;
+        virtual           CRect TmiGetRectangle()          const;
+        virtual            void TmiSetRectangle(const CRect& rc);
+        virtual        COLORREF TmiGetGraphColor()         const;
+        virtual             int TmiGetChildrenCount()      const;
+        virtual CTreemap::Item *TmiGetChild(int c)         const;
+        virtual       ULONGLONG TmiGetSize()               const;
+
+        CItem *m_item;
+        bool m_placeholder;                                 // Not yet read
+        ULONGLONG m_itemSize;                               // m_item->GetSize() when the snapshot was taken
+        ULONGLONG m_size;                                   // Sum of m_children
+        ULONGLONG m_drawnSize;                              // m_size, when the parent was laid out
+        bool m_relayout;                                    // Snapshot renewed since drawn
+        CRect m_rect;
+        CArray<CTreemap::Item *, CTreemap::Item *> m_children; // Done items and proxies, sorted by size
+        CArray<CLiveItem *, CLiveItem *> m_proxies;         // The proxies among m_children. Owned.
+    };
+
+public:
+    CLiveTreemap();
+    ~CLiveTreemap();
+
+    bool IsUpdateDue() const;
+
+    // Refreshes the snapshot of the tree and draws it. pdc must hold the
+    // last drawing; it is drawn completely, if rc, options or colorSerial
+    // (CDirstatDoc::GetExtensionColorSerial()) have changed. The leaves get
+    // provisional colors, as the extension data is deferred during the scan.
+    void Update(CDC *pdc, const CRect& rc, CItem *root, const CTreemap::Options *options, UINT colorSerial);
+
+    // Discards the snapshot. The next update is due at once.
+    void Reset();
+
+protected:
+    static const DWORD MIN_INTERVAL = 1000;     // Milliseconds between two updates
+    static const int MAX_COST_PERCENT = 3;      // Of the time, spent in Update()
+    static const int RELAYOUT_PERMILLE = 50;    // Growth of a folder, which renews its snapshot
+
+    CLiveItem *CreateProxy(CItem *item);
+    void DeleteProxy(CLiveItem *proxy);
+    bool RefreshProxy(CLiveItem *proxy);
+    void RebuildProxy(CLiveItem *proxy);
+    void SortProxy(CLiveItem *proxy);
+    void AccountProxy(CLiveItem *proxy, int sign);
+    bool NeedsRelayout(const CLiveItem *proxy) const;
+    void DrawChanges(CDC *pdc, CLiveItem *proxy, CArray<CTreemap::Item *, CTreemap::Item *>& path);
+    void MarkDrawn(CLiveItem *proxy);
+
+    static int __cdecl _compareBySize(const void *p1, const void *p2);
+
+    CTreemap m_treemap;
+    CLiveItem *m_root;
+    ULONGLONG m_nextUpdate;     // _GetTickCount64()
+    bool m_drawn;               // m_root has been drawn with the following
+    CRect m_drawnRect;
+    ULONGLONG m_drawnOptionsHash;
+    UINT m_drawnColorSerial;
+    LONGLONG m_bytes;           // Accounted as MEM_TREEMAP
+};
+
+#endif // __WDS_LIVETREEMAP_H__
@@ -0,0 +1,179 @@
+// MemoryAccounting.cpp - Implementation of CMemoryAccounting
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "globalhelpers.h"
+#include <common/wds_constants.h>
+#include "MemoryAccounting.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+LONGLONG CMemoryAccounting::_bytes[MEM_SUBSYSTEMCOUNT];
+LONGLONG CMemoryAccounting::_allocations[MEM_SUBSYSTEMCOUNT];
+LONGLONG CMemoryAccounting::_fileBytes;
+LONGLONG CMemoryAccounting::_files;
+LONGLONG CMemoryAccounting::_folderBytes;
+LONGLONG CMemoryAccounting::_folders;
+
+void CMemoryAccounting::Add(MEMORYSUBSYSTEM subsystem, LONGLONG bytes, LONGLONG allocations)
+{
+    ASSERT(subsystem >= 0 && subsystem < MEM_SUBSYSTEMCOUNT);
+    _bytes[subsystem] += bytes;
+    _allocations[subsystem] += allocations;
+    ASSERT(_bytes[subsystem] >= 0);
+    ASSERT(_allocations[subsystem] >= 0);
+}
+
+void CMemoryAccounting::AddItem(bool file, LONGLONG bytes, LONGLONG items)
+{
+    if(file)
+    {
+        _fileBytes += bytes;
+        _files += items;
+    }
+    else
+    {
+        _folderBytes += bytes;
+        _folders += items;
+    }
+}
+
+LONGLONG CMemoryAccounting::GetBytes(MEMORYSUBSYSTEM subsystem)
+{
+    ASSERT(subsystem >= 0 && subsystem < MEM_SUBSYSTEMCOUNT);
+    return _bytes[subsystem];
+}
+
+LONGLONG CMemoryAccounting::GetAllocations(MEMORYSUBSYSTEM subsystem)
+{
+    ASSERT(subsystem >= 0 && subsystem < MEM_SUBSYSTEMCOUNT);
+    return _allocations[subsystem];
+}
+
+LONGLONG CMemoryAccounting::GetTotalBytes()
+{
+    LONGLONG total = 0;
+    for(int i = 0; i < MEM_SUBSYSTEMCOUNT; i++)
+    {
+        total += _bytes[i];
+    }
+    return total;
+}
+
+LONGLONG CMemoryAccounting::GetTotalAllocations()
+{
+    LONGLONG total = 0;
+    for(int i = 0; i < MEM_SUBSYSTEMCOUNT; i++)
+    {
+        total += _allocations[i];
+    }
+    return total;
+}
+
+LONGLONG CMemoryAccounting::GetBytesPerFile()
+{
+    return _files > 0 ? _fileBytes / _files : 0;
+}
+
+LONGLONG CMemoryAccounting::GetBytesPerFolder()
+{
+    return _folders > 0 ? _folderBytes / _folders : 0;
+}
+
+LONGLONG CMemoryAccounting::GetStringBytes(const CString& s)
+{
+    if(s.GetAllocLength() == 0)
+    {
+        return 0;
+    }
+    return sizeof(ATL::CStringData) + (s.GetAllocLength() + 1) * sizeof(TCHAR);
+}
+
+LPCTSTR CMemoryAccounting::GetSubsystemName(MEMORYSUBSYSTEM subsystem)
+{
+    switch (subsystem)
+    {
+    case MEM_NODES:
+        return _T("nodes");
+    case MEM_NAMES:
+        return _T("names");
+    case MEM_CHILDARRAYS:
+        return _T("childArrays");
+    case MEM_EXTENSIONS:
+        return _T("extensionData");
+    case MEM_TREEMAP:
+        return _T("treemapBitmaps");
+    case MEM_TREEMAPINDEX:
+        return _T("treemapIndex");
+    case MEM_FILEINDEX:
+        return _T("fileIndex");
+    default:
+        ASSERT(0);
+        return wds::strEmpty;
+    }
+}
+
+CString CMemoryAccounting::FormatBreakdown()
+{
+    CString s;
+    s.FormatMessage(IDS_MEMORYBREAKDOWN
+        , FormatBytes(GetBytes(MEM_NODES)).GetString()
+        , FormatBytes(GetBytes(MEM_NAMES)).GetString()
+        , FormatBytes(GetBytes(MEM_CHILDARRAYS)).GetString()
+        , FormatBytes(GetBytes(MEM_EXTENSIONS)).GetString()
+        , FormatBytes(GetBytes(MEM_TREEMAP)).GetString()
+        , FormatBytes(GetBytes(MEM_TREEMAPINDEX)).GetString()
+        , FormatBytes(GetTotalBytes()).GetString()
+        , FormatCount(GetTotalAllocations()).GetString()
+        , FormatCount(GetBytesPerFile()).GetString()
+        , FormatCount(GetBytesPerFolder()).GetString()
+        );
+    return s;
+}
+
+void CMemoryAccounting::WriteBreakdown(LPCTSTR path)
+{
+    const LPCTSTR section = _T("memory");
+
+    CString value;
+    for(int i = 0; i < MEM_SUBSYSTEMCOUNT; i++)
+    {
+        CString key = GetSubsystemName((MEMORYSUBSYSTEM)i);
+
+        value.Format(_T("%I64d"), _bytes[i]);
+        ::WritePrivateProfileString(section, key, value, path);
+        value.Format(_T("%I64d"), _allocations[i]);
+        ::WritePrivateProfileString(section, key + _T(".allocations"), value, path);
+    }
+
+    value.Format(_T("%I64d"), GetTotalBytes());
+    ::WritePrivateProfileString(section, _T("total"), value, path);
+    value.Format(_T("%I64d"), GetTotalAllocations());
+    ::WritePrivateProfileString(section, _T("total.allocations"), value, path);
+    value.Format(_T("%I64d"), GetBytesPerFile());
+    ::WritePrivateProfileString(section, _T("bytesPerFile"), value, path);
+    value.Format(_T("%I64d"), GetBytesPerFolder());
+    ::WritePrivateProfileString(section, _T("bytesPerFolder"), value, path);
+}
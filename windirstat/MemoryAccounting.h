@@ -0,0 +1,86 @@
+// MemoryAccounting.h - Declaration of CMemoryAccounting
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_MEMORYACCOUNTING_H__
+#define __WDS_MEMORYACCOUNTING_H__
+#pragma once
+
+// The consumers of memory we keep books for
+enum MEMORYSUBSYSTEM
+{
+    MEM_NODES,          // The CItem objects
+    MEM_NAMES,          // Their names and cached extensions
+    MEM_CHILDARRAYS,    // Their children arrays
+    MEM_EXTENSIONS,     // CExtensionData
+    MEM_TREEMAP,        // Treemap bitmaps and pixel buffers
+    MEM_TREEMAPINDEX,   // The hit index of the treemap
+    MEM_FILEINDEX,      // CFileIndex
+    MEM_SUBSYSTEMCOUNT
+};
+
+//
+// CMemoryAccounting. Live bytes and allocations per subsystem, and the
+// bytes the item tree spends per file and per folder.
+// The owners report their allocations themselves, so this costs
+// a few additions per allocation and is enabled in release builds, too.
+// The counters are not synchronized; only the main thread may call Add().
+//
+class CMemoryAccounting
+{
+public:
+    // bytes and allocations are negative for releases
+    static void Add(MEMORYSUBSYSTEM subsystem, LONGLONG bytes, LONGLONG allocations);
+
+    // Attributes bytes of the item tree to files (leaves) or folders.
+    // items is +1 when an item comes to life and -1 when it dies.
+    static void AddItem(bool file, LONGLONG bytes, LONGLONG items);
+
+    static LONGLONG GetBytes(MEMORYSUBSYSTEM subsystem);
+    static LONGLONG GetAllocations(MEMORYSUBSYSTEM subsystem);
+    static LONGLONG GetTotalBytes();
+    static LONGLONG GetTotalAllocations();
+    static LONGLONG GetBytesPerFile();
+    static LONGLONG GetBytesPerFolder();
+
+    // Heap bytes of the buffer of s (0, if s uses the shared empty buffer)
+    static LONGLONG GetStringBytes(const CString& s);
+
+    // Language independent, for trace and benchmark output
+    static LPCTSTR GetSubsystemName(MEMORYSUBSYSTEM subsystem);
+
+    // Multi-line text for the status bar tooltip
+    static CString FormatBreakdown();
+
+    // The breakdown as section [memory] of an ini file, for headless runs:
+    // <subsystem>=bytes, <subsystem>.allocations=count, total..., bytesPerFile, bytesPerFolder
+    static void WriteBreakdown(LPCTSTR path);
+
+private:
+    static LONGLONG _bytes[MEM_SUBSYSTEMCOUNT];
+    static LONGLONG _allocations[MEM_SUBSYSTEMCOUNT];
+    static LONGLONG _fileBytes;
+    static LONGLONG _files;
+    static LONGLONG _folderBytes;
+    static LONGLONG _folders;
+};
+
+#endif // __WDS_MEMORYACCOUNTING_H__
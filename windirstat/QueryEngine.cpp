@@ -0,0 +1,600 @@
+// QueryEngine.cpp - Implementation of CQueryEngine
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "QueryEngine.h"
+#include "windirstat.h"
+#include "dirstatdoc.h"
+#include "item.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const ULONGLONG TICKS_PER_DAY = 24 * 60 * 60 * ULONGLONG(10000000);
+
+    // "1G" -> 1073741824
+    ULONGLONG ParseSize(const CString& s)
+    {
+        LPTSTR end = NULL;
+        ULONGLONG size = _tcstoui64(s, &end, 10);
+        switch (_totupper(*end))
+        {
+        case _T('T'):
+            size <<= 10;
+            // fall through
+        case _T('G'):
+            size <<= 10;
+            // fall through
+        case _T('M'):
+            size <<= 10;
+            // fall through
+        case _T('K'):
+            size <<= 10;
+        }
+        return size;
+    }
+
+    ULONGLONG GetDaysAgo(ULONGLONG days)
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        ULARGE_INTEGER u;
+        u.LowPart = now.dwLowDateTime;
+        u.HighPart = now.dwHighDateTime;
+        return (u.QuadPart > days * TICKS_PER_DAY) ? u.QuadPart - days * TICKS_PER_DAY : 0;
+    }
+
+    // The letters of FormatAttributes()
+    DWORD GetAttributeOfLetter(TCHAR letter)
+    {
+        switch (_totlower(letter))
+        {
+        case _T('r'): return FILE_ATTRIBUTE_READONLY;
+        case _T('h'): return FILE_ATTRIBUTE_HIDDEN;
+        case _T('s'): return FILE_ATTRIBUTE_SYSTEM;
+        case _T('a'): return FILE_ATTRIBUTE_ARCHIVE;
+        case _T('c'): return FILE_ATTRIBUTE_COMPRESSED;
+        case _T('e'): return FILE_ATTRIBUTE_ENCRYPTED;
+        default:      return 0;
+        }
+    }
+
+    ULONGLONG FileTimeToKey(const FILETIME& t)
+    {
+        ULARGE_INTEGER u;
+        u.LowPart = t.dwLowDateTime;
+        u.HighPart = t.dwHighDateTime;
+        return u.QuadPart;
+    }
+}
+
+ITEMQUERY::ITEMQUERY()
+    : minSize(0)
+    , maxSize(_UI64_MAX)
+    , minLastChange(0)
+    , maxLastChange(_UI64_MAX)
+    , attributesSet(0)
+    , attributesClear(0)
+    , minDepth(0)
+    , maxDepth(INT_MAX)
+    , files(true)
+    , folders(true)
+{
+}
+
+bool ITEMQUERY::Parse(LPCTSTR spec)
+{
+    CString s(spec);
+    int pos = 0;
+    for(CString condition = s.Tokenize(_T(";"), pos); !condition.IsEmpty(); condition = s.Tokenize(_T(";"), pos))
+    {
+        int eq = condition.Find(_T('='));
+        if(eq < 0)
+        {
+            VTRACE(_T("Missing '=' in \"%s\""), condition.GetString());
+            return false;
+        }
+        CString key = condition.Left(eq);
+        key.Trim();
+        key.MakeLower();
+        CString value = condition.Mid(eq + 1);
+        value.Trim();
+
+        if(key == _T("under"))
+        {
+            folder = value;
+        }
+        else if(key == _T("name"))
+        {
+            nameGlob = value;
+        }
+        else if(key == _T("ext"))
+        {
+            extension = (value.Left(1) == wds::strDot) ? value : wds::strDot + value;
+            extension.MakeLower();
+        }
+        else if(key == _T("minsize"))
+        {
+            minSize = ParseSize(value);
+        }
+        else if(key == _T("maxsize"))
+        {
+            maxSize = ParseSize(value);
+        }
+        else if(key == _T("olderthan"))
+        {
+            maxLastChange = GetDaysAgo(_tcstoui64(value, NULL, 10));
+        }
+        else if(key == _T("newerthan"))
+        {
+            minLastChange = GetDaysAgo(_tcstoui64(value, NULL, 10));
+        }
+        else if(key == _T("attr"))
+        {
+            // "+h-r": hidden and not read-only
+            bool set = true;
+            for(int i = 0; i < value.GetLength(); i++)
+            {
+                if(value[i] == _T('+') || value[i] == _T('-'))
+                {
+                    set = (value[i] == _T('+'));
+                }
+                else if(set)
+                {
+                    attributesSet |= GetAttributeOfLetter(value[i]);
+                }
+                else
+                {
+                    attributesClear |= GetAttributeOfLetter(value[i]);
+                }
+            }
+        }
+        else if(key == _T("mindepth"))
+        {
+            minDepth = _ttoi(value);
+        }
+        else if(key == _T("maxdepth"))
+        {
+            maxDepth = _ttoi(value);
+        }
+        else if(key == _T("type"))
+        {
+            files = (value.CompareNoCase(_T("folders")) != 0);
+            folders = (value.CompareNoCase(_T("files")) != 0);
+        }
+        else
+        {
+            VTRACE(_T("Unknown query condition \"%s\""), key.GetString());
+            return false;
+        }
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+QUERYRESULT::QUERYRESULT()
+    : files(0)
+    , folders(0)
+    , bytes(0)
+{
+}
+
+CString QUERYRESULT::FormatReport() const
+{
+    CString report;
+    report.Format(_T("# %I64u files, %I64u folders, %I64u bytes\r\n"), files, folders, bytes);
+
+    for(int i = 0; i < items.GetSize(); i++)
+    {
+        CString line;
+        line.Format(_T("%I64u\t%s\t%s\r\n"), items[i]->GetSize(), FormatFileTime(items[i]->GetLastChange()).GetString(), items[i]->GetPath().GetString());
+        report += line;
+    }
+    return report;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+//
+// CQueryPartThread. Filters one PART of a query.
+//
+class CQueryPartThread: public CWinThread
+{
+public:
+    CQueryPartThread(const CQueryEngine *engine, const ITEMQUERY *query, int extensionId, CQueryEngine::PART *part);
+    bool Start();
+    virtual BOOL InitInstance();
+
+private:
+    const CQueryEngine *m_engine;
+    const ITEMQUERY *m_query;
+    int m_extensionId;
+    CQueryEngine::PART *m_part;
+};
+
+CQueryPartThread::CQueryPartThread(const CQueryEngine *engine, const ITEMQUERY *query, int extensionId, CQueryEngine::PART *part)
+    : m_engine(engine)
+    , m_query(query)
+    , m_extensionId(extensionId)
+    , m_part(part)
+{
+    // CQueryEngine::Run() waits for us and deletes us.
+    m_bAutoDelete = false;
+}
+
+// False, if the thread could not be created. The caller filters the part then.
+bool CQueryPartThread::Start()
+{
+    return (CreateThread() != FALSE);
+}
+
+BOOL CQueryPartThread::InitInstance()
+{
+    m_engine->FilterPart(*m_query, m_extensionId, *m_part);
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CQueryEngine::CQueryEngine(CItem *root)
+    : m_root(root)
+{
+    const INT_PTR expected = max(1024, INT_PTR(root->GetItemsCount()) + 1);
+    m_items.SetSize(0, expected);
+    m_sizes.SetSize(0, expected);
+    m_lastChanges.SetSize(0, expected);
+    m_attributes.SetSize(0, expected);
+    m_depths.SetSize(0, expected);
+    m_extensions.SetSize(0, expected);
+    m_subtreeEnds.SetSize(0, expected);
+
+    m_extensionIds.InitHashTable(2048);
+    m_folderIndexes.InitHashTable(max((UINT)17, (UINT)(root->GetSubdirsCount() * 5 / 4) | 1));
+
+    RecurseAddItems(root, 0);
+}
+
+INT_PTR CQueryEngine::GetItemCount() const
+{
+    return m_items.GetSize();
+}
+
+bool CQueryEngine::Run(const ITEMQUERY& query, QUERYRESULT& result) const
+{
+    result.items.RemoveAll();
+    result.files = 0;
+    result.folders = 0;
+    result.bytes = 0;
+
+    INT_PTR begin;
+    INT_PTR end;
+    if(!GetRange(query, begin, end))
+    {
+        return false;
+    }
+
+    int extensionId = -1;
+    if(!query.extension.IsEmpty() && !m_extensionIds.Lookup(query.extension, extensionId))
+    {
+        return true; // No file has this extension.
+    }
+
+    SYSTEM_INFO si;
+    ::GetSystemInfo(&si);
+    const int partCount = int(max(1, min(min(INT_PTR(si.dwNumberOfProcessors), INT_PTR(MAX_PARTS)), (end - begin) / MIN_PARTSIZE)));
+
+    PART parts[MAX_PARTS];
+    CQueryPartThread *threads[MAX_PARTS];
+    for(int i = 0; i < partCount; i++)
+    {
+        parts[i].begin = begin + (end - begin) * i / partCount;
+        parts[i].end = begin + (end - begin) * (i + 1) / partCount;
+        if(i > 0)
+        {
+            threads[i] = new CQueryPartThread(this, &query, extensionId, &parts[i]);
+            if(!threads[i]->Start())
+            {
+                delete threads[i];
+                threads[i] = NULL;
+            }
+        }
+    }
+
+    FilterPart(query, extensionId, parts[0]);
+
+    for(int i = 1; i < partCount; i++)
+    {
+        if(threads[i] != NULL)
+        {
+            ::WaitForSingleObject(threads[i]->m_hThread, INFINITE);
+            delete threads[i];
+        }
+        else
+        {
+            FilterPart(query, extensionId, parts[i]);
+        }
+    }
+
+    // The parts are in tree order.
+    for(int i = 0; i < partCount; i++)
+    {
+        for(INT_PTR j = 0; j < parts[i].matches.GetSize(); j++)
+        {
+            const INT_PTR index = parts[i].matches[j];
+            result.items.Add(m_items[index]);
+            if(m_extensions[index] < 0)
+            {
+                result.folders++;
+            }
+            else
+            {
+                result.files++;
+                result.bytes += m_sizes[index];
+            }
+        }
+    }
+    return true;
+}
+
+void CQueryEngine::RecurseAddItems(CItem *item, int depth)
+{
+    switch (item->GetType())
+    {
+    case IT_FILE:
+    case IT_DIRECTORY:
+    case IT_DRIVE:
+        {
+            const bool isFile = (item->GetType() == IT_FILE);
+            const DWORD attributes = item->GetAttributes();
+
+            const INT_PTR index = m_items.Add(item);
+            m_sizes.Add(item->GetSize());
+            m_lastChanges.Add(FileTimeToKey(item->GetLastChange()));
+            m_attributes.Add(attributes != INVALID_FILE_ATTRIBUTES ? attributes : 0);
+            m_depths.Add(depth);
+            m_extensions.Add(isFile ? GetExtensionId(item->GetExtension()) : -1);
+            m_subtreeEnds.Add(index + 1);
+            if(!isFile)
+            {
+                m_folderIndexes.SetAt(item, index);
+            }
+
+            for(int i = 0; i < item->GetChildrenCount(); i++)
+            {
+                RecurseAddItems(item->GetChild(i), depth + 1);
+            }
+            m_subtreeEnds[index] = m_items.GetSize();
+        }
+        break;
+
+    case IT_MYCOMPUTER:
+    case IT_FILESFOLDER:
+        {
+            // Pseudo folders don't count as a level.
+            for(int i = 0; i < item->GetChildrenCount(); i++)
+            {
+                RecurseAddItems(item->GetChild(i), depth);
+            }
+        }
+        break;
+    }
+}
+
+int CQueryEngine::GetExtensionId(const CString& extension)
+{
+    int id;
+    if(!m_extensionIds.Lookup(extension, id))
+    {
+        id = int(m_extensionNames.Add(extension));
+        m_extensionIds.SetAt(extension, id);
+    }
+    return id;
+}
+
+bool CQueryEngine::GetRange(const ITEMQUERY& query, INT_PTR& begin, INT_PTR& end) const
+{
+    begin = 0;
+    end = m_items.GetSize();
+    if(query.folder.IsEmpty())
+    {
+        return true;
+    }
+
+    // As CDirstatDoc::RefreshMountPointItems() does
+    CString path = query.folder;
+    path.MakeLower();
+    if(path.GetLength() > 3)
+    {
+        path.TrimRight(wds::chrBackslash);
+    }
+
+    const CItem *folder = m_root->FindDirectoryByPath(path);
+    if(folder == NULL)
+    {
+        return false;
+    }
+
+    INT_PTR i;
+    if(m_folderIndexes.Lookup(folder, i))
+    {
+        begin = i;
+        end = m_subtreeEnds[i];
+        return true;
+    }
+
+    // Our root is My Computer.
+    ASSERT(folder == m_root);
+    return true;
+}
+
+// Each condition is one pass over a block of a column, which ANDs into mask.
+// Conditions, which hold anyway, are skipped.
+void CQueryEngine::FilterPart(const ITEMQUERY& query, int extensionId, PART& part) const
+{
+    CArray<BYTE, BYTE> maskArray;
+    maskArray.SetSize(BLOCKSIZE);
+    BYTE *mask = maskArray.GetData();
+
+    const BYTE wantFiles = query.files ? 1 : 0;
+    const BYTE wantFolders = query.folders ? 1 : 0;
+    const ULONGLONG minSize = query.minSize;
+    const ULONGLONG maxSize = query.maxSize;
+    const ULONGLONG minLastChange = query.minLastChange;
+    const ULONGLONG maxLastChange = query.maxLastChange;
+    const DWORD attributesSet = query.attributesSet;
+    const DWORD attributesClear = query.attributesClear;
+    const int minDepth = query.minDepth;
+    const int maxDepth = query.maxDepth;
+
+    for(INT_PTR blockBegin = part.begin; blockBegin < part.end; blockBegin += BLOCKSIZE)
+    {
+        const int n = int(min(BLOCKSIZE, part.end - blockBegin));
+
+        const ULONGLONG *sizes = m_sizes.GetData() + blockBegin;
+        const ULONGLONG *lastChanges = m_lastChanges.GetData() + blockBegin;
+        const DWORD *attributes = m_attributes.GetData() + blockBegin;
+        const int *depths = m_depths.GetData() + blockBegin;
+        const int *extensions = m_extensions.GetData() + blockBegin;
+
+        for(int i = 0; i < n; i++)
+        {
+            mask[i] = (extensions[i] < 0) ? wantFolders : wantFiles;
+        }
+        if(minSize > 0)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(sizes[i] >= minSize);
+            }
+        }
+        if(maxSize < _UI64_MAX)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(sizes[i] <= maxSize);
+            }
+        }
+        if(minLastChange > 0)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(lastChanges[i] >= minLastChange);
+            }
+        }
+        if(maxLastChange < _UI64_MAX)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(lastChanges[i] <= maxLastChange);
+            }
+        }
+        if(attributesSet != 0)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE((attributes[i] & attributesSet) == attributesSet);
+            }
+        }
+        if(attributesClear != 0)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE((attributes[i] & attributesClear) == 0);
+            }
+        }
+        if(minDepth > 0)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(depths[i] >= minDepth);
+            }
+        }
+        if(maxDepth < INT_MAX)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(depths[i] <= maxDepth);
+            }
+        }
+        if(extensionId >= 0)
+        {
+            for(int i = 0; i < n; i++)
+            {
+                mask[i] &= BYTE(extensions[i] == extensionId);
+            }
+        }
+
+        for(int i = 0; i < n; i++)
+        {
+            if(mask[i] == 0)
+            {
+                continue;
+            }
+            if(!query.nameGlob.IsEmpty() && !::PathMatchSpec(m_items[blockBegin + i]->GetName(), query.nameGlob))
+            {
+                continue;
+            }
+            part.matches.Add(blockBegin + i);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int RunHeadlessQuery(LPCTSTR spec, LPCTSTR outputPath)
+{
+    ITEMQUERY query;
+    if(!query.Parse(spec) || query.folder.IsEmpty())
+    {
+        VTRACE(_T("Invalid query \"%s\""), spec);
+        return 1;
+    }
+
+    CDirstatDoc *doc = GetDocument();
+    if(!doc->ScanToEnd(query.folder))
+    {
+        return 1;
+    }
+
+    QUERYRESULT result;
+    if(!doc->GetQueryEngine()->Run(query, result))
+    {
+        VTRACE(_T("\"%s\" is not in the tree"), query.folder.GetString());
+        return 1;
+    }
+
+    try
+    {
+        CStringA report = CStringA(CW2A(result.FormatReport(), CP_UTF8));
+        CFile file(outputPath, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite);
+        file.Write(report.GetString(), report.GetLength());
+    }
+    catch (CException *pe)
+    {
+        pe->Delete();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+// QueryEngine.h - Declaration of CQueryEngine
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_QUERYENGINE_H__
+#define __WDS_QUERYENGINE_H__
+#pragma once
+
+class CItem;
+
+//
+// ITEMQUERY. The conditions of a CQueryEngine query. All of them must hold.
+//
+struct ITEMQUERY
+{
+    CString folder;             // Only this folder and its subtree. Empty: the whole tree.
+    CString nameGlob;           // PathMatchSpec() pattern like "*.log". Empty: any name.
+    CString extension;          // Like CItem::GetExtension(): ".log". Empty: any. Files only.
+    ULONGLONG minSize;
+    ULONGLONG maxSize;
+    ULONGLONG minLastChange;    // FILETIMEs as 64 bit numbers
+    ULONGLONG maxLastChange;
+    DWORD attributesSet;        // All of these must be set
+    DWORD attributesClear;      // None of these may be set
+    int minDepth;               // The scanned folders (drives) have depth 0
+    int maxDepth;
+    bool files;
+    bool folders;
+
+    ITEMQUERY();
+
+    // spec is a ';'-separated list, e.g.
+    // "under=D:\srv;name=*.log;minsize=1G;olderthan=90;attr=-h;type=files"
+    // Sizes may have a K, M, G or T suffix, olderthan and newerthan are days.
+    bool Parse(LPCTSTR spec);
+};
+
+//
+// QUERYRESULT. The matching items in tree order plus their totals.
+//
+struct QUERYRESULT
+{
+    CArray<CItem *, CItem *> items;
+    ULONGLONG files;
+    ULONGLONG folders;
+    ULONGLONG bytes;            // Of the matching files. Folders would count twice.
+
+    QUERYRESULT();
+    CString FormatReport() const;
+};
+
+//
+// CQueryEngine. Evaluates ITEMQUERYs over a column-oriented snapshot of
+// the files and folders of a finished tree. The columns are in pre-order,
+// so a subtree is an index range.
+// A query filters the columns one condition at a time into a byte mask,
+// with branch-free loops over contiguous arrays, which the compiler
+// vectorizes. Only the survivors are matched against the name pattern.
+// Large ranges are split into parts, which are filtered in parallel.
+// The snapshot holds item pointers, so the owner must delete it before
+// it deletes or refreshes any item.
+//
+class CQueryEngine
+{
+    friend class CQueryPartThread;
+
+    // The share of one thread
+    struct PART
+    {
+        INT_PTR begin;
+        INT_PTR end;
+        CArray<INT_PTR, INT_PTR> matches;
+    };
+
+public:
+    CQueryEngine(CItem *root);
+
+    INT_PTR GetItemCount() const;
+    bool Run(const ITEMQUERY& query, QUERYRESULT& result) const;   // false, if query.folder is not in the tree
+
+protected:
+    void RecurseAddItems(CItem *item, int depth);
+    int GetExtensionId(const CString& extension);
+    bool GetRange(const ITEMQUERY& query, INT_PTR& begin, INT_PTR& end) const;
+    void FilterPart(const ITEMQUERY& query, int extensionId, PART& part) const;
+
+    static const INT_PTR BLOCKSIZE = 16 * 1024;        // Items per mask
+    static const INT_PTR MIN_PARTSIZE = 256 * 1024;    // Smaller ranges are not worth a thread
+    static const int MAX_PARTS = 16;
+
+    CItem *m_root;
+
+    // The columns
+    CArray<CItem *, CItem *> m_items;
+    CArray<ULONGLONG, ULONGLONG> m_sizes;
+    CArray<ULONGLONG, ULONGLONG> m_lastChanges;
+    CArray<DWORD, DWORD> m_attributes;
+    CArray<int, int> m_depths;
+    CArray<int, int> m_extensions;          // Index into m_extensionNames, -1 for folders
+    CArray<INT_PTR, INT_PTR> m_subtreeEnds; // Index behind the subtree
+    CMap<const CItem *, const CItem *, INT_PTR, INT_PTR> m_folderIndexes; // Folders and drives -> index
+
+    CStringArray m_extensionNames;
+    CMap<CString, LPCTSTR, int, int> m_extensionIds;
+};
+
+// For scripts: scans query.folder, runs the query and writes
+// the result to outputPath. Returns the process exit code.
+int RunHeadlessQuery(LPCTSTR spec, LPCTSTR outputPath);
+
+#endif // __WDS_QUERYENGINE_H__
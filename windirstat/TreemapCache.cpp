@@ -0,0 +1,252 @@
+// TreemapCache.cpp - Implementation of CTreemapCache
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "selectobject.h"
+#include "MemoryAccounting.h"
+#include "TreemapCache.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    LONGLONG GetBitmapBytes(CBitmap& bitmap)
+    {
+        BITMAP bm;
+        if(bitmap.m_hObject == NULL || bitmap.GetBitmap(&bm) == 0)
+        {
+            return 0;
+        }
+        return LONGLONG(bm.bmWidthBytes) * bm.bmHeight;
+    }
+
+    // FNV-1a
+    void HashBytes(ULONGLONG& h, const void *data, size_t size)
+    {
+        const BYTE *p = (const BYTE *)data;
+        for(size_t i = 0; i < size; i++)
+        {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    }
+}
+
+CTreemapCache::CTreemapCache()
+    : m_useCount(0)
+    , m_bytes(0)
+{
+}
+
+CTreemapCache::~CTreemapCache()
+{
+    RemoveAll();
+}
+
+// Field by field, as the padding of Options is undefined
+ULONGLONG CTreemapCache::HashOptions(const CTreemap::Options& options)
+{
+    ULONGLONG h = 14695981039346656037ULL;
+    HashBytes(h, &options.style, sizeof(options.style));
+    HashBytes(h, &options.grid, sizeof(options.grid));
+    HashBytes(h, &options.gridColor, sizeof(options.gridColor));
+    HashBytes(h, &options.brightness, sizeof(options.brightness));
+    HashBytes(h, &options.height, sizeof(options.height));
+    HashBytes(h, &options.scaleFactor, sizeof(options.scaleFactor));
+    HashBytes(h, &options.ambientLight, sizeof(options.ambientLight));
+    HashBytes(h, &options.lightSourceX, sizeof(options.lightSourceX));
+    HashBytes(h, &options.lightSourceY, sizeof(options.lightSourceY));
+    return h;
+}
+
+void CTreemapCache::Store(CDC *pdc, CBitmap& bitmap, CSize size, CItem *zoom, ULONGLONG optionsHash, UINT colorSerial, CTreemap& treemap)
+{
+    RemoveStale(colorSerial);
+
+    const INT_PTR old = Find(zoom, size, optionsHash, colorSerial);
+    if(old >= 0)
+    {
+        Remove(old);
+    }
+
+    ENTRY *entry = new ENTRY;
+    entry->zoom = zoom;
+    entry->size = size;
+    entry->optionsHash = optionsHash;
+    entry->colorSerial = colorSerial;
+    entry->lastUse = ++m_useCount;
+
+    VERIFY(entry->bitmap.CreateCompatibleBitmap(pdc, size.cx, size.cy));
+    {
+        CDC dcfrom;
+        dcfrom.CreateCompatibleDC(pdc);
+        CSelectObject sofrom(&dcfrom, &bitmap);
+
+        CDC dcto;
+        dcto.CreateCompatibleDC(pdc);
+        CSelectObject soto(&dcto, &entry->bitmap);
+
+        dcto.BitBlt(0, 0, size.cx, size.cy, &dcfrom, 0, 0, SRCCOPY);
+    }
+
+    const CTreemap::Options options = treemap.GetOptions();
+    RecurseCollect(entry, zoom, options.grid ? 1 : 0);
+    treemap.SaveDrawingState(entry->state);
+
+    entry->bytes = GetBitmapBytes(entry->bitmap)
+        + LONGLONG(entry->items.GetSize()) * LONGLONG(sizeof(CItem *) + sizeof(CRect))
+        + LONGLONG(entry->state.hitPixels.GetSize()) * LONGLONG(sizeof(UINT))
+        + LONGLONG(entry->state.hitItems.GetSize()) * LONGLONG(sizeof(CTreemap::Item *));
+    CMemoryAccounting::Add(MEM_TREEMAP, entry->bytes, 5);
+    m_bytes += entry->bytes;
+
+    m_entries.Add(entry);
+    Trim();
+}
+
+bool CTreemapCache::Restore(CBitmap& bitmap, CSize size, CItem *zoom, ULONGLONG optionsHash, UINT colorSerial, CTreemap& treemap)
+{
+    ASSERT(bitmap.m_hObject == NULL);
+
+    RemoveStale(colorSerial);
+
+    const INT_PTR i = Find(zoom, size, optionsHash, colorSerial);
+    if(i < 0)
+    {
+        return false;
+    }
+
+    ENTRY *entry = m_entries[i];
+    for(INT_PTR j = 0; j < entry->items.GetSize(); j++)
+    {
+        entry->items[j]->TmiSetRectangle(entry->rects[j]);
+    }
+    treemap.RestoreDrawingState(entry->state);
+
+    bitmap.Attach(entry->bitmap.Detach());
+    Remove(i);
+
+    return true;
+}
+
+void CTreemapCache::InvalidateItem(const CItem *item)
+{
+    for(INT_PTR i = m_entries.GetSize() - 1; i >= 0; i--)
+    {
+        CItem *zoom = m_entries[i]->zoom;
+        if(zoom->IsAncestorOf(item) || item->IsAncestorOf(zoom))
+        {
+            Remove(i);
+        }
+    }
+}
+
+void CTreemapCache::RemoveAll()
+{
+    for(INT_PTR i = m_entries.GetSize() - 1; i >= 0; i--)
+    {
+        Remove(i);
+    }
+}
+
+// As RecurseDrawGraph(): the children of the items, which have been
+// subdivided, have got a rectangle.
+void CTreemapCache::RecurseCollect(ENTRY *entry, CItem *item, int gridWidth)
+{
+    const CRect rc = item->TmiGetRectangle();
+    entry->items.Add(item);
+    entry->rects.Add(rc);
+
+    if(item->TmiIsLeaf() || rc.Width() <= gridWidth || rc.Height() <= gridWidth)
+    {
+        return;
+    }
+
+    for(int i = 0; i < item->GetChildrenCount(); i++)
+    {
+        CItem *child = item->GetChild(i);
+        if(child->TmiGetSize() == 0)
+        {
+            break;
+        }
+        RecurseCollect(entry, child, gridWidth);
+    }
+}
+
+INT_PTR CTreemapCache::Find(CItem *zoom, CSize size, ULONGLONG optionsHash, UINT colorSerial) const
+{
+    for(INT_PTR i = 0; i < m_entries.GetSize(); i++)
+    {
+        const ENTRY *entry = m_entries[i];
+        if(entry->zoom == zoom
+            && entry->size == size
+            && entry->optionsHash == optionsHash
+            && entry->colorSerial == colorSerial)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void CTreemapCache::Remove(INT_PTR i)
+{
+    ENTRY *entry = m_entries[i];
+    CMemoryAccounting::Add(MEM_TREEMAP, -entry->bytes, -5);
+    m_bytes -= entry->bytes;
+
+    m_entries.RemoveAt(i);
+    delete entry;
+}
+
+// The colors never come back.
+void CTreemapCache::RemoveStale(UINT colorSerial)
+{
+    for(INT_PTR i = m_entries.GetSize() - 1; i >= 0; i--)
+    {
+        if(m_entries[i]->colorSerial != colorSerial)
+        {
+            Remove(i);
+        }
+    }
+}
+
+// Drops the least recently stored entries
+void CTreemapCache::Trim()
+{
+    while(m_entries.GetSize() > 0 && (m_bytes > MAX_BYTES || m_entries.GetSize() > MAX_ENTRIES))
+    {
+        INT_PTR oldest = 0;
+        for(INT_PTR i = 1; i < m_entries.GetSize(); i++)
+        {
+            if(m_entries[i]->lastUse < m_entries[oldest]->lastUse)
+            {
+                oldest = i;
+            }
+        }
+        Remove(oldest);
+    }
+}
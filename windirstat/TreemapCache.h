@@ -0,0 +1,88 @@
+// TreemapCache.h - Declaration of CTreemapCache
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_TREEMAPCACHE_H__
+#define __WDS_TREEMAPCACHE_H__
+#pragma once
+
+#include "treemap.h"
+
+class CItem;
+
+//
+// CTreemapCache. The treemaps, which the graph view has shown before,
+// keyed by zoom item, view size, options and extension colors. Each
+// entry keeps the bitmap, the rectangles of the items below the zoom
+// item and the hit index, so that going back to a zoom level is a blit.
+// The least recently stored entries are dropped beyond MAX_BYTES.
+// The owner must call InvalidateItem(), before an item or its subtree
+// changes, and RemoveAll() for a new tree.
+//
+class CTreemapCache
+{
+    struct ENTRY
+    {
+        CItem *zoom;
+        CSize size;
+        ULONGLONG optionsHash;
+        UINT colorSerial;
+        CBitmap bitmap;
+        CArray<CItem *, CItem *> items;         // The zoom item and the items below,
+        CArray<CRect, const CRect&> rects;      // which the drawing has laid out
+        CTreemap::DRAWINGSTATE state;
+        ULONGLONG lastUse;
+        LONGLONG bytes;                         // Booked in CMemoryAccounting
+    };
+
+public:
+    CTreemapCache();
+    ~CTreemapCache();
+
+    static ULONGLONG HashOptions(const CTreemap::Options& options);
+
+    // Keeps a copy of bitmap, which shows zoom, as drawn by treemap
+    void Store(CDC *pdc, CBitmap& bitmap, CSize size, CItem *zoom, ULONGLONG optionsHash, UINT colorSerial, CTreemap& treemap);
+
+    // Moves the cached bitmap into bitmap, which must be empty, and makes
+    // it the last drawing of treemap. Returns false, if there is none.
+    bool Restore(CBitmap& bitmap, CSize size, CItem *zoom, ULONGLONG optionsHash, UINT colorSerial, CTreemap& treemap);
+
+    // Drops the entries, which show item or a part of it
+    void InvalidateItem(const CItem *item);
+    void RemoveAll();
+
+protected:
+    void RecurseCollect(ENTRY *entry, CItem *item, int gridWidth);
+    INT_PTR Find(CItem *zoom, CSize size, ULONGLONG optionsHash, UINT colorSerial) const;
+    void Remove(INT_PTR i);
+    void RemoveStale(UINT colorSerial);
+    void Trim();
+
+    static const LONGLONG MAX_BYTES = 128 * 1024 * 1024;
+    static const int MAX_ENTRIES = 16;
+
+    CArray<ENTRY *, ENTRY *> m_entries;
+    ULONGLONG m_useCount;
+    LONGLONG m_bytes;
+};
+
+#endif // __WDS_TREEMAPCACHE_H__
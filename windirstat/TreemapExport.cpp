@@ -0,0 +1,339 @@
+// TreemapExport.cpp - Implementation of CTreemapImageFile
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "dirstatdoc.h"
+#include "item.h"
+#include "TreemapExport.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    const int STRIP_ROWS = 128;     // Of RunHeadlessExport(). 16 MB per strip at 32768 columns.
+
+    const BYTE PNG_SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+}
+
+CTreemapImageFile::CTreemapImageFile()
+    : m_format(FORMAT_PNG)
+    , m_open(false)
+    , m_failed(false)
+    , m_size(0, 0)
+    , m_rowsWritten(0)
+    , m_adler(1)
+{
+}
+
+CTreemapImageFile::~CTreemapImageFile()
+{
+    if(m_open)
+    {
+        m_file.Abort();
+    }
+}
+
+CTreemapImageFile::FORMAT CTreemapImageFile::GetFormatByPath(LPCTSTR path)
+{
+    return (CString(::PathFindExtension(path)).CompareNoCase(_T(".ppm")) == 0) ? FORMAT_PPM : FORMAT_PNG;
+}
+
+bool CTreemapImageFile::Open(LPCTSTR path, CSize size, FORMAT format)
+{
+    ASSERT(!m_open);
+    ASSERT(size.cx > 0 && size.cx <= MAX_SIZE);
+    ASSERT(size.cy > 0 && size.cy <= MAX_SIZE);
+
+    m_format = format;
+    m_size = size;
+    m_rowsWritten = 0;
+    m_adler = 1;
+    m_failed = false;
+
+    if(!m_file.Open(path, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite))
+    {
+        VTRACE(_T("Cannot create \"%s\""), path);
+        return false;
+    }
+    m_open = true;
+
+    if(m_format == FORMAT_PPM)
+    {
+        CStringA header;
+        header.Format("P6\n%d %d\n255\n", size.cx, size.cy);
+        return Write(header.GetString(), header.GetLength());
+    }
+
+    BYTE header[13];
+    PutBigEndian(header, size.cx);
+    PutBigEndian(header + 4, size.cy);
+    header[8] = 8;      // Bits per sample
+    header[9] = 2;      // RGB
+    header[10] = 0;     // Deflate
+    header[11] = 0;     // Adaptive filtering
+    header[12] = 0;     // Not interlaced
+
+    // The IDAT chunks form one zlib stream. This is its header
+    // (deflate, 32K window, no dictionary).
+    const BYTE zlibHeader[] = { 0x78, 0x01 };
+
+    Write(PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+    WritePngChunk("IHDR", header, sizeof(header));
+    return WritePngChunk("IDAT", zlibHeader, sizeof(zlibHeader));
+}
+
+bool CTreemapImageFile::Close()
+{
+    if(!m_open)
+    {
+        return false;
+    }
+
+    if(m_rowsWritten != m_size.cy)
+    {
+        m_failed = true;
+    }
+
+    if(m_format == FORMAT_PNG && !m_failed)
+    {
+        // An empty final block and the checksum end the zlib stream.
+        BYTE trailer[9] = { 0x01, 0x00, 0x00, 0xFF, 0xFF };
+        PutBigEndian(trailer + 5, m_adler);
+
+        WritePngChunk("IDAT", trailer, sizeof(trailer));
+        WritePngChunk("IEND", NULL, 0);
+    }
+
+    try
+    {
+        m_file.Close();
+    }
+    catch (CException *pe)
+    {
+        pe->Delete();
+        m_failed = true;
+    }
+    m_open = false;
+
+    return !m_failed;
+}
+
+bool CTreemapImageFile::TreemapStrip(const COLORREF *bits, int width, int rows)
+{
+    ASSERT(m_open);
+    ASSERT(width == m_size.cx);
+    ASSERT(m_rowsWritten + rows <= m_size.cy);
+
+    EncodeRows(bits, width, rows);
+    m_rowsWritten += rows;
+
+    if(m_format == FORMAT_PPM)
+    {
+        return Write(m_rows.GetData(), (UINT)m_rows.GetSize());
+    }
+
+    // The scanlines continue the zlib stream, in stored blocks.
+    m_adler = UpdateAdler(m_adler, m_rows.GetData(), (UINT)m_rows.GetSize());
+
+    const INT_PTR blocks = (m_rows.GetSize() + STORED_BLOCK_BYTES - 1) / STORED_BLOCK_BYTES;
+    m_chunk.SetSize(m_rows.GetSize() + 5 * blocks);
+
+    BYTE *out = m_chunk.GetData();
+    for(INT_PTR offset = 0; offset < m_rows.GetSize(); offset += STORED_BLOCK_BYTES)
+    {
+        const UINT length = (UINT)min(INT_PTR(STORED_BLOCK_BYTES), m_rows.GetSize() - offset);
+
+        *out++ = 0x00;                  // Not the final block, stored
+        *out++ = BYTE(length);
+        *out++ = BYTE(length >> 8);
+        *out++ = BYTE(~length);
+        *out++ = BYTE(~length >> 8);
+
+        memcpy(out, m_rows.GetData() + offset, length);
+        out += length;
+    }
+    ASSERT(out == m_chunk.GetData() + m_chunk.GetSize());
+
+    return WritePngChunk("IDAT", m_chunk.GetData(), (UINT)m_chunk.GetSize());
+}
+
+// Converts 0x00RRGGBB pixels into RGB triples. PNG scanlines are
+// preceded by their filter type (0, none).
+//
+void CTreemapImageFile::EncodeRows(const COLORREF *bits, int width, int rows)
+{
+    const int filterBytes = (m_format == FORMAT_PNG ? 1 : 0);
+    const INT_PTR rowBytes = filterBytes + 3 * INT_PTR(width);
+
+    m_rows.SetSize(rowBytes * rows);
+
+    BYTE *out = m_rows.GetData();
+    for(int y = 0; y < rows; y++)
+    {
+        if(filterBytes > 0)
+        {
+            *out++ = 0;
+        }
+
+        const COLORREF *row = bits + INT_PTR(y) * width;
+        for(int x = 0; x < width; x++)
+        {
+            *out++ = BYTE(row[x] >> 16);
+            *out++ = BYTE(row[x] >> 8);
+            *out++ = BYTE(row[x]);
+        }
+    }
+}
+
+bool CTreemapImageFile::Write(const void *data, UINT length)
+{
+    if(m_failed)
+    {
+        return false;
+    }
+
+    try
+    {
+        m_file.Write(data, length);
+    }
+    catch (CException *pe)
+    {
+        pe->Delete();
+        m_failed = true;
+    }
+    return !m_failed;
+}
+
+bool CTreemapImageFile::WritePngChunk(const char *type, const BYTE *data, UINT length)
+{
+    BYTE header[8];
+    PutBigEndian(header, length);
+    memcpy(header + 4, type, 4);
+
+    // Over type and data
+    DWORD crc = UpdateCrc(0xFFFFFFFF, header + 4, 4);
+    crc = UpdateCrc(crc, data, length);
+
+    BYTE trailer[4];
+    PutBigEndian(trailer, ~crc);
+
+    Write(header, sizeof(header));
+    if(length > 0)
+    {
+        Write(data, length);
+    }
+    return Write(trailer, sizeof(trailer));
+}
+
+DWORD CTreemapImageFile::UpdateCrc(DWORD crc, const BYTE *data, UINT length)
+{
+    // CRC-32 as in ISO 3309, table driven
+    static DWORD table[256];
+    static bool tableDone = false;
+
+    if(!tableDone)
+    {
+        for(DWORD n = 0; n < 256; n++)
+        {
+            DWORD c = n;
+            for(int k = 0; k < 8; k++)
+            {
+                c = (c & 1) != 0 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        tableDone = true;
+    }
+
+    for(UINT i = 0; i < length; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+DWORD CTreemapImageFile::UpdateAdler(DWORD adler, const BYTE *data, UINT length)
+{
+    const DWORD base = 65521;   // Largest prime below 65536
+    const UINT nmax = 5552;     // Bytes, after which b could overflow
+
+    DWORD a = adler & 0xFFFF;
+    DWORD b = adler >> 16;
+
+    while(length > 0)
+    {
+        const UINT n = min(length, nmax);
+        for(UINT i = 0; i < n; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= base;
+        b %= base;
+
+        data += n;
+        length -= n;
+    }
+    return (b << 16) | a;
+}
+
+void CTreemapImageFile::PutBigEndian(BYTE *p, DWORD value)
+{
+    p[0] = BYTE(value >> 24);
+    p[1] = BYTE(value >> 16);
+    p[2] = BYTE(value >> 8);
+    p[3] = BYTE(value);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int RunHeadlessExport(LPCTSTR folder, LPCTSTR outputPath, CSize size)
+{
+    if(size.cx <= 1 || size.cy <= 1 || size.cx > CTreemapImageFile::MAX_SIZE || size.cy > CTreemapImageFile::MAX_SIZE)
+    {
+        VTRACE(_T("Invalid image size %dx%d"), size.cx, size.cy);
+        return 1;
+    }
+
+    CDirstatDoc *doc = GetDocument();
+    if(!doc->ScanToEnd(folder))
+    {
+        return 1;
+    }
+
+    CTreemapImageFile file;
+    if(!file.Open(outputPath, size, CTreemapImageFile::GetFormatByPath(outputPath)))
+    {
+        return 1;
+    }
+
+    CTreemap treemap;
+    const bool complete = treemap.DrawTreemapStrips(&file, size, doc->GetRootItem(), STRIP_ROWS, GetOptions()->GetTreemapOptions());
+
+    if(!file.Close() || !complete)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+// TreemapExport.h - Declaration of CTreemapImageFile
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_TREEMAPEXPORT_H__
+#define __WDS_TREEMAPEXPORT_H__
+#pragma once
+
+#include "treemap.h"
+
+//
+// CTreemapImageFile. Writes the strips of CTreemap::DrawTreemapStrips()
+// to an image file as they come, so that images up to MAX_SIZE x MAX_SIZE
+// pixels need no more memory than a strip.
+// PNG files are not compressed (deflate "stored" blocks), as there is no
+// zlib in the project. PPM is the binary P6 format.
+//
+class CTreemapImageFile: public CTreemap::StripSink
+{
+public:
+    enum FORMAT
+    {
+        FORMAT_PNG,
+        FORMAT_PPM
+    };
+
+    static const int MAX_SIZE = 32768;
+
+    CTreemapImageFile();
+    virtual ~CTreemapImageFile();
+
+    // ".ppm" selects FORMAT_PPM, everything else FORMAT_PNG.
+    static FORMAT GetFormatByPath(LPCTSTR path);
+
+    bool Open(LPCTSTR path, CSize size, FORMAT format);
+    bool Close(); // Writes the trailer. Returns false, if anything has failed.
+
+    // CTreemap::StripSink
+    virtual bool TreemapStrip(const COLORREF *bits, int width, int rows);
+
+protected:
+    static const int STORED_BLOCK_BYTES = 65535;    // Maximum of a deflate stored block
+
+    bool Write(const void *data, UINT length);
+    bool WritePngChunk(const char *type, const BYTE *data, UINT length);
+    void EncodeRows(const COLORREF *bits, int width, int rows);
+
+    static DWORD UpdateCrc(DWORD crc, const BYTE *data, UINT length);
+    static DWORD UpdateAdler(DWORD adler, const BYTE *data, UINT length);
+    static void PutBigEndian(BYTE *p, DWORD value);
+
+    FORMAT m_format;
+    CFile m_file;
+    bool m_open;
+    bool m_failed;
+    CSize m_size;
+    int m_rowsWritten;
+    DWORD m_adler;                      // Of the PNG scanlines so far
+    CArray<BYTE, BYTE> m_rows;          // One strip, as scanlines
+    CArray<BYTE, BYTE> m_chunk;         // The IDAT chunk of a strip
+};
+
+// For scripts: scans folder and writes its treemap with the current
+// options to outputPath. Returns the process exit code.
+int RunHeadlessExport(LPCTSTR folder, LPCTSTR outputPath, CSize size);
+
+#endif // __WDS_TREEMAPEXPORT_H__
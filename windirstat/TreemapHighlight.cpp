@@ -0,0 +1,169 @@
+// TreemapHighlight.cpp - Implementation of CTreemapHighlight
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#include "stdafx.h"
+#include "windirstat.h"
+#include "item.h"
+#include "MemoryAccounting.h"
+#include "TreemapHighlight.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+CTreemapHighlight::CTreemapHighlight()
+    : m_valid(false)
+{
+}
+
+CTreemapHighlight::~CTreemapHighlight()
+{
+    Reset();
+}
+
+void CTreemapHighlight::Build(const CItem *root, Classifier *classifier)
+{
+    CWaitCursor wc;
+
+    Reset();
+
+    RecurseCollect(root, classifier);
+
+    // Counting sort by group
+    int groupCount = 0;
+    for(INT_PTR i = 0; i < m_leafGroups.GetSize(); i++)
+    {
+        groupCount = max(groupCount, m_leafGroups[i] + 1);
+    }
+
+    m_groupStarts.SetSize(groupCount + 1);
+    for(int g = 0; g <= groupCount; g++)
+    {
+        m_groupStarts[g] = 0;
+    }
+    for(INT_PTR i = 0; i < m_leafGroups.GetSize(); i++)
+    {
+        m_groupStarts[m_leafGroups[i] + 1]++;
+    }
+    for(int g = 0; g < groupCount; g++)
+    {
+        m_groupStarts[g + 1] += m_groupStarts[g];
+    }
+
+    CArray<INT_PTR, INT_PTR> next;
+    next.SetSize(groupCount);
+    for(int g = 0; g < groupCount; g++)
+    {
+        next[g] = m_groupStarts[g];
+    }
+
+    m_rects.SetSize(m_leafRects.GetSize());
+    for(INT_PTR i = 0; i < m_leafRects.GetSize(); i++)
+    {
+        m_rects[next[m_leafGroups[i]]++] = m_leafRects[i];
+    }
+
+    m_leafRects.RemoveAll();
+    m_leafGroups.RemoveAll();
+
+    Account(+1);
+    m_valid = true;
+}
+
+void CTreemapHighlight::Reset()
+{
+    if(m_valid)
+    {
+        Account(-1);
+    }
+
+    m_valid = false;
+    m_rects.RemoveAll();
+    m_groupStarts.RemoveAll();
+}
+
+bool CTreemapHighlight::IsValid() const
+{
+    return m_valid;
+}
+
+void CTreemapHighlight::GetGroup(int group, INT_PTR& begin, INT_PTR& end) const
+{
+    ASSERT(m_valid);
+
+    if(group < 0 || group + 1 >= m_groupStarts.GetSize())
+    {
+        begin = end = 0;
+        return;
+    }
+
+    begin = m_groupStarts[group];
+    end = m_groupStarts[group + 1];
+}
+
+const CRect& CTreemapHighlight::GetRect(INT_PTR i) const
+{
+    return m_rects[i];
+}
+
+// The visible leaves. As the children are sorted by size, the first one
+// without a rectangle ends the visible ones.
+void CTreemapHighlight::RecurseCollect(const CItem *item, Classifier *classifier)
+{
+    const CRect rc(item->TmiGetRectangle());
+    if(rc.Width() <= 0 || rc.Height() <= 0)
+    {
+        return;
+    }
+
+    if(item->TmiIsLeaf())
+    {
+        const int group = classifier->Classify(item);
+        if(group >= 0)
+        {
+            m_leafRects.Add(rc);
+            m_leafGroups.Add(group);
+        }
+    }
+    else
+    {
+        for(int i = 0; i < item->TmiGetChildrenCount(); i++)
+        {
+            const CItem *child = item->GetChild(i);
+            if(child->TmiGetSize() == 0)
+            {
+                break;
+            }
+            if(child->TmiGetRectangle().left == -1)
+            {
+                break;
+            }
+            RecurseCollect(child, classifier);
+        }
+    }
+}
+
+void CTreemapHighlight::Account(LONGLONG sign)
+{
+    const LONGLONG bytes = LONGLONG(m_rects.GetSize()) * LONGLONG(sizeof(CRect)) + LONGLONG(m_groupStarts.GetSize()) * LONGLONG(sizeof(INT_PTR));
+    CMemoryAccounting::Add(MEM_TREEMAP, sign * bytes, sign * 2);
+}
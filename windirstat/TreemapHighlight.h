@@ -0,0 +1,72 @@
+// TreemapHighlight.h - Declaration of CTreemapHighlight
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+
+#ifndef __WDS_TREEMAPHIGHLIGHT_H__
+#define __WDS_TREEMAPHIGHLIGHT_H__
+#pragma once
+
+class CItem;
+
+//
+// CTreemapHighlight. The rectangles of the treemap leaves, collected
+// once from the current layout (the rectangles of the items) and packed
+// by group. A classifier assigns the groups, e.g. one per extension, so
+// that another extension is only another index range.
+// The graph view renders them into an overlay bitmap, so that repaints
+// need not walk the tree. The owner must rebuild it, whenever the
+// treemap has been redrawn.
+//
+class CTreemapHighlight
+{
+public:
+    class Classifier
+    {
+    public:
+        // 0, 1, ..., or -1, if item is never highlighted
+        virtual int Classify(const CItem *item) =0;
+    };
+
+    CTreemapHighlight();
+    ~CTreemapHighlight();
+
+    void Build(const CItem *root, Classifier *classifier);
+    void Reset();
+    bool IsValid() const;
+
+    // The rectangles of group are begin .. end - 1
+    void GetGroup(int group, INT_PTR& begin, INT_PTR& end) const;
+    const CRect& GetRect(INT_PTR i) const;
+
+protected:
+    void RecurseCollect(const CItem *item, Classifier *classifier);
+    void Account(LONGLONG sign);
+
+    bool m_valid;
+    CArray<CRect, const CRect&> m_rects;        // Sorted by group
+    CArray<INT_PTR, INT_PTR> m_groupStarts;     // Into m_rects, per group, plus the end
+
+    // Collected in tree order by RecurseCollect()
+    CArray<CRect, const CRect&> m_leafRects;
+    CArray<int, int> m_leafGroups;
+};
+
+#endif // __WDS_TREEMAPHIGHLIGHT_H__
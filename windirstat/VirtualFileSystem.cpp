@@ -0,0 +1,822 @@
+// VirtualFileSystem.cpp - Implementation of CVirtualFileSystem and its backends
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include "stdafx.h"
+#include "VirtualFileSystem.h"
+#include "globalhelpers.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+namespace
+{
+    // 2019-01-01 00:00 UTC. Synthetic timestamps lie within five years before.
+    const ULONGLONG SYNTHETIC_TIME_BASE = 131907744000000000ULL;
+    const ULONGLONG SYNTHETIC_TIME_SPAN = 5ULL * 365 * 24 * 60 * 60 * 10000000;
+
+    const LPCTSTR _syntheticExtensions[] = {
+        _T(".txt"), _T(".dll"), _T(".jpg"), _T(".cpp"), _T(".h"), _T(".log"),
+        _T(".png"), _T(".exe"), _T(".pdf"), _T(".zip"), _T(".mp4"), _T(".iso")
+    };
+
+    // SplitMix64. Small, fast and good enough to shape a directory tree.
+    ULONGLONG NextRandom(ULONGLONG& state)
+    {
+        ULONGLONG z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Inclusive range
+    ULONGLONG RandomRange(ULONGLONG& state, ULONGLONG lo, ULONGLONG hi)
+    {
+        ASSERT(lo <= hi);
+        return lo + NextRandom(state) % (hi - lo + 1);
+    }
+
+    // [0, 1)
+    double RandomUnit(ULONGLONG& state)
+    {
+        return (NextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // FNV-1a over the lower-cased path, as paths are case insensitive.
+    ULONGLONG HashPath(ULONGLONG seed, LPCTSTR path)
+    {
+        ULONGLONG h = 14695981039346656037ULL ^ seed;
+        for(; *path != 0; path++)
+        {
+            h ^= (ULONGLONG)_totlower(*path);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // The base-36 index after the '_' makes the name unique within its directory.
+    CString MakeSyntheticName(ULONGLONG& rnd, int index, int minLength, int maxLength)
+    {
+        static const TCHAR digits[] = _T("0123456789abcdefghijklmnopqrstuvwxyz");
+
+        CString unique;
+        for(int n = index; ; n /= 36)
+        {
+            unique.Insert(0, digits[n % 36]);
+            if(n < 36)
+            {
+                break;
+            }
+        }
+        unique.Insert(0, _T('_'));
+
+        const int length = (int)RandomRange(rnd, minLength, maxLength);
+        const int randomLength = max(0, length - unique.GetLength());
+
+        CString name;
+        LPTSTR p = name.GetBuffer(randomLength);
+        for(int i = 0; i < length; i++)
+        {
+            // Always draw length characters, so that the sequence does not depend on index.
+            TCHAR c = (TCHAR)(_T('a') + RandomRange(rnd, 0, 25));
+            if(i < randomLength)
+            {
+                p[i] = c;
+            }
+        }
+        name.ReleaseBuffer(randomLength);
+
+        return name + unique;
+    }
+
+    // Log-uniform: there are as many files of 1-10 KB as of 1-10 MB.
+    ULONGLONG MakeSyntheticSize(ULONGLONG& rnd, ULONGLONG minSize, ULONGLONG maxSize)
+    {
+        const double lo = log((double)minSize + 1);
+        const double hi = log((double)maxSize + 1);
+        ULONGLONG size = (ULONGLONG)exp(lo + RandomUnit(rnd) * (hi - lo)) - 1;
+        return min(max(size, minSize), maxSize);
+    }
+
+    FILETIME MakeSyntheticTime(ULONGLONG& rnd)
+    {
+        ULARGE_INTEGER t;
+        t.QuadPart = SYNTHETIC_TIME_BASE - RandomRange(rnd, 0, SYNTHETIC_TIME_SPAN / 10000000) * 10000000;
+
+        FILETIME ft;
+        ft.dwLowDateTime = t.LowPart;
+        ft.dwHighDateTime = t.HighPart;
+        return ft;
+    }
+
+    typedef CMap<CString, LPCTSTR, ULONGLONG, ULONGLONG> CSpecValues;
+
+    // "key=value,key=value"
+    void ParseSpecValues(const CString& args, CSpecValues& values)
+    {
+        int pos = 0;
+        for(CString pair = args.Tokenize(wds::strComma, pos); !pair.IsEmpty(); pair = args.Tokenize(wds::strComma, pos))
+        {
+            int eq = pair.Find(_T('='));
+            if(eq < 0)
+            {
+                VTRACE(_T("Ignoring \"%s\" in file system spec"), pair.GetString());
+                continue;
+            }
+            CString key = pair.Left(eq);
+            key.Trim();
+            key.MakeLower();
+            values.SetAt(key, _tcstoui64(pair.Mid(eq + 1), NULL, 0));
+        }
+    }
+
+    template<class T> void GetSpecValue(const CSpecValues& values, LPCTSTR key, T& value)
+    {
+        ULONGLONG v;
+        if(values.Lookup(key, v))
+        {
+            value = (T)v;
+        }
+    }
+
+    CNativeFileSystem _nativeFileSystem;
+    CAutoPtr<CVirtualFileSystem> _virtualFileSystem;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CVirtualFileSystem *GetVirtualFileSystem()
+{
+    if(_virtualFileSystem != NULL)
+    {
+        return _virtualFileSystem;
+    }
+    return &_nativeFileSystem;
+}
+
+void SetVirtualFileSystem(CVirtualFileSystem *fs)
+{
+    _virtualFileSystem.Free();
+    if(fs != NULL)
+    {
+        _virtualFileSystem.Attach(fs);
+    }
+    VTRACE(_T("Virtual file system: %s"), GetVirtualFileSystem()->GetName().GetString());
+}
+
+CVirtualFileSystem *CVirtualFileSystem::CreateFromSpec(LPCTSTR spec)
+{
+    CAutoPtr<CVirtualFileSystem> fs;
+
+    CString s(spec);
+    int pos = 0;
+    for(CString stage = s.Tokenize(_T(";"), pos); !stage.IsEmpty(); stage = s.Tokenize(_T(";"), pos))
+    {
+        CString kind = stage;
+        CString args;
+        int colon = stage.Find(wds::chrColon);
+        if(colon >= 0)
+        {
+            kind = stage.Left(colon);
+            args = stage.Mid(colon + 1);
+        }
+        kind.Trim();
+
+        CSpecValues values;
+        ParseSpecValues(args, values);
+
+        if(kind.CompareNoCase(_T("native")) == 0)
+        {
+            fs.Free();
+            fs.Attach(new CNativeFileSystem());
+        }
+        else if(kind.CompareNoCase(_T("synthetic")) == 0)
+        {
+            SYNTHETICTREESHAPE shape;
+            GetSpecValue(values, _T("seed"), shape.seed);
+            GetSpecValue(values, _T("fanout"), shape.fanOut);
+            GetSpecValue(values, _T("depth"), shape.depth);
+            GetSpecValue(values, _T("files"), shape.filesPerDirectory);
+            GetSpecValue(values, _T("minsize"), shape.minFileSize);
+            GetSpecValue(values, _T("maxsize"), shape.maxFileSize);
+            GetSpecValue(values, _T("minname"), shape.minNameLength);
+            GetSpecValue(values, _T("maxname"), shape.maxNameLength);
+            GetSpecValue(values, _T("hardlinks"), shape.hardLinkPermille);
+
+            fs.Free();
+            fs.Attach(new CSyntheticFileSystem(shape));
+        }
+        else if(kind.CompareNoCase(_T("faults")) == 0)
+        {
+            FAULTINJECTIONPARAMS params;
+            GetSpecValue(values, _T("seed"), params.seed);
+            GetSpecValue(values, _T("open"), params.openLatency);
+            GetSpecValue(values, _T("batch"), params.batchLatency);
+            GetSpecValue(values, _T("jitter"), params.latencyJitter);
+            GetSpecValue(values, _T("batchsize"), params.batchSize);
+            GetSpecValue(values, _T("errors"), params.errorPermille);
+            GetSpecValue(values, _T("truncate"), params.truncatePermille);
+
+            CVirtualFileSystem *inner = (fs != NULL) ? fs.Detach() : new CNativeFileSystem();
+            fs.Attach(new CFaultInjectionFileSystem(inner, params));
+        }
+        else
+        {
+            VTRACE(_T("Unknown file system \"%s\""), kind.GetString());
+            return NULL;
+        }
+    }
+
+    return fs.Detach();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CVirtualFileFind::CVirtualFileFind()
+{
+    m_finder.Attach(GetVirtualFileSystem()->CreateFinder());
+}
+
+BOOL CVirtualFileFind::FindFile(LPCTSTR pattern)
+{
+    return m_finder->FindFile(pattern);
+}
+
+BOOL CVirtualFileFind::FindNextFile()
+{
+    return m_finder->FindNextFile();
+}
+
+void CVirtualFileFind::Close()
+{
+    m_finder->Close();
+}
+
+BOOL CVirtualFileFind::IsDots() const
+{
+    return m_finder->IsDots();
+}
+
+BOOL CVirtualFileFind::IsDirectory() const
+{
+    return m_finder->IsDirectory();
+}
+
+BOOL CVirtualFileFind::IsHidden() const
+{
+    return m_finder->IsHidden();
+}
+
+CString CVirtualFileFind::GetFileName() const
+{
+    return m_finder->GetFileName();
+}
+
+CString CVirtualFileFind::GetFilePath() const
+{
+    return m_finder->GetFilePath();
+}
+
+DWORD CVirtualFileFind::GetAttributes() const
+{
+    return m_finder->GetAttributes();
+}
+
+ULONGLONG CVirtualFileFind::GetCompressedLength() const
+{
+    return m_finder->GetCompressedLength();
+}
+
+BOOL CVirtualFileFind::GetLastWriteTime(FILETIME *pTimeStamp) const
+{
+    return m_finder->GetLastWriteTime(pTimeStamp);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    class CNativeFileFinder: public CVirtualFileFinder
+    {
+    public:
+        virtual BOOL FindFile(LPCTSTR pattern)          { return m_finder.FindFile(pattern); }
+        virtual BOOL FindNextFile()                     { return m_finder.FindNextFile(); }
+        virtual void Close()                            { m_finder.Close(); }
+
+        virtual BOOL IsDots() const                     { return m_finder.IsDots(); }
+        virtual BOOL IsDirectory() const                { return m_finder.IsDirectory(); }
+        virtual BOOL IsHidden() const                   { return m_finder.IsHidden(); }
+        virtual CString GetFileName() const             { return m_finder.GetFileName(); }
+        virtual CString GetFilePath() const             { return m_finder.GetFilePath(); }
+        virtual DWORD GetAttributes() const             { return m_finder.GetAttributes(); }
+        virtual ULONGLONG GetCompressedLength() const   { return m_finder.GetCompressedLength(); }
+        virtual BOOL GetLastWriteTime(FILETIME *pTimeStamp) const { return m_finder.GetLastWriteTime(pTimeStamp); }
+
+    protected:
+        CFileFindWDS m_finder;
+    };
+}
+
+CString CNativeFileSystem::GetName() const
+{
+    return _T("native");
+}
+
+CVirtualFileFinder *CNativeFileSystem::CreateFinder()
+{
+    return new CNativeFileFinder();
+}
+
+bool CNativeFileSystem::FileExists(LPCTSTR path)
+{
+    return (FALSE != ::PathFileExists(path));
+}
+
+bool CNativeFileSystem::FolderExists(LPCTSTR path)
+{
+    return ::FolderExists(path);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+SYNTHETICTREESHAPE::SYNTHETICTREESHAPE()
+    : seed(0)
+    , fanOut(8)
+    , depth(4)
+    , filesPerDirectory(16)
+    , minFileSize(0)
+    , maxFileSize(64 * 1024 * 1024)
+    , minNameLength(4)
+    , maxNameLength(16)
+    , hardLinkPermille(0)
+{
+}
+
+namespace
+{
+    class CSyntheticFileFinder: public CVirtualFileFinder
+    {
+    public:
+        CSyntheticFileFinder(const CSyntheticFileSystem *fs)
+            : m_fs(fs)
+            , m_current(-1)
+        {
+        }
+
+        virtual BOOL FindFile(LPCTSTR pattern)
+        {
+            Close();
+
+            CString path = CSyntheticFileSystem::NormalizePath(pattern);
+            int i = path.ReverseFind(wds::chrBackslash);
+            if(i < 0)
+            {
+                ::SetLastError(ERROR_PATH_NOT_FOUND);
+                return FALSE;
+            }
+            m_folder = path.Left(i + 1);
+            CString spec = path.Mid(i + 1);
+
+            m_fs->ListDirectory(m_folder, m_entries);
+
+            if(spec != wds::strStar && spec != _T("*.*"))
+            {
+                const bool wildcard = (spec.FindOneOf(_T("*?")) >= 0);
+                for(INT_PTR j = m_entries.GetSize() - 1; j >= 0; j--)
+                {
+                    const bool match = wildcard
+                        ? (FALSE != ::PathMatchSpec(m_entries[j].name, spec))
+                        : (m_entries[j].name.CompareNoCase(spec) == 0);
+                    if(!match)
+                    {
+                        m_entries.RemoveAt(j);
+                    }
+                }
+            }
+
+            if(m_entries.GetSize() == 0)
+            {
+                ::SetLastError(ERROR_FILE_NOT_FOUND);
+                return FALSE;
+            }
+            return TRUE;
+        }
+
+        virtual BOOL FindNextFile()
+        {
+            ASSERT(m_current + 1 < m_entries.GetSize());
+            m_current++;
+            return (m_current + 1 < m_entries.GetSize());
+        }
+
+        virtual void Close()
+        {
+            m_entries.RemoveAll();
+            m_current = -1;
+        }
+
+        virtual BOOL IsDots() const                     { return FALSE; }
+        virtual BOOL IsDirectory() const                { return (Current().attributes & FILE_ATTRIBUTE_DIRECTORY) != 0; }
+        virtual BOOL IsHidden() const                   { return (Current().attributes & FILE_ATTRIBUTE_HIDDEN) != 0; }
+        virtual CString GetFileName() const             { return Current().name; }
+        virtual CString GetFilePath() const             { return m_folder + Current().name; }
+        virtual DWORD GetAttributes() const             { return Current().attributes; }
+        virtual ULONGLONG GetCompressedLength() const   { return Current().size; }
+
+        virtual BOOL GetLastWriteTime(FILETIME *pTimeStamp) const
+        {
+            *pTimeStamp = Current().lastWriteTime;
+            return TRUE;
+        }
+
+    protected:
+        const CSyntheticFileSystem::ENTRY& Current() const
+        {
+            ASSERT(m_current >= 0 && m_current < m_entries.GetSize());
+            return m_entries[m_current];
+        }
+
+        const CSyntheticFileSystem *m_fs;
+        CString m_folder;                           // With trailing backslash
+        CSyntheticFileSystem::CEntryArray m_entries;
+        INT_PTR m_current;
+    };
+}
+
+CSyntheticFileSystem::CSyntheticFileSystem(const SYNTHETICTREESHAPE& shape)
+    : m_shape(shape)
+    , m_rootLevel(0)
+{
+    if(!m_shape.root.IsEmpty())
+    {
+        m_shape.root = NormalizePath(m_shape.root, &m_rootLevel);
+    }
+    m_shape.fanOut = max(0, m_shape.fanOut);
+    m_shape.depth = max(0, m_shape.depth);
+    m_shape.filesPerDirectory = max(0, m_shape.filesPerDirectory);
+    m_shape.maxFileSize = max(m_shape.minFileSize, m_shape.maxFileSize);
+    m_shape.minNameLength = max(1, m_shape.minNameLength);
+    m_shape.maxNameLength = max(m_shape.minNameLength, m_shape.maxNameLength);
+    m_shape.hardLinkPermille = min(max(0, m_shape.hardLinkPermille), 1000);
+
+    VTRACE(_T("Synthetic file system: %I64u entries per drive"), GetEntryCount());
+}
+
+CString CSyntheticFileSystem::GetName() const
+{
+    CString s;
+    s.Format(_T("synthetic:seed=%I64u,fanout=%d,depth=%d,files=%d,minsize=%I64u,maxsize=%I64u,minname=%d,maxname=%d,hardlinks=%d"),
+        m_shape.seed, m_shape.fanOut, m_shape.depth, m_shape.filesPerDirectory, m_shape.minFileSize, m_shape.maxFileSize,
+        m_shape.minNameLength, m_shape.maxNameLength, m_shape.hardLinkPermille
+    );
+    return s;
+}
+
+CVirtualFileFinder *CSyntheticFileSystem::CreateFinder()
+{
+    return new CSyntheticFileFinder(this);
+}
+
+bool CSyntheticFileSystem::FileExists(LPCTSTR path)
+{
+    ENTRY entry;
+    return Lookup(path, entry) && (entry.attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+}
+
+bool CSyntheticFileSystem::FolderExists(LPCTSTR path)
+{
+    ENTRY entry;
+    if(Lookup(path, entry))
+    {
+        return (entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+    // The folder the user selected is not part of any synthetic listing.
+    return ::FolderExists(path);
+}
+
+void CSyntheticFileSystem::ListDirectory(LPCTSTR folder, CEntryArray& entries) const
+{
+    int level = 0;
+    CString path = NormalizePath(folder, &level);
+    level = GetLevel(path, level);
+
+    ULONGLONG rnd = HashPath(m_shape.seed, path);
+
+    const int dirs = (level < m_shape.depth) ? m_shape.fanOut : 0;
+    const int count = dirs + m_shape.filesPerDirectory;
+
+    entries.SetSize(count);
+    for(int i = 0; i < count; i++)
+    {
+        ENTRY& entry = entries[i];
+
+        entry.name = MakeSyntheticName(rnd, i, m_shape.minNameLength, m_shape.maxNameLength);
+        entry.lastWriteTime = MakeSyntheticTime(rnd);
+
+        if(i < dirs)
+        {
+            entry.attributes = FILE_ATTRIBUTE_DIRECTORY;
+            entry.size = 0;
+        }
+        else if(i > dirs && (int)RandomRange(rnd, 0, 999) < m_shape.hardLinkPermille)
+        {
+            // A second name of an earlier file (which is counted twice, as by the real scanner).
+            const ENTRY& original = entries[(int)RandomRange(rnd, dirs, i - 1)];
+            entry.name += ::PathFindExtension(original.name);
+            entry.attributes = original.attributes;
+            entry.size = original.size;
+            entry.lastWriteTime = original.lastWriteTime;
+        }
+        else
+        {
+            const double u = RandomUnit(rnd);
+            entry.name += _syntheticExtensions[(int)(u * u * _countof(_syntheticExtensions))];
+            entry.attributes = FILE_ATTRIBUTE_ARCHIVE;
+            if(RandomRange(rnd, 0, 99) == 0)
+            {
+                entry.attributes |= FILE_ATTRIBUTE_HIDDEN;
+            }
+            entry.size = MakeSyntheticSize(rnd, m_shape.minFileSize, m_shape.maxFileSize);
+        }
+    }
+}
+
+bool CSyntheticFileSystem::Lookup(LPCTSTR path, ENTRY& entry) const
+{
+    int level = 0;
+    CString s = NormalizePath(path, &level);
+    if(level == 0)
+    {
+        return false;
+    }
+
+    int i = s.ReverseFind(wds::chrBackslash);
+    CString name = s.Mid(i + 1);
+
+    CEntryArray entries;
+    ListDirectory(s.Left(i + 1), entries);
+    for(INT_PTR j = 0; j < entries.GetSize(); j++)
+    {
+        if(entries[j].name.CompareNoCase(name) == 0)
+        {
+            entry = entries[j];
+            return true;
+        }
+    }
+    return false;
+}
+
+ULONGLONG CSyntheticFileSystem::GetEntryCount() const
+{
+    ULONGLONG dirs = 1; // the root
+    ULONGLONG levelDirs = 1;
+    for(int level = 1; level <= m_shape.depth; level++)
+    {
+        levelDirs *= m_shape.fanOut;
+        dirs += levelDirs;
+    }
+    return (dirs - 1) + dirs * m_shape.filesPerDirectory;
+}
+
+// driveLevel is the level of normalizedPath below its drive root
+int CSyntheticFileSystem::GetLevel(const CString& normalizedPath, int driveLevel) const
+{
+    const int len = m_shape.root.GetLength();
+    if(len == 0 || normalizedPath.GetLength() < len || normalizedPath.Left(len).CompareNoCase(m_shape.root) != 0)
+    {
+        return driveLevel;
+    }
+    if(normalizedPath.GetLength() > len && normalizedPath[len] != wds::chrBackslash && m_shape.root[len - 1] != wds::chrBackslash)
+    {
+        return driveLevel; // "C:\Temp2" is not below "C:\Temp"
+    }
+    return driveLevel - m_rootLevel;
+}
+
+CString CSyntheticFileSystem::NormalizePath(LPCTSTR path, int *level)
+{
+    CString s(path);
+    s.Replace(_T('/'), wds::chrBackslash);
+
+    // Split off the root, "C:\" or "\\server\share\".
+    CString root;
+    int pos = 0;
+    if(s.Left(2) == _T("\\\\"))
+    {
+        int i = s.Find(wds::chrBackslash, 2);
+        if(i >= 0)
+        {
+            i = s.Find(wds::chrBackslash, i + 1);
+        }
+        if(i < 0)
+        {
+            i = s.GetLength();
+        }
+        root = s.Left(i) + wds::strBackslash;
+        pos = i;
+    }
+    else if(s.GetLength() >= 2 && s[1] == wds::chrColon)
+    {
+        root = s.Left(2) + wds::strBackslash;
+        pos = 2;
+    }
+
+    CStringArray parts;
+    for(CString token = s.Tokenize(wds::strBackslash, pos); !token.IsEmpty(); token = s.Tokenize(wds::strBackslash, pos))
+    {
+        if(token == _T(".."))
+        {
+            if(parts.GetSize() > 0)
+            {
+                parts.RemoveAt(parts.GetSize() - 1);
+            }
+        }
+        else if(token != wds::strDot)
+        {
+            parts.Add(token);
+        }
+    }
+
+    CString normalized = root;
+    for(INT_PTR i = 0; i < parts.GetSize(); i++)
+    {
+        if(i > 0)
+        {
+            normalized += wds::chrBackslash;
+        }
+        normalized += parts[i];
+    }
+
+    if(level != NULL)
+    {
+        *level = (int)parts.GetSize();
+    }
+    return normalized;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+FAULTINJECTIONPARAMS::FAULTINJECTIONPARAMS()
+    : seed(0)
+    , openLatency(0)
+    , batchLatency(0)
+    , latencyJitter(0)
+    , batchSize(64)
+    , errorPermille(0)
+    , truncatePermille(0)
+{
+}
+
+namespace
+{
+    class CFaultInjectionFileFinder: public CVirtualFileFinder
+    {
+    public:
+        CFaultInjectionFileFinder(const CFaultInjectionFileSystem *fs)
+            : m_fs(fs)
+            , m_dice(0)
+            , m_delivered(0)
+            , m_limit(-1)
+        {
+            m_inner.Attach(fs->GetInner()->CreateFinder());
+        }
+
+        virtual BOOL FindFile(LPCTSTR pattern)
+        {
+            const FAULTINJECTIONPARAMS& params = m_fs->GetParams();
+
+            m_dice = HashPath(params.seed, pattern);
+            m_delivered = 0;
+            m_limit = -1;
+
+            m_fs->Delay(params.openLatency, m_dice);
+
+            if((int)RandomRange(m_dice, 0, 999) < params.errorPermille)
+            {
+                m_inner->Close();
+                ::SetLastError(ERROR_UNEXP_NET_ERR);
+                return FALSE;
+            }
+            if((int)RandomRange(m_dice, 0, 999) < params.truncatePermille)
+            {
+                m_limit = (int)RandomRange(m_dice, 1, 2 * max(1, params.batchSize));
+            }
+
+            return m_inner->FindFile(pattern);
+        }
+
+        virtual BOOL FindNextFile()
+        {
+            const FAULTINJECTIONPARAMS& params = m_fs->GetParams();
+
+            if(params.batchSize > 0 && m_delivered % params.batchSize == 0)
+            {
+                m_fs->Delay(params.batchLatency, m_dice);
+            }
+            m_delivered++;
+
+            BOOL more = m_inner->FindNextFile();
+            if(more && m_limit >= 0 && m_delivered >= m_limit)
+            {
+                ::SetLastError(ERROR_UNEXP_NET_ERR);
+                more = FALSE;
+            }
+            return more;
+        }
+
+        virtual void Close()                            { m_inner->Close(); }
+
+        virtual BOOL IsDots() const                     { return m_inner->IsDots(); }
+        virtual BOOL IsDirectory() const                { return m_inner->IsDirectory(); }
+        virtual BOOL IsHidden() const                   { return m_inner->IsHidden(); }
+        virtual CString GetFileName() const             { return m_inner->GetFileName(); }
+        virtual CString GetFilePath() const             { return m_inner->GetFilePath(); }
+        virtual DWORD GetAttributes() const             { return m_inner->GetAttributes(); }
+        virtual ULONGLONG GetCompressedLength() const   { return m_inner->GetCompressedLength(); }
+        virtual BOOL GetLastWriteTime(FILETIME *pTimeStamp) const { return m_inner->GetLastWriteTime(pTimeStamp); }
+
+    protected:
+        const CFaultInjectionFileSystem *m_fs;
+        CAutoPtr<CVirtualFileFinder> m_inner;
+        ULONGLONG m_dice;
+        int m_delivered;    // Entries delivered so far
+        int m_limit;        // -1 or the number of entries after which the listing breaks off
+    };
+}
+
+CFaultInjectionFileSystem::CFaultInjectionFileSystem(CVirtualFileSystem *inner, const FAULTINJECTIONPARAMS& params)
+    : m_params(params)
+{
+    ASSERT(inner != NULL);
+    m_inner.Attach(inner);
+}
+
+CString CFaultInjectionFileSystem::GetName() const
+{
+    CString s;
+    s.Format(_T("%s;faults:seed=%I64u,open=%u,batch=%u,jitter=%u,batchsize=%d,errors=%d,truncate=%d"),
+        m_inner->GetName().GetString(), m_params.seed, m_params.openLatency, m_params.batchLatency,
+        m_params.latencyJitter, m_params.batchSize, m_params.errorPermille, m_params.truncatePermille
+    );
+    return s;
+}
+
+CVirtualFileFinder *CFaultInjectionFileSystem::CreateFinder()
+{
+    return new CFaultInjectionFileFinder(this);
+}
+
+bool CFaultInjectionFileSystem::FileExists(LPCTSTR path)
+{
+    ULONGLONG dice = HashPath(m_params.seed, path);
+    Delay(m_params.openLatency, dice);
+    return m_inner->FileExists(path);
+}
+
+bool CFaultInjectionFileSystem::FolderExists(LPCTSTR path)
+{
+    ULONGLONG dice = HashPath(m_params.seed, path);
+    Delay(m_params.openLatency, dice);
+    return m_inner->FolderExists(path);
+}
+
+CVirtualFileSystem *CFaultInjectionFileSystem::GetInner() const
+{
+    return m_inner;
+}
+
+const FAULTINJECTIONPARAMS& CFaultInjectionFileSystem::GetParams() const
+{
+    return m_params;
+}
+
+void CFaultInjectionFileSystem::Delay(DWORD latency, ULONGLONG& dice) const
+{
+    DWORD ms = latency;
+    if(m_params.latencyJitter > 0)
+    {
+        ms += (DWORD)RandomRange(dice, 0, m_params.latencyJitter);
+    }
+    if(ms > 0)
+    {
+        ::Sleep(ms);
+    }
+}
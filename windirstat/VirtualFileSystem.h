@@ -0,0 +1,220 @@
+// VirtualFileSystem.h - Declaration of CVirtualFileSystem and its backends
+//
+// WinDirStat - Directory Statistics
+// Copyright (C) 2003-2005 Bernhard Seifert
+// Copyright (C) 2004-2019 WinDirStat Team (windirstat.net)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef __WDS_VIRTUALFILESYSTEM_H__
+#define __WDS_VIRTUALFILESYSTEM_H__
+#pragma once
+
+#include "FileFindWDS.h"
+
+//
+// CVirtualFileFinder. One directory enumeration.
+// The semantics are those of CFileFind: FindFile() starts the enumeration,
+// FindNextFile() makes the next entry current and returns FALSE, if that
+// entry is the last one.
+//
+class CVirtualFileFinder
+{
+public:
+    virtual ~CVirtualFileFinder() {}
+
+    virtual BOOL FindFile(LPCTSTR pattern) =0;
+    virtual BOOL FindNextFile() =0;
+    virtual void Close() =0;
+
+    virtual BOOL IsDots() const =0;
+    virtual BOOL IsDirectory() const =0;
+    virtual BOOL IsHidden() const =0;
+    virtual CString GetFileName() const =0;
+    virtual CString GetFilePath() const =0;
+    virtual DWORD GetAttributes() const =0;
+    virtual ULONGLONG GetCompressedLength() const =0;
+    virtual BOOL GetLastWriteTime(FILETIME *pTimeStamp) const =0;
+};
+
+//
+// CVirtualFileSystem. What the scanner sees of the file system:
+// a factory for finders plus the existence checks needed by a refresh.
+// The active instance is returned by GetVirtualFileSystem(). It is the
+// native file system unless a developer selected another one with the
+// environment variable WINDIRSTAT_VFS (see CreateFromSpec()).
+//
+class CVirtualFileSystem
+{
+public:
+    virtual ~CVirtualFileSystem() {}
+
+    virtual CString GetName() const =0;
+    virtual CVirtualFileFinder *CreateFinder() =0;
+    virtual bool FileExists(LPCTSTR path) =0;
+    virtual bool FolderExists(LPCTSTR path) =0;
+
+    // spec is a ';'-separated chain, innermost first, e.g.
+    // "synthetic:seed=7,fanout=10,depth=6;faults:open=20,batch=5,errors=3"
+    static CVirtualFileSystem *CreateFromSpec(LPCTSTR spec);
+};
+
+CVirtualFileSystem *GetVirtualFileSystem();
+void SetVirtualFileSystem(CVirtualFileSystem *fs); // Takes ownership. NULL selects the native file system.
+
+//
+// CVirtualFileFind. Used by the scanner in place of CFileFindWDS.
+// Obtains its finder from the active virtual file system.
+//
+class CVirtualFileFind
+{
+public:
+    CVirtualFileFind();
+
+    BOOL FindFile(LPCTSTR pattern);
+    BOOL FindNextFile();
+    void Close();
+
+    BOOL IsDots() const;
+    BOOL IsDirectory() const;
+    BOOL IsHidden() const;
+    CString GetFileName() const;
+    CString GetFilePath() const;
+    DWORD GetAttributes() const;
+    ULONGLONG GetCompressedLength() const;
+    BOOL GetLastWriteTime(FILETIME *pTimeStamp) const;
+
+private:
+    CAutoPtr<CVirtualFileFinder> m_finder;
+};
+
+//
+// CNativeFileSystem. The real thing: CFileFindWDS and the Win32 API.
+//
+class CNativeFileSystem: public CVirtualFileSystem
+{
+public:
+    virtual CString GetName() const;
+    virtual CVirtualFileFinder *CreateFinder();
+    virtual bool FileExists(LPCTSTR path);
+    virtual bool FolderExists(LPCTSTR path);
+};
+
+//
+// Shape of a synthetic tree. Every directory on level < depth has exactly
+// fanOut subdirectories, and every directory has filesPerDirectory files.
+// Levels are counted from root, which is level 0. Without a root, they are
+// counted from the drive root, so "C:\" is level 0.
+//
+struct SYNTHETICTREESHAPE
+{
+    ULONGLONG seed;
+    int fanOut;
+    int depth;
+    int filesPerDirectory;
+    ULONGLONG minFileSize;      // File sizes are log-uniformly distributed
+    ULONGLONG maxFileSize;      // between these two.
+    int minNameLength;          // Without extension
+    int maxNameLength;
+    int hardLinkPermille;       // Files which repeat an earlier file of their directory
+    CString root;               // The folder which is scanned, e.g. "C:\Temp". May be empty.
+
+    SYNTHETICTREESHAPE();
+};
+
+//
+// CSyntheticFileSystem. Deterministic in-memory file system.
+// Nothing is stored: the listing of a directory is generated from
+// the seed and the (case insensitive) path whenever it is requested,
+// so trees of 100 million entries cost no more memory than small ones.
+//
+class CSyntheticFileSystem: public CVirtualFileSystem
+{
+public:
+    struct ENTRY
+    {
+        CString name;
+        DWORD attributes;
+        ULONGLONG size;
+        FILETIME lastWriteTime;
+    };
+    typedef CArray<ENTRY, const ENTRY&> CEntryArray;
+
+    CSyntheticFileSystem(const SYNTHETICTREESHAPE& shape);
+
+    virtual CString GetName() const;
+    virtual CVirtualFileFinder *CreateFinder();
+    virtual bool FileExists(LPCTSTR path);
+    virtual bool FolderExists(LPCTSTR path);
+
+    void ListDirectory(LPCTSTR folder, CEntryArray& entries) const;
+    bool Lookup(LPCTSTR path, ENTRY& entry) const;
+    ULONGLONG GetEntryCount() const;   // Below level 0
+
+    // Resolves "." and "..". level receives the number of components below the root.
+    static CString NormalizePath(LPCTSTR path, int *level = NULL);
+
+protected:
+    int GetLevel(const CString& normalizedPath, int driveLevel) const;
+
+    SYNTHETICTREESHAPE m_shape;
+    int m_rootLevel;            // Of m_shape.root, counted from the drive root
+};
+
+//
+// Parameters of CFaultInjectionFileSystem. Latencies are in milliseconds.
+// A directory listing is delivered in batches of batchSize entries,
+// each of which costs batchLatency (like READDIR on NFS or
+// QUERY_DIRECTORY on SMB).
+//
+struct FAULTINJECTIONPARAMS
+{
+    ULONGLONG seed;
+    DWORD openLatency;          // Per FindFile() and existence check
+    DWORD batchLatency;
+    DWORD latencyJitter;        // Added randomly to each of the above
+    int batchSize;
+    int errorPermille;          // FindFile() fails with a network error
+    int truncatePermille;       // The listing breaks off after a random entry
+
+    FAULTINJECTIONPARAMS();
+};
+
+//
+// CFaultInjectionFileSystem. Decorator, which slows down and breaks
+// an inner file system. The dice are seeded with the path, so a given
+// directory always behaves the same way and runs can be repeated.
+//
+class CFaultInjectionFileSystem: public CVirtualFileSystem
+{
+public:
+    CFaultInjectionFileSystem(CVirtualFileSystem *inner, const FAULTINJECTIONPARAMS& params); // Takes ownership of inner
+
+    virtual CString GetName() const;
+    virtual CVirtualFileFinder *CreateFinder();
+    virtual bool FileExists(LPCTSTR path);
+    virtual bool FolderExists(LPCTSTR path);
+
+    CVirtualFileSystem *GetInner() const;
+    const FAULTINJECTIONPARAMS& GetParams() const;
+    void Delay(DWORD latency, ULONGLONG& dice) const;
+
+protected:
+    CAutoPtr<CVirtualFileSystem> m_inner;
+    FAULTINJECTIONPARAMS m_params;
+};
+
+#endif // __WDS_VIRTUALFILESYSTEM_H__
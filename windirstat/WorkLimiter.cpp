@@ -27,7 +27,7 @@ bool CWorkLimiter::IsDone() const
     // check remaining ticks
     ULONGLONG now = CWorkLimiter::Now();
     // signed subtraction to deal with overflow
-    ULONGLONG remaining = m_tickLimit - now;
+    LONGLONG remaining = LONGLONG(m_tickLimit - now);
     if (remaining <= 0)
     {
         m_done = true;
@@ -25,6 +25,12 @@
 #include "mainframe.h"
 #include "osspecific.h"
 #include "globalhelpers.h"
+#include "MemoryAccounting.h"
+#include "DuplicateFinder.h"
+#include "FileIndex.h"
+#include "QueryEngine.h"
+#include "ExtensionCollector.h"
+#include "WorkLimiter.h"
 #include "deletewarningdlg.h"
 #include "modalshellapi.h"
 #include <common/mdexceptions.h>
@@ -53,6 +59,34 @@ namespace
         RGB(255, 255, 150),
         RGB(255, 255, 255)
     };
+
+    const INT_PTR _largestFilesCount = 1000;    // Report|Largest Files
+
+    // For SortExtensionData(). The comparison needs no map lookups.
+    struct SORTEDEXTENSION
+    {
+        ULONGLONG bytes;
+        CString ext;
+    };
+
+    // The cushion colors of the largest extensions. The last one is for the rest.
+    const CArray<COLORREF, COLORREF&>& GetExtensionPalette()
+    {
+        static CArray<COLORREF, COLORREF&> colors;
+
+        if(0 == colors.GetSize())
+        {
+            CTreemap::GetDefaultPalette(colors);
+        }
+        return colors;
+    }
+
+    int __cdecl CompareExtensionsByBytes(const void *p1, const void *p2)
+    {
+        const SORTEDEXTENSION *r1 = (const SORTEDEXTENSION *)p1;
+        const SORTEDEXTENSION *r2 = (const SORTEDEXTENSION *)p2;
+        return usignum(r2->bytes, r1->bytes);
+    }
 }
 
 CDirstatDoc *_theDocument;
@@ -74,6 +108,12 @@ CDirstatDoc::CDirstatDoc()
     , m_zoomItem(NULL)
     , m_workingItem(NULL)
     , m_extensionDataValid(false)
+    , m_extensionDataChanged(false)
+    , m_extensionRankingChanged(false)
+    , m_extensionDataBytes(0)
+    , m_extensionDataAllocations(0)
+    , m_extensionColorSerial(0)
+    , m_highlightDuplicates(false)
 {
     ASSERT(NULL == _theDocument);
     _theDocument = this;
@@ -86,7 +126,11 @@ CDirstatDoc::~CDirstatDoc()
     CPersistence::SetShowFreeSpace(m_showFreeSpace);
     CPersistence::SetShowUnknown(m_showUnknown);
 
+    m_duplicateFinder.Free();
+    m_fileIndex.Free(); // Otherwise every file would remove itself from it
+    m_extensionDataValid = false;
     delete m_rootItem;
+    CMemoryAccounting::Add(MEM_EXTENSIONS, -m_extensionDataBytes, -m_extensionDataAllocations);
     _theDocument = NULL;
 }
 
@@ -193,8 +237,14 @@ TCHAR CDirstatDoc::GetEncodingSeparator()
 
 void CDirstatDoc::DeleteContents()
 {
+    DiscardDuplicates();
+    DiscardQueryEngine();
+    m_fileIndex.Free();
+    m_extensionDataValid = false;
     delete m_rootItem;
     m_rootItem = NULL;
+    m_extensionIds.RemoveAll();
+    m_extensionColors.RemoveAll();
     SetWorkingItem(NULL);
     m_zoomItem = NULL;
     m_selectedItems.RemoveAll();
@@ -316,6 +366,36 @@ COLORREF CDirstatDoc::GetCushionColor(LPCTSTR ext)
     return r.color;
 }
 
+// The treemap asks for the color of every leaf it draws. So each file
+// looks its extension up only once, here, and keeps the id. The colors
+// per id are kept up to date by SetExtensionColors() and AddExtensionFile().
+// While the extension data is deferred, the id gets a provisional color
+// (by order of appearance), which RebuildExtensionData() replaces.
+int CDirstatDoc::GetExtensionId(LPCTSTR ext)
+{
+    int id;
+    if(!m_extensionIds.Lookup(ext, id))
+    {
+        const CArray<COLORREF, COLORREF&>& colors = GetExtensionPalette();
+        const COLORREF color = IsExtensionDataDeferred()
+            ? colors[m_extensionColors.GetSize() % colors.GetSize()]
+            : GetCushionColor(ext);
+        id = int(m_extensionColors.Add(color));
+        m_extensionIds.SetAt(ext, id);
+    }
+    return id;
+}
+
+COLORREF CDirstatDoc::GetExtensionColor(int extensionId)
+{
+    // Brings the colors up to date
+    if(!IsExtensionDataDeferred())
+    {
+        GetExtensionData();
+    }
+    return m_extensionColors[extensionId];
+}
+
 COLORREF CDirstatDoc::GetZoomColor()
 {
     return RGB(0,0,255);
@@ -337,9 +417,126 @@ const CExtensionData *CDirstatDoc::GetExtensionData()
     {
         RebuildExtensionData();
     }
+    else if(m_extensionDataChanged)
+    {
+        UpdateExtensionData();
+    }
     return &m_extensionData;
 }
 
+UINT CDirstatDoc::GetExtensionColorSerial()
+{
+    // Brings the colors up to date
+    if(!IsExtensionDataDeferred())
+    {
+        GetExtensionData();
+    }
+    return m_extensionColorSerial;
+}
+
+// The extension data is built, when the root is done. Building it
+// earlier (e.g. for the live treemap) would make AddExtensionFile()
+// maintain it for every file, which the scan still finds.
+bool CDirstatDoc::IsExtensionDataDeferred()
+{
+    return !m_extensionDataValid && !IsRootDone();
+}
+
+void CDirstatDoc::AddExtensionFile(const CItem *file)
+{
+    ASSERT(file->GetType() == IT_FILE);
+    if(!m_extensionDataValid)
+    {
+        return;
+    }
+
+    const CString ext = file->GetExtension();
+    SExtensionRecord r;
+    if(m_extensionData.Lookup(ext, r))
+    {
+        r.files++;
+        r.bytes += file->GetSize();
+    }
+    else
+    {
+        r.files = 1;
+        r.bytes = file->GetSize();
+        r.color = GetExtensionPalette()[GetExtensionPalette().GetSize() - 1];
+
+        // The extension may have been here before.
+        int id;
+        if(m_extensionIds.Lookup(ext, id))
+        {
+            m_extensionColors[id] = r.color;
+        }
+    }
+    m_extensionData.SetAt(ext, r);
+
+    OnExtensionChanged(ext, r.bytes);
+}
+
+// Only a change within the top extensions or a newcomer to them
+// can change the colors.
+void CDirstatDoc::OnExtensionChanged(const CString& ext, ULONGLONG bytes)
+{
+    m_extensionDataChanged = true;
+    if(m_extensionRankingChanged)
+    {
+        return;
+    }
+
+    if(m_topExtensions.GetSize() < GetExtensionPalette().GetSize())
+    {
+        m_extensionRankingChanged = true;
+        return;
+    }
+
+    for(int i = 0; i < m_topExtensions.GetSize(); i++)
+    {
+        if(m_topExtensions[i] == ext)
+        {
+            m_extensionRankingChanged = true;
+            return;
+        }
+    }
+
+    // Unchanged, as it is in the top.
+    SExtensionRecord last;
+    VERIFY(m_extensionData.Lookup(m_topExtensions[m_topExtensions.GetSize() - 1], last));
+    if(bytes >= last.bytes)
+    {
+        m_extensionRankingChanged = true;
+    }
+}
+
+void CDirstatDoc::RemoveExtensionFile(const CItem *file)
+{
+    ASSERT(file->GetType() == IT_FILE);
+    if(!m_extensionDataValid)
+    {
+        return;
+    }
+
+    const CString ext = file->GetExtension();
+    SExtensionRecord r;
+    VERIFY(m_extensionData.Lookup(ext, r));
+    ASSERT(r.files > 0);
+    ASSERT(r.bytes >= file->GetSize());
+
+    r.files--;
+    r.bytes -= file->GetSize();
+    if(r.files == 0)
+    {
+        m_extensionData.RemoveKey(ext);
+    }
+    else
+    {
+        m_extensionData.SetAt(ext, r);
+    }
+
+    OnExtensionChanged(ext, r.bytes);
+}
+
 ULONGLONG CDirstatDoc::GetRootSize()
 {
     ASSERT(m_rootItem != NULL);
@@ -379,7 +576,10 @@ bool CDirstatDoc::Work(CWorkLimiter* limiter)
         m_rootItem->DoSomeWork(limiter);
         if(m_rootItem->IsDone())
         {
-            m_extensionDataValid = false;
+            if(m_fileIndex == NULL)
+            {
+                BuildFileIndex();
+            }
 
             GetMainFrame()->SetProgressPos100();
             GetMainFrame()->RestoreTypeView();
@@ -401,6 +601,10 @@ bool CDirstatDoc::Work(CWorkLimiter* limiter)
     }
     if(m_rootItem->IsDone())
     {
+        if(m_duplicateFinder != NULL && !m_duplicateFinder->IsDone())
+        {
+            return WorkOnDuplicates();
+        }
         SetWorkingItem(NULL);
         return true;
     }
@@ -410,6 +614,87 @@ bool CDirstatDoc::Work(CWorkLimiter* limiter)
     }
 }
 
+// Opens folder and works as CDirstatApp::OnIdle() does, until the
+// scan is complete. For headless runs, whose main window stays hidden.
+//
+bool CDirstatDoc::ScanToEnd(LPCTSTR folder)
+{
+    if(!OnOpenDocument(folder))
+    {
+        return false;
+    }
+    SetPathName(folder, false);
+
+    while(!IsRootDone())
+    {
+        CWorkLimiter limiter;
+        limiter.Start(600);
+        if(Work(&limiter) && !IsRootDone())
+        {
+            return false;
+        }
+
+        MSG msg;
+        while(::PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE))
+        {
+            if(!AfxPumpMessage())
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Returns true, when the duplicate finder has finished.
+//
+bool CDirstatDoc::WorkOnDuplicates()
+{
+    if(!m_duplicateFinder->Work())
+    {
+        GetMainFrame()->SetProgressPos(m_duplicateFinder->GetProgressPos());
+        return false;
+    }
+
+    GetMainFrame()->SetProgressPos100();
+    GetMainFrame()->HideProgress();
+
+    m_highlightDuplicates = true;
+    UpdateAllViews(NULL, HINT_SELECTIONSTYLECHANGED);
+
+    ReportDuplicates();
+    return true;
+}
+
+void CDirstatDoc::ReportDuplicates()
+{
+    if(m_duplicateFinder->GetSetCount() == 0)
+    {
+        AfxMessageBox(IDS_NODUPLICATESFOUND, MB_ICONINFORMATION);
+        return;
+    }
+
+    CString msg;
+    msg.FormatMessage(IDS_DUPLICATESFOUNDsss
+        , FormatCount(m_duplicateFinder->GetRedundantCount()).GetString()
+        , FormatCount(m_duplicateFinder->GetSetCount()).GetString()
+        , FormatBytes(m_duplicateFinder->GetWastedBytes()).GetString()
+        );
+
+    if(IDYES == AfxMessageBox(msg, MB_YESNO | MB_ICONINFORMATION))
+    {
+        GetMainFrame()->CopyToClipboard(m_duplicateFinder->FormatReport());
+    }
+}
+
+void CDirstatDoc::BuildFileIndex()
+{
+    CWaitCursor wc;
+
+    m_fileIndex.Attach(new CFileIndex);
+    m_fileIndex->Build(m_rootItem);
+}
+
 bool CDirstatDoc::IsDrive(CString spec)
 {
     return (3 == spec.GetLength() && wds::chrColon == spec[1] && wds::chrBackslash == spec[2]);
@@ -562,6 +847,61 @@ void CDirstatDoc::UnlinkRoot()
     UpdateAllViews(NULL, HINT_NEWROOT);
 }
 
+// The duplicate finder holds item pointers. Called before items are deleted.
+//
+void CDirstatDoc::DiscardDuplicates()
+{
+    if(m_duplicateFinder == NULL)
+    {
+        return;
+    }
+
+    if(!m_duplicateFinder->IsDone() && GetMainFrame() != NULL)
+    {
+        GetMainFrame()->HideProgress();
+    }
+
+    m_duplicateFinder.Free();
+    m_highlightDuplicates = false;
+}
+
+const CDuplicateFinder *CDirstatDoc::GetDuplicates()
+{
+    if(m_duplicateFinder == NULL || !m_duplicateFinder->IsDone())
+    {
+        return NULL;
+    }
+    return m_duplicateFinder;
+}
+
+bool CDirstatDoc::IsHighlightingDuplicates()
+{
+    return m_highlightDuplicates && GetDuplicates() != NULL;
+}
+
+CFileIndex *CDirstatDoc::GetFileIndex()
+{
+    return m_fileIndex;
+}
+
+// The query engine holds item pointers and copies of their data.
+// Called before items are deleted or refreshed.
+//
+void CDirstatDoc::DiscardQueryEngine()
+{
+    m_queryEngine.Free();
+}
+
+const CQueryEngine *CDirstatDoc::GetQueryEngine()
+{
+    if(m_queryEngine == NULL && m_rootItem != NULL && m_rootItem->IsDone())
+    {
+        CWaitCursor wc;
+        m_queryEngine.Attach(new CQueryEngine(m_rootItem));
+    }
+    return m_queryEngine;
+}
+
 // Determines, whether an UDC works for a given item.
 //
 bool CDirstatDoc::UserDefinedCleanupWorksForItem(const USERDEFINEDCLEANUP *udc, const CItem *item)
@@ -751,22 +1091,58 @@ void CDirstatDoc::RebuildExtensionData()
     CWaitCursor wc;
 
     m_extensionData.RemoveAll();
-    // 2048 is a rough estimate for amount of different extensions
-    m_extensionData.InitHashTable(2048);
-    m_rootItem->RecurseCollectExtensionData(&m_extensionData);
+    CollectExtensionData(m_rootItem, m_extensionData);
+    AccountExtensionData();
 
     CStringArray sortedExtensions;
     SortExtensionData(sortedExtensions);
     SetExtensionColors(sortedExtensions);
 
     m_extensionDataValid = true;
+    m_extensionDataChanged = false;
+    m_extensionRankingChanged = false;
 }
 
-void CDirstatDoc::SortExtensionData(CStringArray& sortedExtensions)
+// Applies what AddExtensionFile() and RemoveExtensionFile() have changed.
+// The colors are only reassigned, if the order of the top extensions
+// has actually changed.
+void CDirstatDoc::UpdateExtensionData()
 {
-    sortedExtensions.SetSize(m_extensionData.GetCount());
+    AccountExtensionData();
+
+    if(m_extensionRankingChanged)
+    {
+        CStringArray sortedExtensions;
+        SortExtensionData(sortedExtensions);
+
+        const INT_PTR topCount = min(sortedExtensions.GetSize(), GetExtensionPalette().GetSize());
+        bool changed = (topCount != m_topExtensions.GetSize());
+        for(INT_PTR i = 0; !changed && i < topCount; i++)
+        {
+            changed = (sortedExtensions[i] != m_topExtensions[i]);
+        }
+
+        if(changed)
+        {
+            SetExtensionColors(sortedExtensions);
+        }
+    }
+
+    m_extensionDataChanged = false;
+    m_extensionRankingChanged = false;
+}
+
+// CMap doesn't tell its memory usage, so we estimate it: the hash table,
+// one association (allocated in blocks) per extension and the key strings.
+void CDirstatDoc::AccountExtensionData()
+{
+    const LONGLONG assocBytes = sizeof(void *) + sizeof(UINT) + sizeof(CString) + sizeof(SExtensionRecord);
+    const INT_PTR blockSize = 10; // CMap default
+
+    LONGLONG bytes = LONGLONG(m_extensionData.GetHashTableSize()) * LONGLONG(sizeof(void *));
+    bytes += LONGLONG(m_extensionData.GetCount()) * assocBytes;
+    LONGLONG allocations = 1 + (m_extensionData.GetCount() + blockSize - 1) / blockSize;
 
-    int i = 0;
     POSITION pos = m_extensionData.GetStartPosition();
     while(pos != NULL)
     {
@@ -774,45 +1150,68 @@ void CDirstatDoc::SortExtensionData(CStringArray& sortedExtensions)
         SExtensionRecord r;
         m_extensionData.GetNextAssoc(pos, ext, r);
 
-        sortedExtensions[i++]= ext;
+        const LONGLONG keyBytes = CMemoryAccounting::GetStringBytes(ext);
+        bytes += keyBytes;
+        allocations += keyBytes > 0 ? 1 : 0;
     }
 
-    _pqsortExtensionData = &m_extensionData;
-    qsort(sortedExtensions.GetData(), sortedExtensions.GetSize(), sizeof(CString), &_compareExtensions);
-    _pqsortExtensionData = NULL;
+    // The extension ids. Their keys share the buffers of the extension caches of the items.
+    const LONGLONG idAssocBytes = sizeof(void *) + sizeof(UINT) + sizeof(CString) + sizeof(int);
+    bytes += LONGLONG(m_extensionIds.GetCount()) * idAssocBytes;
+    bytes += LONGLONG(m_extensionColors.GetSize()) * LONGLONG(sizeof(COLORREF));
+    allocations += (m_extensionIds.GetCount() + blockSize - 1) / blockSize;
+
+    CMemoryAccounting::Add(MEM_EXTENSIONS, bytes - m_extensionDataBytes, allocations - m_extensionDataAllocations);
+    m_extensionDataBytes = bytes;
+    m_extensionDataAllocations = allocations;
 }
 
-void CDirstatDoc::SetExtensionColors(const CStringArray& sortedExtensions)
+void CDirstatDoc::SortExtensionData(CStringArray& sortedExtensions)
 {
-    static CArray<COLORREF, COLORREF&> colors;
+    CArray<SORTEDEXTENSION, const SORTEDEXTENSION&> records;
+    records.SetSize(m_extensionData.GetCount());
 
-    if(0 == colors.GetSize())
+    int i = 0;
+    POSITION pos = m_extensionData.GetStartPosition();
+    while(pos != NULL)
+    {
+        SExtensionRecord r;
+        m_extensionData.GetNextAssoc(pos, records[i].ext, r);
+        records[i++].bytes = r.bytes;
+    }
+
+    qsort(records.GetData(), records.GetSize(), sizeof(SORTEDEXTENSION), &CompareExtensionsByBytes);
+
+    sortedExtensions.SetSize(records.GetSize());
+    for(i = 0; i < records.GetSize(); i++)
     {
-        CTreemap::GetDefaultPalette(colors);
+        sortedExtensions[i] = records[i].ext;
     }
+}
 
+void CDirstatDoc::SetExtensionColors(const CStringArray& sortedExtensions)
+{
+    const CArray<COLORREF, COLORREF&>& colors = GetExtensionPalette();
+
+    m_topExtensions.RemoveAll();
     for(int i = 0; i < sortedExtensions.GetSize(); i++)
     {
         COLORREF c = colors[colors.GetSize() - 1];
         if(i < colors.GetSize())
         {
             c = colors[i];
+            m_topExtensions.Add(sortedExtensions[i]);
         }
         m_extensionData[sortedExtensions[i]].color = c;
-    }
-}
 
-CExtensionData *CDirstatDoc::_pqsortExtensionData;
+        int id;
+        if(m_extensionIds.Lookup(sortedExtensions[i], id))
+        {
+            m_extensionColors[id] = c;
+        }
+    }
 
-int __cdecl CDirstatDoc::_compareExtensions(const void *item1, const void *item2)
-{
-    CString *ext1 = (CString *)item1;
-    CString *ext2 = (CString *)item2;
-    SExtensionRecord r1;
-    SExtensionRecord r2;
-    VERIFY(_pqsortExtensionData->Lookup(*ext1, r1));
-    VERIFY(_pqsortExtensionData->Lookup(*ext2, r2));
-    return usignum(r2.bytes, r1.bytes);
+    m_extensionColorSerial++;
 }
 
 void CDirstatDoc::SetWorkingItemAncestor(CItem *item)
@@ -902,6 +1301,8 @@ void CDirstatDoc::RefreshItem(CItem *item)
 
     CItem *parent = item->GetParent();
 
+    UpdateAllViews(NULL, HINT_REFRESHITEM, reinterpret_cast<CObject *>(item));
+
     if(!item->StartRefresh())
     {
         if(GetZoomItem() == item)
@@ -1167,6 +1568,12 @@ BEGIN_MESSAGE_MAP(CDirstatDoc, CDocument)
     ON_COMMAND(ID_CLEANUP_OPEN, OnCleanupOpen)
     ON_UPDATE_COMMAND_UI(ID_CLEANUP_PROPERTIES, OnUpdateCleanupProperties)
     ON_COMMAND(ID_CLEANUP_PROPERTIES, OnCleanupProperties)
+    ON_UPDATE_COMMAND_UI(ID_REPORT_FINDDUPLICATES, OnUpdateReportFindduplicates)
+    ON_COMMAND(ID_REPORT_FINDDUPLICATES, OnReportFindduplicates)
+    ON_UPDATE_COMMAND_UI(ID_REPORT_HIGHLIGHTDUPLICATES, OnUpdateReportHighlightduplicates)
+    ON_COMMAND(ID_REPORT_HIGHLIGHTDUPLICATES, OnReportHighlightduplicates)
+    ON_UPDATE_COMMAND_UI(ID_REPORT_LARGESTFILES, OnUpdateReportLargestfiles)
+    ON_COMMAND(ID_REPORT_LARGESTFILES, OnReportLargestfiles)
 END_MESSAGE_MAP()
 
 
@@ -1238,6 +1645,11 @@ void CDirstatDoc::OnViewShowfreespace()
     CArray<CItem *, CItem *> drives;
     GetDriveItems(drives);
 
+    for(int i = 0; i < drives.GetSize(); i++)
+    {
+        UpdateAllViews(NULL, HINT_REFRESHITEM, reinterpret_cast<CObject *>(drives[i]));
+    }
+
     if(m_showFreeSpace)
     {
         for(int i = 0; i < drives.GetSize(); i++)
@@ -1287,6 +1699,11 @@ void CDirstatDoc::OnViewShowunknown()
     CArray<CItem *, CItem *> drives;
     GetDriveItems(drives);
 
+    for(int i = 0; i < drives.GetSize(); i++)
+    {
+        UpdateAllViews(NULL, HINT_REFRESHITEM, reinterpret_cast<CObject *>(drives[i]));
+    }
+
     if(m_showUnknown)
     {
         for(int i = 0; i < drives.GetSize(); i++)
@@ -1674,6 +2091,73 @@ void CDirstatDoc::OnCleanupProperties()
 //     }
 }
 
+void CDirstatDoc::OnUpdateReportFindduplicates(CCmdUI *pCmdUI)
+{
+    pCmdUI->Enable(
+        m_rootItem != NULL && m_rootItem->IsDone()
+        && (m_duplicateFinder == NULL || m_duplicateFinder->IsDone())
+    );
+}
+
+void CDirstatDoc::OnReportFindduplicates()
+{
+    DiscardDuplicates();
+    UpdateAllViews(NULL, HINT_SELECTIONSTYLECHANGED);
+
+    m_duplicateFinder.Attach(new CDuplicateFinder(m_rootItem));
+    if(m_duplicateFinder->IsDone())
+    {
+        ReportDuplicates(); // There was nothing to read.
+    }
+    else
+    {
+        GetMainFrame()->ShowProgress(m_duplicateFinder->GetProgressRange());
+    }
+}
+
+void CDirstatDoc::OnUpdateReportHighlightduplicates(CCmdUI *pCmdUI)
+{
+    pCmdUI->Enable(GetDuplicates() != NULL);
+    pCmdUI->SetCheck(IsHighlightingDuplicates());
+}
+
+void CDirstatDoc::OnReportHighlightduplicates()
+{
+    m_highlightDuplicates = !m_highlightDuplicates;
+    UpdateAllViews(NULL, HINT_SELECTIONSTYLECHANGED);
+}
+
+void CDirstatDoc::OnUpdateReportLargestfiles(CCmdUI *pCmdUI)
+{
+    pCmdUI->Enable(m_fileIndex != NULL && m_fileIndex->GetCount() > 0);
+}
+
+void CDirstatDoc::OnReportLargestfiles()
+{
+    CArray<CItem *, CItem *> files;
+    m_fileIndex->GetLargest(_largestFilesCount, files);
+
+    CString report;
+    ULONGLONG total = 0;
+    for(int i = 0; i < files.GetSize(); i++)
+    {
+        total += files[i]->GetSize();
+        report += FormatBytes(files[i]->GetSize()) + _T("\t") + files[i]->GetPath() + _T("\r\n");
+    }
+
+    CString msg;
+    msg.FormatMessage(IDS_LARGESTFILESsss
+        , FormatCount(files.GetSize()).GetString()
+        , FormatCount(m_fileIndex->GetCount()).GetString()
+        , FormatBytes(total).GetString()
+        );
+
+    if(IDYES == AfxMessageBox(msg, MB_YESNO | MB_ICONINFORMATION))
+    {
+        GetMainFrame()->CopyToClipboard(report);
+    }
+}
+
 // CDirstatDoc Diagnostics
 #ifdef _DEBUG
 void CDirstatDoc::AssertValid() const
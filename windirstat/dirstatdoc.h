@@ -28,6 +28,9 @@
 #include "options.h"
 
 class CItem;
+class CDuplicateFinder;
+class CFileIndex;
+class CQueryEngine;
 class CWorkLimiter;
 
 //
@@ -70,7 +73,8 @@ enum
     HINT_SOMEWORKDONE,              // Directory list shall process mouse messages first, then re-sort.
 
     HINT_LISTSTYLECHANGED,          // Options: List style (grid/stripes) or treelist colors changed
-    HINT_TREEMAPSTYLECHANGED        // Options: Treemap style (grid, colors etc.) changed
+    HINT_TREEMAPSTYLECHANGED,       // Options: Treemap style (grid, colors etc.) changed
+    HINT_REFRESHITEM                // An item or its subtree is about to change (or be deleted). pHint = CItem *
 };
 
 //
@@ -99,16 +103,23 @@ public:
     void SetTitlePrefix(CString prefix);
 
     COLORREF GetCushionColor(LPCTSTR ext);
+    int GetExtensionId(LPCTSTR ext);                // Stays valid as long as the tree
+    COLORREF GetExtensionColor(int extensionId);    // The cushion color without a lookup
     COLORREF GetZoomColor();
 
     bool OptionShowFreeSpace();
     bool OptionShowUnknown();
 
     const CExtensionData *GetExtensionData();
+    UINT GetExtensionColorSerial();                 // Changes, whenever the cushion colors are reassigned
+    bool IsExtensionDataDeferred();                 // Not built until the root is done
+    void AddExtensionFile(const CItem *file);       // Maintain m_extensionData,
+    void RemoveExtensionFile(const CItem *file);    // once it has been built.
     ULONGLONG GetRootSize();
 
     void ForgetItemTree();
     bool Work(CWorkLimiter* limiter); // return: true if done.
+    bool ScanToEnd(LPCTSTR folder);   // For headless runs. return: false on failure.
     bool IsDrive(CString spec);
     void RefreshMountPointItems();
     void RefreshJunctionItems();
@@ -138,16 +149,27 @@ public:
 
     void OpenItem(const CItem *item);
 
+    void DiscardDuplicates();
+    const CDuplicateFinder *GetDuplicates();   // NULL, unless the duplicate finder has finished
+    bool IsHighlightingDuplicates();
+    CFileIndex *GetFileIndex();                 // NULL, unless the root is done
+    void DiscardQueryEngine();
+    const CQueryEngine *GetQueryEngine();       // NULL, unless the root is done
+
 protected:
     void RecurseRefreshMountPointItems(CItem *item);
     void RecurseRefreshJunctionItems(CItem *item);
     void GetDriveItems(CArray<CItem *, CItem *>& drives);
     void RefreshRecyclers();
     void RebuildExtensionData();
+    void UpdateExtensionData();
+    void OnExtensionChanged(const CString& ext, ULONGLONG bytes);
+    void AccountExtensionData();
+    bool WorkOnDuplicates();
+    void ReportDuplicates();
+    void BuildFileIndex();
     void SortExtensionData(CStringArray& sortedExtensions);
     void SetExtensionColors(const CStringArray& sortedExtensions);
-    static CExtensionData *_pqsortExtensionData;
-    static int __cdecl _compareExtensions(const void *ext1, const void *ext2);
     void SetWorkingItemAncestor(CItem *item);
     void SetWorkingItem(CItem *item);
     bool DeletePhysicalItem(CItem *item, bool toTrashBin);
@@ -181,9 +203,23 @@ protected:
 
     bool m_extensionDataValid;      // If this is false, m_extensionData must be rebuilt
     CExtensionData m_extensionData; // Base for the extension view and cushion colors
+    bool m_extensionDataChanged;    // By AddExtensionFile() or RemoveExtensionFile()
+    bool m_extensionRankingChanged; // The colors may have to be reassigned
+    CStringArray m_topExtensions;   // The extensions with a palette color of their own, largest first
+    UINT m_extensionColorSerial;    // Incremented by SetExtensionColors()
+    CMap<CString, LPCTSTR, int, int> m_extensionIds; // See GetExtensionId(). Only grows until DeleteContents().
+    CArray<COLORREF, COLORREF> m_extensionColors;   // The cushion color per extension id
+    LONGLONG m_extensionDataBytes;  // What we have booked for m_extensionData in CMemoryAccounting
+    LONGLONG m_extensionDataAllocations;
 
     CList<CItem *, CItem *> m_reselectChildStack; // Stack for the "Re-select Child"-Feature
 
+    CAutoPtr<CDuplicateFinder> m_duplicateFinder;   // Must be discarded before items are deleted
+    bool m_highlightDuplicates;                     // Highlight the redundant copies in the treemap
+
+    CAutoPtr<CFileIndex> m_fileIndex;               // Maintained by CItem, once the root is done
+    CAutoPtr<CQueryEngine> m_queryEngine;           // Snapshot. Must be discarded before items change.
+
 protected:
     DECLARE_MESSAGE_MAP()
     afx_msg void OnUpdateRefreshselected(CCmdUI *pCmdUI);
@@ -218,6 +254,12 @@ protected:
     afx_msg void OnCleanupOpen();
     afx_msg void OnUpdateCleanupProperties(CCmdUI *pCmdUI);
     afx_msg void OnCleanupProperties();
+    afx_msg void OnUpdateReportFindduplicates(CCmdUI *pCmdUI);
+    afx_msg void OnReportFindduplicates();
+    afx_msg void OnUpdateReportHighlightduplicates(CCmdUI *pCmdUI);
+    afx_msg void OnReportHighlightduplicates();
+    afx_msg void OnUpdateReportLargestfiles(CCmdUI *pCmdUI);
+    afx_msg void OnReportLargestfiles();
 
 public:
     #ifdef _DEBUG
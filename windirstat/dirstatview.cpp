@@ -283,6 +283,7 @@ int CDirstatView::OnCreate(LPCREATESTRUCT lpCreateStruct)
     m_treeListControl.InsertColumn(COL_SUBDIRS, LoadString(IDS_TREECOL_SUBDIRS), LVCFMT_RIGHT, 55, COL_SUBDIRS);
     m_treeListControl.InsertColumn(COL_LASTCHANGE, LoadString(IDS_TREECOL_LASTCHANGE), LVCFMT_LEFT, 120, COL_LASTCHANGE);
     m_treeListControl.InsertColumn(COL_ATTRIBUTES, LoadString(IDS_TREECOL_ATTRIBUTES), LVCFMT_LEFT, 50, COL_ATTRIBUTES);
+    m_treeListControl.InsertColumn(COL_COLDDATA, LoadString(IDS_TREECOL_COLDDATA), LVCFMT_RIGHT, 90, COL_COLDDATA);
 
     m_treeListControl.OnColumnsInserted();
 
@@ -416,7 +417,15 @@ void CDirstatView::OnUpdate(CView *pSender, LPARAM lHint, CObject *pHint)
         // fall through
     case 0:
         {
-            m_treeListControl.Sort();
+            if(lHint == HINT_SOMEWORKDONE)
+            {
+                // Only the parents of changed items need to be sorted.
+                m_treeListControl.ResortPending();
+            }
+            else
+            {
+                m_treeListControl.Sort();
+            }
 
             // I decided (from 1.0.1 to 1.0.2) that this is not so good:
             // m_treeListControl.EnsureItemVisible(GetDocument()->GetSelection());
@@ -28,6 +28,9 @@
 #include "WorkLimiter.h"
 #include "item.h"
 #include "globalhelpers.h"
+#include "MemoryAccounting.h"
+#include "FileIndex.h"
+#include "ExtensionCollector.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -50,9 +53,11 @@ CItem::CItem(ITEMTYPE type, LPCTSTR name, bool dontFollow)
     , m_etype(static_cast<ITEMTYPE>(type & ~ITF_FLAGS))
     , m_name(name)
     , m_extension_cached(false)
+    , m_extensionId(-1)
     , m_size(0)
     , m_files(0)
     , m_subdirs(0)
+    , m_ageHistogram(NULL)
     , m_readJobDone(false)
     , m_done(false)
     , m_ticksWorked(0)
@@ -75,10 +80,32 @@ CItem::CItem(ITEMTYPE type, LPCTSTR name, bool dontFollow)
     }
 
     ZeroMemory(&m_lastChange, sizeof(m_lastChange));
+
+    if(!IsLeaf(GetType()))
+    {
+        m_ageHistogram = new CAgeHistogram;
+    }
+
+    AccountMemory(+1);
 }
 
 CItem::~CItem()
 {
+    AccountMemory(-1);
+
+    if(GetType() == IT_FILE && GetDocument()->GetFileIndex() != NULL)
+    {
+        GetDocument()->GetFileIndex()->Remove(this);
+    }
+
+    // A file being refreshed (not done) has already been removed.
+    if(GetType() == IT_FILE && IsDone())
+    {
+        GetDocument()->RemoveExtensionFile(this);
+    }
+
+    delete m_ageHistogram;
+
     for(int i = 0; i < m_children.GetSize(); i++)
     {
         delete m_children[i];
@@ -222,6 +249,13 @@ CString CItem::GetText(int subitem) const
         }
         break;
 
+    case COL_COLDDATA:
+        if(GetType() != IT_FREESPACE && GetType() != IT_UNKNOWN)
+        {
+            s = FormatBytes(GetColdBytes());
+        }
+        break;
+
     default:
         {
             ASSERT(0);
@@ -341,6 +375,12 @@ int CItem::CompareSibling(const CTreeListItem *tlib, int subitem) const
         }
         break;
 
+    case COL_COLDDATA:
+        {
+            r = usignum(GetColdBytes(), other->GetColdBytes());
+        }
+        break;
+
     default:
         {
             ASSERT(false);
@@ -533,7 +573,7 @@ void CItem::UpdateLastChange()
         CString basename = path.Mid(i + 1);
         CString pattern;
         pattern.Format(_T("%s\\..\\%s"), path.GetString(), basename.GetString());
-        CFileFindWDS finder;
+        CVirtualFileFind finder;
         BOOL b = finder.FindFile(pattern);
         if(!b)
         {
@@ -576,17 +616,33 @@ void CItem::AddChild(CItem *child)
     // because the treelist will display it immediately.
     // If we did it the other way round, CItem::GetFraction() could ASSERT.
     UpwardAddSize(child->GetSize());
+    UpwardAddAges(child->GetAgeHistogram());
     UpwardAddReadJobs(child->GetReadJobs());
     UpwardUpdateLastChange(child->GetLastChange());
 
+    const INT_PTR oldCapacity = m_children.GetCapacity();
     m_children.Add(child);
+    AccountChildrenCapacity(oldCapacity);
     child->SetParent(this);
 
+    if(child->GetType() == IT_FILE && GetDocument()->GetFileIndex() != NULL)
+    {
+        GetDocument()->GetFileIndex()->Add(child);
+    }
+    if(child->GetType() == IT_FILE)
+    {
+        ASSERT(child->IsDone());
+        GetDocument()->AddExtensionFile(child);
+    }
+
     GetTreeListControl()->OnChildAdded(this, child);
 }
 
 void CItem::RemoveChild(int i)
 {
+    GetDocument()->DiscardDuplicates();
+    GetDocument()->DiscardQueryEngine();
+
     CItem *child = GetChild(i);
     m_children.RemoveAt(i);
     GetTreeListControl()->OnChildRemoved(this, child);
@@ -595,13 +651,17 @@ void CItem::RemoveChild(int i)
 
 void CItem::RemoveAllChildren()
 {
+    GetDocument()->DiscardDuplicates();
+    GetDocument()->DiscardQueryEngine();
     GetTreeListControl()->OnRemovingAllChildren(this);
 
     for(int i = 0; i < GetChildrenCount(); i++)
     {
         delete m_children[i];
     }
+    const INT_PTR oldCapacity = m_children.GetCapacity();
     m_children.SetSize(0);
+    AccountChildrenCapacity(oldCapacity);
 }
 
 void CItem::UpwardAddSubdirs(ULONGLONG dirCount)
@@ -708,6 +768,71 @@ void CItem::UpwardRecalcLastChange()
     }
 }
 
+// Leaves have no histogram of their own, so they only pass the call on.
+void CItem::UpwardAddAges(const CAgeHistogram& ages)
+{
+    if(ages.IsEmpty())
+    {
+        return;
+    }
+
+    if(m_ageHistogram != NULL)
+    {
+        m_ageHistogram->Add(ages);
+    }
+    if(GetParent() != NULL)
+    {
+        GetParent()->UpwardAddAges(ages);
+    }
+}
+
+void CItem::UpwardSubtractAges(const CAgeHistogram& ages)
+{
+    if(ages.IsEmpty())
+    {
+        return;
+    }
+
+    if(m_ageHistogram != NULL)
+    {
+        m_ageHistogram->Subtract(ages);
+    }
+    if(GetParent() != NULL)
+    {
+        GetParent()->UpwardSubtractAges(ages);
+    }
+}
+
+// For a file this is the file alone.
+CAgeHistogram CItem::GetAgeHistogram() const
+{
+    if(m_ageHistogram != NULL)
+    {
+        return *m_ageHistogram;
+    }
+
+    CAgeHistogram ages;
+    if(GetType() == IT_FILE)
+    {
+        ages.AddFile(m_lastChange, m_size);
+    }
+    return ages;
+}
+
+// Bytes not written to since AGE_FIRSTCOLD
+ULONGLONG CItem::GetColdBytes() const
+{
+    if(m_ageHistogram != NULL)
+    {
+        return m_ageHistogram->GetBytesFrom(AGE_FIRSTCOLD);
+    }
+    if(GetType() == IT_FILE && CAgeHistogram::GetBucket(m_lastChange) >= AGE_FIRSTCOLD)
+    {
+        return m_size;
+    }
+    return 0;
+}
+
 ULONGLONG CItem::GetSize() const
 {
     return m_size;
@@ -913,9 +1038,19 @@ CString CItem::GetName() const
 
 CString CItem::GetExtension() const
 {
-    if (m_extension_cached)
-        return m_extension;
+    if(!m_extension_cached)
+    {
+        const LONGLONG bytes = CacheExtension();
+        CMemoryAccounting::Add(MEM_NAMES, bytes, bytes > 0 ? 1 : 0);
+        CMemoryAccounting::AddItem(IsLeaf(GetType()), bytes, 0);
+    }
+    return m_extension;
+}
 
+// Fills the cache and returns the bytes it costs, which the caller
+// has to account.
+LONGLONG CItem::CacheExtension() const
+{
     CString ext;
 
     CString name = GetName();
@@ -952,7 +1087,12 @@ CString CItem::GetExtension() const
     m_extension = ext;
     m_extension_cached = true;
 
-    return ext;
+    // For <Free Space> and <Unknown> the cache shares the buffer of m_name
+    if(m_extension.GetString() == m_name.GetString())
+    {
+        return 0;
+    }
+    return CMemoryAccounting::GetStringBytes(m_extension);
 }
 
 ULONGLONG CItem::GetFilesCount() const
@@ -987,6 +1127,7 @@ void CItem::SetReadJobDone(bool done)
     }
     m_readJobDone = done;
 
+    GetTreeListControl()->OnChildrenChanged(GetParent());
 }
 
 bool CItem::IsDone() const
@@ -1037,6 +1178,10 @@ void CItem::SetDone()
     ZeroMemory(&m_rect, sizeof(m_rect));
 
     m_done = true;
+
+    // Our children don't show read jobs any more (see MustShowReadJobs()),
+    // and a drive may have grown by the unknown space.
+    GetTreeListControl()->OnChildrenChanged(this);
 }
 
 ULONGLONG CItem::GetTicksWorked() const
@@ -1072,7 +1217,7 @@ void CItem::DoSomeWork(CWorkLimiter* limiter)
             CList<FILEINFO, FILEINFO> files;
 
 
-            CFileFindWDS finder;
+            CVirtualFileFind finder;
             BOOL b = finder.FindFile(GetFindPattern());
             while(b)
             {
@@ -1191,6 +1336,8 @@ bool CItem::StartRefresh()
     ASSERT(GetType() != IT_FREESPACE);
     ASSERT(GetType() != IT_UNKNOWN);
 
+    GetDocument()->DiscardQueryEngine();
+
     m_ticksWorked = 0;
 
     // Special case IT_MYCOMPUTER
@@ -1216,6 +1363,17 @@ bool CItem::StartRefresh()
 
     UncacheImage();
 
+    // Before UpdateLastChange() moves a file to another age bucket
+    UpwardSubtractAges(GetAgeHistogram());
+    if(GetType() == IT_FILE && GetDocument()->GetFileIndex() != NULL)
+    {
+        GetDocument()->GetFileIndex()->Remove(this);
+    }
+    if(GetType() == IT_FILE)
+    {
+        GetDocument()->RemoveExtensionFile(this);
+    }
+
     // Upward clear data
     UpdateLastChange();
 
@@ -1242,6 +1400,7 @@ bool CItem::StartRefresh()
 
     UpwardSubtractSize(GetSize());
     ASSERT(GetSize() == 0);
+    GetTreeListControl()->OnChildrenChanged(GetParent());
 
     RemoveAllChildren();
     UpwardRecalcLastChange();
@@ -1249,7 +1408,7 @@ bool CItem::StartRefresh()
     // Special case IT_FILESFOLDER
     if(GetType() == IT_FILESFOLDER)
     {
-        CFileFindWDS finder;
+        CVirtualFileFind finder;
         BOOL b = finder.FindFile(GetFindPattern());
         while(b)
         {
@@ -1285,11 +1444,11 @@ bool CItem::StartRefresh()
     }
     else if(GetType() == IT_FILE)
     {
-        deleted = !::PathFileExists(GetPath());
+        deleted = !GetVirtualFileSystem()->FileExists(GetPath());
     }
     else if(GetType() == IT_DIRECTORY)
     {
-        deleted = !FolderExists(GetPath());
+        deleted = !GetVirtualFileSystem()->FolderExists(GetPath());
     }
 
     if(deleted)
@@ -1309,7 +1468,7 @@ bool CItem::StartRefresh()
     // Case IT_FILE
     if(GetType() == IT_FILE)
     {
-        CFileFindWDS finder;
+        CVirtualFileFind finder;
         BOOL b = finder.FindFile(GetPath());
         if(b)
         {
@@ -1326,10 +1485,18 @@ bool CItem::StartRefresh()
                 SetLastChange(fi.lastWriteTime);
 
                 UpwardAddSize(fi.length);
+                UpwardAddAges(GetAgeHistogram());
+                if(GetDocument()->GetFileIndex() != NULL)
+                {
+                    GetDocument()->GetFileIndex()->Add(this);
+                }
                 UpwardUpdateLastChange(GetLastChange());
                 GetParent()->UpwardAddFiles(1);
+                GetTreeListControl()->OnChildrenChanged(GetParent());
             }
         }
+        // Also if the file has vanished: ~CItem() will remove it again.
+        GetDocument()->AddExtensionFile(this);
         SetDone();
         return true;
     }
@@ -1398,6 +1565,7 @@ void CItem::UpwardSetUndone()
         UpwardSubtractSize(unknown->GetSize());
 
         unknown->SetSize(0);
+        GetTreeListControl()->OnChildrenChanged(this);
     }
 
     m_done = false;
@@ -1450,6 +1618,7 @@ void CItem::RefreshRecycler()
         return; // nicht gefunden
     }
 
+    GetDocument()->UpdateAllViews(NULL, HINT_REFRESHITEM, reinterpret_cast<CObject *>(GetChild(i)));
     GetChild(i)->StartRefresh();
 }
 
@@ -1504,6 +1673,7 @@ void CItem::UpdateFreeSpaceItem()
     ULONGLONG diff = free - before;
 
     freeSpaceItem->UpwardAddSize(diff);
+    GetTreeListControl()->OnChildrenChanged(this);
 
     ASSERT(freeSpaceItem->GetSize() == free);
 }
@@ -1599,35 +1769,27 @@ CItem *CItem::FindDirectoryByPath(const CString& path)
     return NULL;
 }
 
-void CItem::RecurseCollectExtensionData(CExtensionData *ed)
+// Runs in worker threads (see CollectExtensionData()), so it must not
+// touch anything but its subtree and table.
+void CItem::RecurseCollectExtensionData(CExtensionTable *table)
 {
-    GetWDSApp()->PeriodicalUpdateRamUsage();
-
     ITEMTYPE type = GetType();
     if(IsLeaf(type))
     {
         if(type == IT_FILE)
         {
-            CString ext = GetExtension();
-            SExtensionRecord r;
-            if(ed->Lookup(ext, r))
+            if(!m_extension_cached)
             {
-                r.bytes += GetSize();
-                r.files++;
+                table->AddCachedExtension(CacheExtension());
             }
-            else
-            {
-                r.bytes = GetSize();
-                r.files = 1;
-            }
-            ed->SetAt(ext, r);
+            table->Add(m_extension, 1, GetSize());
         }
     }
     else
     {
         for(int i = 0; i < GetChildrenCount(); i++)
         {
-            GetChild(i)->RecurseCollectExtensionData(ed);
+            GetChild(i)->RecurseCollectExtensionData(table);
         }
     }
 }
@@ -1714,7 +1876,11 @@ COLORREF CItem::GetGraphColor() const
 
     case IT_FILE:
         {
-            color = GetDocument()->GetCushionColor(GetExtension());
+            if(m_extensionId < 0)
+            {
+                m_extensionId = GetDocument()->GetExtensionId(GetExtension());
+            }
+            color = GetDocument()->GetExtensionColor(m_extensionId);
         }
         break;
 
@@ -1827,7 +1993,7 @@ CString CItem::UpwardGetPathWithoutBackslash() const
     return path;
 }
 
-void CItem::AddDirectory(CFileFindWDS& finder)
+void CItem::AddDirectory(CVirtualFileFind& finder)
 {
     bool dontFollow = GetWDSApp()->IsVolumeMountPoint(finder.GetFilePath()) && !GetOptions()->IsFollowMountPoints();
 
@@ -1897,3 +2063,38 @@ void CItem::DrivePacman()
     rc.DeflateRect(sizeDeflatePacman);
     DrawPacman(&dc, rc, GetTreeListControl()->GetItemSelectionBackgroundColor(i));
 }
+
+// Books our own memory (not that of the children) in (sign = +1) or out (-1).
+void CItem::AccountMemory(int sign)
+{
+    LONGLONG nameBytes = CMemoryAccounting::GetStringBytes(m_name);
+    LONGLONG nameAllocations = nameBytes > 0 ? 1 : 0;
+    if(m_extension_cached && m_extension.GetString() != m_name.GetString())
+    {
+        const LONGLONG extensionBytes = CMemoryAccounting::GetStringBytes(m_extension);
+        nameBytes += extensionBytes;
+        nameAllocations += extensionBytes > 0 ? 1 : 0;
+    }
+    const LONGLONG childrenBytes = LONGLONG(m_children.GetCapacity()) * LONGLONG(sizeof(CItem *));
+    const LONGLONG nodeBytes = LONGLONG(sizeof(CItem)) + (m_ageHistogram != NULL ? LONGLONG(sizeof(CAgeHistogram)) : 0);
+    const LONGLONG nodeAllocations = m_ageHistogram != NULL ? 2 : 1;
+
+    CMemoryAccounting::Add(MEM_NODES, sign * nodeBytes, sign * nodeAllocations);
+    CMemoryAccounting::Add(MEM_NAMES, sign * nameBytes, sign * nameAllocations);
+    CMemoryAccounting::Add(MEM_CHILDARRAYS, sign * childrenBytes, childrenBytes > 0 ? sign : 0);
+    CMemoryAccounting::AddItem(IsLeaf(GetType()), sign * (nodeBytes + nameBytes + childrenBytes), sign);
+}
+
+// CArray grows in steps, so the capacity changes only now and then.
+void CItem::AccountChildrenCapacity(INT_PTR oldCapacity)
+{
+    const INT_PTR capacity = m_children.GetCapacity();
+    if(capacity == oldCapacity)
+    {
+        return;
+    }
+
+    const LONGLONG bytes = LONGLONG(capacity - oldCapacity) * LONGLONG(sizeof(CItem *));
+    CMemoryAccounting::Add(MEM_CHILDARRAYS, bytes, (capacity > 0 ? 1 : 0) - (oldCapacity > 0 ? 1 : 0));
+    CMemoryAccounting::AddItem(IsLeaf(GetType()), bytes, 0);
+}
@@ -26,10 +26,13 @@
 #include "Treelistcontrol.h"
 #include "treemap.h"
 #include "dirstatdoc.h" // CExtensionData
-#include "FileFindWDS.h" // CFileFindWDS
+#include "VirtualFileSystem.h" // CVirtualFileFind
+#include "AgeHistogram.h"
 #include <common/wds_constants.h>
 
 class CWorkLimiter;
+class CExtensionTable;
+class CItem;
 
 // Columns
 enum
@@ -42,7 +45,8 @@ enum
     COL_FILES,
     COL_SUBDIRS,
     COL_LASTCHANGE,
-    COL_ATTRIBUTES
+    COL_ATTRIBUTES,
+    COL_COLDDATA
 };
 
 // Item types
@@ -76,6 +80,16 @@ inline bool operator== (const FILETIME& t1, const FILETIME& t2)
     return (t1.dwLowDateTime == t2.dwLowDateTime) && (t1.dwHighDateTime == t2.dwHighDateTime);
 }
 
+//
+// CItemArray. Array of child items, which reveals its capacity
+// for the memory accounting (see CMemoryAccounting).
+//
+class CItemArray: public CArray<CItem *, CItem *>
+{
+public:
+    INT_PTR GetCapacity() const { return m_nMaxSize; }
+};
+
 //
 // CItem. This is the object, from which the whole tree is built.
 // For every directory, file etc., we find on the Harddisks, there is one CItem.
@@ -95,6 +109,8 @@ inline bool operator== (const FILETIME& t1, const FILETIME& t2)
 //
 class CItem: public CTreeListItem, public CTreemap::Item
 {
+    friend struct CItemTreemapAccess;
+
     // We collect data of files in FILEINFOs before we create items for them,
     // because we need to know their count before we can decide whether or not
     // we have to create a <Files> item. (A <Files> item is only created, when
@@ -155,6 +171,10 @@ public:
     void UpwardSubtractReadJobs(ULONGLONG count);
     void UpwardUpdateLastChange(const FILETIME& t);
     void UpwardRecalcLastChange();
+    void UpwardAddAges(const CAgeHistogram& ages);
+    void UpwardSubtractAges(const CAgeHistogram& ages);
+    CAgeHistogram GetAgeHistogram() const;
+    ULONGLONG GetColdBytes() const;
     ULONGLONG GetSize() const;
     void SetSize(ULONGLONG ownSize);
     ULONGLONG GetReadJobs() const;
@@ -194,7 +214,7 @@ public:
     CItem *FindUnknownItem() const;
     void RemoveUnknownItem();
     CItem *FindDirectoryByPath(const CString& path);
-    void RecurseCollectExtensionData(CExtensionData *ed);
+    void RecurseCollectExtensionData(CExtensionTable *table); // Thread safe for disjoint subtrees
 
 private:
     static int __cdecl _compareBySize(const void *p1, const void *p2);
@@ -208,21 +228,26 @@ private:
     int FindFreeSpaceItemIndex() const;
     int FindUnknownItemIndex() const;
     CString UpwardGetPathWithoutBackslash() const;
-    void AddDirectory(CFileFindWDS& finder);
+    void AddDirectory(CVirtualFileFind& finder);
     void AddFile(const FILEINFO& fi);
     void DriveVisualUpdateDuringWork();
     void UpwardDrivePacman();
     void DrivePacman();
+    void AccountMemory(int sign);
+    void AccountChildrenCapacity(INT_PTR oldCapacity);
+    LONGLONG CacheExtension() const;
 
     ITEMTYPE m_type;            // Indicates our type. See ITEMTYPE.
     ITEMTYPE m_etype;           
     CString m_name;             // Display name
     mutable CString m_extension;		// Cache of extension (it's used often)
     mutable bool m_extension_cached;
+    mutable int m_extensionId;  // CDirstatDoc::GetExtensionId() of a file, -1 until its first GetGraphColor()
     ULONGLONG m_size;           // OwnSize, if IT_FILE or IT_FREESPACE, or IT_UNKNOWN; SubtreeTotal else.
     ULONGLONG m_files;          // # Files in subtree
     ULONGLONG m_subdirs;        // # Folder in subtree
     FILETIME m_lastChange;      // Last modification time OF SUBTREE
+    CAgeHistogram *m_ageHistogram; // Files of the subtree by age. NULL for leaves.
     unsigned char m_attributes; // Packed file attributes of the item
 
     bool m_readJobDone;         // FindFiles() (our own read job) is finished.
@@ -232,10 +257,26 @@ private:
 
 
     // Our children. When "this" is set to "done", this array is sorted by child size.
-    CArray<CItem *, CItem *> m_children;
+    CItemArray m_children;
 
     // For GraphView:
     RECT m_rect;                // Finally, this is our coordinates in the Treemap view.
 };
 
+//
+// CItemTreemapAccess. The access policy of CTreemapEngine (see
+// TreemapEngine.h) for CItem: the treemap accessors without virtual calls.
+//
+struct CItemTreemapAccess
+{
+    typedef CItem *Node;
+
+    static int GetChildrenCount(const CItem *item)          { return int(item->m_children.GetSize()); }
+    static CItem *GetChild(const CItem *item, int i)        { return item->m_children[i]; }
+    static ULONGLONG GetSize(const CItem *item)             { return item->m_size; }
+    static bool IsLeaf(const CItem *item)                   { return ::IsLeaf(item->m_etype); }
+    static COLORREF GetGraphColor(const CItem *item)        { return item->GetGraphColor(); }
+    static void SetRectangle(CItem *item, const CRect& rc)  { item->m_rect = rc; }
+};
+
 #endif // __WDS_ITEM_H__
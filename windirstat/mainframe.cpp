@@ -30,6 +30,7 @@
 #include "osspecific.h"
 #include "globalhelpers.h"
 #include "item.h"
+#include "MemoryAccounting.h"
 
 #include "pagecleanups.h"
 #include "pagetreelist.h"
@@ -399,6 +400,8 @@ BEGIN_MESSAGE_MAP(CMainFrame, CFrameWnd)
     ON_WM_SIZE()
     ON_UPDATE_COMMAND_UI(ID_VIEW_SHOWTREEMAP, OnUpdateViewShowtreemap)
     ON_COMMAND(ID_VIEW_SHOWTREEMAP, OnViewShowtreemap)
+    ON_UPDATE_COMMAND_UI(ID_TREEMAP_LIVE, OnUpdateTreemapLive)
+    ON_COMMAND(ID_TREEMAP_LIVE, OnTreemapLive)
     ON_UPDATE_COMMAND_UI(ID_VIEW_SHOWFILETYPES, OnUpdateViewShowfiletypes)
     ON_COMMAND(ID_VIEW_SHOWFILETYPES, OnViewShowfiletypes)
     ON_COMMAND(ID_CONFIGURE, OnConfigure)
@@ -696,6 +699,14 @@ int CMainFrame::OnCreate(LPCREATESTRUCT lpCreateStruct)
 
     VERIFY(m_wndStatusBar.Create(this));
     VERIFY(m_wndStatusBar.SetIndicators(indic, size));
+
+    if(indic == indicators)
+    {
+        VERIFY(m_memoryTip.Create(this, TTS_ALWAYSTIP | TTS_NOPREFIX));
+        m_memoryTip.SetMaxTipWidth(SHRT_MAX); // Enables the line breaks
+        m_memoryTip.SetDelayTime(TTDT_AUTOPOP, SHRT_MAX);
+        VERIFY(m_memoryTip.AddTool(&m_wndStatusBar, _T(" "), CRect(0, 0, 0, 0), ID_INDICATOR_MEMORYUSAGE));
+    }
     m_wndDeadFocus.Create(this);
 
     m_wndToolBar.EnableDocking(CBRS_ALIGN_ANY);
@@ -773,6 +784,7 @@ void CMainFrame::OnDestroy()
 
     CPersistence::SetShowFileTypes(GetTypeView()->IsShowTypes());
     CPersistence::SetShowTreemap(GetGraphView()->IsShowTreemap());
+    CPersistence::SetShowLiveTreemap(GetGraphView()->IsShowLiveTreemap());
 
     CFrameWnd::OnDestroy();
 }
@@ -790,6 +802,7 @@ BOOL CMainFrame::OnCreateClient(LPCREATESTRUCT /*lpcs*/, CCreateContext* pContex
 
     GetTypeView()->ShowTypes(CPersistence::GetShowFileTypes());
     GetGraphView()->ShowTreemap(CPersistence::GetShowTreemap());
+    GetGraphView()->ShowLiveTreemap(CPersistence::GetShowLiveTreemap());
 
     return TRUE;
 }
@@ -804,6 +817,15 @@ BOOL CMainFrame::PreCreateWindow(CREATESTRUCT& cs)
     return TRUE;
 }
 
+BOOL CMainFrame::PreTranslateMessage(MSG* pMsg)
+{
+    if(m_memoryTip.m_hWnd != NULL)
+    {
+        m_memoryTip.RelayEvent(pMsg);
+    }
+    return CFrameWnd::PreTranslateMessage(pMsg);
+}
+
 
 // CMainFrame Diagnose
 
@@ -1131,6 +1153,27 @@ void CMainFrame::OnUpdateMemoryUsage(CCmdUI *pCmdUI)
 {
     pCmdUI->Enable(true);
     pCmdUI->SetText(GetWDSApp()->GetCurrentProcessMemoryInfo());
+    UpdateMemoryTip();
+}
+
+void CMainFrame::UpdateMemoryTip()
+{
+    if(m_memoryTip.m_hWnd == NULL)
+    {
+        return;
+    }
+
+    // The panes move whenever the status bar changes its size
+    CRect rc;
+    m_wndStatusBar.GetItemRect(m_wndStatusBar.CommandToIndex(ID_INDICATOR_MEMORYUSAGE), rc);
+    m_memoryTip.SetToolRect(&m_wndStatusBar, ID_INDICATOR_MEMORYUSAGE, rc);
+
+    CString text = CMemoryAccounting::FormatBreakdown();
+    if(text != m_memoryTipText)
+    {
+        m_memoryTipText = text;
+        m_memoryTip.UpdateTipText(m_memoryTipText, &m_wndStatusBar, ID_INDICATOR_MEMORYUSAGE);
+    }
 }
 
 void CMainFrame::OnSize(UINT nType, int cx, int cy)
@@ -1180,6 +1223,16 @@ void CMainFrame::OnViewShowtreemap()
     }
 }
 
+void CMainFrame::OnUpdateTreemapLive(CCmdUI *pCmdUI)
+{
+    pCmdUI->SetCheck(GetGraphView()->IsShowLiveTreemap());
+}
+
+void CMainFrame::OnTreemapLive()
+{
+    GetGraphView()->ShowLiveTreemap(!GetGraphView()->IsShowLiveTreemap());
+}
+
 void CMainFrame::OnUpdateViewShowfiletypes(CCmdUI *pCmdUI)
 {
     pCmdUI->SetCheck(GetTypeView()->IsShowTypes());
@@ -185,7 +185,9 @@ public:
 protected:
     virtual BOOL OnCreateClient(LPCREATESTRUCT lpcs, CCreateContext* pContext);
     virtual BOOL PreCreateWindow(CREATESTRUCT& cs);
+    virtual BOOL PreTranslateMessage(MSG* pMsg);
     void MakeSaneShowCmd(UINT& u);
+    void UpdateMemoryTip();
 
     void CreateStatusProgress();
     void CreatePacmanProgress();
@@ -206,6 +208,8 @@ protected:
     CProgressCtrl   m_progress;     // Progress control. Is Create()ed and Destroy()ed again every time.
     CPacmanControl  m_pacman;       // Static control for Pacman.
     CButton         m_suspendButton;// Progress-Suspend-Button
+    CToolTipCtrl    m_memoryTip;    // Shows the CMemoryAccounting breakdown over the RAM usage pane
+    CString         m_memoryTipText;// Current text of m_memoryTip
 
     LOGICAL_FOCUS   m_logicalFocus; // Which view has the logical focus
     CDeadFocusWnd   m_wndDeadFocus; // Zero-size window which holds the focus if logical focus is "NONE"
@@ -224,6 +228,8 @@ protected:
     afx_msg void OnSize(UINT nType, int cx, int cy);
     afx_msg void OnUpdateViewShowtreemap(CCmdUI *pCmdUI);
     afx_msg void OnViewShowtreemap();
+    afx_msg void OnUpdateTreemapLive(CCmdUI *pCmdUI);
+    afx_msg void OnTreemapLive();
     afx_msg void OnUpdateViewShowfiletypes(CCmdUI *pCmdUI);
     afx_msg void OnViewShowfiletypes();
     afx_msg void OnConfigure();
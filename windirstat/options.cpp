@@ -38,6 +38,7 @@ namespace
     const LPCTSTR entryShowUnknown          = _T("showUnknown");
     const LPCTSTR entryShowFileTypes        = _T("showFileTypes");
     const LPCTSTR entryShowTreemap          = _T("showTreemap");
+    const LPCTSTR entryShowLiveTreemap      = _T("showLiveTreemap");
     const LPCTSTR entryShowToolbar          = _T("showToolbar");
     const LPCTSTR entryShowStatusbar        = _T("showStatusbar");
     const LPCTSTR entryMainWindowPlacement  = _T("mainWindowPlacement");
@@ -154,6 +155,16 @@ void CPersistence::SetShowTreemap(bool show)
     getProfileBool(sectionPersistence, entryShowTreemap, show);
 }
 
+bool CPersistence::GetShowLiveTreemap()
+{
+    return getProfileBool(sectionPersistence, entryShowLiveTreemap, true);
+}
+
+void CPersistence::SetShowLiveTreemap(bool show)
+{
+    setProfileBool(sectionPersistence, entryShowLiveTreemap, show);
+}
+
 bool CPersistence::GetShowToolbar()
 {
     return getProfileBool(sectionPersistence, entryShowToolbar, true);
@@ -212,6 +212,9 @@ public:
     static bool GetShowTreemap();
     static void SetShowTreemap(bool show);
 
+    static bool GetShowLiveTreemap();
+    static void SetShowLiveTreemap(bool show);
+
     static bool GetShowToolbar();
     static void SetShowToolbar(bool show);
 
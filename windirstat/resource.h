@@ -105,6 +105,11 @@
 #define IDS_LANGUAGERESTARTNOW          277
 #define IDS_ABOUT_AUTHORS               278
 #define IDS_ABOUT_AUTHORSTEXTs          279
+#define IDS_MEMORYBREAKDOWN             280
+#define IDS_DUPLICATESFOUNDsss          281
+#define IDS_NODUPLICATESFOUND           282
+#define IDS_TREECOL_COLDDATA            283
+#define IDS_LARGESTFILESsss             284
 #define IDS_TRANSLATORS                 899
 #define IDR_TEXT1                       900
 #define IDR_AUTHORS                     900
@@ -263,6 +268,10 @@
 #define ID_HELP_CHECKFORUPDATES         33024
 #define ID_FILE_RUNWINDIRSTATELEVATED   33025
 #define ID_RUNELEVATED                  33026
+#define ID_REPORT_FINDDUPLICATES        33027
+#define ID_REPORT_HIGHLIGHTDUPLICATES   33028
+#define ID_REPORT_LARGESTFILES          33029
+#define ID_TREEMAP_LIVE                 33030
 #define ID_INDICATOR_MEMORYUSAGE        59142
 
 // Next default values for new objects
@@ -270,7 +279,7 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        910
-#define _APS_NEXT_COMMAND_VALUE         33027
+#define _APS_NEXT_COMMAND_VALUE         33031
 #define _APS_NEXT_CONTROL_VALUE         1230
 #define _APS_NEXT_SYMED_VALUE           104
 #endif
@@ -33,6 +33,11 @@
 #include "osspecific.h"
 #include "globalhelpers.h"
 #include "WorkLimiter.h"
+#include "VirtualFileSystem.h"
+#include "Benchmark.h"
+#include "QueryEngine.h"
+#include "TreemapExport.h"
+#include "MemoryAccounting.h"
 #pragma warning(push)
 #pragma warning(disable : 4091)
 #include <Dbghelp.h> // for mini dumps
@@ -70,6 +75,20 @@ CMyImageList* GetMyImageList()
     return GetWDSApp()->GetMyImageList();
 }
 
+namespace
+{
+    // WINDIRSTAT_MEMORY names an ini file, which receives the memory
+    // breakdown at the end of a headless run.
+    void WriteMemoryBreakdown()
+    {
+        CString path;
+        if(path.GetEnvironmentVariable(_T("WINDIRSTAT_MEMORY")) && !path.IsEmpty())
+        {
+            CMemoryAccounting::WriteBreakdown(path);
+        }
+    }
+}
+
 
 // CDirstatApp
 
@@ -99,6 +118,7 @@ CDirstatApp::CDirstatApp()
 #   endif /* (_WIN32_WINNT < _WIN32_WINNT_VISTA) */
     , m_altColor(GetAlternativeColor(RGB(0x00, 0x00, 0xFF), _T("AltColor")))
     , m_altEncryptionColor(GetAlternativeColor(RGB(0x00, 0x80, 0x00), _T("AltEncryptionColor")))
+    , m_exitCode(0)
 #   if SUPPORT_ELEVATION
     , m_ElevationEvent(NULL)
     , m_ElevationEventName()
@@ -565,6 +585,18 @@ BOOL CDirstatApp::InitInstance()
 
     GetOptions()->LoadFromRegistry();
 
+    // For benchmarking: WINDIRSTAT_VFS puts a synthetic and/or fault injecting
+    // file system underneath the scanner (see CVirtualFileSystem::CreateFromSpec()).
+    CString vfsSpec;
+    if(vfsSpec.GetEnvironmentVariable(_T("WINDIRSTAT_VFS")) && !vfsSpec.IsEmpty())
+    {
+        CVirtualFileSystem *fs = CVirtualFileSystem::CreateFromSpec(vfsSpec);
+        if(fs != NULL)
+        {
+            SetVirtualFileSystem(fs);
+        }
+    }
+
     m_pDocTemplate = new CSingleDocTemplate(
         IDR_MAINFRAME,
         RUNTIME_CLASS(CDirstatDoc),
@@ -586,6 +618,55 @@ BOOL CDirstatApp::InitInstance()
     }
     FileIconInit(TRUE);
 
+    // For scripts: WINDIRSTAT_QUERY holds an ITEMQUERY spec (see RunHeadlessQuery()).
+    // The main window stays hidden.
+    CString querySpec;
+    if(querySpec.GetEnvironmentVariable(_T("WINDIRSTAT_QUERY")) && !querySpec.IsEmpty())
+    {
+        CString output;
+        if(!output.GetEnvironmentVariable(_T("WINDIRSTAT_QUERY_OUTPUT")) || output.IsEmpty())
+        {
+            DWORD len = ::GetTempPath(_MAX_PATH, output.GetBuffer(_MAX_PATH));
+            output.ReleaseBuffer(len);
+            output += _T("windirstat-query.txt");
+        }
+        m_exitCode = RunHeadlessQuery(querySpec, output);
+        WriteMemoryBreakdown();
+        m_pMainWnd->PostMessage(WM_CLOSE);
+        return TRUE;
+    }
+
+    // For reports: WINDIRSTAT_EXPORT names a folder, whose treemap is written
+    // to an image file (see RunHeadlessExport()). The main window stays hidden.
+    CString exportFolder;
+    if(exportFolder.GetEnvironmentVariable(_T("WINDIRSTAT_EXPORT")) && !exportFolder.IsEmpty())
+    {
+        CString output;
+        if(!output.GetEnvironmentVariable(_T("WINDIRSTAT_EXPORT_OUTPUT")) || output.IsEmpty())
+        {
+            DWORD len = ::GetTempPath(_MAX_PATH, output.GetBuffer(_MAX_PATH));
+            output.ReleaseBuffer(len);
+            output += _T("windirstat-treemap.png");
+        }
+
+        // "<width>x<height>", e.g. "16384x16384"
+        int width = 3840;
+        int height = 2160;
+        CString sizeSpec;
+        if(sizeSpec.GetEnvironmentVariable(_T("WINDIRSTAT_EXPORT_SIZE")) && !sizeSpec.IsEmpty())
+        {
+            if(2 != _stscanf_s(sizeSpec, _T("%dx%d"), &width, &height))
+            {
+                width = height = 0;
+            }
+        }
+
+        m_exitCode = RunHeadlessExport(exportFolder, output, CSize(width, height));
+        WriteMemoryBreakdown();
+        m_pMainWnd->PostMessage(WM_CLOSE);
+        return TRUE;
+    }
+
     GetMainFrame()->InitialShowWindow();
     m_pMainWnd->UpdateWindow();
 
@@ -594,6 +675,19 @@ BOOL CDirstatApp::InitInstance()
     m_pMainWnd->BringWindowToTop();
     m_pMainWnd->SetForegroundWindow();
 
+    // For performance work: WINDIRSTAT_BENCHMARK names a baseline file (see CBenchmark).
+    // The exit code is the number of regressions.
+    CString benchmarkBaseline;
+    if(benchmarkBaseline.GetEnvironmentVariable(_T("WINDIRSTAT_BENCHMARK")) && !benchmarkBaseline.IsEmpty())
+    {
+        CString update;
+        CBenchmark benchmark(benchmarkBaseline, update.GetEnvironmentVariable(_T("WINDIRSTAT_BENCHMARK_UPDATE")) != FALSE);
+        m_exitCode = benchmark.Run();
+        WriteMemoryBreakdown();
+        m_pMainWnd->PostMessage(WM_CLOSE);
+        return TRUE;
+    }
+
     if(cmdInfo.m_nShellCommand != CCommandLineInfo::FileOpen)
     {
         OnFileOpen();
@@ -604,7 +698,8 @@ BOOL CDirstatApp::InitInstance()
 
 int CDirstatApp::ExitInstance()
 {
-    return Inherited::ExitInstance();
+    int ret = Inherited::ExitInstance();
+    return (m_exitCode != 0) ? m_exitCode : ret;
 }
 
 LANGID CDirstatApp::GetLangid()
@@ -758,6 +853,19 @@ BOOL CDirstatApp::OnIdle(LONG lCount)
         more = true;
     }
 
+    // The progressive drawing of the treemap, in slices of its own.
+    CMainFrame *frame = GetMainFrame();
+    if((frame) && (frame->GetGraphView()) && (!frame->GetGraphView()->ContinueDrawing()))
+    {
+        more = true;
+    }
+
+    // The live treemap, while the scan goes on.
+    if((frame) && (frame->GetGraphView()))
+    {
+        frame->GetGraphView()->UpdateLiveTreemap();
+    }
+
     if(Inherited::OnIdle(lCount))
     {
         more = true;
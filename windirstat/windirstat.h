@@ -121,6 +121,7 @@ protected:
     ULONGLONG m_lastPeriodicalRamUsageUpdate; // Tick count
     COLORREF m_altColor;                    // Coloring of compressed items
     COLORREF m_altEncryptionColor;          // Coloring of encrypted items
+    int m_exitCode;                         // Overrides the exit code, if not 0 (benchmark)
 #if SUPPORT_ELEVATION
     HANDLE m_ElevationEvent;
     CString m_ElevationEventName;